@@ -0,0 +1 @@
+../../utilities/json_writer.cpp
\ No newline at end of file
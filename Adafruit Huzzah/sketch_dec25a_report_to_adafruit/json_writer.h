@@ -0,0 +1 @@
+../../utilities/json_writer.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../utilities/reading_batch.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../utilities/reading_batch.h
\ No newline at end of file
@@ -1,16 +1,25 @@
 /* Reports temperature, humidity and Vcc voltage to io.adafruit.com.
  * 
  * Sequence:
- * 1) Set SENSOR_POWER to OUTPUT HIGH.
- * 2) Connect to sensor.
- * 3) Start connecting to AP.
- * 4) Measure temperature, humidity and Vcc voltage.
- * 5) Set SENSOR_POWER to INPUT.
- * 6) Wait until connected to AP.
- * 7) Report measurements.
- * 8) Enter deepSleep.
+ * 1) Read the batch of readings from RTC memory.
+ * 2) Set SENSOR_POWER to OUTPUT HIGH.
+ * 3) Connect to sensor.
+ * 4) If an upload is due, start connecting to AP.
+ * 5) Measure temperature, humidity and Vcc voltage, add to the batch.
+ * 6) Set SENSOR_POWER to INPUT.
+ * 7) If an upload is due, wait until connected to AP, and POST the batch.
+ * 8) Write the batch to RTC memory.
+ * 9) Enter deepSleep, with the radio disabled unless the next wake uploads.
  *
  * Change Log:
+ * 2026-10-17:        Report in batches (see reading_batch.h): the readings are
+ *                    kept in RTC memory across deep sleep, and POSTed together
+ *                    every kBatchSize wakes, so that the radio (which takes
+ *                    seconds to connect to the AP) is only enabled for those.
+ *                    Failed uploads are retried, and the wait for the AP is
+ *                    bounded. See host/reading_batch_tester.ino for a model
+ *                    of the energy saved.
+ *
  * 2015-12-25a:       Starting from sketch_dec19a_gpio_enable_sensor, send
  *                    report to io.adafruit.com so that the laptop doesn't
  *                    need to be running.
@@ -40,6 +49,8 @@
 #include <ESP8266WiFi.h>
 #include <Wire.h>
 #include "Adafruit_HTU21DF.h"
+#include "json_writer.h"
+#include "reading_batch.h"
 
 extern "C" {
 #include "user_interface.h"
@@ -68,6 +79,23 @@ const int hostPort = 80;
 const int report_interval_secs = (2 * 60) * 1.03;
 // const int report_interval_secs = (60 * 60) * 1.05;
 
+// The number of readings uploaded together; at 2 minutes per reading, an
+// upload every 16 minutes.
+const uint8_t kBatchSize = 8;
+
+// Give up connecting to the AP after this long, and retry on a later wake,
+// rather than staying awake until the battery is flat.
+const unsigned long kWiFiTimeoutMs = 10000;
+const unsigned long kResponseTimeoutMs = 5000;
+
+// The readings not yet uploaded, kept in RTC memory during deep sleep.
+ReadingBatch batch;
+
+// The digits after the decimal point of each value of a reading:
+// temperature, humidity and compensated humidity in hundredths, Vcc in
+// millivolts.
+const uint8_t kDigits[ReadingBatch::kChannels] = {2, 2, 2, 3};
+
 String FormatDurationMs(unsigned long ms) {
   int seconds = ms / 1000;
   ms -= seconds * 1000;
@@ -136,7 +164,7 @@ LevelPrinter console;
 
 // Use low power mode, which will reboot the ESP after the specified sleep period
 // (in particular, will run this sketch from the beginning again).
-void EnterDeepSleep() {
+void EnterDeepSleep(bool radio_needed) {
   unsigned long current_time = millis();
   console.print(DEBUG, "Current time: ");
   console.printDurationMs(DEBUG, current_time);
@@ -159,7 +187,9 @@ void EnterDeepSleep() {
   console.print(INFO, "Requesting deep sleep mode for ");
   console.printDurationMs(INFO, sleep_ms);
   console.println(INFO);
-  ESP.deepSleep(sleep_us, WAKE_RF_DISABLED);
+  // Skipping the radio's calibration and leaving it off saves a lot of power,
+  // but then it can't be used until the next wake.
+  ESP.deepSleep(sleep_us, radio_needed ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
   // Wait a little while because the ESP8266 takes a while to enter low power mode after that call.
   if (console.LevelIsOn(DEBUG)) {
     while (true) {
@@ -183,10 +213,15 @@ void StartConnectingToWiFi() {
   WiFi.begin(ssid, password);
 }
 
-void WaitUntilConnectedToWiFi() {
+bool WaitUntilConnectedToWiFi() {
   if (WiFi.status() != WL_CONNECTED) {
     console.print(INFO, "Waiting until connected to WiFi");
+    unsigned long start_time = millis();
     do {
+      if (millis() - start_time > kWiFiTimeoutMs) {
+        console.println(RARE, " timed out");
+        return false;
+      }
       delay(500);
       console.print(INFO, ".");
     } while (WiFi.status() != WL_CONNECTED);
@@ -195,9 +230,43 @@ void WaitUntilConnectedToWiFi() {
   
   console.print(INFO, "WiFi connected, local IP address: ");  
   console.println(INFO, WiFi.localIP());
+  return true;
 }
 
-void GETtoSerial(const char* hostAddr, const char* hostName, int httpPort, const String& url) {
+// Counts what is written to it, for the Content-Length of the batch.
+class CountingPrint : public Print {
+ public:
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    bytes += size;
+    return size;
+  }
+  using Print::write;
+
+  size_t bytes = 0;
+};
+
+// Writes the batch as JSON, with the wake count so that the server can
+// compute when each reading was taken from its age (in wakes):
+//
+//     {"sensor":"rs1","wake":123,"interval":123,"dropped":0,
+//      "readings":[[age,temperature,humidity,compensated,vcc],...]}
+void WriteBatchJson(Print* out) {
+  JsonWriter json(out);
+  json.beginObject();
+  json.property(F("sensor"), F("rs1"));
+  json.property(F("wake"), batch.wakes());
+  json.property(F("interval"), report_interval_secs);
+  json.property(F("dropped"), batch.dropped());
+  json.key(F("readings"));
+  batch.writeJson(&json, kDigits);
+  json.endObject();
+}
+
+// POSTs the batch in a single request, returning true if the server
+// accepted it (i.e. the status is 2xx).
+bool POSTBatch(const char* hostAddr, const char* hostName, int httpPort,
+               const char* path) {
   if (hostAddr == nullptr) {
     hostAddr = hostName;
   } else if (hostName == nullptr) {
@@ -206,57 +275,63 @@ void GETtoSerial(const char* hostAddr, const char* hostName, int httpPort, const
 
   // Use WiFiClient class to create TCP connections
   WiFiClient client;
-  console.print(DEBUG, "Client created, client status: ");
-  console.println(DEBUG, client.status());
-
   console.print(INFO, "Connecting to http://");
   console.print(INFO, hostAddr);
   console.print(INFO, ":");
   console.print(INFO, httpPort);
-  console.println(INFO, url);
+  console.println(INFO, path);
   unsigned long start_time = millis();
   if (!client.connect(hostAddr, httpPort)) {
     unsigned long duration = millis() - start_time;
     console.print(RARE, "TCP connect() failed after ");
     console.printDurationMs(RARE, duration);
     console.println(RARE);
-    return;
+    return false;
   }
 
-  console.print(DEBUG, "Connected, client status: ");
-  console.println(DEBUG, client.status());
-
-  // We now create a URI for the request
-  console.println(INFO, "Connected to server, sending GET request");
-
-  // This will send the request to the server
-  client.print("GET ");
-  client.print(url);
-  client.print(" HTTP/1.1\r\n");
-  client.print(String("Host: ") + hostName + "\r\nConnection: close\r\n\r\n");
+  console.print(INFO, "Connected to server, sending POST of ");
+  console.print(INFO, batch.count());
+  console.println(INFO, " readings");
+
+  // The body is generated twice, first just to count it, so that it needn't
+  // be held in RAM.
+  CountingPrint counter;
+  WriteBatchJson(&counter);
+  client.print("POST ");
+  client.print(path);
+  client.print(" HTTP/1.1\r\nHost: ");
+  client.print(hostName);
+  client.print("\r\nContent-Type: application/json\r\nContent-Length: ");
+  client.print(counter.bytes);
+  client.print("\r\nConnection: close\r\n\r\n");
+  WriteBatchJson(&client);
   client.flush();
 
-  console.print(DEBUG, "Sent request, client status: ");
-  console.println(DEBUG, client.status());
-
-  // TODO Determine if this delay is necessary, or if I can just loop checking for status is still ESTABLISHED, and waiting until
-  // available is true.
-  delay(500);
+  // Wait for the status line, e.g. "HTTP/1.1 200 OK".
+  start_time = millis();
+  while (!client.available()) {
+    if (millis() - start_time > kResponseTimeoutMs || !client.connected()) {
+      console.println(RARE, "No response from server");
+      client.stop();
+      return false;
+    }
+    delay(10);
+  }
+  String line = client.readStringUntil('\r');
+  console.println(INFO, line);
+  int status = line.startsWith("HTTP/1.") ? line.substring(9, 12).toInt() : 0;
 
-  // Read all the lines of the reply from server and print them to Serial.
   // TODO Parse the server timestamp, and make it available for computing when we
   // should next report (e.g. if prefer to report on the hour, then try to move to reporting such that the offset is tiny).
-  while(client.available()){
-    String line = client.readStringUntil('\r');
-    console.print(INFO, line);
+  while (client.available()) {
+    line = client.readStringUntil('\r');
+    console.print(DEBUG, line);
   }
-
   console.println(DEBUG);
-  console.print(DEBUG, "Status: ");
-  console.println(DEBUG, client.status());
   console.print(INFO, "Closing TCP connection...");
   client.stop();
   console.println(INFO, "  disconnected");
+  return 200 <= status && status < 300;
 }
 
 class Reporter {
@@ -317,16 +392,15 @@ class Reporter {
     console.println(INFO);
   }
 
-  void ReportMeasurements() {
-    String url("/.record-data?sensor=rs1&temperature=");
-    url += temperature_;
-    url += "&humidity=";
-    url += humidity_;
-    url += "&compensated=";
-    url += compensated_;
-    url += "&vcc=";
-    url += vcc_;
-    GETtoSerial(hostAddr, hostName, hostPort, url);
+  // Adds the measurements to the batch, scaled to integers; see kDigits.
+  void AddMeasurements() {
+    const int16_t values[ReadingBatch::kChannels] = {
+        static_cast<int16_t>(lround(temperature_ * 100)),
+        static_cast<int16_t>(lround(humidity_ * 100)),
+        static_cast<int16_t>(lround(compensated_ * 100)),
+        static_cast<int16_t>(lround(vcc_ * 1000)),
+    };
+    batch.add(values);
   }
 
  private:
@@ -350,42 +424,69 @@ void setup() {
   console.print(DEBUG, "Start time: ");
   console.println(DEBUG, start_time);
 
+  // The readings not yet uploaded; after power on, there are none.
+  ESP.rtcUserMemoryRead(0, batch.words(), sizeof batch);
+  if (!batch.begin(kBatchSize)) {
+    console.println(INFO, "Starting a new batch");
+  }
+  batch.startWake();
+  const bool upload = batch.uploadDue();
+
   // Connect to HTU21D-F Temperature and Humidity Sensor.
   start_time = millis();
-  reporter.Init();
+  const bool have_sensor = reporter.Init();
   end_time = millis();
   console.print(DEBUG, "reporter.Init() took: ");
   console.println(DEBUG, end_time - start_time);
 
   // Connect to wi-fi base station.
-  start_time = millis();
-  StartConnectingToWiFi();
-  end_time = millis();
-  console.print(DEBUG, "StartConnectingToWiFi() took: ");
-  console.println(DEBUG, end_time - start_time);
+  if (upload) {
+    start_time = millis();
+    StartConnectingToWiFi();
+    end_time = millis();
+    console.print(DEBUG, "StartConnectingToWiFi() took: ");
+    console.println(DEBUG, end_time - start_time);
+  }
 
   // Measure.
-  start_time = millis();
-  reporter.Measure();
-  end_time = millis();
-  console.print(DEBUG, "reporter.Measure() took: ");
-  console.println(DEBUG, end_time - start_time);
-  reporter.PrintMeasurements();
-
-  // Connect to wi-fi base station.
-  start_time = millis();
-  WaitUntilConnectedToWiFi();
-  end_time = millis();
-  console.print(DEBUG, "WaitUntilConnectedToWiFi() took: ");
-  console.println(DEBUG, end_time - start_time);
+  if (have_sensor) {
+    start_time = millis();
+    reporter.Measure();
+    end_time = millis();
+    console.print(DEBUG, "reporter.Measure() took: ");
+    console.println(DEBUG, end_time - start_time);
+    reporter.PrintMeasurements();
+    reporter.AddMeasurements();
+  }
 
-  start_time = end_time;
-  reporter.ReportMeasurements();
-  end_time = millis();
-  console.print(DEBUG, "reporter.ReportMeasurements() took: ");
-  console.println(DEBUG, end_time - start_time);
+  if (upload) {
+    // Connect to wi-fi base station.
+    start_time = millis();
+    bool ok = WaitUntilConnectedToWiFi();
+    end_time = millis();
+    console.print(DEBUG, "WaitUntilConnectedToWiFi() took: ");
+    console.println(DEBUG, end_time - start_time);
+
+    start_time = end_time;
+    ok = ok && POSTBatch(hostAddr, hostName, hostPort, "/.record-batch");
+    end_time = millis();
+    console.print(DEBUG, "POSTBatch() took: ");
+    console.println(DEBUG, end_time - start_time);
+    if (ok) {
+      batch.uploadSucceeded();
+    } else {
+      batch.uploadFailed();
+      console.print(RARE, "Upload failed; readings queued: ");
+      console.println(RARE, batch.count());
+    }
+  } else {
+    console.print(INFO, "Readings queued: ");
+    console.println(INFO, batch.count());
+  }
 
-  EnterDeepSleep();
+  batch.seal();
+  ESP.rtcUserMemoryWrite(0, batch.words(), sizeof batch);
+  EnterDeepSleep(batch.radioNeededNextWake());
 }
 
 void loop() {
@@ -49,8 +49,12 @@ loop()
 */
 
 #include <EEPROM.h>
+#include "eeprom_io.h"
 #include "misc.h"
 #include "SensorAndLED.h"
+#include "time.h"
+
+using jamessynge::MonotonicClock;
 
 const int LOW_SENSOR_PIN = 0;    // Analog pin 0, GP2Y0A02YK, smoothed with RC circuit
 const int MEDIUM_SENSOR_PIN = 2; // Analog pin 2, GP2Y0A02YK, smoothed with RC circuit
@@ -104,17 +108,33 @@ boolean initializeFromEEPROM() {
   return EEPROM.read(addr) == 0;
 }
 
+// Number of bytes used by saveToEEPROM: "Dog", 3 bytes per sensor, and a
+// terminating zero.
+const int EEPROM_BYTES = 3 + 3 * 3 + 1;
+
 void saveToEEPROM() {
   DLOG("saveToEEPROM\n");
-  int addr = 0;
-  EEPROM.write(addr++, 'X');  // Mark as invalid until done.
-  EEPROM.write(addr++, 'o');
-  EEPROM.write(addr++, 'g');
-  addr = low_sensor.writeThreshold(addr);
-  addr = medium_sensor.writeThreshold(addr);
-  addr = high_sensor.writeThreshold(addr);
-  EEPROM.write(addr++, 0);
-  EEPROM.write(0, 'D');       // Finally valid.
+  // Stage everything after the leading 'D', then write only the bytes that
+  // have changed. The 'D' is handled separately so that the saved values are
+  // marked as invalid until they have all been written.
+  eeprom_io::EepromTransactionBuffer<EEPROM_BYTES - 1> txn(1);
+  int addr = 1;
+  addr = txn.putByte(addr, 'o');
+  addr = txn.putByte(addr, 'g');
+  addr = low_sensor.writeThreshold(&txn, addr);
+  addr = medium_sensor.writeThreshold(&txn, addr);
+  addr = high_sensor.writeThreshold(&txn, addr);
+  addr = txn.putByte(addr, 0);
+  if (txn.isDirty()) {
+    EEPROM.update(0, 'X');  // Mark as invalid until done.
+    const size_t written = txn.commit();
+    if (written == eeprom_io::EepromTransaction::kCommitFailed) {
+      DLOG("saveToEEPROM: thresholds don't fit\n");
+      return;  // Leave it marked as invalid.
+    }
+    DLOG("saveToEEPROM wrote %d bytes\n", static_cast<int>(written));
+  }
+  EEPROM.update(0, 'D');    // Finally valid.
 }
 
 void initSensorsAndLEDs() {
@@ -129,18 +149,20 @@ void calibrationButtonPressed() {
   do_calibrate = true;
 }
 
-unsigned long ignore_until = 0;
-unsigned long activate_after = 0;
-unsigned long deactivate_after = 0;
+// Times from MonotonicClock::Millis64(), which doesn't wrap around, so these
+// can be compared with the current time directly.
+uint64_t ignore_until = 0;
+uint64_t activate_after = 0;
+uint64_t deactivate_after = 0;
 
 void activateAlert() {
   if (deactivate_after) {
     // Already activated.
-    deactivate_after = millis() + ALERT_PERIOD;
+    deactivate_after = MonotonicClock::Millis64() + ALERT_PERIOD;
     return;
   }
   activate_after = 0;
-  deactivate_after = millis() + ALERT_PERIOD;
+  deactivate_after = MonotonicClock::Millis64() + ALERT_PERIOD;
 
   DLOG("activateAlert()\n");
 
@@ -171,10 +193,11 @@ void calibrate() {
   // Just in case an alert is active.
   deactivateAlert();
 
-  // Clear the EEPROM bytes we use.
-  for (int addr = 0; addr < 11; ++addr) {
-    EEPROM.write(addr, 0);
-  }
+  // Invalidate the saved calibration, in case we're interrupted before it is
+  // complete. Only the first byte needs to change for that, and leaving the
+  // rest alone means saveToEEPROM won't need to rewrite any thresholds that
+  // come out the same.
+  EEPROM.update(0, 0);
 
   // Wait for a bit (5 seconds) to allow the user to get out of the way.
   // Toggle the high LED.
@@ -216,11 +239,11 @@ enum MovementState {
 };
 
 // When was current upwards movement first detected?
-unsigned long g_started_up_at_ms;
-unsigned long g_last_state_change_ms = 0;
+uint64_t g_started_up_at_ms;
+uint64_t g_last_state_change_ms = 0;
 MovementState g_movement_state;
 
-void setMovementState(const int new_state, const unsigned long now_ms) {
+void setMovementState(const int new_state, const uint64_t now_ms) {
   if (new_state != g_movement_state) {
     g_movement_state = (MovementState)new_state;
     g_last_state_change_ms = now_ms;
@@ -291,7 +314,7 @@ void loop() {
   }
 
   // Check on timed events.
-  const unsigned long now = millis();
+  const uint64_t now = MonotonicClock::Millis64();
   if (ignore_until && ignore_until <= now) {
     DLOG("Ignore Movement Period Expired\n");
     ignore_until = 0;
@@ -436,16 +459,6 @@ void loop() {
   }
 
 
-  if (now > 4000000000L) {
-    // Millisecond clock will wrap around soon. Is now a quiet time to reboot?
-    if (!low_reading.isTriggered(20000) &&
-        !medium_reading.isTriggered(20000) &&
-        !high_reading.isTriggered(20000)) {
-      DLOG("Millisecond clock will soon wrap around; rebooting\n");
-      reboot();
-    }
-  }
-
   setMovementState(next_state, now);
 
   delay(10);
@@ -4,6 +4,9 @@
 #include <Arduino.h>
 
 #include "misc.h"
+#include "time.h"
+
+using jamessynge::MonotonicClock;
 
 #define CALIBRATION_PERIOD 500  // milliseconds
 #define CALIBRATION_BLINK_PERIOD 100
@@ -44,7 +47,7 @@ void SensorAndLED::toggleLed() {
   }
 }
 
-void SensorAndLED::startBlinking(const long now_millis, const int toggle_period) {
+void SensorAndLED::startBlinking(const uint64_t now_millis, const int toggle_period) {
   if (this->toggle_period == toggle_period) {
     return;
   }
@@ -61,7 +64,7 @@ void SensorAndLED::stopBlinking() {
   }
 }
 
-void SensorAndLED::updateLed(const long now_millis) {
+void SensorAndLED::updateLed(const uint64_t now_millis) {
   if (toggle_period) {
     if (next_toggle <= now_millis) {
       toggleLed();
@@ -73,14 +76,14 @@ void SensorAndLED::updateLed(const long now_millis) {
 void SensorAndLED::calibrate() {
   threshold = 0;
 
-  unsigned long now = millis();
-  const unsigned long end_millis = now + CALIBRATION_PERIOD;
+  uint64_t now = MonotonicClock::Millis64();
+  const uint64_t end_millis = now + CALIBRATION_PERIOD;
 
   startBlinking(now, CALIBRATION_BLINK_PERIOD);
 
   while (true) {
     threshold = max(threshold, analogRead(sensor_pin));
-    now = millis();
+    now = MonotonicClock::Millis64();
     if (now >= end_millis) {
       break;
     }
@@ -92,13 +95,13 @@ void SensorAndLED::calibrate() {
   DLOG("calibrate sensor '%c', pin %d -> %d\n", tag, sensor_pin, threshold);
 }
 
-SensorReading SensorAndLED::readSensor(const long now_ms, const int num_reads, const int tolerance) {
+SensorReading SensorAndLED::readSensor(const uint64_t now_ms, const int num_reads, const int tolerance) {
   const int value = readSensor(num_reads);
   const int adjusted_threshold = threshold + tolerance;
   SensorReading result;
   result.is_triggered = value >= adjusted_threshold;
   result.is_changed = result.is_triggered != last_state;
-  unsigned long duration_ms = min(now_ms - last_transition, 0xffff);
+  const uint64_t duration_ms = min(now_ms - last_transition, 0xffff);
   result.duration_ms = static_cast<uint16_t>(duration_ms);
   if (result.is_changed) {
     last_state = result.is_triggered;
@@ -106,10 +109,9 @@ SensorReading SensorAndLED::readSensor(const long now_ms, const int num_reads, c
   }
 
 #if DEBUG
-  unsigned long now = millis();
   if (next_announce == 0) {
-    next_announce = now + ANNOUNCE_INTERVAL;
-  } else if (now >= next_announce || result.is_changed) {
+    next_announce = now_ms + ANNOUNCE_INTERVAL;
+  } else if (now_ms >= next_announce || result.is_changed) {
     DLOG("isSensorTriggered '%c': pin=%d, value=%d, margin=%d, is_triggered=%d, is_changed=%d, duration_ms=%u\n",
          tag, sensor_pin, value, adjusted_threshold - value, result.is_triggered, result.is_changed, result.duration_ms);
     next_announce += ANNOUNCE_INTERVAL;
@@ -126,11 +128,12 @@ int SensorAndLED::readSensor(int num_reads) const {
   return value;
 }
 
-int SensorAndLED::writeThreshold(int addr) const {
+int SensorAndLED::writeThreshold(eeprom_io::EepromTransaction* txn,
+                                 int addr) const {
   DLOG("writeThreshold(%d) '%c' threshold %d\n", addr, tag, threshold);
-  EEPROM.write(addr++, tag);
-  EEPROM.write(addr++, threshold >> 8);
-  EEPROM.write(addr++, threshold & 0xff);
+  addr = txn->putByte(addr, tag);
+  addr = txn->putByte(addr, threshold >> 8);
+  addr = txn->putByte(addr, threshold & 0xff);
   return addr;
 }
 
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 
+#include "eeprom_io.h"
 #include "misc.h"
 
 struct SensorReading {
@@ -34,16 +35,18 @@ class SensorAndLED {
 
   void ledOn();
   void toggleLed();
-  void startBlinking(const long now_millis, const int toggle_period);
+  // now_millis and now_ms are from jamessynge::MonotonicClock::Millis64().
+  void startBlinking(const uint64_t now_millis, const int toggle_period);
   void stopBlinking();
-  void updateLed(const long now_millis);
+  void updateLed(const uint64_t now_millis);
   void calibrate();
-  SensorReading readSensor(const long now_ms, const int num_reads, const int tolerance);
+  SensorReading readSensor(const uint64_t now_ms, const int num_reads, const int tolerance);
   int readSensor(int num_reads) const;
 
-  // Write the threshold for this sensor (Tag Byte, High Byte, Low Byte)
-  // to EEPROM starting at addr.  Doesn't check that the value is valid.
-  int writeThreshold(int addr) const;
+  // Stage writing the threshold for this sensor (Tag Byte, High Byte, Low
+  // Byte) to EEPROM starting at addr; it is written when txn is committed.
+  // Doesn't check that the value is valid.
+  int writeThreshold(eeprom_io::EepromTransaction* txn, int addr) const;
 
   // Read the threshold for this sensor (Tag Byte, High Byte, Low Byte)
   // from the EEPROM at addr. Returns the addr beyond the threshold if
@@ -51,10 +54,10 @@ class SensorAndLED {
   int readThreshold(int addr);
 
  private:
-  unsigned long next_toggle;
-  unsigned long last_transition;
+  uint64_t next_toggle;
+  uint64_t last_transition;
 #if DEBUG
-  unsigned long next_announce;
+  uint64_t next_announce;
 #endif
   int toggle_period;
   int threshold;
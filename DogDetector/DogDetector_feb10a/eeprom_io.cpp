@@ -0,0 +1 @@
+../../utilities/eeprom_io.cpp
\ No newline at end of file
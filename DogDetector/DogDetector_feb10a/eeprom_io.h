@@ -0,0 +1 @@
+../../utilities/eeprom_io.h
\ No newline at end of file
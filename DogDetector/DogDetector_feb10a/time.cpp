@@ -0,0 +1 @@
+../../utilities/time.cpp
\ No newline at end of file
@@ -84,8 +84,9 @@
 //
 //       MLX90614 not found           <== Only if not connected
 //       MAC: 52-C4-58-43-37-4D       <== Randomly generated
-//       No DHCP                      <== Only if no DHCP server gave an IP
+//       No DHCP yet                  <== Only if no DHCP server gave an IP
 //       IP: 169.254.211.176          <== 169.254.*.* only if no DHCP
+//       DHCP IP: 192.168.86.48       <== Later, if a DHCP server answers
 //
 //     It will check if there is a MLX90614 correctly hooked up to SDA, SCL,
 //     5V and GND; if not, it will print "MLX90614 not found".
@@ -93,11 +94,14 @@
 //     generated (the first 6 of the hexadecimal digits are fixed by this
 //     sketch).
 //     It will attempt to allocate an IP address via requesting one from a
-//     DHCP over the Ethernet. If such a server is not found, it will print
-//     "No DHCP" and will print the IP address that it has randomly generated
-//     from what is called the Link-Local address range (169.254.*.*). However,
-//     if such a server does allocate an IP address to the Arduino, then it
-//     will print that IP address.
+//     DHCP over the Ethernet. If such a server hasn't answered within half a
+//     second, it will print "No DHCP yet" and will print the IP address that
+//     it has randomly generated from what is called the Link-Local address
+//     range (169.254.*.*), and will respond to requests on that address while
+//     it keeps asking; when a server does allocate an IP address to the
+//     Arduino, it switches to that address, and prints "DHCP IP:" and the
+//     address. The lease is saved, so after a reboot the same address is
+//     usually reclaimed at once.
 //     Here is an example from the same board, but when "cleanly" starting:
 //
 //       MAC: 52-C4-58-43-37-4D
@@ -124,7 +128,7 @@
 //     Using the exampes above, that would be http://192.168.86.48/
 //     You should see something like this:
 //
-//       {"relay":1, "object":67.30, "ambient":69.03}
+//       {"relay":1,"object":67.30,"ambient":69.03}
 //
 //     The last two values only appear if the sketch has read those values from
 //     an attached MLX90614.
@@ -141,6 +145,19 @@
 //
 //     Ideally you'll see the same kind of result as you saw earlier in the
 //     browser.
+//
+// 15) For monitoring with Prometheus, the readings, along with counts of
+//     requests and errors, and a histogram of the loop time, are available
+//     in its text format at:
+//
+//       http://rainsensor.local/metrics
+//
+//     For example:
+//
+//       # HELP rain_sensor_relay State of the RG-11 rain sensor's relay.
+//       # TYPE rain_sensor_relay gauge
+//       rain_sensor_relay 1
+//       ...
 
 #include <Arduino.h>
 
@@ -167,9 +184,39 @@
 // My wrapper class for simplifying dealing with the Ethernet library.
 #include "simple_http_server.h"
 
+// Maps request paths to the functions that handle them.
+#include "http_router.h"
+
+// Writes the JSON responses.
+#include "json_writer.h"
+
+// Holds the response to GET /, rendered when the readings change.
+#include "prerendered_response.h"
+
+// Buffers the other responses, so that each is sent in one packet.
+#include "response_writer.h"
+
+// The readings and server statistics, served at /metrics for Prometheus.
+#include "metrics.h"
+
+// Sleeps between network events, if the Ethernet chip's interrupt is wired up.
+#include "ethernet_events.h"
+
 // Pin hooked up to the RG-11 rain sensor's relay.
 constexpr int kRelayInputPin = 7;
 
+// Pin connected to the Ethernet chip's INTn output (e.g. via the INT solder
+// jumper to pin 2 on the Arduino Ethernet Shield 2), or -1 if it isn't
+// connected. If it is, loop() sleeps until there is a connection or data to
+// handle, rather than polling the chip continuously.
+constexpr int kEthernetIntPin = -1;
+
+// How long loop() may sleep, so that the sensors are still sampled, and the
+// DHCP lease and mDNS maintained, without waiting for network events.
+constexpr unsigned long kHousekeepingMs = 100;
+
+bool sleep_between_events = false;
+
 // Class instance for reading from the attached MLX90614 IR Sensor.
 IRTherm irTherm;
 
@@ -180,10 +227,26 @@ const char kMulticastDnsName[] = "rainsensor";
 // appropriate chip select pin, and to listen on port 80 for TCP connections.
 SimpleHttpServer server(kEthernetShieldCS, 80);
 
+MetricRegistry metrics;
+HttpServerMetrics server_metrics(&metrics);
+constexpr char kRelayMetric[] PROGMEM = "rain_sensor_relay";
+constexpr char kRelayMetricHelp[] PROGMEM =
+    "State of the RG-11 rain sensor's relay.";
+constexpr char kObjectMetric[] PROGMEM = "ir_object_temperature_fahrenheit";
+constexpr char kObjectMetricHelp[] PROGMEM =
+    "Temperature of the sky, measured by the MLX90614; NaN if stale.";
+constexpr char kAmbientMetric[] PROGMEM = "ir_ambient_temperature_fahrenheit";
+constexpr char kAmbientMetricHelp[] PROGMEM =
+    "Temperature of the MLX90614; NaN if stale.";
+Gauge relay_gauge(&metrics, kRelayMetric, kRelayMetricHelp, 0);
+Gauge object_gauge(&metrics, kObjectMetric, kObjectMetricHelp);
+Gauge ambient_gauge(&metrics, kAmbientMetric, kAmbientMetricHelp);
+
 // Forward declarations. Not necessary in an Arduino sketch, but appropriate
 // for C & C++.
 void announceFailure(const char* message);
 void initializeRandomSeed();
+void sampleSensors(bool force);
 
 void setup() {
   Serial.begin(9600);
@@ -224,50 +287,229 @@ void setup() {
   if (!server.setup(&oui_prefix)) {
     announceFailure("Unable to initialize networking!");
   }
+  server.setMetrics(&server_metrics);
+  if (kEthernetIntPin >= 0) {
+    sleep_between_events = EthernetEvents::begin(kEthernetIntPin);
+  }
 
-  if (!EthernetBonjour.begin(kMulticastDnsName)) {
+  // Monitoring hosts poll frequently, so let them keep their connections open
+  // rather than paying for a TCP handshake per request. The W5100 has just 4
+  // sockets: one is used for mDNS, and one must be left for accepting new
+  // connections, so keep at most 2 open between requests.
+  server.enableKeepAlive(5000, 100, 2);
+
+  // A network profile (see addresses.h) may have a name of its own, e.g. so
+  // that boards in the lab are distinguishable from those in production.
+  const char* mdns_name = server.profile().name;
+  if (mdns_name[0] == 0) {
+    mdns_name = kMulticastDnsName;
+  }
+  if (!EthernetBonjour.begin(mdns_name)) {
     Serial.println("No mDNS! continuing");
   }
+
+  sampleSensors(true);
+}
+
+// The sensors are sampled from loop, rather than when a request arrives, and
+// the response to GET / is rendered only when the readings change, so that
+// serving a request is just a single write of the prerendered response.
+//
+// On average it takes just over one millisecond to read from the IR sensor,
+// and formatting floats isn't fast either, which adds up when several hosts
+// are polling the sketch. Reading the relay is cheap, so it is read on every
+// loop, and a change is reflected in the response immediately.
+constexpr unsigned long kIrSampleIntervalMs = 2000;
+
+// IR readings older than this (i.e. the sensor hasn't responded for a while)
+// are flagged as stale in the responses.
+constexpr unsigned long kMaxIrAgeMs = 10000;
+
+struct Readings {
+  int relay = -1;
+  // False until the IR sensor has been read successfully.
+  bool have_ir = false;
+  bool ir_stale = false;
+  float object;
+  float ambient;
+  unsigned long ir_read_ms;
+};
+
+Readings readings;
+unsigned long last_ir_sample_ms;
+PrerenderedResponseBuffer<160> root_response;
+
+void writeRelayField(JsonWriter* json) {
+  json->property(F("relay"), readings.relay);
+}
+
+// Writes the IR readings, if there are any.
+void writeIrFields(JsonWriter* json) {
+  if (!readings.have_ir) {
+    return;
+  }
+  json->property(F("object"), readings.object);
+  json->property(F("ambient"), readings.ambient);
+  if (readings.ir_stale) {
+    json->property(F("stale"), true);
+  }
 }
 
-void clientHandler(EthernetClient* client) {
-  Serial.println("Got a client!!");
-
-  // Skip the request header, i.e. we give the same result regardless of the
-  // request, so really not much of a webserver!
-  server.skipHttpRequestHeader(client);
-
-  // Send a basic HTTP response header:
-  client->println("HTTP/1.1 200 OK");
-  client->println("Content-Type: application/json");
-  client->println();
-
-  client->print("{\"relay\":");
-  client->print((digitalRead(kRelayInputPin) == LOW) ? 0 : 1);
-
-  // On average it takes just over one millisecond to read from the IR sensor,
-  // so there is no need to do so periodically, (i.e. between client requests,
-  // with caching of the results). So we just try to read and return the
-  // results if we get them.
-  if (irTherm.read() == 1) {
-    client->print(", \"object\":");
-    client->print(irTherm.object());
-    client->print(", \"ambient\":");
-    client->print(irTherm.ambient());
+void renderRootResponse() {
+  root_response.startBody();
+  JsonWriter json(&root_response);
+  json.beginObject();
+  writeRelayField(&json);
+  writeIrFields(&json);
+  json.endObject();
+  if (!root_response.finish("application/json")) {
+    Serial.println("Response too large");
   }
+}
+
+// Reads the sensors that are due to be read (or all of them, if force), and
+// re-renders the response if the readings have changed.
+void sampleSensors(bool force) {
+  bool changed = false;
+  const int relay = (digitalRead(kRelayInputPin) == LOW) ? 0 : 1;
+  if (relay != readings.relay) {
+    readings.relay = relay;
+    changed = true;
+  }
+  const unsigned long now = millis();
+  if (force || now - last_ir_sample_ms >= kIrSampleIntervalMs) {
+    last_ir_sample_ms = now;
+    if (irTherm.read() == 1) {
+      const float object = irTherm.object();
+      const float ambient = irTherm.ambient();
+      if (!readings.have_ir || object != readings.object ||
+          ambient != readings.ambient) {
+        changed = true;
+      }
+      readings.have_ir = true;
+      readings.object = object;
+      readings.ambient = ambient;
+      readings.ir_read_ms = now;
+    }
+  }
+  const bool ir_stale =
+      readings.have_ir && now - readings.ir_read_ms > kMaxIrAgeMs;
+  if (ir_stale != readings.ir_stale) {
+    readings.ir_stale = ir_stale;
+    changed = true;
+  }
+  if (changed || force) {
+    renderRootResponse();
+    relay_gauge.set(readings.relay);
+    const bool ir_valid = readings.have_ir && !readings.ir_stale;
+    object_gauge.set(ir_valid ? readings.object : NAN);
+    ambient_gauge.set(ir_valid ? readings.ambient : NAN);
+  }
+}
+
+// Starts a response with a JSON body. The response is buffered by writer,
+// so that it is sent in one packet, rather than one per print.
+void beginJsonResponse(ResponseWriter* writer, const HttpRequest& request) {
+  writer->beginResponse("200 OK", request);
+  writer->header("Content-Type", "application/json");
+  writer->beginBody();
+}
+
+// GET / returns all of the readings.
+void handleRoot(const HttpRequest& request, EthernetClient* client) {
+  root_response.send(client);
+}
+
+void handleRelay(const HttpRequest& request, EthernetClient* client) {
+  ResponseWriterBuffer<96> writer(client);
+  beginJsonResponse(&writer, request);
+  JsonWriter json(&writer);
+  json.beginObject();
+  writeRelayField(&json);
+  json.endObject();
+  writer.println();
+  writer.endResponse();
+}
+
+void handleIr(const HttpRequest& request, EthernetClient* client) {
+  ResponseWriterBuffer<128> writer(client);
+  beginJsonResponse(&writer, request);
+  JsonWriter json(&writer);
+  json.beginObject();
+  writeIrFields(&json);
+  json.endObject();
+  writer.println();
+  writer.endResponse();
+}
+
+// The network configuration of the sketch.
+void handleConfig(const HttpRequest& request, EthernetClient* client) {
+  ResponseWriterBuffer<160> writer(client);
+  beginJsonResponse(&writer, request);
+  JsonWriter json(&writer);
+  json.beginObject();
+  // Formatted here as strings, rather than printed a byte at a time by
+  // IPAddress::printTo.
+  char ip[kIPAddressChars];
+  formatIPAddress(Ethernet.localIP(), ip);
+  json.property(F("ip"), ip);
+  formatIPAddress(Ethernet.subnetMask(), ip);
+  json.property(F("subnet"), ip);
+  formatIPAddress(Ethernet.gatewayIP(), ip);
+  json.property(F("gateway"), ip);
+  json.endObject();
+  writer.println();
+  writer.endResponse();
+}
+
+void handleMetrics(const HttpRequest& request, EthernetClient* client) {
+  metrics.sendResponse(request, client);
+}
 
-  client->println("}");
-  client->println();
+// The routes must be sorted by path; see http_router.h.
+constexpr char kRootPath[] PROGMEM = "/";
+constexpr char kConfigPath[] PROGMEM = "/config";
+constexpr char kIrPath[] PROGMEM = "/ir";
+constexpr char kMetricsPath[] PROGMEM = "/metrics";
+constexpr char kRelayPath[] PROGMEM = "/relay";
+constexpr HttpRoute kRoutes[] PROGMEM = {
+    {kRootPath, handleRoot},
+    {kConfigPath, handleConfig},
+    {kIrPath, handleIr},
+    {kMetricsPath, handleMetrics},
+    {kRelayPath, handleRelay},
+};
+static_assert(HttpRouter::isSorted(kRoutes), "kRoutes must be sorted");
+const HttpRouter router(kRoutes);
+
+void clientHandler(const HttpRequest& request, EthernetClient* client) {
+  // Printing to Serial at 9600 baud takes about 1ms per character, so only
+  // do so when debugging.
+  DBG("Got a request for ");
+  DBGLN(request.path);
+  router.dispatch(request, client);
 }
 
 void loop() {
+  // Before checking the sockets, so that any event after this ends the sleep
+  // below.
+  if (sleep_between_events) {
+    EthernetEvents::acknowledge();
+  }
+
   // If we've received an mDNS query for our name, respond. This must be called
   // often in order for the mDNS feature to work, ideally once per loop.
   EthernetBonjour.run();
 
-  // If there is a client, pass it to clientHandler;
+  sampleSensors(false);
+
+  // If there is a complete request, pass it to clientHandler;
   // also maintain our DHCP lease.
   server.loop(clientHandler);
+
+  if (sleep_between_events && server.idle()) {
+    EthernetEvents::sleep(kHousekeepingMs);
+  }
 }
 
 void announceFailure(const char* message) {
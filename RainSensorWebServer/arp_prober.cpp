@@ -0,0 +1 @@
+../utilities/arp_prober.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/arp_prober.h
\ No newline at end of file
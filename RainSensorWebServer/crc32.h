@@ -0,0 +1 @@
+../utilities/crc32.h
\ No newline at end of file
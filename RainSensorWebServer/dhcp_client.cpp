@@ -0,0 +1 @@
+../utilities/dhcp_client.cpp
\ No newline at end of file
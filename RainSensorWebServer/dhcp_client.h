@@ -0,0 +1 @@
+../utilities/dhcp_client.h
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/ethernet_events.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/ethernet_events.h
\ No newline at end of file
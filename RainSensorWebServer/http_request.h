@@ -0,0 +1 @@
+../utilities/http_request.h
\ No newline at end of file
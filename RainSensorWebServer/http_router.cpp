@@ -0,0 +1 @@
+../utilities/http_router.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/http_router.h
\ No newline at end of file
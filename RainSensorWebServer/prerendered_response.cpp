@@ -0,0 +1 @@
+../utilities/prerendered_response.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/prerendered_response.h
\ No newline at end of file
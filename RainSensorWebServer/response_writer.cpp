@@ -0,0 +1 @@
+../utilities/response_writer.cpp
\ No newline at end of file
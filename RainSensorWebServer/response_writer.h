@@ -0,0 +1 @@
+../utilities/response_writer.h
\ No newline at end of file
@@ -6,17 +6,432 @@
 #include "eeprom_io.h"
 #include "test.h"
 
+// Number of bytes saved by Addresses::save with one profile: "nets", the
+// count, the order, the profile and the CRC.
+constexpr int kSavedBytes =
+    4 + 1 + Addresses::kMaxProfiles + Addresses::kProfileBytes + 4;
+
+// Flips the bits of the byte at address, returning the original value.
+uint8_t corrupt(int address) {
+  const uint8_t v = EEPROM.read(address);
+  EEPROM.write(address, ~v);
+  return v;
+}
+
+// Checks that each kind of corruption is reported as such, assuming that valid
+// addresses are currently saved.
+void testLoadStatus() {
+  Addresses a;
+  ASSERT_TRUE(a.loadWithStatus(nullptr) == Addresses::LoadStatus::kLoaded);
+
+  // Name.
+  uint8_t v = corrupt(1);
+  EXPECT_TRUE(a.loadWithStatus(nullptr) ==
+              Addresses::LoadStatus::kNameMismatch);
+  EEPROM.write(1, v);
+
+  // The count (which must be valid before the CRC can be checked), the
+  // payload (the last byte of the name), then the CRC itself.
+  const int payloadAndCrcAddresses[] = {4, kSavedBytes - 5, kSavedBytes - 1};
+  for (int address : payloadAndCrcAddresses) {
+    v = corrupt(address);
+    EXPECT_TRUE(a.loadWithStatus(nullptr) ==
+                Addresses::LoadStatus::kCrcMismatch);
+    EEPROM.write(address, v);
+  }
+
+  EXPECT_TRUE(a.loadWithStatus(nullptr) == Addresses::LoadStatus::kLoaded);
+}
+
+// Reads the EEPROM as Addresses::load used to, verifying the name, then
+// reading each field, then reading and checking the CRC; for one profile.
+bool loadInSteps(Addresses* a) {
+  int address;
+  if (!eeprom_io::verifyName(0, "nets", &address)) {
+    return false;
+  }
+  eeprom_io::Crc32 crc;
+  eeprom_io::getBytes(address, 1, &a->count, &crc);
+  eeprom_io::getBytes(address + 1, sizeof a->order, a->order, &crc);
+  address += 1 + sizeof a->order;
+  NetworkProfile& profile = a->profiles[0];
+  address = profile.mac.read(address, &crc);
+  uint8_t flags;
+  eeprom_io::getBytes(address++, 1, &flags, &crc);
+  profile.use_dhcp = flags == 0;
+  address = profile.ip.read(address, &crc);
+  address = profile.subnet.read(address, &crc);
+  address = profile.gateway.read(address, &crc);
+  address = profile.dns.read(address, &crc);
+  eeprom_io::getBytes(address, sizeof profile.name,
+                      reinterpret_cast<uint8_t*>(profile.name), &crc);
+  return eeprom_io::verifyCrc(address + sizeof profile.name, crc);
+}
+
+// Compares the time taken by Addresses::load (which reads each of the saved
+// bytes once, in one pass) with loadInSteps.
+void benchmarkLoad() {
+  constexpr int kLoops = 1000;
+  Addresses a;
+  unsigned long start = BenchmarkMicros();
+  for (int i = 0; i < kLoops; ++i) {
+    EXPECT_TRUE(loadInSteps(&a));
+  }
+  const unsigned long stepsElapsed = BenchmarkMicros() - start;
+
+  start = BenchmarkMicros();
+  for (int i = 0; i < kLoops; ++i) {
+    EXPECT_TRUE(a.load(nullptr));
+  }
+  const unsigned long fusedElapsed = BenchmarkMicros() - start;
+
+  Serial.print("Loading ");
+  Serial.print(kSavedBytes);
+  Serial.print(" bytes ");
+  Serial.print(kLoops);
+  Serial.print(" times; in steps: ");
+  Serial.print(stepsElapsed);
+  Serial.print(" us, single pass: ");
+  Serial.print(fusedElapsed);
+  Serial.println(" us");
+
+#ifdef ARDUINO_HOST
+  // The host's EEPROM counts reads.
+  EEPROM.resetCounts();
+  loadInSteps(&a);
+  const uint32_t stepsReads = EEPROM.readCount();
+  EEPROM.resetCounts();
+  a.load(nullptr);
+  const uint32_t fusedReads = EEPROM.readCount();
+  Serial.print("EEPROM reads per load; in steps: ");
+  Serial.print(stepsReads);
+  Serial.print(", single pass: ");
+  Serial.println(fusedReads);
+  EXPECT_EQ(fusedReads, kSavedBytes);
+#endif  // ARDUINO_HOST
+}
+
+NetworkProfile labProfile() {
+  NetworkProfile lab;
+  lab.mac.generateAddress(nullptr);
+  lab.use_dhcp = false;
+  lab.ip = SaveableIPAddress(10, 1, 2, 3);
+  lab.subnet = SaveableIPAddress(255, 255, 255, 0);
+  lab.gateway = SaveableIPAddress(10, 1, 2, 1);
+  lab.dns = SaveableIPAddress(10, 1, 2, 53);
+  lab.setName("lab-sensor-with-a-long-name");
+  return lab;
+}
+
+// A table of several profiles, assuming that valid addresses (i.e. one
+// profile) are currently saved.
+void testProfiles() {
+  Addresses a;
+  ASSERT_TRUE(a.load(nullptr));
+  ASSERT_EQ(a.count, 1);
+  const NetworkProfile generated = a.profiles[0];
+  EXPECT_TRUE(generated.use_dhcp);
+
+  // The name is truncated.
+  const NetworkProfile lab = labProfile();
+  EXPECT_EQ(strlen(lab.name), NetworkProfile::kMaxNameLength);
+  EXPECT_EQ(strcmp(lab.name, "lab-sensor-with"), 0);
+
+  // Added profiles are the least recently used.
+  EXPECT_EQ(a.addProfile(lab), 1);
+  EXPECT_EQ(a.order[0], 0);
+  EXPECT_EQ(a.order[1], 1);
+  a.save();
+  Addresses loaded;
+  ASSERT_TRUE(loaded.load(nullptr));
+  ASSERT_EQ(loaded, a);
+  EXPECT_TRUE(loaded.profiles[1] == lab);
+
+  // Static profiles needn't have the OUI prefix.
+  OuiPrefix oui_prefix(generated.mac.mac[0], generated.mac.mac[1],
+                       generated.mac.mac[2]);
+  loaded.profiles[1].mac.mac[0] = ~oui_prefix.bytes[0];
+  loaded.save();
+  EXPECT_TRUE(loaded.load(&oui_prefix));
+
+  // Using a profile successfully makes it the most recent, which changes
+  // just the order, and so the CRC.
+  EXPECT_TRUE(loaded.markSuccessful(1));
+  EXPECT_FALSE(loaded.markSuccessful(1));
+  EXPECT_EQ(loaded.order[0], 1);
+  EXPECT_EQ(loaded.order[1], 0);
+#ifdef ARDUINO_HOST
+  EEPROM.resetCounts();
+  loaded.save();
+  EXPECT_TRUE(EEPROM.bytesWritten() <= 2 + 4);
+#else
+  loaded.save();
+#endif  // ARDUINO_HOST
+  ASSERT_TRUE(a.load(nullptr));
+  EXPECT_EQ(a, loaded);
+
+  // An order which doesn't list each profile once is rejected, even with a
+  // valid CRC.
+  Addresses bad_order = a;
+  bad_order.order[1] = bad_order.order[0];
+  bad_order.save();
+  EXPECT_TRUE(bad_order.loadWithStatus(nullptr) ==
+              Addresses::LoadStatus::kCrcMismatch);
+  EXPECT_EQ(bad_order.order[1], bad_order.order[0]);
+  a.save();
+
+  // The table has a limited size.
+  while (a.count < Addresses::kMaxProfiles) {
+    EXPECT_EQ(a.addProfile(lab), a.count - 1);
+  }
+  EXPECT_EQ(a.addProfile(lab), Addresses::kMaxProfiles);
+
+  // Back to just one profile, for the tests which follow.
+  a.count = 0;
+  a.addProfile(generated);
+  a.save();
+}
+
+// Addresses saved by the earlier version, as a single IP and MAC address,
+// are loaded as the first profile.
+void testLegacy() {
+  Addresses saved;
+  ASSERT_TRUE(saved.load(nullptr));
+  const NetworkProfile& profile = saved.profiles[0];
+  eeprom_io::EepromTransactionBuffer<5 + 4 + 6 + 4> txn(0);
+  const int ipAddress = txn.putName(0, "addrs");
+  const int macAddress = profile.ip.save(ipAddress, &txn);
+  const int crcAddress = profile.mac.save(macAddress, &txn);
+  txn.putCrc(ipAddress, crcAddress);
+  txn.commit();
+
+  Addresses a;
+  EXPECT_TRUE(a.loadWithStatus(nullptr) ==
+              Addresses::LoadStatus::kNameMismatch);
+  a.loadOrGenAndSave(nullptr);
+  EXPECT_EQ(a, saved);
+  Addresses reloaded;
+  EXPECT_TRUE(reloaded.load(nullptr));
+  EXPECT_EQ(reloaded, saved);
+}
+
+// Collects what is printed, and counts the writes.
+class StringPrint : public Print {
+ public:
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    ++writes;
+    for (size_t i = 0; i < size && used < sizeof buf - 1; ++i) {
+      buf[used++] = buffer[i];
+    }
+    buf[used] = 0;
+    return size;
+  }
+  using Print::write;
+
+  void clear() {
+    used = 0;
+    buf[0] = 0;
+    writes = 0;
+  }
+
+  char buf[512] = "";
+  size_t used = 0;
+  unsigned long writes = 0;
+};
+
+void testFormatting() {
+  char buf[kMacAddressChars];
+  const uint8_t bytes[6] = {0x52, 0xC4, 0x05, 0x0A, 0x00, 0xFF};
+  EXPECT_EQ(formatHexBytes(bytes, 6, '-', buf), 17);
+  EXPECT_EQ(strcmp(buf, "52-C4-05-0A-00-FF"), 0);
+  EXPECT_EQ(formatHexBytes(bytes, 1, ':', buf), 2);
+  EXPECT_EQ(strcmp(buf, "52"), 0);
+  EXPECT_EQ(formatHexBytes(bytes, 0, ':', buf), 0);
+  EXPECT_EQ(strcmp(buf, ""), 0);
+
+  // Every octet value, in each position.
+  char ip_buf[kIPAddressChars];
+  char expected[kIPAddressChars];
+  for (int b = 0; b < 256; ++b) {
+    const IPAddress ip(b, 255 - b, b, 255 - b);
+    snprintf(expected, sizeof expected, "%d.%d.%d.%d", b, 255 - b, b,
+             255 - b);
+    EXPECT_EQ(formatIPAddress(ip, ip_buf), strlen(expected));
+    EXPECT_EQ(strcmp(ip_buf, expected), 0);
+  }
+  EXPECT_EQ(formatIPAddress(IPAddress(255, 255, 255, 255), ip_buf),
+            kIPAddressChars - 1);
+
+  // Each is printed with one write.
+  StringPrint out;
+  OuiPrefix oui_prefix(0x52, 0xC4, 0x05);
+  EXPECT_EQ(out.print(oui_prefix), 8);
+  EXPECT_EQ(strcmp(out.buf, "52-C4-05"), 0);
+  EXPECT_EQ(out.writes, 1);
+
+  out.clear();
+  MacAddress mac;
+  memcpy(mac.mac, bytes, 6);
+  EXPECT_EQ(out.print(mac), 17);
+  EXPECT_EQ(strcmp(out.buf, "52-C4-05-0A-00-FF"), 0);
+  EXPECT_EQ(out.writes, 1);
+
+  out.clear();
+  EXPECT_EQ(printIPAddress(out, IPAddress(10, 0, 100, 9)), 10);
+  EXPECT_EQ(strcmp(out.buf, "10.0.100.9"), 0);
+  EXPECT_EQ(out.writes, 1);
+
+  out.clear();
+  NetworkProfile profile;
+  profile.mac = mac;
+  profile.ip = SaveableIPAddress(169, 254, 1, 205);
+  EXPECT_EQ(out.print(profile), 39);
+  EXPECT_EQ(strcmp(out.buf, "MAC=52-C4-05-0A-00-FF, IP=169.254.1.205"), 0);
+  EXPECT_EQ(out.writes, 1);
+
+  out.clear();
+  NetworkProfile lab;
+  lab.mac = mac;
+  lab.use_dhcp = false;
+  lab.ip = SaveableIPAddress(10, 1, 2, 3);
+  lab.subnet = SaveableIPAddress(255, 255, 255, 0);
+  lab.gateway = SaveableIPAddress(10, 1, 2, 1);
+  lab.dns = SaveableIPAddress(10, 1, 2, 53);
+  lab.setName("lab");
+  out.print(lab);
+  EXPECT_EQ(strcmp(out.buf,
+                   "MAC=52-C4-05-0A-00-FF, IP=10.1.2.3, mask=255.255.255.0, "
+                   "gw=10.1.2.1, dns=10.1.2.53, name=lab"),
+            0);
+  EXPECT_EQ(out.writes, 1);
+
+  // The longest possible profile fills the buffer exactly.
+  NetworkProfile longest = lab;
+  longest.ip = longest.subnet = longest.gateway = longest.dns =
+      SaveableIPAddress(255, 255, 255, 255);
+  longest.setName("abcdefghijklmnopqrstuvwxyz");
+  char profile_buf[NetworkProfile::kMaxChars];
+  EXPECT_EQ(longest.format(profile_buf), NetworkProfile::kMaxChars - 1);
+
+  // The whole table too, most recently used first.
+  out.clear();
+  Addresses addresses;
+  EXPECT_EQ(addresses.addProfile(profile), 0);
+  EXPECT_EQ(addresses.addProfile(lab), 1);
+  EXPECT_EQ(addresses.addProfile(longest), 2);
+  addresses.markSuccessful(1);
+  out.print(addresses);
+  char expected_table[512];
+  char* end = expected_table;
+  end += sprintf(end, "nets: #1 ");
+  end += lab.format(end);
+  end += sprintf(end, "; #0 ");
+  end += profile.format(end);
+  end += sprintf(end, "; #2 ");
+  end += longest.format(end);
+  EXPECT_EQ(strcmp(out.buf, expected_table), 0);
+  EXPECT_EQ(out.writes, 1);
+}
+
+// The way the addresses used to be printed, with a print call per byte and
+// separator (and without leading zeros).
+size_t printMacByBytes(Print& p, const MacAddress& mac) {
+  size_t result = p.print(mac.mac[0], HEX);
+  for (int i = 1; i < 6; ++i) {
+    result += p.print("-");
+    result += p.print(mac.mac[i], HEX);
+  }
+  return result;
+}
+
+size_t printIPByBytes(Print& p, const IPAddress& ip) {
+  size_t result = p.print(ip[0], DEC);
+  for (int i = 1; i < 4; ++i) {
+    result += p.print('.');
+    result += p.print(ip[i], DEC);
+  }
+  return result;
+}
+
+size_t printMacFormatted(Print& p, const MacAddress& mac) {
+  return p.print(mac);
+}
+
+size_t printIPFormatted(Print& p, const IPAddress& ip) {
+  return printIPAddress(p, ip);
+}
+
+// Prints the writes and the time per address, and on a board the cycles.
+void reportBenchmark(const char* label, unsigned long elapsed_us,
+                     unsigned long writes, int count) {
+  Serial.print(label);
+  Serial.print(": ");
+  Serial.print(static_cast<float>(writes) / count);
+  Serial.print(" writes, ");
+  Serial.print(elapsed_us * 1000.0 / count);
+  Serial.print(" ns");
+#ifndef ARDUINO_HOST
+  Serial.print(", ");
+  Serial.print(elapsed_us * (F_CPU / 1000000.0) / count);
+  Serial.print(" cycles");
+#endif  // !ARDUINO_HOST
+  Serial.println(" per address");
+}
+
+// Compares the time and the number of writes per address for the old and new
+// ways of printing them, for a variety of addresses (e.g. some octets with 1
+// digit, some with 3).
+void benchmarkPrinting() {
+  constexpr int kCount = 1000;
+  StringPrint out;
+
+  using MacFunc = size_t (*)(Print&, const MacAddress&);
+  const MacFunc mac_funcs[] = {printMacByBytes, printMacFormatted};
+  const char* const mac_labels[] = {"MAC, print per byte", "MAC, formatted     "};
+  MacAddress mac;
+  mac.generateAddress(nullptr);
+  for (int f = 0; f < 2; ++f) {
+    unsigned long writes = 0;
+    const unsigned long start = BenchmarkMicros();
+    for (int i = 0; i < kCount; ++i) {
+      mac.mac[4] = i;
+      mac.mac[5] = i >> 2;
+      out.clear();
+      mac_funcs[f](out, mac);
+      writes += out.writes;
+    }
+    const unsigned long elapsed_us = BenchmarkMicros() - start;
+    reportBenchmark(mac_labels[f], elapsed_us, writes, kCount);
+  }
+
+  using IPFunc = size_t (*)(Print&, const IPAddress&);
+  const IPFunc ip_funcs[] = {printIPByBytes, printIPFormatted};
+  const char* const ip_labels[] = {"IP, print per byte ", "IP, formatted      "};
+  for (int f = 0; f < 2; ++f) {
+    unsigned long writes = 0;
+    const unsigned long start = BenchmarkMicros();
+    for (int i = 0; i < kCount; ++i) {
+      const IPAddress ip(192 + (i & 7), i >> 2, i, 255 - i);
+      out.clear();
+      ip_funcs[f](out, ip);
+      writes += out.writes;
+    }
+    const unsigned long elapsed_us = BenchmarkMicros() - start;
+    reportBenchmark(ip_labels[f], elapsed_us, writes, kCount);
+  }
+}
+
 void setup()
 {
   Serial.begin(9600);
   delay(500);
 
   // Wipe out the contents of the EEPROM; really, just flip bits in one of
-  // the first 14 bytes, will will invalidate the first load; 14 is the number
-  // of bytes required to store an IP address, a MAC address and a Crc32.
+  // the first kSavedBytes bytes, which will invalidate the first load.
   {
     AnalogRandom rnd;
-    int i = rnd.random32() % 14;
+    int i = rnd.random32() % kSavedBytes;
     uint8_t v = EEPROM.read(i);
     EEPROM.write(i, ~v);
   }
@@ -30,7 +445,8 @@ void setup()
   // Try again with loadOrGenAndSave(nullptr), i.e. no OUI prefix.
   // This will generate ans save some values.
   Addresses a1;
-  ASSERT_TRUE(a1.loadOrGenAndSave(nullptr));
+  a1.loadOrGenAndSave(nullptr);
+  ASSERT_TRUE(a1.load(nullptr));
 
   // Load again, which should produce the same values.
   {
@@ -41,16 +457,22 @@ void setup()
 
   // Now try loading with a different OUI prefix specified. Load will fail
   // because of the mismatch.
-  OuiPrefix oui_prefix(0x52, 0xC4, ~a1.mac.mac[2]);
+  OuiPrefix oui_prefix(0x52, 0xC4, ~a1.profiles[0].mac.mac[2]);
   {
-    Addresses a3;
-    ASSERT_FALSE(a3.load(&oui_prefix));
+    Addresses a3 = a1;
+    a3.generateAddresses(nullptr);
+    const Addresses unchanged = a3;
+    ASSERT_TRUE(a3.loadWithStatus(&oui_prefix) ==
+                Addresses::LoadStatus::kOuiMismatch);
+    // The fields are left alone when the load fails.
+    ASSERT_EQ(a3, unchanged);
   }
 
   // Try again with loadOrGenAndSave, which will replace the values in
   // the EEPROM.
   Addresses a4;
-  ASSERT_TRUE(a4.loadOrGenAndSave(&oui_prefix));
+  a4.loadOrGenAndSave(&oui_prefix);
+  ASSERT_TRUE(a4.load(&oui_prefix));
   ASSERT_NE(a1, a4);
 
   // Now try loading with the same OUI prefix as when we generated.
@@ -60,6 +482,13 @@ void setup()
     ASSERT_EQ(a4, a5);
   }
 
+  testLoadStatus();
+  benchmarkLoad();
+  testProfiles();
+  testLegacy();
+  testFormatting();
+  benchmarkPrinting();
+
   Serial.println();
   Serial.println("##############################################");
   Serial.println("Test complete");
@@ -0,0 +1 @@
+../utilities/crc32.cpp
\ No newline at end of file
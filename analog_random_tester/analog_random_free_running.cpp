@@ -0,0 +1 @@
+../utilities/analog_random_free_running.cpp
\ No newline at end of file
@@ -159,14 +159,50 @@ void loop() {
   }
 }
 
+// Prints random32 values, one per line in hex, for evaluation with
+// eval_analog_random.py, taking the readings in free-running mode if
+// free_running is true (and the board supports it), else with analogRead.
+// Also reports the rate at which they're produced, timing only the calls to
+// random32: the values are produced a batch at a time into an array, which
+// is printed afterwards. (In free-running mode the interrupt handler's pool
+// fills up while a batch is printed, which flatters the rate by about 2%.)
+// Call it from loop() in place of the dump of analog readings.
+void loop_random32(bool free_running) {
+  constexpr int kValuesPerBatch = 64;
+  constexpr int kBatches = 16;
+  static uint32_t values[kValuesPerBatch];
+  if (free_running) {
+    free_running = rng.startFreeRunning();
+  }
+  Serial.print("# free_running=");
+  Serial.println(free_running ? "true" : "false");
+  unsigned long elapsed_us = 0;
+  for (int batch = 0; batch < kBatches; ++batch) {
+    // Don't time the serial interrupts sending the previous batch.
+    Serial.flush();
+    const unsigned long start_us = micros();
+    for (int i = 0; i < kValuesPerBatch; ++i) {
+      values[i] = rng.random32();
+    }
+    elapsed_us += micros() - start_us;
+    for (int i = 0; i < kValuesPerBatch; ++i) {
+      Serial.print("0x");
+      Serial.println(values[i], HEX);
+    }
+  }
+  rng.stopFreeRunning();
+  Serial.print("# bits/second=");
+  Serial.println(32e6 * kValuesPerBatch * kBatches / elapsed_us);
+}
+
 void loop_old() {
   #define ARRAY_ELEMS(a) ((sizeof a) / (sizeof a[0]))
   static const int kNBitsChoices[] = {1, 2, 3, 4, 5};
   static const long kBucketMaxChoices[] = {256, 1024, 4096};
   constexpr auto kNumNbitsChoices = ARRAY_ELEMS(kNBitsChoices);
   constexpr auto kNumBucketMaxChoices = ARRAY_ELEMS(kBucketMaxChoices);
-  static int nbits_index = 0;
-  static int bucket_max_index = 0;
+  static size_t nbits_index = 0;
+  static size_t bucket_max_index = 0;
   static bool use_analog_random = false;
 
   const auto nbits = kNBitsChoices[nbits_index];
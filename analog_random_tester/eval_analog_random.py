@@ -0,0 +1,63 @@
+#!/usr/bin/env python
+# Evaluates the random32 values printed by analog_random_tester's
+# loop_random32 (one per line, in hex; lines starting with '#' are ignored),
+# counting the occurrences of each value of every run of 1 to 8 adjacent
+# bits, and applying the Chi-Squared test, as hash_tester.py does for the
+# JitterRandom hashes.
+#
+# Usage: eval_analog_random.py captured_serial_output.txt
+
+import argparse
+import copy
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', 'jitter_random_tester'))
+
+from hash_tester import Occurrences, bits_subset
+
+
+def read_values(path):
+    values = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            values.append(int(line, 16))
+    return values
+
+
+def occurrences_for_num_bits(values, num_bits):
+    combined = None
+    for bit_offset in range(33 - num_bits):
+        occurrences = Occurrences(bits_subset(values, bit_offset, num_bits))
+        if combined is None:
+            combined = copy.deepcopy(occurrences)
+        else:
+            combined.add(occurrences)
+    return combined
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Test the randomness of AnalogRandom.random32 values.')
+    parser.add_argument('path', help='file of values, one per line, in hex')
+    args = parser.parse_args()
+
+    values = read_values(args.path)
+    print('Read %d values' % len(values))
+    for num_bits in range(1, 9):
+        print()
+        print('#' * 80)
+        print('Counting %d bit occurrences' % num_bits)
+        occurrences = occurrences_for_num_bits(values, num_bits)
+        occurrences.print_summary()
+        occurrences.print_chisquare()
+        print()
+        occurrences.print_count_table()
+
+
+if __name__ == "__main__":
+    main()
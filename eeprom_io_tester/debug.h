@@ -0,0 +1 @@
+../utilities/debug.h
\ No newline at end of file
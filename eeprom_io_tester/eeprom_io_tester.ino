@@ -1,14 +1,475 @@
+// Tests and benchmarks for eeprom_io. Prints the results to Serial.
 
 #include <Arduino.h>
+#include <EEPROM.h>
 
 #include "eeprom_io.h"
+#include "eeprom_ring_store.h"
+#include "eeprom_schema.h"
+#include "test.h"
 
-void setup()
-{
-  
+// Set to 1 to also benchmark RingStore scanning regions the size of the whole
+// EEPROM of an Uno (1KB) and of a Mega (4KB), when the board has enough. This
+// fills the whole EEPROM (i.e. wipes out what other sketches have saved) and
+// costs thousands of EEPROM writes, so it isn't on by default.
+#ifndef BENCHMARK_WHOLE_EEPROM
+#define BENCHMARK_WHOLE_EEPROM 0
+#endif
+
+using CrcAppendFn = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+// Buffer of "random" bytes to compute the CRC of; the content doesn't matter
+// much, but it shouldn't be all zeroes.
+constexpr size_t kBufferSize = 256;
+uint8_t buffer[kBufferSize];
+
+void fillBuffer() {
+  uint32_t v = 12345;
+  for (size_t i = 0; i < kBufferSize; ++i) {
+    v = v * 1103515245 + 12345;
+    buffer[i] = v >> 16;
+  }
+}
+
+// The value of a Crc32 to which nothing has been appended.
+const uint32_t kInitialCrc = eeprom_io::Crc32().value();
+
+void testCrcImplementationsAgree() {
+  // Try all the lengths, so that slice-by-4 is tested with each of the
+  // possible number of trailing bytes.
+  for (size_t n = 0; n <= 64; ++n) {
+    const uint32_t nibble = eeprom_io::appendBytesNibbleTable(kInitialCrc, buffer, n);
+    const uint32_t byte = eeprom_io::appendBytesByteTable(kInitialCrc, buffer, n);
+    const uint32_t slice4 = eeprom_io::appendBytesSlice4(kInitialCrc, buffer, n);
+    ASSERT_EQ(nibble, byte);
+    ASSERT_EQ(nibble, slice4);
+  }
+
+  // Crc32 must produce the same value whether fed a byte at a time or in bulk.
+  eeprom_io::Crc32 bulk;
+  bulk.append(buffer, kBufferSize);
+  eeprom_io::Crc32 bytewise;
+  for (size_t i = 0; i < kBufferSize; ++i) {
+    bytewise.appendByte(buffer[i]);
+  }
+  EXPECT_EQ(bulk.value(), bytewise.value());
+  EXPECT_EQ(bulk.value(),
+            eeprom_io::appendBytesNibbleTable(kInitialCrc, buffer, kBufferSize));
+}
+
+void benchmarkCrc(const char* name, CrcAppendFn fn, size_t tableBytes,
+                  bool tableInProgmem) {
+  constexpr int kIterations = 32;
+  uint32_t value = kInitialCrc;
+  const unsigned long start = BenchmarkMicros();
+  for (int i = 0; i < kIterations; ++i) {
+    value = fn(value, buffer, kBufferSize);
+  }
+  const unsigned long elapsed = BenchmarkMicros() - start;
+  const unsigned long bytes = kIterations * kBufferSize;
+
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(bytes);
+  Serial.print(" bytes in ");
+  Serial.print(elapsed);
+  Serial.print(" us; bytes/second: ");
+  if (elapsed > 0) {
+    Serial.print((bytes * 1000000.0) / elapsed, 0);
+  } else {
+    Serial.print("too fast to measure");
+  }
+  Serial.print("; table: ");
+  Serial.print(tableBytes);
+  Serial.print(tableInProgmem ? " bytes of flash" : " bytes of flash and RAM");
+  // Printing the value ensures the compiler can't skip the computation.
+  Serial.print("; crc=0x");
+  Serial.println(value, HEX);
+}
+
+// The transaction tests use the last kRegionSize bytes of the EEPROM, to stay
+// out of the way of the sketches that store data at address 0.
+constexpr int kRegionSize = 32;
+int regionStart() { return EEPROM.length() - kRegionSize; }
+
+// Approximate time to write one byte of the EEPROM on an AVR.
+constexpr float kMillisPerEepromWrite = 3.3;
+
+void fillRegion(uint8_t offset) {
+  for (int i = 0; i < kRegionSize; ++i) {
+    EEPROM.update(regionStart() + i, buffer[i] + offset);
+  }
+}
+
+void reportWrites(const char* what, size_t written) {
+  Serial.print(what);
+  Serial.print(": ");
+  Serial.print(written);
+  Serial.print(" bytes written, simulated write time ");
+  Serial.print(written * kMillisPerEepromWrite);
+  Serial.println(" ms");
+}
+
+void testTransactionWritesOnlyChangedBytes() {
+  fillRegion(0);
+  const int start = regionStart();
+
+  // Staging the current contents changes nothing.
+  {
+    eeprom_io::EepromTransactionBuffer<kRegionSize> txn(start);
+    txn.putBytes(start, buffer, kRegionSize);
+    EXPECT_FALSE(txn.isDirty());
+    EXPECT_EQ(txn.commit(), 0);
+  }
+
+  // Changing a couple of bytes writes just those.
+  {
+    eeprom_io::EepromTransactionBuffer<kRegionSize> txn(start);
+    txn.putBytes(start, buffer, kRegionSize);
+    txn.putByte(start + 3, ~buffer[3]);
+    txn.putByte(start + 20, ~buffer[20]);
+    EXPECT_TRUE(txn.isDirty());
+    const size_t written = txn.commit();
+    EXPECT_EQ(written, 2);
+    EXPECT_EQ(EEPROM.read(start + 3), static_cast<uint8_t>(~buffer[3]));
+    EXPECT_EQ(EEPROM.read(start + 20), static_cast<uint8_t>(~buffer[20]));
+    EXPECT_EQ(EEPROM.read(start + 4), buffer[4]);
+    reportWrites("Transaction, 2 of 32 bytes changed", written);
+  }
+
+  // More scattered changes than there are dirty ranges; the ranges get
+  // merged, but still only the changed bytes are written.
+  fillRegion(0);
+  {
+    eeprom_io::EepromTransactionBuffer<kRegionSize> txn(start);
+    for (int i = kRegionSize - 1; i >= 0; i -= 3) {
+      txn.putByte(start + i, buffer[i] + 1);
+    }
+    const size_t written = txn.commit();
+    EXPECT_EQ(written, (kRegionSize + 2) / 3);
+    for (int i = 0; i < kRegionSize; ++i) {
+      const uint8_t expected = buffer[i] + (i % 3 == 1 ? 1 : 0);
+      EXPECT_EQ(EEPROM.read(start + i), expected);
+    }
+  }
+
+  // For comparison, the approach that DogDetector used to take: writing
+  // every byte regardless.
+  reportWrites("EEPROM.write of every byte", kRegionSize);
+}
+
+void testTransactionCrc() {
+  fillRegion(0);
+  const int start = regionStart();
+  const char kName[] = "test";
+  constexpr size_t kDataSize = 8;
+
+  eeprom_io::EepromTransactionBuffer<kRegionSize> txn(start);
+  const int dataAddress = txn.putName(start, kName);
+  const int crcAddress = txn.putBytes(dataAddress, buffer, kDataSize);
+  txn.putCrc(dataAddress, crcAddress);
+  const size_t written = txn.commit();
+  reportWrites("Transaction with name, data and CRC", written);
+
+  // Confirm that it can be read back the way Addresses::load does.
+  int afterName;
+  ASSERT_TRUE(eeprom_io::verifyName(start, kName, &afterName));
+  ASSERT_EQ(afterName, dataAddress);
+  uint8_t data[kDataSize];
+  eeprom_io::Crc32 crc;
+  eeprom_io::getBytes(dataAddress, kDataSize, data, &crc);
+  EXPECT_TRUE(eeprom_io::verifyCrc(crcAddress, crc));
+  EXPECT_EQ(memcmp(data, buffer, kDataSize), 0);
+
+  // Saving the same again writes nothing, not even the CRC.
+  eeprom_io::EepromTransactionBuffer<kRegionSize> again(start);
+  again.putName(start, kName);
+  again.putBytes(dataAddress, buffer, kDataSize);
+  again.putCrc(dataAddress, crcAddress);
+  EXPECT_EQ(again.commit(), 0);
+}
+
+void testTransactionOutOfRange() {
+  fillRegion(0);
+  const int start = regionStart();
+  constexpr size_t kShadowSize = 8;
+  constexpr uint8_t kCanary = 0xA5;
+
+  // The shadow is followed by canary bytes, which a put past the end of the
+  // region would overwrite.
+  uint8_t shadow[kShadowSize + 4];
+  memset(shadow, kCanary, sizeof shadow);
+  eeprom_io::EepromTransaction txn(start, shadow, kShadowSize);
+  txn.putBytes(start, buffer, kShadowSize);
+  EXPECT_FALSE(txn.failed());
+  txn.putBytes(start + 6, buffer, 4);
+  EXPECT_TRUE(txn.failed());
+  for (size_t i = kShadowSize; i < sizeof shadow; ++i) {
+    EXPECT_EQ(shadow[i], kCanary);
+  }
+  // Nothing is written, not even the bytes that were in range.
+  txn.putByte(start, ~buffer[0]);
+  EXPECT_EQ(txn.commit(), eeprom_io::EepromTransaction::kCommitFailed);
+  EXPECT_EQ(EEPROM.read(start), buffer[0]);
+
+  // Before the start of the region.
+  eeprom_io::EepromTransaction before(start, shadow, kShadowSize);
+  before.putByte(start - 1, 1);
+  EXPECT_TRUE(before.failed());
+
+  // A CRC that doesn't fit, or covers data outside the region.
+  eeprom_io::EepromTransaction crc(start, shadow, kShadowSize);
+  crc.putCrc(start, start + kShadowSize - 2);
+  EXPECT_TRUE(crc.failed());
+  eeprom_io::EepromTransaction data(start, shadow, kShadowSize);
+  data.putCrc(start - 4, start);
+  EXPECT_TRUE(data.failed());
+  EXPECT_EQ(data.commit(), eeprom_io::EepromTransaction::kCommitFailed);
+}
+
+// The RingStore tests use the kRingRegionSize bytes before the transaction
+// test region.
+constexpr int kRingRegionSize = 256;
+int ringRegionStart() { return regionStart() - kRingRegionSize; }
+const char kRingName[] = "ring";
+
+struct Calibration {
+  uint16_t low;
+  uint16_t medium;
+  uint16_t high;
+};
+
+void wipe(int start, int size) {
+  for (int i = 0; i < size; ++i) {
+    EEPROM.update(start + i, 0xff);
+  }
+}
+
+void fillRing(eeprom_io::RingStore* store, uint16_t numWrites) {
+  for (uint16_t i = 0; i < numWrites; ++i) {
+    Calibration c = {i, static_cast<uint16_t>(i + 1),
+                     static_cast<uint16_t>(i + 2)};
+    store->writeStruct(c);
+  }
+}
+
+void testRingStore() {
+  const int start = ringRegionStart();
+  wipe(start, kRingRegionSize);
+
+  eeprom_io::RingStore store(kRingName, start, kRingRegionSize,
+                             sizeof(Calibration));
+  // 4 byte name, 2 byte sequence, 6 byte payload, 4 byte CRC.
+  ASSERT_EQ(store.slotSize(), 16);
+  ASSERT_EQ(store.numSlots(), kRingRegionSize / 16);
+  EXPECT_FALSE(store.begin());
+  EXPECT_FALSE(store.hasRecord());
+
+  // Go around the ring a couple of times.
+  const uint16_t kWrites = 2 * store.numSlots() + 3;
+  fillRing(&store, kWrites);
+
+  // A fresh RingStore finds the newest record.
+  {
+    eeprom_io::RingStore reloaded(kRingName, start, kRingRegionSize,
+                                  sizeof(Calibration));
+    ASSERT_TRUE(reloaded.begin());
+    EXPECT_EQ(reloaded.sequence(), kWrites - 1);
+    Calibration c;
+    ASSERT_TRUE(reloaded.readStruct(&c));
+    EXPECT_EQ(c.low, kWrites - 1);
+    EXPECT_EQ(c.high, kWrites + 1);
+  }
+
+  // Simulate losing power while writing the newest record by corrupting its
+  // payload; the one before it should be found instead.
+  const int newestSlot = (kWrites - 1) % store.numSlots();
+  const int payloadAddress =
+      start + newestSlot * store.slotSize() + strlen(kRingName) + 2;
+  EEPROM.write(payloadAddress, ~EEPROM.read(payloadAddress));
+  {
+    eeprom_io::RingStore reloaded(kRingName, start, kRingRegionSize,
+                                  sizeof(Calibration));
+    ASSERT_TRUE(reloaded.begin());
+    EXPECT_EQ(reloaded.sequence(), kWrites - 2);
+    Calibration c;
+    ASSERT_TRUE(reloaded.readStruct(&c));
+    EXPECT_EQ(c.low, kWrites - 2);
+
+    // The next write replaces the damaged record.
+    c.low = 1000;
+    reloaded.writeStruct(c);
+  }
+  {
+    eeprom_io::RingStore reloaded(kRingName, start, kRingRegionSize,
+                                  sizeof(Calibration));
+    ASSERT_TRUE(reloaded.begin());
+    EXPECT_EQ(reloaded.sequence(), kWrites - 1);
+    Calibration c;
+    ASSERT_TRUE(reloaded.readStruct(&c));
+    EXPECT_EQ(c.low, 1000);
+  }
+}
+
+void testRingStoreTooSmall() {
+  // The region is one byte short of a slot.
+  const int start = ringRegionStart();
+  constexpr int kTooSmall = 15;
+  wipe(start, kTooSmall + 1);
+  eeprom_io::RingStore store(kRingName, start, kTooSmall,
+                             sizeof(Calibration));
+  ASSERT_EQ(store.numSlots(), 0);
+  EXPECT_FALSE(store.begin());
+  const Calibration c = {1, 2, 3};
+  EXPECT_FALSE(store.writeStruct(c));
+  EXPECT_FALSE(store.hasRecord());
+  // Not even the name was written.
+  for (int i = 0; i <= kTooSmall; ++i) {
+    EXPECT_EQ(EEPROM.read(start + i), 0xff);
+  }
+}
+
+// Measures the time for RingStore::begin to find the newest record in a full
+// region.
+void benchmarkRingScan(int start, int size) {
+  eeprom_io::RingStore store(kRingName, start, size, sizeof(Calibration));
+  wipe(start, size);
+  fillRing(&store, store.numSlots() + 1);
+
+  eeprom_io::RingStore reloaded(kRingName, start, size, sizeof(Calibration));
+  const unsigned long begin = BenchmarkMicros();
+  const bool found = reloaded.begin();
+  const unsigned long elapsed = BenchmarkMicros() - begin;
+  EXPECT_TRUE(found);
+
+  Serial.print("RingStore scan of ");
+  Serial.print(size);
+  Serial.print(" byte region, ");
+  Serial.print(store.numSlots());
+  Serial.print(" slots: ");
+  Serial.print(elapsed);
+  Serial.println(" us");
+}
+
+// The EepromSchema tests use the bytes before the RingStore test region. The
+// address of a schema is a template argument, so this is fixed, and assumes a
+// board with at least 1KB of EEPROM.
+constexpr int kSchemaBase = 512;
+
+struct Settings {
+  uint8_t volume;
+  bool enabled;
+};
+
+using TestSchema =
+    eeprom_io::EepromSchema<kSchemaBase, eeprom_io::Record<Calibration, 1>,
+                            eeprom_io::Record<Settings, 1>>;
+
+// Same layout, but the Settings record has a new version, as it would after a
+// change to the struct.
+using NewSettingsSchema =
+    eeprom_io::EepromSchema<kSchemaBase, eeprom_io::Record<Calibration, 1>,
+                            eeprom_io::Record<Settings, 2>>;
+
+void testSchema() {
+  // 2 byte header + payload + 4 byte CRC for each record.
+  static_assert(TestSchema::kSize == (2 + 6 + 4) + (2 + 2 + 4), "kSize");
+  static_assert(TestSchema::address<0>() == kSchemaBase, "address<0>");
+  static_assert(TestSchema::address<1>() == kSchemaBase + 12, "address<1>");
+  static_assert(TestSchema::kAllLoaded == 3, "kAllLoaded");
+  ASSERT_TRUE(TestSchema::kEndAddress <= ringRegionStart());
+
+  wipe(kSchemaBase, TestSchema::kSize);
+  Calibration c = {1, 2, 3};
+  Settings s = {7, true};
+  EXPECT_EQ(TestSchema::load(&c, &s), 0);
+  // Not loaded, so the defaults are unchanged.
+  EXPECT_EQ(c.medium, 2);
+  EXPECT_EQ(s.volume, 7);
+
+  reportWrites("Schema initial save", TestSchema::save(c, s));
+  {
+    Calibration c2 = {0, 0, 0};
+    Settings s2 = {0, false};
+    EXPECT_EQ(TestSchema::load(&c2, &s2), TestSchema::kAllLoaded);
+    EXPECT_EQ(c2.high, 3);
+    EXPECT_EQ(s2.volume, 7);
+    EXPECT_TRUE(s2.enabled);
+  }
+
+  // Saving the same values doesn't write anything, and changing one field
+  // writes just that byte and the CRC bytes that changed.
+  EXPECT_EQ(TestSchema::save(c, s), 0);
+  s.volume = 8;
+  const size_t written = TestSchema::save(c, s);
+  EXPECT_TRUE(written >= 1);
+  EXPECT_TRUE(written <= 5);
+  reportWrites("Schema save of one changed field", written);
+
+  // A new version of Settings ignores the old record, but still loads the
+  // Calibration record.
+  {
+    Calibration c2 = {0, 0, 0};
+    Settings s2 = {42, false};
+    EXPECT_EQ(NewSettingsSchema::load(&c2, &s2), 1);
+    EXPECT_EQ(c2.low, 1);
+    EXPECT_EQ(s2.volume, 42);
+  }
+
+  // Corrupting the Calibration payload is detected by its CRC.
+  const int payloadAddress = TestSchema::address<0>() + 2;
+  EEPROM.write(payloadAddress, ~EEPROM.read(payloadAddress));
+  {
+    Calibration c2 = {0, 0, 0};
+    Settings s2 = {0, false};
+    EXPECT_EQ(TestSchema::load(&c2, &s2), 2);
+    EXPECT_EQ(c2.low, 0);
+    EXPECT_EQ(s2.volume, 8);
+  }
+}
+
+void setup() {
+  Serial.begin(9600);
+  delay(500);
+
+  fillBuffer();
+  testCrcImplementationsAgree();
+
+  // The nibble table isn't in PROGMEM, so on AVR it is copied into RAM.
+  benchmarkCrc("Nibble table", eeprom_io::appendBytesNibbleTable,
+               eeprom_io::kNibbleTableBytes, false);
+  benchmarkCrc("Byte table", eeprom_io::appendBytesByteTable,
+               eeprom_io::kByteTableBytes, true);
+  benchmarkCrc("Slice-by-4", eeprom_io::appendBytesSlice4,
+               eeprom_io::kSlice4TableBytes, true);
+
+  testTransactionWritesOnlyChangedBytes();
+  testTransactionCrc();
+  testTransactionOutOfRange();
+
+  testRingStore();
+  testRingStoreTooSmall();
+  benchmarkRingScan(ringRegionStart(), kRingRegionSize);
+
+  testSchema();
+
+#if BENCHMARK_WHOLE_EEPROM
+  if (EEPROM.length() >= 1024) {
+    benchmarkRingScan(0, 1024);
+  }
+  if (EEPROM.length() >= 4096) {
+    benchmarkRingScan(0, 4096);
+  }
+#endif  // BENCHMARK_WHOLE_EEPROM
+
+  Serial.println();
+  Serial.println("##############################################");
+  Serial.println("Test complete");
+  Serial.println("##############################################");
+  Serial.println();
 }
 
 void loop()
 {
   
-}
\ No newline at end of file
+}
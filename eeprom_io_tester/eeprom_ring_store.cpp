@@ -0,0 +1 @@
+../utilities/eeprom_ring_store.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/eeprom_ring_store.h
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/eeprom_schema.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/eeprom_schema.h
\ No newline at end of file
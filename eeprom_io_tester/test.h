@@ -0,0 +1 @@
+../utilities/test.h
\ No newline at end of file
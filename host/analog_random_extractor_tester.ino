@@ -0,0 +1,186 @@
+// Host-only test of AnalogRandom's extractor, fed with simulated analog
+// readings whose low bit is biased, which checks that its output passes a
+// chi-squared test, and reports how many bits it yields per reading, and so
+// per second on an AVR; see CMakeLists.txt.
+//
+// The hardware itself is assessed with analog_random_tester, whose output
+// can be checked with analog_random_tester/eval_analog_random.py.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+
+#include "analog_random.h"
+#include "arduino_host.h"
+#include "test.h"
+
+// The time taken by an analogRead with the Arduino core's ADC settings, and
+// by a conversion in AnalogRandom's free-running mode, at 16MHz.
+constexpr double kAnalogReadMicros = 112;
+constexpr double kFreeRunningMicros = 26;
+
+// The 0.1% critical value of the chi-squared distribution with 255 degrees
+// of freedom, i.e. for the counts of each byte value.
+constexpr double kChiSquared255 = 330.5;
+
+// Makes analogRead's low bit 1 with probability ones_per_1024 / 1024,
+// independently of the other readings.
+void useBiasedSource(uint32_t ones_per_1024) {
+  uint32_t state = 2463534242UL;
+  arduino_host::setAnalogReadSource([state, ones_per_1024](uint8_t) mutable {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return 512 + ((state >> 8) % 1024 < ones_per_1024 ? 1 : 0);
+  });
+}
+
+void testExtract() {
+  // Pairs (taken from the low bit up): (1, 1), (0, 1).
+  const uint32_t raw = 0b1011;
+  uint32_t pool = 0;
+  uint8_t count = 0;
+  // Just Von Neumann: the second pair yields its first bit, 0.
+  AnalogRandom::extract(raw, 4, 0, &pool, &count);
+  EXPECT_EQ(count, 1);
+  EXPECT_EQ(pool, 0);
+
+  // The XORs are (0, 1), which yield a 0, then the one equal bit is too few.
+  pool = 0xF0;
+  count = 4;
+  AnalogRandom::extract(raw, 4, 1, &pool, &count);
+  EXPECT_EQ(count, 6);
+  EXPECT_EQ(pool, 0xF0);
+
+  // Pairs (1, 0), (1, 1), (0, 0), (0, 1): Von Neumann yields 1, 0; the XORs
+  // (1, 0, 0, 1) yield 1, 0 and the equal bits (1, 0) yield a 1.
+  pool = 0;
+  count = 0;
+  AnalogRandom::extract(0b10001101, 8, 1, &pool, &count);
+  EXPECT_EQ(count, 5);
+  EXPECT_EQ(pool, 0b10101);
+
+  // Never more bits out than in.
+  pool = 0;
+  count = 0;
+  AnalogRandom::extract(0xAAAAAAAA, 32, 8, &pool, &count);
+  EXPECT_EQ(count, 16);
+  EXPECT_EQ(pool, 0);
+  AnalogRandom::extract(0, 32, 8, &pool, &count);
+  EXPECT_EQ(count, 16);
+}
+
+// Returns the chi-squared statistic of the counts of each byte value.
+double chiSquared(const uint32_t counts[256], uint32_t total) {
+  const double expected = total / 256.0;
+  double sum = 0;
+  for (int i = 0; i < 256; ++i) {
+    const double d = counts[i] - expected;
+    sum += d * d / expected;
+  }
+  return sum;
+}
+
+void testChiSquared(uint32_t ones_per_1024) {
+  useBiasedSource(ones_per_1024);
+  AnalogRandom rng;
+  constexpr uint32_t kNumBytes = 256 * 200;
+  uint32_t counts[256] = {};
+  uint32_t ones = 0;
+  for (uint32_t i = 0; i < kNumBytes; ++i) {
+    const int b = rng.randomByte();
+    ASSERT_TRUE(b >= 0);
+    ++counts[b];
+    for (int v = b; v != 0; v >>= 1) {
+      ones += v & 1;
+    }
+  }
+  const double chi2 = chiSquared(counts, kNumBytes);
+  printf("Bias %4u/1024: chi-squared of %u bytes = %.1f, ones = %.4f\n",
+         ones_per_1024, kNumBytes, chi2, ones / (kNumBytes * 8.0));
+  EXPECT_TRUE(chi2 < kChiSquared255);
+  // Within 4 standard deviations of half.
+  EXPECT_TRUE(ones > kNumBytes * 4 - 4 * 320 && ones < kNumBytes * 4 + 4 * 320);
+  arduino_host::resetAnalogReadSource();
+}
+
+// Returns the bits extracted per reading from num_blocks blocks of readings
+// from the current analogRead source, at the given depth.
+double bitsPerRead(uint8_t depth, uint32_t num_blocks) {
+  uint32_t bits = 0;
+  for (uint32_t n = 0; n < num_blocks; ++n) {
+    uint32_t raw = 0;
+    for (uint8_t i = 0; i < AnalogRandom::kBlockReads; ++i) {
+      raw |= static_cast<uint32_t>(analogRead(A0) & 1) << i;
+    }
+    uint32_t pool = 0;
+    uint8_t count = 0;
+    AnalogRandom::extract(raw, AnalogRandom::kBlockReads, depth, &pool, &count);
+    bits += count;
+  }
+  return bits / (num_blocks * double(AnalogRandom::kBlockReads));
+}
+
+void testYield(uint32_t ones_per_1024) {
+  useBiasedSource(ones_per_1024);
+  const double von_neumann = bitsPerRead(0, 10000);
+  const double peres = bitsPerRead(AnalogRandom::kExtractDepth, 10000);
+  printf("Bias %4u/1024: bits per reading: Von Neumann %.3f, Peres %.3f; "
+         "bits/s: analogRead %.0f -> %.0f, free-running %.0f\n",
+         ones_per_1024, von_neumann, peres,
+         von_neumann * 1e6 / kAnalogReadMicros,
+         peres * 1e6 / kAnalogReadMicros, peres * 1e6 / kFreeRunningMicros);
+  EXPECT_TRUE(peres > 2 * von_neumann);
+
+  // And randomBit gets the same yield.
+  AnalogRandom rng;
+  const uint32_t reads_before = arduino_host::analogReadCount();
+  for (int i = 0; i < 10000; ++i) {
+    rng.random32();
+  }
+  const double bits_per_read =
+      320000.0 / (arduino_host::analogReadCount() - reads_before);
+  EXPECT_TRUE(bits_per_read > peres * 0.95 && bits_per_read < peres * 1.05);
+  arduino_host::resetAnalogReadSource();
+}
+
+void testNoRandomness() {
+  static const int kConstant[] = {512};
+  arduino_host::setAnalogReadScript(kConstant, 1);
+  AnalogRandom rng;
+  uint32_t reads_before = arduino_host::analogReadCount();
+  EXPECT_EQ(rng.randomBit(), -1);
+  // 100 rounded up to whole blocks.
+  EXPECT_EQ(arduino_host::analogReadCount() - reads_before, 128);
+  EXPECT_EQ(rng.randomByte(), -1);
+  EXPECT_EQ(rng.random32(), 0);
+  EXPECT_FALSE(rng.seedArduinoRNG());
+  // Free-running mode is only for AVR boards.
+  EXPECT_FALSE(rng.startFreeRunning());
+  arduino_host::resetAnalogReadSource();
+}
+
+void testDefaultNoise() {
+  AnalogRandom rng;
+  EXPECT_TRUE(rng.seedArduinoRNG());
+  const uint32_t a = rng.random32();
+  const uint32_t b = rng.random32();
+  EXPECT_TRUE(a != 0);
+  EXPECT_TRUE(a != b);
+}
+
+void setup() {
+  Serial.begin(9600);
+  testExtract();
+  testChiSquared(512);
+  testChiSquared(820);
+  testChiSquared(200);
+  testYield(512);
+  testYield(666);
+  testYield(820);
+  testNoRandomness();
+  testDefaultNoise();
+  Serial.println("Done");
+}
+
+void loop() {}
@@ -0,0 +1,115 @@
+#ifndef _ARDUINO_HOST_ARDUINO_H_
+#define _ARDUINO_HOST_ARDUINO_H_
+
+// Host (Linux) stand-in for the Arduino core, providing just enough of the
+// API for the code in utilities/ and the tester sketches to be compiled and
+// run as ordinary programs; see CMakeLists.txt. The pin layout is that
+// of an Uno. The simulated hardware is controlled with the functions in
+// arduino_host.h.
+
+#include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include "Print.h"
+#include "Printable.h"
+#include "Stream.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define LED_BUILTIN 13
+
+#define NUM_DIGITAL_PINS 20
+#define NUM_ANALOG_INPUTS 6
+constexpr uint8_t A0 = 14;
+constexpr uint8_t A1 = 15;
+constexpr uint8_t A2 = 16;
+constexpr uint8_t A3 = 17;
+constexpr uint8_t A4 = 18;
+constexpr uint8_t A5 = 19;
+
+template <class T, class U>
+auto min(const T& a, const U& b) -> decltype(a < b ? a : b) {
+  return b < a ? b : a;
+}
+template <class T, class U>
+auto max(const T& a, const U& b) -> decltype(a < b ? a : b) {
+  return a < b ? b : a;
+}
+template <class T, class L, class H>
+T constrain(T x, L low, H high) {
+  return x < low ? low : (x > high ? high : x);
+}
+
+// Time, from the virtual clock (see arduino_host.h).
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+inline void yield() {}
+
+// Nothing runs concurrently with the sketch on the host: an interrupt handler
+// is called only from within a call to the core (e.g. sleep_cpu, or
+// arduino_host::setPinInput), so there is nothing for these to do.
+inline void interrupts() {}
+inline void noInterrupts() {}
+
+// External interrupts, on pins 2 and 3 as on an Uno. The handler is called
+// when the pin's level is changed (see arduino_host::setPinInput) as mode
+// requires.
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) \
+  ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+void attachInterrupt(uint8_t interrupt_num, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interrupt_num);
+
+// Digital pins just remember the last value written.
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+int analogRead(uint8_t pin);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Writes to stdout; there is no input.
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) {}
+  void begin(unsigned long baud, uint8_t config) {}
+  void end() {}
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  void flush() override;
+  explicit operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// Provided by the sketch.
+void setup();
+void loop();
+
+#endif  // _ARDUINO_HOST_ARDUINO_H_
@@ -0,0 +1,75 @@
+#include "EEPROM.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arduino_host.h"
+
+EEPROMClass EEPROM;
+
+EERef::operator uint8_t() const { return eeprom_->read(index_); }
+
+EERef& EERef::operator=(uint8_t value) {
+  eeprom_->write(index_, value);
+  return *this;
+}
+
+EERef& EERef::update(uint8_t value) {
+  eeprom_->update(index_, value);
+  return *this;
+}
+
+EEPROMClass::EEPROMClass() { erase(); }
+
+namespace {
+void checkIndex(int index, size_t length) {
+  if (index < 0 || static_cast<size_t>(index) >= length) {
+    // On a board this would silently wrap around (or worse); on the host we
+    // want to know about it.
+    fprintf(stderr, "EEPROM index %d out of range [0, %zu)\n", index, length);
+    abort();
+  }
+}
+}  // namespace
+
+uint8_t EEPROMClass::read(int index) {
+  checkIndex(index, length_);
+  ++read_count_;
+  return bytes_[index];
+}
+
+void EEPROMClass::write(int index, uint8_t value) {
+  checkIndex(index, length_);
+  ++write_call_count_;
+  ++bytes_written_;
+  bytes_[index] = value;
+  arduino_host::advanceMicros(kMicrosPerWrite);
+}
+
+void EEPROMClass::update(int index, uint8_t value) {
+  checkIndex(index, length_);
+  ++write_call_count_;
+  // The AVR library reads the byte first, but we don't count that as a read
+  // by the caller.
+  if (bytes_[index] != value) {
+    ++bytes_written_;
+    bytes_[index] = value;
+    arduino_host::advanceMicros(kMicrosPerWrite);
+  }
+}
+
+void EEPROMClass::resetCounts() {
+  read_count_ = 0;
+  write_call_count_ = 0;
+  bytes_written_ = 0;
+}
+
+void EEPROMClass::erase(size_t length) {
+  if (length > kDefaultLength) {
+    length = kDefaultLength;
+  }
+  length_ = length;
+  memset(bytes_, 0xff, sizeof bytes_);
+  resetCounts();
+}
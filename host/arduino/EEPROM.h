@@ -0,0 +1,91 @@
+#ifndef _ARDUINO_HOST_EEPROM_H_
+#define _ARDUINO_HOST_EEPROM_H_
+
+// Host (Linux) stand-in for the AVR EEPROM library, backed by a byte array.
+// Like a real EEPROM it starts out erased (all 0xFF). It also counts the
+// reads and writes, and each write that changes a byte advances the virtual
+// clock (see arduino_host.h) by the time a write takes on an ATmega, so that
+// benchmarks can report what a change costs on a board.
+
+#include <inttypes.h>
+#include <stddef.h>
+
+class EEPROMClass;
+
+// What EEPROM[index] returns; reads and writes a single byte.
+class EERef {
+public:
+  EERef(EEPROMClass* eeprom, int index) : eeprom_(eeprom), index_(index) {}
+  operator uint8_t() const;
+  EERef& operator=(uint8_t value);
+  EERef& update(uint8_t value);
+
+private:
+  EEPROMClass* const eeprom_;
+  const int index_;
+};
+
+class EEPROMClass {
+public:
+  // The size of the EEPROM of an ATmega2560 (Mega).
+  static constexpr size_t kDefaultLength = 4096;
+
+  // Time to write one byte, from the ATmega328P datasheet.
+  static constexpr uint32_t kMicrosPerWrite = 3300;
+
+  EEPROMClass();
+
+  uint8_t read(int index);
+  void write(int index, uint8_t value);
+  // Writes the value only if it differs from the current value.
+  void update(int index, uint8_t value);
+  uint16_t length() const { return static_cast<uint16_t>(length_); }
+
+  EERef operator[](int index) { return EERef(this, index); }
+
+  template <typename T>
+  T& get(int index, T& t) {
+    uint8_t* ptr = reinterpret_cast<uint8_t*>(&t);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      *ptr++ = read(index++);
+    }
+    return t;
+  }
+
+  // Like the AVR library, put only writes the bytes that have changed.
+  template <typename T>
+  const T& put(int index, const T& t) {
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&t);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      update(index++, *ptr++);
+    }
+    return t;
+  }
+
+  // Host only: statistics, and control of the simulation.
+
+  // Number of bytes read, number of write or update calls, and number of
+  // bytes actually written (i.e. writes plus updates that changed a byte).
+  uint32_t readCount() const { return read_count_; }
+  uint32_t writeCallCount() const { return write_call_count_; }
+  uint32_t bytesWritten() const { return bytes_written_; }
+  void resetCounts();
+
+  // Sets every byte to 0xFF (and resets the counts). length must be at most
+  // kDefaultLength.
+  void erase(size_t length = kDefaultLength);
+
+  // Direct access to the contents, without counting.
+  uint8_t* data() { return bytes_; }
+
+private:
+  uint8_t bytes_[kDefaultLength];
+  size_t length_;
+  uint32_t read_count_;
+  uint32_t write_call_count_;
+  uint32_t bytes_written_;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif  // _ARDUINO_HOST_EEPROM_H_
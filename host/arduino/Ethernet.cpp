@@ -0,0 +1,917 @@
+#include "Ethernet.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+#include "Arduino.h"
+#include "arduino_host.h"
+#include "avr/sleep.h"
+#include "utility/w5100.h"
+
+EthernetClass Ethernet;
+W5100Class W5100;
+SPIClass SPI;
+
+namespace {
+
+// The simulated sockets of the Ethernet chip.
+struct Socket {
+  int fd = -1;
+  // The (Arduino) port of the server that accepted the connection, or 0 for
+  // an outgoing connection.
+  uint16_t server_port = 0;
+  // True until returned by EthernetServer::accept (or available).
+  bool is_new = false;
+  // The simulated interrupt registers, Sn_IR and Sn_IMR.
+  uint8_t ir = 0;
+  uint8_t imr = 0xFF;
+  // The bytes available to read when last checked for RECV.
+  int last_available = 0;
+  bool discon_reported = false;
+};
+Socket sockets[MAX_SOCK_NUM];
+
+struct Listener {
+  int fd = -1;
+  uint16_t arduino_port = 0;
+  uint16_t host_port = 0;
+};
+Listener listeners[MAX_SOCK_NUM];
+
+bool use_ephemeral_ports = false;
+bool dhcp_available = false;
+uint32_t send_count = 0;
+uint32_t dhcp_address = 0;
+
+// The simulated SIMR register, and the pin connected to INTn.
+uint8_t simr = 0;
+uint8_t interrupt_pin = NUM_DIGITAL_PINS;
+
+uint32_t sleep_count = 0;
+uint64_t slept_micros = 0;
+
+// Socket 0 in MACRAW mode. The pointers are free running, as on the chip,
+// and wrap around within the buffers.
+struct MacRawSocket {
+  bool open = false;
+  uint8_t mr = 0;
+  uint8_t ir = 0;
+  uint16_t tx_rd = 0;
+  uint16_t tx_wr = 0;
+  uint16_t rx_rd = 0;
+  uint16_t rx_wr = 0;
+  uint8_t tx[W5100Class::SSIZE];
+  uint8_t rx[W5100Class::SSIZE];
+};
+MacRawSocket macraw;
+arduino_host::RawFrameFn raw_frame_handler;
+
+struct Datagram {
+  IPAddress remote_ip;
+  uint16_t remote_port;
+  std::vector<uint8_t> data;
+};
+
+// A socket in UDP mode. The datagram being read is at the front of rx.
+struct UdpSocket {
+  bool open = false;
+  uint16_t port = 0;
+  std::deque<Datagram> rx;
+  size_t rx_bytes = 0;
+  // The read position in rx.front(), or -1 if parsePacket hasn't been
+  // called for it.
+  int read_pos = -1;
+  // The datagram being built, after beginPacket.
+  bool building = false;
+  Datagram tx;
+};
+UdpSocket udp_sockets[MAX_SOCK_NUM];
+arduino_host::UdpFn udp_handler;
+
+bool socketInUse(int i) {
+  return sockets[i].fd >= 0 || udp_sockets[i].open || (i == 0 && macraw.open);
+}
+
+int freeSocketIndex() {
+  for (int i = 0; i < MAX_SOCK_NUM; ++i) {
+    if (!socketInUse(i)) {
+      return i;
+    }
+  }
+  return MAX_SOCK_NUM;
+}
+
+Listener* findListener(uint16_t arduino_port) {
+  for (Listener& l : listeners) {
+    if (l.fd >= 0 && l.arduino_port == arduino_port) {
+      return &l;
+    }
+  }
+  return nullptr;
+}
+
+// Also disables Nagle's algorithm, so that (as with the chip) each write is
+// sent immediately, rather than being held back to be combined with later
+// writes.
+bool setNonBlocking(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Returns -1 if the listening socket couldn't be created.
+int listenOn(uint16_t port, uint16_t* bound_port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  socklen_t len = sizeof addr;
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+      listen(fd, MAX_SOCK_NUM) != 0 || !setNonBlocking(fd) ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    close(fd);
+    return -1;
+  }
+  *bound_port = ntohs(addr.sin_port);
+  return fd;
+}
+
+// Accepts pending connections on the listener into free sockets.
+void acceptPending(const Listener& listener) {
+  while (true) {
+    const int ndx = freeSocketIndex();
+    if (ndx >= MAX_SOCK_NUM) {
+      // All sockets in use; the connection waits in the backlog, much as it
+      // would in the chip.
+      return;
+    }
+    int fd = accept(listener.fd, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+    if (!setNonBlocking(fd)) {
+      close(fd);
+      continue;
+    }
+    sockets[ndx] = Socket();
+    sockets[ndx].fd = fd;
+    sockets[ndx].server_port = listener.arduino_port;
+    sockets[ndx].is_new = true;
+    sockets[ndx].ir = SnIR::CON;
+  }
+}
+
+// Returns true if the peer has closed the connection, and all of the data
+// has been read.
+bool isClosedByPeer(int fd) {
+  uint8_t b;
+  ssize_t n = recv(fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n > 0) {
+    return false;
+  }
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return false;
+  }
+  return true;
+}
+
+int bytesAvailable(int fd) {
+  int n = 0;
+  if (ioctl(fd, FIONREAD, &n) != 0) {
+    return 0;
+  }
+  return n;
+}
+
+// Sends all of the bytes, waiting if the host's socket buffer is full.
+size_t sendAll(int fd, const uint8_t* buf, size_t size) {
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = send(fd, buf + sent, size - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      pollfd pfd = {fd, POLLOUT, 0};
+      if (poll(&pfd, 1, 1000) <= 0) {
+        break;
+      }
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      break;
+    }
+  }
+  return sent;
+}
+
+// The simulated SIR register.
+uint8_t socketInterrupts() {
+  uint8_t sir = 0;
+  for (int i = 0; i < MAX_SOCK_NUM; ++i) {
+    if (sockets[i].fd >= 0 && (sockets[i].ir & sockets[i].imr) != 0) {
+      sir |= 1 << i;
+    }
+  }
+  return sir & simr;
+}
+
+void driveInterruptPin() {
+  if (interrupt_pin < NUM_DIGITAL_PINS) {
+    arduino_host::setPinInput(interrupt_pin, socketInterrupts() ? LOW : HIGH);
+  }
+}
+
+// Does what the chip does by itself: accepts connections, and sets the
+// socket interrupt bits for new connections, data and disconnections; then
+// updates INTn.
+void updateChip() {
+  for (const Listener& l : listeners) {
+    if (l.fd >= 0) {
+      acceptPending(l);
+    }
+  }
+  for (Socket& s : sockets) {
+    if (s.fd < 0) {
+      continue;
+    }
+    const int available = bytesAvailable(s.fd);
+    if (available > s.last_available) {
+      s.ir |= SnIR::RECV;
+    }
+    s.last_available = available;
+    if (available == 0 && !s.discon_reported && isClosedByPeer(s.fd)) {
+      s.ir |= SnIR::DISCON;
+      s.discon_reported = true;
+    }
+  }
+  driveInterruptPin();
+}
+
+}  // namespace
+
+namespace arduino_host {
+
+void setEthernetInterruptPin(uint8_t pin) {
+  interrupt_pin = pin;
+  setPinInput(pin, HIGH);
+  driveInterruptPin();
+}
+
+uint32_t sleepCount() { return sleep_count; }
+
+uint64_t sleptMicros() { return slept_micros; }
+
+void setDhcpLease(bool available, uint32_t address_in_network_order) {
+  dhcp_available = available;
+  dhcp_address = address_in_network_order;
+}
+
+uint16_t listeningPort(uint16_t arduino_port) {
+  const Listener* l = findListener(arduino_port);
+  return l ? l->host_port : 0;
+}
+
+void setUseEphemeralPorts(bool use_ephemeral) {
+  use_ephemeral_ports = use_ephemeral;
+}
+
+uint32_t ethernetSendCount() { return send_count; }
+
+void setRawFrameHandler(RawFrameFn fn) { raw_frame_handler = fn; }
+
+void setUdpHandler(UdpFn fn) { udp_handler = fn; }
+
+bool injectUdpPacket(const IPAddress& src_ip, uint16_t src_port,
+                     uint16_t dest_port, const uint8_t* data, size_t size) {
+  for (UdpSocket& u : udp_sockets) {
+    if (u.open && u.port == dest_port) {
+      // The chip also stores an 8 byte header with each datagram.
+      if (u.rx_bytes + size + 8 > W5100Class::SSIZE) {
+        return false;
+      }
+      u.rx.push_back(
+          {src_ip, src_port, std::vector<uint8_t>(data, data + size)});
+      u.rx_bytes += size + 8;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool injectRawFrame(const uint8_t* frame, size_t size) {
+  const size_t used = static_cast<uint16_t>(macraw.rx_wr - macraw.rx_rd);
+  if (!macraw.open || size + 2 > W5100Class::SSIZE - used) {
+    return false;
+  }
+  const uint16_t total = size + 2;
+  macraw.rx[macraw.rx_wr++ & W5100Class::SMASK] = total >> 8;
+  macraw.rx[macraw.rx_wr++ & W5100Class::SMASK] = total & 0xFF;
+  for (size_t i = 0; i < size; ++i) {
+    macraw.rx[macraw.rx_wr++ & W5100Class::SMASK] = frame[i];
+  }
+  return true;
+}
+
+}  // namespace arduino_host
+
+////////////////////////////////////////////////////////////////////////////////
+
+int EthernetClass::begin(uint8_t* mac, unsigned long timeout,
+                         unsigned long responseTimeout) {
+  setMACAddress(mac);
+  local_ip_ = IPAddress();
+  if (!dhcp_available) {
+    // As with the real library, which waits that long for an offer.
+    arduino_host::advanceMillis(timeout);
+    return 0;
+  }
+  local_ip_ = dhcp_address;
+  subnet_mask_ = IPAddress(255, 255, 255, 0);
+  gateway_ip_ = local_ip_;
+  gateway_ip_[3] = 1;
+  dns_server_ip_ = gateway_ip_;
+  return 1;
+}
+
+void EthernetClass::begin(uint8_t* mac, IPAddress ip) {
+  IPAddress dns = ip;
+  dns[3] = 1;
+  begin(mac, ip, dns);
+}
+
+void EthernetClass::begin(uint8_t* mac, IPAddress ip, IPAddress dns) {
+  IPAddress gateway = ip;
+  gateway[3] = 1;
+  begin(mac, ip, dns, gateway);
+}
+
+void EthernetClass::begin(uint8_t* mac, IPAddress ip, IPAddress dns,
+                          IPAddress gateway) {
+  begin(mac, ip, dns, gateway, IPAddress(255, 255, 255, 0));
+}
+
+void EthernetClass::begin(uint8_t* mac, IPAddress ip, IPAddress dns,
+                          IPAddress gateway, IPAddress subnet) {
+  setMACAddress(mac);
+  local_ip_ = ip;
+  dns_server_ip_ = dns;
+  gateway_ip_ = gateway;
+  subnet_mask_ = subnet;
+}
+
+void EthernetClass::MACAddress(uint8_t* mac_address) {
+  memcpy(mac_address, mac_, sizeof mac_);
+}
+
+void EthernetClass::setMACAddress(const uint8_t* mac_address) {
+  memcpy(mac_, mac_address, sizeof mac_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int EthernetClient::connect(IPAddress ip, uint16_t port) {
+  char host[16];
+  snprintf(host, sizeof host, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return connect(host, port);
+}
+
+int EthernetClient::connect(const char* host, uint16_t port) {
+  stop();
+  const int ndx = freeSocketIndex();
+  if (ndx >= MAX_SOCK_NUM) {
+    return 0;
+  }
+  addrinfo hints;
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char service[8];
+  snprintf(service, sizeof service, "%u", port);
+  addrinfo* result = nullptr;
+  if (getaddrinfo(host, service, &hints, &result) != 0) {
+    return 0;
+  }
+  int fd = -1;
+  for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+        setNonBlocking(fd)) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  if (fd < 0) {
+    return 0;
+  }
+  sockets[ndx].fd = fd;
+  sockets[ndx].server_port = 0;
+  sockets[ndx].is_new = false;
+  sockindex_ = ndx;
+  return 1;
+}
+
+uint8_t EthernetClient::connected() {
+  if (sockindex_ >= MAX_SOCK_NUM || sockets[sockindex_].fd < 0) {
+    return 0;
+  }
+  return isClosedByPeer(sockets[sockindex_].fd) ? 0 : 1;
+}
+
+int EthernetClient::available() {
+  if (sockindex_ >= MAX_SOCK_NUM || sockets[sockindex_].fd < 0) {
+    return 0;
+  }
+  return bytesAvailable(sockets[sockindex_].fd);
+}
+
+int EthernetClient::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int EthernetClient::read(uint8_t* buf, size_t size) {
+  if (sockindex_ >= MAX_SOCK_NUM || sockets[sockindex_].fd < 0) {
+    return -1;
+  }
+  Socket& s = sockets[sockindex_];
+  ssize_t n = recv(s.fd, buf, size, MSG_DONTWAIT);
+  if (n <= 0) {
+    return -1;
+  }
+  s.last_available = n < s.last_available ? s.last_available - n : 0;
+  return static_cast<int>(n);
+}
+
+int EthernetClient::peek() {
+  if (sockindex_ >= MAX_SOCK_NUM || sockets[sockindex_].fd < 0) {
+    return -1;
+  }
+  uint8_t b;
+  ssize_t n = recv(sockets[sockindex_].fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n == 1 ? b : -1;
+}
+
+size_t EthernetClient::write(uint8_t b) { return write(&b, 1); }
+
+size_t EthernetClient::write(const uint8_t* buf, size_t size) {
+  if (sockindex_ >= MAX_SOCK_NUM || sockets[sockindex_].fd < 0) {
+    return 0;
+  }
+  if (size > 0) {
+    ++send_count;
+  }
+  return sendAll(sockets[sockindex_].fd, buf, size);
+}
+
+void EthernetClient::stop() {
+  if (sockindex_ >= MAX_SOCK_NUM) {
+    return;
+  }
+  Socket& s = sockets[sockindex_];
+  if (s.fd >= 0) {
+    close(s.fd);
+  }
+  s = Socket();
+  sockindex_ = MAX_SOCK_NUM;
+}
+
+IPAddress EthernetClient::remoteIP() {
+  sockaddr_in addr;
+  socklen_t len = sizeof addr;
+  if (sockindex_ >= MAX_SOCK_NUM || sockets[sockindex_].fd < 0 ||
+      getpeername(sockets[sockindex_].fd, reinterpret_cast<sockaddr*>(&addr),
+                  &len) != 0) {
+    return IPAddress();
+  }
+  return IPAddress(static_cast<uint32_t>(addr.sin_addr.s_addr));
+}
+
+uint16_t EthernetClient::remotePort() {
+  sockaddr_in addr;
+  socklen_t len = sizeof addr;
+  if (sockindex_ >= MAX_SOCK_NUM || sockets[sockindex_].fd < 0 ||
+      getpeername(sockets[sockindex_].fd, reinterpret_cast<sockaddr*>(&addr),
+                  &len) != 0) {
+    return 0;
+  }
+  return ntohs(addr.sin_port);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void EthernetServer::begin() {
+  if (findListener(port_)) {
+    return;
+  }
+  for (Listener& l : listeners) {
+    if (l.fd >= 0) {
+      continue;
+    }
+    uint16_t bound_port = 0;
+    int fd = use_ephemeral_ports ? -1 : listenOn(port_, &bound_port);
+    if (fd < 0) {
+      fd = listenOn(0, &bound_port);
+    }
+    if (fd < 0) {
+      perror("EthernetServer::begin");
+      return;
+    }
+    l.fd = fd;
+    l.arduino_port = port_;
+    l.host_port = bound_port;
+    if (bound_port != port_) {
+      fprintf(stderr, "EthernetServer: port %u is on 127.0.0.1:%u\n", port_,
+              bound_port);
+    }
+    return;
+  }
+}
+
+EthernetClient EthernetServer::available() {
+  const Listener* l = findListener(port_);
+  if (l == nullptr) {
+    return EthernetClient();
+  }
+  acceptPending(*l);
+  for (uint8_t i = 0; i < MAX_SOCK_NUM; ++i) {
+    Socket& s = sockets[i];
+    if (s.fd < 0 || s.server_port != port_) {
+      continue;
+    }
+    if (bytesAvailable(s.fd) > 0 || isClosedByPeer(s.fd)) {
+      s.is_new = false;
+      return EthernetClient(i);
+    }
+  }
+  return EthernetClient();
+}
+
+EthernetClient EthernetServer::accept() {
+  const Listener* l = findListener(port_);
+  if (l == nullptr) {
+    return EthernetClient();
+  }
+  acceptPending(*l);
+  for (uint8_t i = 0; i < MAX_SOCK_NUM; ++i) {
+    Socket& s = sockets[i];
+    if (s.fd >= 0 && s.server_port == port_ && s.is_new) {
+      s.is_new = false;
+      return EthernetClient(i);
+    }
+  }
+  return EthernetClient();
+}
+
+size_t EthernetServer::write(uint8_t b) { return write(&b, 1); }
+
+size_t EthernetServer::write(const uint8_t* buf, size_t size) {
+  size_t n = 0;
+  for (Socket& s : sockets) {
+    if (s.fd >= 0 && s.server_port == port_) {
+      n += sendAll(s.fd, buf, size);
+    }
+  }
+  return n;
+}
+
+EthernetServer::operator bool() { return findListener(port_) != nullptr; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint8_t EthernetUDP::begin(uint16_t port) {
+  stop();
+  const int ndx = freeSocketIndex();
+  if (ndx >= MAX_SOCK_NUM) {
+    return 0;
+  }
+  udp_sockets[ndx] = UdpSocket();
+  udp_sockets[ndx].open = true;
+  udp_sockets[ndx].port = port;
+  sockindex_ = ndx;
+  return 1;
+}
+
+void EthernetUDP::stop() {
+  if (sockindex_ < MAX_SOCK_NUM) {
+    udp_sockets[sockindex_] = UdpSocket();
+    sockindex_ = MAX_SOCK_NUM;
+  }
+}
+
+int EthernetUDP::beginPacket(IPAddress ip, uint16_t port) {
+  if (sockindex_ >= MAX_SOCK_NUM) {
+    return 0;
+  }
+  UdpSocket& u = udp_sockets[sockindex_];
+  u.building = true;
+  u.tx = {ip, port, {}};
+  return 1;
+}
+
+int EthernetUDP::endPacket() {
+  if (sockindex_ >= MAX_SOCK_NUM || !udp_sockets[sockindex_].building) {
+    return 0;
+  }
+  UdpSocket& u = udp_sockets[sockindex_];
+  u.building = false;
+  const Datagram d = u.tx;
+  const uint16_t port = u.port;
+  // The handler may inject replies.
+  if (udp_handler) {
+    udp_handler(d.remote_ip, d.remote_port, port, d.data.data(),
+                d.data.size());
+  }
+  return 1;
+}
+
+size_t EthernetUDP::write(uint8_t b) { return write(&b, 1); }
+
+size_t EthernetUDP::write(const uint8_t* buf, size_t size) {
+  if (sockindex_ >= MAX_SOCK_NUM || !udp_sockets[sockindex_].building) {
+    return 0;
+  }
+  std::vector<uint8_t>& data = udp_sockets[sockindex_].tx.data;
+  // The whole datagram must fit in the socket's transmit buffer.
+  if (data.size() + size > W5100Class::SSIZE) {
+    size = W5100Class::SSIZE - data.size();
+  }
+  data.insert(data.end(), buf, buf + size);
+  return size;
+}
+
+int EthernetUDP::parsePacket() {
+  if (sockindex_ >= MAX_SOCK_NUM) {
+    return 0;
+  }
+  UdpSocket& u = udp_sockets[sockindex_];
+  if (u.read_pos >= 0) {
+    u.rx_bytes -= u.rx.front().data.size() + 8;
+    u.rx.pop_front();
+    u.read_pos = -1;
+  }
+  if (u.rx.empty()) {
+    return 0;
+  }
+  u.read_pos = 0;
+  remote_ip_ = u.rx.front().remote_ip;
+  remote_port_ = u.rx.front().remote_port;
+  return u.rx.front().data.size();
+}
+
+int EthernetUDP::available() {
+  if (sockindex_ >= MAX_SOCK_NUM || udp_sockets[sockindex_].read_pos < 0) {
+    return 0;
+  }
+  const UdpSocket& u = udp_sockets[sockindex_];
+  return u.rx.front().data.size() - u.read_pos;
+}
+
+int EthernetUDP::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int EthernetUDP::read(uint8_t* buf, size_t size) {
+  const int n = available();
+  if (n <= 0) {
+    return -1;
+  }
+  if (size > static_cast<size_t>(n)) {
+    size = n;
+  }
+  UdpSocket& u = udp_sockets[sockindex_];
+  memcpy(buf, u.rx.front().data.data() + u.read_pos, size);
+  u.read_pos += size;
+  return size;
+}
+
+int EthernetUDP::peek() {
+  if (available() <= 0) {
+    return -1;
+  }
+  const UdpSocket& u = udp_sockets[sockindex_];
+  return u.rx.front().data[u.read_pos];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint8_t W5100Class::read(uint16_t addr) {
+  switch (addr) {
+    case 0x0017:
+      updateChip();
+      return socketInterrupts();
+    case 0x0018:
+      return simr;
+  }
+  return 0;
+}
+
+uint8_t W5100Class::write(uint16_t addr, uint8_t data) {
+  if (addr == 0x0018) {
+    simr = data;
+    driveInterruptPin();
+  }
+  return 1;
+}
+
+uint16_t W5100Class::read(uint16_t addr, uint8_t* buf, uint16_t len) {
+  // Only socket 0's buffers are simulated.
+  if (addr >= RBASE(0) && addr < RBASE(0) + SSIZE) {
+    for (uint16_t i = 0; i < len; ++i) {
+      buf[i] = macraw.rx[(addr - RBASE(0) + i) & SMASK];
+    }
+  } else {
+    memset(buf, 0, len);
+  }
+  return len;
+}
+
+uint16_t W5100Class::write(uint16_t addr, const uint8_t* buf, uint16_t len) {
+  if (addr >= SBASE(0) && addr < SBASE(0) + SSIZE) {
+    for (uint16_t i = 0; i < len; ++i) {
+      macraw.tx[(addr - SBASE(0) + i) & SMASK] = buf[i];
+    }
+  }
+  return len;
+}
+
+void W5100Class::execCmdSn(SOCKET s, SockCMD cmd) {
+  if (s != 0) {
+    return;
+  }
+  switch (cmd) {
+    case Sock_OPEN:
+      if (macraw.mr == SnMR::MACRAW && !socketInUse(0)) {
+        macraw.open = true;
+        macraw.ir = 0;
+        macraw.tx_rd = macraw.tx_wr = 0;
+        macraw.rx_rd = macraw.rx_wr = 0;
+      }
+      break;
+    case Sock_CLOSE:
+      macraw.open = false;
+      break;
+    case Sock_SEND:
+      if (macraw.open) {
+        uint8_t frame[SSIZE];
+        uint16_t size = 0;
+        while (macraw.tx_rd != macraw.tx_wr) {
+          frame[size++] = macraw.tx[macraw.tx_rd++ & SMASK];
+        }
+        macraw.ir |= SnIR::SEND_OK;
+        // The handler may inject replies.
+        if (raw_frame_handler) {
+          raw_frame_handler(frame, size);
+        }
+      }
+      break;
+    case Sock_RECV:
+      break;
+  }
+}
+
+uint8_t W5100Class::readSn(SOCKET s, uint16_t addr) {
+  if (s >= MAX_SOCK_NUM) {
+    return 0;
+  }
+  if (s == 0 && addr < 0x002C && (macraw.open || addr == 0x0000)) {
+    const uint16_t tx_free = SSIZE - (macraw.tx_wr - macraw.tx_rd);
+    const uint16_t rx_size = macraw.rx_wr - macraw.rx_rd;
+    switch (addr) {
+      case 0x0000:
+        return macraw.mr;
+      case 0x0002:
+        return macraw.ir;
+      case 0x0003:
+        return SnSR::MACRAW;
+      case 0x0020:
+        return tx_free >> 8;
+      case 0x0021:
+        return tx_free & 0xFF;
+      case 0x0024:
+        return macraw.tx_wr >> 8;
+      case 0x0025:
+        return macraw.tx_wr & 0xFF;
+      case 0x0026:
+        return rx_size >> 8;
+      case 0x0027:
+        return rx_size & 0xFF;
+      case 0x0028:
+        return macraw.rx_rd >> 8;
+      case 0x0029:
+        return macraw.rx_rd & 0xFF;
+    }
+    return 0;
+  }
+  switch (addr) {
+    case 0x0002:
+      updateChip();
+      return sockets[s].ir;
+    case 0x0003:
+      if (udp_sockets[s].open) {
+        return SnSR::UDP;
+      }
+      return sockets[s].fd >= 0 ? SnSR::ESTABLISHED : SnSR::CLOSED;
+    case 0x002C:
+      return sockets[s].imr;
+  }
+  return 0;
+}
+
+uint8_t W5100Class::writeSn(SOCKET s, uint16_t addr, uint8_t data) {
+  if (s >= MAX_SOCK_NUM) {
+    return 0;
+  }
+  if (s == 0 && addr < 0x002C && (macraw.open || addr == 0x0000)) {
+    switch (addr) {
+      case 0x0000:
+        macraw.mr = data;
+        break;
+      case 0x0002:
+        macraw.ir &= ~data;
+        break;
+      case 0x0024:
+        macraw.tx_wr = (data << 8) | (macraw.tx_wr & 0xFF);
+        break;
+      case 0x0025:
+        macraw.tx_wr = (macraw.tx_wr & 0xFF00) | data;
+        break;
+      case 0x0028:
+        macraw.rx_rd = (data << 8) | (macraw.rx_rd & 0xFF);
+        break;
+      case 0x0029:
+        macraw.rx_rd = (macraw.rx_rd & 0xFF00) | data;
+        break;
+    }
+    return 1;
+  }
+  switch (addr) {
+    case 0x0002:
+      sockets[s].ir &= ~data;
+      break;
+    case 0x002C:
+      sockets[s].imr = data;
+      break;
+  }
+  driveInterruptPin();
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Here rather than in arduino_host.cpp, as (apart from the timer) the
+// Ethernet chip is the only source of interrupts to wake the CPU.
+void sleep_cpu() {
+  // Wait for a new connection, data or disconnection; a socket that still
+  // has data to be read can't raise RECV until more arrives, which isn't
+  // worth polling for, so that is picked up at the next timer tick.
+  pollfd fds[2 * MAX_SOCK_NUM];
+  nfds_t nfds = 0;
+  if (freeSocketIndex() < MAX_SOCK_NUM) {
+    for (const Listener& l : listeners) {
+      if (l.fd >= 0) {
+        fds[nfds++] = {l.fd, POLLIN, 0};
+      }
+    }
+  }
+  for (const Socket& s : sockets) {
+    if (s.fd >= 0 && s.last_available == 0 && !s.discon_reported) {
+      fds[nfds++] = {s.fd, POLLIN, 0};
+    }
+  }
+  // Timer 0 overflows every 1024us.
+  const timespec timeout = {0, 1024 * 1000};
+  const uint64_t start = arduino_host::hostMicros();
+  ppoll(fds, nfds, &timeout, nullptr);
+  const uint64_t slept = arduino_host::hostMicros() - start;
+  ++sleep_count;
+  slept_micros += slept;
+  arduino_host::advanceMicros(slept);
+  updateChip();
+}
@@ -0,0 +1,179 @@
+#ifndef _ARDUINO_HOST_ETHERNET_H_
+#define _ARDUINO_HOST_ETHERNET_H_
+
+// Host (Linux) stand-in for the Arduino Ethernet library (v2). Each of the
+// chip's TCP sockets is simulated with a TCP socket on the host: an
+// EthernetServer listens on 127.0.0.1 (see arduino_host::listeningPort), and
+// EthernetClient::connect makes an ordinary outgoing connection. All socket
+// operations are non-blocking except for writes.
+//
+// The UDP sockets (EthernetUDP) don't reach the host's network; instead the
+// datagrams sent are passed to a handler, which plays the part of the other
+// devices on the LAN (e.g. a DHCP server); see arduino_host::setUdpHandler.
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "IPAddress.h"
+#include "Stream.h"
+
+// Number of sockets supported by the W5500.
+#define MAX_SOCK_NUM 8
+
+enum EthernetLinkStatus { Unknown, LinkON, LinkOFF };
+
+enum EthernetHardwareStatus {
+  EthernetNoHardware,
+  EthernetW5100,
+  EthernetW5200,
+  EthernetW5500
+};
+
+class EthernetClass {
+public:
+  void init(uint8_t sspin = 10) {}
+
+  // Returns 1 if a (simulated) DHCP lease was obtained, else 0; see
+  // arduino_host::setDhcpLease.
+  int begin(uint8_t* mac, unsigned long timeout = 60000,
+            unsigned long responseTimeout = 4000);
+  void begin(uint8_t* mac, IPAddress ip);
+  void begin(uint8_t* mac, IPAddress ip, IPAddress dns);
+  void begin(uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway);
+  void begin(uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway,
+             IPAddress subnet);
+
+  // Returns 0 (nothing happened); a lease never expires on the host.
+  int maintain() { return 0; }
+
+  EthernetLinkStatus linkStatus() { return LinkON; }
+  EthernetHardwareStatus hardwareStatus() { return EthernetW5500; }
+
+  void MACAddress(uint8_t* mac_address);
+  IPAddress localIP() { return local_ip_; }
+  IPAddress subnetMask() { return subnet_mask_; }
+  IPAddress gatewayIP() { return gateway_ip_; }
+  IPAddress dnsServerIP() { return dns_server_ip_; }
+
+  void setMACAddress(const uint8_t* mac_address);
+  void setLocalIP(const IPAddress local_ip) { local_ip_ = local_ip; }
+  void setSubnetMask(const IPAddress subnet) { subnet_mask_ = subnet; }
+  void setGatewayIP(const IPAddress gateway) { gateway_ip_ = gateway; }
+  void setDnsServerIP(const IPAddress dns_server) {
+    dns_server_ip_ = dns_server;
+  }
+
+private:
+  uint8_t mac_[6] = {0};
+  IPAddress local_ip_;
+  IPAddress subnet_mask_;
+  IPAddress gateway_ip_;
+  IPAddress dns_server_ip_;
+};
+
+extern EthernetClass Ethernet;
+
+class EthernetClient : public Stream {
+public:
+  EthernetClient() : sockindex_(MAX_SOCK_NUM) {}
+  explicit EthernetClient(uint8_t sockindex) : sockindex_(sockindex) {}
+
+  // Returns 1 if connected, else 0.
+  int connect(IPAddress ip, uint16_t port);
+  int connect(const char* host, uint16_t port);
+
+  // True if the socket is open, or if the peer has closed it but there is
+  // still data to be read.
+  uint8_t connected();
+  explicit operator bool() { return sockindex_ < MAX_SOCK_NUM; }
+
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size);
+  int peek() override;
+
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+  void flush() override {}
+
+  void stop();
+
+  uint8_t getSocketNumber() const { return sockindex_; }
+  IPAddress remoteIP();
+  uint16_t remotePort();
+
+  bool operator==(const EthernetClient& other) const {
+    return sockindex_ == other.sockindex_;
+  }
+  bool operator!=(const EthernetClient& other) const {
+    return sockindex_ != other.sockindex_;
+  }
+
+private:
+  uint8_t sockindex_;
+};
+
+class EthernetServer : public Print {
+public:
+  explicit EthernetServer(uint16_t port) : port_(port) {}
+
+  void begin();
+
+  // Returns a client (connected socket) which has data available to read,
+  // accepting new connections as needed; if there isn't one, returns a
+  // client for which operator bool is false. As with the real library, the
+  // same client is returned by each call until its data has been read.
+  EthernetClient available();
+
+  // Returns a newly connected client, or one for which operator bool is
+  // false.
+  EthernetClient accept();
+
+  // Writes to all of the connected clients.
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+
+  explicit operator bool();
+
+private:
+  const uint16_t port_;
+};
+
+// Uses one of the chip's sockets from begin until stop.
+class EthernetUDP : public Stream {
+public:
+  // Returns 1 if a socket was available, else 0.
+  uint8_t begin(uint16_t port);
+  void stop();
+
+  // Starts building a datagram to send; returns 1, or 0 if not begun.
+  int beginPacket(IPAddress ip, uint16_t port);
+  // Sends the datagram; returns 1 if successful.
+  int endPacket();
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+
+  // Discards the rest of the current datagram, if any, and moves on to the
+  // next one received, returning its size, or 0 if there is none.
+  int parsePacket();
+  // The number of bytes left in the current datagram.
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size);
+  int peek() override;
+  void flush() override {}
+
+  // The sender of the current datagram.
+  IPAddress remoteIP() { return remote_ip_; }
+  uint16_t remotePort() { return remote_port_; }
+
+private:
+  uint8_t sockindex_ = MAX_SOCK_NUM;
+  IPAddress remote_ip_;
+  uint16_t remote_port_ = 0;
+};
+
+#endif  // _ARDUINO_HOST_ETHERNET_H_
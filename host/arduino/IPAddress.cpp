@@ -0,0 +1,53 @@
+#include "IPAddress.h"
+
+#include <string.h>
+
+#include "Print.h"
+
+IPAddress::IPAddress() { memset(bytes_, 0, sizeof bytes_); }
+
+IPAddress::IPAddress(uint8_t first_octet, uint8_t second_octet,
+                     uint8_t third_octet, uint8_t fourth_octet) {
+  bytes_[0] = first_octet;
+  bytes_[1] = second_octet;
+  bytes_[2] = third_octet;
+  bytes_[3] = fourth_octet;
+}
+
+IPAddress::IPAddress(uint32_t address) { *this = address; }
+
+IPAddress::IPAddress(const uint8_t* address) { *this = address; }
+
+IPAddress::operator uint32_t() const {
+  uint32_t address;
+  memcpy(&address, bytes_, sizeof address);
+  return address;
+}
+
+bool IPAddress::operator==(const IPAddress& addr) const {
+  return memcmp(bytes_, addr.bytes_, sizeof bytes_) == 0;
+}
+
+bool IPAddress::operator==(const uint8_t* addr) const {
+  return memcmp(bytes_, addr, sizeof bytes_) == 0;
+}
+
+IPAddress& IPAddress::operator=(const uint8_t* address) {
+  memcpy(bytes_, address, sizeof bytes_);
+  return *this;
+}
+
+IPAddress& IPAddress::operator=(uint32_t address) {
+  memcpy(bytes_, &address, sizeof bytes_);
+  return *this;
+}
+
+size_t IPAddress::printTo(Print& p) const {
+  size_t n = 0;
+  for (int i = 0; i < 3; ++i) {
+    n += p.print(bytes_[i], DEC);
+    n += p.print('.');
+  }
+  n += p.print(bytes_[3], DEC);
+  return n;
+}
@@ -0,0 +1,39 @@
+#ifndef _ARDUINO_HOST_IP_ADDRESS_H_
+#define _ARDUINO_HOST_IP_ADDRESS_H_
+
+// Host (Linux) stand-in for the Arduino core's IPAddress.h (IPv4 only, as on
+// AVR).
+
+#include <inttypes.h>
+
+#include "Printable.h"
+
+class IPAddress : public Printable {
+public:
+  IPAddress();
+  IPAddress(uint8_t first_octet, uint8_t second_octet, uint8_t third_octet,
+            uint8_t fourth_octet);
+  // address is in network byte order, as in the AVR core.
+  IPAddress(uint32_t address);
+  IPAddress(const uint8_t* address);
+
+  // Returns the address in network byte order.
+  operator uint32_t() const;
+  bool operator==(const IPAddress& addr) const;
+  bool operator==(const uint8_t* addr) const;
+
+  uint8_t operator[](int index) const { return bytes_[index]; }
+  uint8_t& operator[](int index) { return bytes_[index]; }
+
+  IPAddress& operator=(const uint8_t* address);
+  IPAddress& operator=(uint32_t address);
+
+  size_t printTo(Print& p) const override;
+
+private:
+  uint8_t bytes_[4];
+};
+
+const IPAddress INADDR_NONE(0, 0, 0, 0);
+
+#endif  // _ARDUINO_HOST_IP_ADDRESS_H_
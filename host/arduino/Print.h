@@ -0,0 +1,66 @@
+#ifndef _ARDUINO_HOST_PRINT_H_
+#define _ARDUINO_HOST_PRINT_H_
+
+// Host (Linux) stand-in for the Arduino core's Print.h, with the same
+// overloads as the AVR core, so that overload resolution (e.g. of uint8_t
+// versus char) matches what happens on a board.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "Printable.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Strings in flash (PROGMEM) on AVR; on the host they're just in RAM.
+class __FlashStringHelper;
+#define F(string_literal) \
+  (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str) {
+    return str == nullptr ? 0 : write(str, strlen(str));
+  }
+  size_t write(const char* buffer, size_t size) {
+    return write(reinterpret_cast<const uint8_t*>(buffer), size);
+  }
+  virtual void flush() {}
+
+  size_t print(const __FlashStringHelper* s);
+  size_t print(const char s[]);
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+  size_t print(const Printable& x);
+
+  size_t println(const __FlashStringHelper* s);
+  size_t println(const char s[]);
+  size_t println(char c);
+  size_t println(unsigned char n, int base = DEC);
+  size_t println(int n, int base = DEC);
+  size_t println(unsigned int n, int base = DEC);
+  size_t println(long n, int base = DEC);
+  size_t println(unsigned long n, int base = DEC);
+  size_t println(double n, int digits = 2);
+  size_t println(const Printable& x);
+  size_t println();
+
+private:
+  size_t printNumber(unsigned long n, uint8_t base);
+  size_t printFloat(double number, uint8_t digits);
+};
+
+#endif  // _ARDUINO_HOST_PRINT_H_
@@ -0,0 +1,20 @@
+#ifndef _ARDUINO_HOST_PRINTABLE_H_
+#define _ARDUINO_HOST_PRINTABLE_H_
+
+// Host (Linux) stand-in for the Arduino core's Printable.h.
+
+#include <stddef.h>
+
+class Print;
+
+// A class that knows how to print itself to a Print instance. The AVR core's
+// has no virtual destructor, but some others (e.g. ESP8266) do, so this one
+// does too, so that code which relies on its absence (e.g. a constexpr class
+// deriving from Printable) doesn't compile here either.
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+#endif  // _ARDUINO_HOST_PRINTABLE_H_
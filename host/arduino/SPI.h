@@ -0,0 +1,28 @@
+#ifndef _ARDUINO_HOST_SPI_H_
+#define _ARDUINO_HOST_SPI_H_
+
+// Host (Linux) stand-in for the Arduino SPI library; there is no SPI bus on
+// the host (the Ethernet chip is simulated without one), so this just lets
+// sketches that use SPI transactions compile.
+
+#include <inttypes.h>
+
+#define MSBFIRST 1
+#define SPI_MODE0 0x00
+
+class SPISettings {
+public:
+  SPISettings() {}
+  SPISettings(uint32_t clock, uint8_t bit_order, uint8_t data_mode) {}
+};
+
+class SPIClass {
+public:
+  static void begin() {}
+  static void beginTransaction(SPISettings settings) {}
+  static void endTransaction() {}
+};
+
+extern SPIClass SPI;
+
+#endif  // _ARDUINO_HOST_SPI_H_
@@ -0,0 +1,16 @@
+#ifndef _ARDUINO_HOST_STREAM_H_
+#define _ARDUINO_HOST_STREAM_H_
+
+// Host (Linux) stand-in for the Arduino core's Stream.h; just the input
+// methods used by this repo.
+
+#include "Print.h"
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+#endif  // _ARDUINO_HOST_STREAM_H_
@@ -0,0 +1,204 @@
+#include "arduino_host.h"
+
+#include <stdio.h>
+
+#include <chrono>
+
+#include "Arduino.h"
+
+HardwareSerial Serial;
+
+namespace arduino_host {
+namespace {
+
+uint64_t virtual_micros = 0;
+uint32_t micros_per_clock_call = 0;
+
+uint8_t digital_pins[NUM_DIGITAL_PINS];
+
+struct InterruptHandler {
+  void (*isr)() = nullptr;
+  int mode;
+};
+InterruptHandler interrupt_handlers[2];
+
+AnalogReadFn analog_read_source;
+uint32_t analog_read_count = 0;
+uint32_t analog_noise_state = 1;
+
+// A small linear congruential generator for the default analogRead noise, so
+// that the sequence is the same on every run.
+int defaultAnalogRead(uint8_t pin) {
+  analog_noise_state = analog_noise_state * 1103515245UL + 12345UL;
+  return 512 + pin + static_cast<int>((analog_noise_state >> 16) & 7) - 4;
+}
+
+// The Arduino core's random() is the C library's random(); use a separate
+// generator here so that the sequence doesn't depend on the host C library.
+uint32_t random_state = 1;
+
+uint32_t nextRandom() {
+  // xorshift32; the state must not be zero.
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+}  // namespace
+
+uint64_t virtualMicros() { return virtual_micros; }
+
+void advanceMicros(uint64_t micros) { virtual_micros += micros; }
+
+void advanceMillis(uint64_t millis) { virtual_micros += millis * 1000; }
+
+void setVirtualMicros(uint64_t micros) { virtual_micros = micros; }
+
+void setMicrosPerClockCall(uint32_t micros_per_call) {
+  micros_per_clock_call = micros_per_call;
+}
+
+uint64_t hostMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void setAnalogReadSource(AnalogReadFn fn) { analog_read_source = fn; }
+
+void setAnalogReadScript(const int* values, size_t num_values) {
+  size_t next = 0;
+  analog_read_source = [values, num_values, next](uint8_t) mutable {
+    int v = values[next++];
+    if (next >= num_values) {
+      next = 0;
+    }
+    return v;
+  };
+}
+
+void resetAnalogReadSource() {
+  analog_read_source = nullptr;
+  analog_noise_state = 1;
+}
+
+uint32_t analogReadCount() { return analog_read_count; }
+
+void setPinInput(uint8_t pin, uint8_t level) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+  level = level ? HIGH : LOW;
+  const uint8_t old_level = digital_pins[pin];
+  digital_pins[pin] = level;
+  const int interrupt_num = digitalPinToInterrupt(pin);
+  if (interrupt_num == NOT_AN_INTERRUPT) {
+    return;
+  }
+  const InterruptHandler& handler = interrupt_handlers[interrupt_num];
+  if (handler.isr == nullptr) {
+    return;
+  }
+  bool fire = false;
+  switch (handler.mode) {
+    case LOW:
+      fire = level == LOW;
+      break;
+    case CHANGE:
+      fire = level != old_level;
+      break;
+    case FALLING:
+      fire = level == LOW && old_level == HIGH;
+      break;
+    case RISING:
+      fire = level == HIGH && old_level == LOW;
+      break;
+  }
+  if (fire) {
+    handler.isr();
+  }
+}
+
+}  // namespace arduino_host
+
+using arduino_host::micros_per_clock_call;
+using arduino_host::virtual_micros;
+
+unsigned long millis() {
+  virtual_micros += micros_per_clock_call;
+  return static_cast<uint32_t>(virtual_micros / 1000);
+}
+
+unsigned long micros() {
+  virtual_micros += micros_per_clock_call;
+  return static_cast<uint32_t>(virtual_micros);
+}
+
+void delay(unsigned long ms) { arduino_host::advanceMillis(ms); }
+
+void delayMicroseconds(unsigned int us) { arduino_host::advanceMicros(us); }
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void attachInterrupt(uint8_t interrupt_num, void (*isr)(), int mode) {
+  if (interrupt_num < 2) {
+    arduino_host::interrupt_handlers[interrupt_num].isr = isr;
+    arduino_host::interrupt_handlers[interrupt_num].mode = mode;
+  }
+}
+
+void detachInterrupt(uint8_t interrupt_num) {
+  if (interrupt_num < 2) {
+    arduino_host::interrupt_handlers[interrupt_num].isr = nullptr;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < NUM_DIGITAL_PINS) {
+    arduino_host::digital_pins[pin] = value ? HIGH : LOW;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < NUM_DIGITAL_PINS ? arduino_host::digital_pins[pin] : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  ++arduino_host::analog_read_count;
+  if (arduino_host::analog_read_source) {
+    return arduino_host::analog_read_source(pin);
+  }
+  return arduino_host::defaultAnalogRead(pin);
+}
+
+long random(long howbig) {
+  if (howbig <= 0) {
+    return 0;
+  }
+  return arduino_host::nextRandom() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) {
+    return howsmall;
+  }
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+  const uint32_t state = static_cast<uint32_t>(seed);
+  if (state != 0) {
+    arduino_host::random_state = state;
+  }
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+  return fwrite(&b, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() { fflush(stdout); }
@@ -0,0 +1,107 @@
+#ifndef _ARDUINO_HOST_ARDUINO_HOST_H_
+#define _ARDUINO_HOST_ARDUINO_HOST_H_
+
+// Controls for the simulated hardware of the host (Linux) build, for use by
+// tests and benchmarks. None of this exists on a board, so sketches that use
+// it should do so only when ARDUINO_HOST is defined.
+//
+// Author: James Synge
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <functional>
+
+#include "IPAddress.h"
+
+namespace arduino_host {
+
+// The virtual clock behind millis() and micros(). It starts at zero, and only
+// moves when advanced: by delay() and delayMicroseconds(), by EEPROM writes
+// (see EEPROMClass), by advanceMicros(), and by micros_per_call on each call
+// to millis() or micros(). The latter is zero by default; setting it to a
+// small value lets loops that poll the clock make progress.
+//
+// As on a board, millis() and micros() wrap around at 2^32.
+uint64_t virtualMicros();
+void advanceMicros(uint64_t micros);
+void advanceMillis(uint64_t millis);
+void setVirtualMicros(uint64_t micros);
+void setMicrosPerClockCall(uint32_t micros_per_call);
+
+// Microseconds of real (host) time since some arbitrary point, for timing
+// code on the host; the virtual clock can't do that.
+uint64_t hostMicros();
+
+// The source of analogRead values, which is called with the pin (e.g. A0).
+// By default the readings are 512 plus a little deterministic noise.
+using AnalogReadFn = std::function<int(uint8_t pin)>;
+void setAnalogReadSource(AnalogReadFn fn);
+
+// Makes analogRead return the values in order, starting over at the
+// beginning after the last one, regardless of the pin read. values must
+// outlive its use.
+void setAnalogReadScript(const int* values, size_t num_values);
+
+// Restores the default analogRead source.
+void resetAnalogReadSource();
+
+// The number of times analogRead has been called.
+uint32_t analogReadCount();
+
+// Sets the level of an input pin, as external hardware would, calling the
+// handler attached to its interrupt (if any; see attachInterrupt) if the
+// change matches the handler's mode.
+void setPinInput(uint8_t pin, uint8_t level);
+
+// The pin connected to the (simulated) Ethernet chip's INTn output, which the
+// chip pulls low while any socket interrupt that the sketch has enabled is
+// pending; see host/arduino/utility/w5100.h. By default it isn't connected
+// (as on most shields), i.e. the chip's interrupts go nowhere.
+void setEthernetInterruptPin(uint8_t pin);
+
+// The number of calls to sleep_cpu, and the total (real) time spent in them,
+// i.e. with the CPU idle.
+uint32_t sleepCount();
+uint64_t sleptMicros();
+
+// Whether Ethernet.begin(mac) gets a (simulated) DHCP lease, and the address
+// it leases. By default there is no DHCP server.
+void setDhcpLease(bool available, uint32_t address_in_network_order = 0);
+
+// The TCP port on 127.0.0.1 on which an EthernetServer for the given port is
+// listening (after begin()), or 0 if there is none. By default an
+// EthernetServer listens on the same port number as on the board, unless
+// that isn't available (e.g. port 80 when not root), in which case it listens
+// on an unused port chosen by the OS.
+uint16_t listeningPort(uint16_t arduino_port);
+void setUseEphemeralPorts(bool use_ephemeral);
+
+// The other devices on the (simulated) LAN, as seen by socket 0 of the chip
+// in MACRAW mode (see host/arduino/utility/w5100.h): the handler is called
+// with each frame sent, and may reply by injecting frames, which are
+// received in the order injected. injectRawFrame returns false if socket 0
+// isn't in MACRAW mode, or its receive buffer is full.
+using RawFrameFn = std::function<void(const uint8_t* frame, size_t size)>;
+void setRawFrameHandler(RawFrameFn fn);
+bool injectRawFrame(const uint8_t* frame, size_t size);
+
+// The other devices on the (simulated) LAN, as seen by EthernetUDP: the
+// handler is called with each datagram sent (from Ethernet.localIP()), and
+// may reply by injecting datagrams, which are received by the socket begun
+// on dest_port, in the order injected. injectUdpPacket returns false if there
+// is no such socket, or its receive buffer (2KB, as on the chip) is full.
+using UdpFn = std::function<void(const IPAddress& dest_ip, uint16_t dest_port,
+                                 uint16_t src_port, const uint8_t* data,
+                                 size_t size)>;
+void setUdpHandler(UdpFn fn);
+bool injectUdpPacket(const IPAddress& src_ip, uint16_t src_port,
+                     uint16_t dest_port, const uint8_t* data, size_t size);
+
+// The number of writes of data to an EthernetClient. With the real library,
+// each is a SEND command to the chip, and hence at least one TCP segment.
+uint32_t ethernetSendCount();
+
+}  // namespace arduino_host
+
+#endif  // _ARDUINO_HOST_ARDUINO_HOST_H_
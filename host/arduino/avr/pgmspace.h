@@ -0,0 +1,29 @@
+#ifndef _ARDUINO_HOST_AVR_PGMSPACE_H_
+#define _ARDUINO_HOST_AVR_PGMSPACE_H_
+
+// Host (Linux) stand-in for avr-libc's pgmspace.h. There is just one address
+// space on the host, so PROGMEM data is read directly.
+
+#include <inttypes.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t*>(addr))
+#define pgm_read_word(addr) (*reinterpret_cast<const uint16_t*>(addr))
+#define pgm_read_dword(addr) (*reinterpret_cast<const uint32_t*>(addr))
+#define pgm_read_float(addr) (*reinterpret_cast<const float*>(addr))
+#define pgm_read_ptr(addr) \
+  (*static_cast<void* const*>(static_cast<const void*>(addr)))
+
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+
+#endif  // _ARDUINO_HOST_AVR_PGMSPACE_H_
@@ -0,0 +1,21 @@
+#ifndef _ARDUINO_HOST_AVR_SLEEP_H_
+#define _ARDUINO_HOST_AVR_SLEEP_H_
+
+// Host (Linux) stand-in for avr-libc's sleep.h. Only idle mode is simulated:
+// sleep_cpu waits for the next event that would wake an AVR in idle mode,
+// i.e. activity on the simulated Ethernet chip's sockets (which may raise
+// its interrupt; see arduino_host::setEthernetInterruptPin), or the timer 0
+// overflow interrupt (every 1024us) that drives millis(). It really waits,
+// so the host's CPU is idle too, and advances the virtual clock by the time
+// waited.
+
+#include <inttypes.h>
+
+#define SLEEP_MODE_IDLE 0
+
+inline void set_sleep_mode(uint8_t mode) {}
+inline void sleep_enable() {}
+inline void sleep_disable() {}
+void sleep_cpu();
+
+#endif  // _ARDUINO_HOST_AVR_SLEEP_H_
@@ -0,0 +1,120 @@
+#ifndef _ARDUINO_HOST_UTILITY_W5100_H_
+#define _ARDUINO_HOST_UTILITY_W5100_H_
+
+// Host (Linux) stand-in for the Ethernet library's low-level access to the
+// Wiznet chip's registers, covering just the interrupt registers of the
+// (simulated) W5500, and socket 0 in MACRAW mode:
+//
+//   SIR (0x0017): bit s is set while socket s has an enabled interrupt
+//                 pending; read only.
+//   SIMR (0x0018): bit s enables the interrupts of socket s; 0 at reset.
+//   Sn_IR (socket register 0x02): CON, DISCON, RECV (and TIMEOUT, SEND_OK,
+//                 which aren't simulated); set by the chip, and cleared by
+//                 writing 1s.
+//   Sn_IMR (socket register 0x2C): which of the Sn_IR bits are enabled;
+//                 0xFF at reset.
+//   Sn_SR (socket register 0x03): CLOSED, or ESTABLISHED while a TCP socket
+//                 is connected, or UDP or MACRAW.
+//
+// RECV is set when more data arrives, not while there is data to be read,
+// so (as on the chip) a sketch which clears it before reading all of the
+// data won't be interrupted for the rest. The chip's INTn output is low
+// while SIR is non-zero; see arduino_host::setEthernetInterruptPin.
+//
+// In MACRAW mode (Sn_MR = MACRAW, then OPEN), socket 0 sends and receives
+// whole Ethernet frames through its buffers, as on the chip: a SEND sends
+// the bytes from Sn_TX_RD to Sn_TX_WR as one frame, to the handler set with
+// arduino_host::setRawFrameHandler, and frames passed to
+// arduino_host::injectRawFrame are appended to the receive buffer, each
+// preceded by its size (plus 2) as 2 big endian bytes. The buffers are 2KB,
+// and addressed as on the W5500 (i.e. offsets wrap around within them).
+//
+// Other registers read as zero, and writes to them are ignored.
+
+#include <inttypes.h>
+
+#include "SPI.h"
+
+#define SPI_ETHERNET_SETTINGS SPISettings(14000000, MSBFIRST, SPI_MODE0)
+
+typedef uint8_t SOCKET;
+
+class SnIR {
+public:
+  static const uint8_t SEND_OK = 0x10;
+  static const uint8_t TIMEOUT = 0x08;
+  static const uint8_t RECV = 0x04;
+  static const uint8_t DISCON = 0x02;
+  static const uint8_t CON = 0x01;
+};
+
+class SnMR {
+public:
+  static const uint8_t CLOSE = 0x00;
+  static const uint8_t TCP = 0x21;
+  static const uint8_t UDP = 0x02;
+  static const uint8_t MACRAW = 0x04;
+};
+
+class SnSR {
+public:
+  static const uint8_t CLOSED = 0x00;
+  static const uint8_t ESTABLISHED = 0x17;
+  static const uint8_t UDP = 0x22;
+  static const uint8_t MACRAW = 0x42;
+};
+
+enum SockCMD {
+  Sock_OPEN = 0x01,
+  Sock_CLOSE = 0x10,
+  Sock_SEND = 0x20,
+  Sock_RECV = 0x40,
+};
+
+class W5100Class {
+public:
+  // Common registers.
+  static uint8_t read(uint16_t addr);
+  static uint8_t write(uint16_t addr, uint8_t data);
+
+  // Socket buffers, at SBASE (transmit) and RBASE (receive).
+  static uint16_t read(uint16_t addr, uint8_t* buf, uint16_t len);
+  static uint16_t write(uint16_t addr, const uint8_t* buf, uint16_t len);
+  static const uint16_t SSIZE = 2048;
+  static const uint16_t SMASK = 0x07FF;
+  static uint16_t SBASE(uint8_t socknum) { return socknum * SSIZE + 0x8000; }
+  static uint16_t RBASE(uint8_t socknum) { return socknum * SSIZE + 0xC000; }
+  static bool hasOffsetAddressMapping() { return true; }
+
+  // Socket registers.
+  static uint8_t readSn(SOCKET s, uint16_t addr);
+  static uint8_t writeSn(SOCKET s, uint16_t addr, uint8_t data);
+  static uint16_t readSn16(SOCKET s, uint16_t addr) {
+    return (readSn(s, addr) << 8) | readSn(s, addr + 1);
+  }
+  static void writeSn16(SOCKET s, uint16_t addr, uint16_t data) {
+    writeSn(s, addr, data >> 8);
+    writeSn(s, addr + 1, data & 0xFF);
+  }
+  static void execCmdSn(SOCKET s, SockCMD cmd);
+
+  static uint8_t readSnMR(SOCKET s) { return readSn(s, 0x0000); }
+  static void writeSnMR(SOCKET s, uint8_t data) { writeSn(s, 0x0000, data); }
+  static uint8_t readSnIR(SOCKET s) { return readSn(s, 0x0002); }
+  static void writeSnIR(SOCKET s, uint8_t data) { writeSn(s, 0x0002, data); }
+  static uint8_t readSnSR(SOCKET s) { return readSn(s, 0x0003); }
+  static uint16_t readSnTX_FSR(SOCKET s) { return readSn16(s, 0x0020); }
+  static uint16_t readSnTX_WR(SOCKET s) { return readSn16(s, 0x0024); }
+  static void writeSnTX_WR(SOCKET s, uint16_t data) {
+    writeSn16(s, 0x0024, data);
+  }
+  static uint16_t readSnRX_RSR(SOCKET s) { return readSn16(s, 0x0026); }
+  static uint16_t readSnRX_RD(SOCKET s) { return readSn16(s, 0x0028); }
+  static void writeSnRX_RD(SOCKET s, uint16_t data) {
+    writeSn16(s, 0x0028, data);
+  }
+};
+
+extern W5100Class W5100;
+
+#endif  // _ARDUINO_HOST_UTILITY_W5100_H_
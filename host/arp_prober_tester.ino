@@ -0,0 +1,396 @@
+// Host-only test of ArpProber, and of SimpleHttpServer::setup's use of it,
+// against other (simulated) devices on the LAN, which see the frames sent by
+// socket 0 of the chip in MACRAW mode, and reply as real ones would; see
+// CMakeLists.txt.
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <utility/w5100.h>
+
+#include <vector>
+
+#include "addresses.h"
+#include "arduino_host.h"
+#include "arp_prober.h"
+#include "simple_http_server.h"
+#include "test.h"
+
+using Frame = std::vector<uint8_t>;
+
+const uint8_t kOurMac[6] = {0x52, 0xC4, 0x05, 0x01, 0x02, 0x03};
+const uint8_t kOtherMac[6] = {0x00, 0x1B, 0x21, 0xAA, 0xBB, 0xCC};
+const IPAddress kCandidate(169, 254, 7, 9);
+const IPAddress kOtherIp(169, 254, 30, 40);
+
+// Offsets within an ARP frame.
+constexpr int kSenderIp = 28;
+constexpr int kTargetIp = 38;
+
+IPAddress ipAt(const Frame& frame, int offset) {
+  return IPAddress(&frame[offset]);
+}
+
+// Another device on the LAN, with address ip, which replies to ARP requests
+// for it, and records all of the frames sent.
+struct Lan {
+  void start() {
+    frames.clear();
+    arduino_host::setRawFrameHandler(
+        [this](const uint8_t* frame, size_t size) {
+          frames.emplace_back(frame, frame + size);
+          if (has_device && size >= 42 && frame[12] == 0x08 &&
+              frame[13] == 0x06 && IPAddress(frame + kTargetIp) == device_ip) {
+            uint8_t reply[ArpProber::kFrameSize];
+            ArpProber::buildRequest(reply, kOtherMac, device_ip,
+                                    IPAddress(frame + kSenderIp));
+            reply[21] = 2;  // A reply,
+            memcpy(reply, frame + 6, 6);  // to the sender.
+            memcpy(reply + 32, frame + 6, 6);
+            arduino_host::injectRawFrame(reply, sizeof reply);
+          }
+        });
+  }
+
+  // The frames sent which are probes (sender IP 0.0.0.0) for ip.
+  int probesFor(const IPAddress& ip) const {
+    int n = 0;
+    for (const Frame& f : frames) {
+      if (ipAt(f, kSenderIp) == IPAddress(0, 0, 0, 0) &&
+          ipAt(f, kTargetIp) == ip) {
+        ++n;
+      }
+    }
+    return n;
+  }
+
+  // The frames sent which are announcements of ip.
+  int announcementsOf(const IPAddress& ip) const {
+    int n = 0;
+    for (const Frame& f : frames) {
+      if (ipAt(f, kSenderIp) == ip && ipAt(f, kTargetIp) == ip) {
+        ++n;
+      }
+    }
+    return n;
+  }
+
+  bool has_device = false;
+  IPAddress device_ip;
+  std::vector<Frame> frames;
+};
+
+Lan lan;
+
+// Polls until the prober decides, returning the result and the (virtual)
+// time it took.
+ArpProber::Result pollUntilDone(ArpProber* prober, uint32_t* elapsed_ms) {
+  const uint32_t start = millis();
+  ArpProber::Result result;
+  while ((result = prober->poll()) == ArpProber::Result::kProbing) {
+    delay(1);
+  }
+  *elapsed_ms = millis() - start;
+  return result;
+}
+
+void testBuildRequest() {
+  uint8_t frame[ArpProber::kFrameSize];
+  ArpProber::buildRequest(frame, kOurMac, IPAddress(0, 0, 0, 0), kCandidate);
+  const uint8_t kExpected[42] = {
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // Broadcast,
+      0x52, 0xC4, 0x05, 0x01, 0x02, 0x03,  // from us;
+      0x08, 0x06,                          // ARP:
+      0x00, 0x01, 0x08, 0x00, 6, 4,        // Ethernet, IPv4,
+      0x00, 0x01,                          // request,
+      0x52, 0xC4, 0x05, 0x01, 0x02, 0x03,  // sender MAC,
+      0, 0, 0, 0,                          // sender IP,
+      0, 0, 0, 0, 0, 0,                    // target MAC,
+      169, 254, 7, 9,                      // target IP.
+  };
+  EXPECT_EQ(memcmp(frame, kExpected, sizeof kExpected), 0);
+  // Padded with zeros.
+  for (int i = 42; i < ArpProber::kFrameSize; ++i) {
+    EXPECT_EQ(frame[i], 0);
+  }
+}
+
+void testIsConflict() {
+  uint8_t frame[ArpProber::kFrameSize];
+  auto conflict = [&frame](int size) {
+    return ArpProber::isConflict(frame, size, kOurMac, kCandidate);
+  };
+  // Another device using the address (e.g. asking for another's MAC).
+  ArpProber::buildRequest(frame, kOtherMac, kCandidate, kOtherIp);
+  EXPECT_TRUE(conflict(sizeof frame));
+  EXPECT_TRUE(conflict(42));
+  EXPECT_FALSE(conflict(41));
+  // Or replying.
+  frame[21] = 2;
+  EXPECT_TRUE(conflict(sizeof frame));
+  // Another device probing for the address.
+  ArpProber::buildRequest(frame, kOtherMac, IPAddress(0, 0, 0, 0),
+                          kCandidate);
+  EXPECT_TRUE(conflict(sizeof frame));
+  // Our own probe.
+  ArpProber::buildRequest(frame, kOurMac, IPAddress(0, 0, 0, 0), kCandidate);
+  EXPECT_FALSE(conflict(sizeof frame));
+  // A device asking for the address's MAC isn't using it.
+  ArpProber::buildRequest(frame, kOtherMac, kOtherIp, kCandidate);
+  EXPECT_FALSE(conflict(sizeof frame));
+  // Probing for another address.
+  ArpProber::buildRequest(frame, kOtherMac, IPAddress(0, 0, 0, 0), kOtherIp);
+  EXPECT_FALSE(conflict(sizeof frame));
+  // Not ARP (e.g. IPv4).
+  ArpProber::buildRequest(frame, kOtherMac, kCandidate, kOtherIp);
+  frame[13] = 0x00;
+  EXPECT_FALSE(conflict(sizeof frame));
+}
+
+void testNoConflict() {
+  lan.has_device = true;
+  lan.device_ip = kOtherIp;
+  lan.start();
+  ArpProber prober;
+  ASSERT_TRUE(prober.begin(kOurMac, kCandidate) ==
+              ArpProber::Result::kProbing);
+  EXPECT_EQ(W5100.readSnSR(0), SnSR::MACRAW);
+  EXPECT_EQ(lan.probesFor(kCandidate), 1);
+  uint32_t elapsed_ms;
+  EXPECT_TRUE(pollUntilDone(&prober, &elapsed_ms) ==
+              ArpProber::Result::kAvailable);
+  EXPECT_EQ(lan.probesFor(kCandidate), ArpProber::kProbeNum);
+  EXPECT_TRUE(elapsed_ms >= (ArpProber::kProbeNum - 1) *
+                                    ArpProber::kProbeIntervalMs +
+                                ArpProber::kAnnounceWaitMs);
+  EXPECT_TRUE(elapsed_ms <= ArpProber::kMaxFinishMs + 10);
+  prober.announce();
+  EXPECT_EQ(lan.announcementsOf(kCandidate), ArpProber::kAnnounceNum);
+  EXPECT_EQ(prober.conflicts(), 0);
+  // Socket 0 is free again.
+  EXPECT_EQ(W5100.readSnSR(0), SnSR::CLOSED);
+}
+
+void testConflict() {
+  lan.has_device = true;
+  lan.device_ip = kCandidate;
+  lan.start();
+  ArpProber prober;
+  ASSERT_TRUE(prober.begin(kOurMac, kCandidate) ==
+              ArpProber::Result::kProbing);
+  uint32_t elapsed_ms;
+  EXPECT_TRUE(pollUntilDone(&prober, &elapsed_ms) ==
+              ArpProber::Result::kConflict);
+  // Decided on the first poll, as the reply was already there.
+  EXPECT_EQ(elapsed_ms, 0);
+  EXPECT_EQ(prober.conflicts(), 1);
+
+  prober.restart(kOtherIp);
+  EXPECT_TRUE(pollUntilDone(&prober, &elapsed_ms) ==
+              ArpProber::Result::kAvailable);
+  EXPECT_EQ(prober.conflicts(), 1);
+  prober.end();
+  EXPECT_EQ(W5100.readSnSR(0), SnSR::CLOSED);
+}
+
+void testSimultaneousProbe() {
+  lan.has_device = false;
+  lan.start();
+  ArpProber prober;
+  ASSERT_TRUE(prober.begin(kOurMac, kCandidate) ==
+              ArpProber::Result::kProbing);
+  EXPECT_TRUE(prober.poll() == ArpProber::Result::kProbing);
+  // Another device probes for the same address.
+  uint8_t frame[ArpProber::kFrameSize];
+  ArpProber::buildRequest(frame, kOtherMac, IPAddress(0, 0, 0, 0),
+                          kCandidate);
+  EXPECT_TRUE(arduino_host::injectRawFrame(frame, sizeof frame));
+  EXPECT_TRUE(prober.poll() == ArpProber::Result::kConflict);
+  prober.end();
+  // Nothing is received once closed.
+  EXPECT_FALSE(arduino_host::injectRawFrame(frame, sizeof frame));
+}
+
+// Many frames that aren't of interest (e.g. broadcasts), wrapping around
+// the receive buffer, don't hide a conflict.
+void testBusyLan() {
+  lan.has_device = false;
+  lan.start();
+  ArpProber prober;
+  ASSERT_TRUE(prober.begin(kOurMac, kCandidate) ==
+              ArpProber::Result::kProbing);
+  uint8_t frame[100] = {};
+  frame[12] = 0x08;  // IPv4.
+  for (int i = 0; i < 500; ++i) {
+    frame[99] = i;
+    EXPECT_TRUE(arduino_host::injectRawFrame(frame, sizeof frame));
+    EXPECT_TRUE(prober.poll() == ArpProber::Result::kProbing);
+  }
+  ArpProber::buildRequest(frame, kOtherMac, kCandidate, kOtherIp);
+  EXPECT_TRUE(arduino_host::injectRawFrame(frame, ArpProber::kFrameSize));
+  EXPECT_TRUE(prober.poll() == ArpProber::Result::kConflict);
+  prober.end();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SimpleHttpServer::setup, without a DHCP server, i.e. using the link-local
+// address saved in the EEPROM.
+
+SimpleHttpServer server(kEthernetShieldCS);
+
+// Returns the (virtual) time taken by setup.
+uint32_t timeSetup() {
+  const uint32_t start = millis();
+  EXPECT_TRUE(server.setup());
+  return millis() - start;
+}
+
+void testSetup() {
+  Addresses saved;
+  saved.loadOrGenAndSave(nullptr);
+  arduino_host::setMicrosPerClockCall(10);
+
+  // No other device: the saved address is used, once probed.
+  lan.has_device = false;
+  lan.start();
+  uint32_t elapsed_ms = timeSetup();
+  Serial.print("Boot without DHCP, no conflict: ");
+  Serial.print(elapsed_ms);
+  Serial.println(" ms");
+  EXPECT_TRUE(elapsed_ms <= ArpProber::kMaxFinishMs + 50);
+  EXPECT_TRUE(Ethernet.localIP() == saved.profiles[0].ip);
+  EXPECT_EQ(lan.probesFor(saved.profiles[0].ip), ArpProber::kProbeNum);
+  EXPECT_EQ(lan.announcementsOf(saved.profiles[0].ip), ArpProber::kAnnounceNum);
+  EXPECT_EQ(W5100.readSnSR(0), SnSR::CLOSED);
+
+  // Another device has the address: another is picked, and saved.
+  lan.has_device = true;
+  lan.device_ip = saved.profiles[0].ip;
+  lan.start();
+  elapsed_ms = timeSetup();
+  Serial.print("Boot without DHCP, one conflict: ");
+  Serial.print(elapsed_ms);
+  Serial.println(" ms");
+  EXPECT_FALSE(Ethernet.localIP() == saved.profiles[0].ip);
+  EXPECT_EQ(Ethernet.localIP()[0], 169);
+  EXPECT_EQ(Ethernet.localIP()[1], 254);
+  EXPECT_EQ(lan.announcementsOf(saved.profiles[0].ip), 0);
+  EXPECT_EQ(lan.announcementsOf(Ethernet.localIP()), ArpProber::kAnnounceNum);
+  EXPECT_TRUE(elapsed_ms <= 2 * ArpProber::kMaxFinishMs + 100);
+  Addresses reloaded;
+  EXPECT_TRUE(reloaded.load(nullptr));
+  EXPECT_TRUE(reloaded.profiles[0].ip == Ethernet.localIP());
+  EXPECT_TRUE(reloaded.profiles[0].mac == saved.profiles[0].mac);
+  arduino_host::setMicrosPerClockCall(0);
+}
+
+// SimpleHttpServer::setup choosing between a DHCP profile and a static
+// profile for a lab network, recognized by its gateway (the simulated device)
+// answering probes.
+void testProfiles() {
+  const uint8_t kJumperPin = 7;
+  const uint8_t kLabMac[6] = {0x52, 0xC4, 0x05, 0x0D, 0x0E, 0x0F};
+  const IPAddress kLabIp(10, 1, 2, 3);
+  const IPAddress kLabGateway(10, 1, 2, 1);
+  Addresses saved;
+  ASSERT_TRUE(saved.load(nullptr));
+  ASSERT_EQ(saved.count, 1);
+  const IPAddress link_local_ip = saved.profiles[0].ip;
+  NetworkProfile lab;
+  memcpy(lab.mac.mac, kLabMac, 6);
+  lab.use_dhcp = false;
+  lab.ip = kLabIp;
+  lab.subnet = SaveableIPAddress(255, 255, 255, 0);
+  lab.gateway = kLabGateway;
+  lab.dns = SaveableIPAddress(10, 1, 2, 53);
+  lab.setName("lab");
+  ASSERT_EQ(saved.addProfile(lab), 1);
+  saved.save();
+  arduino_host::setMicrosPerClockCall(10);
+  arduino_host::setPinInput(kJumperPin, HIGH);
+  server.setProfileJumper(kJumperPin, 0);
+
+  // Moved to the lab: the DHCP profile isn't confirmed (no DHCP server), so
+  // the lab profile is tried, and becomes the most recently used.
+  lan.has_device = true;
+  lan.device_ip = kLabGateway;
+  lan.start();
+  uint32_t elapsed_ms = timeSetup();
+  Serial.print("Boot in the lab, DHCP profile first: ");
+  Serial.print(elapsed_ms);
+  Serial.println(" ms");
+  EXPECT_TRUE(elapsed_ms <= 2 * ArpProber::kMaxFinishMs + 100);
+  EXPECT_TRUE(Ethernet.localIP() == kLabIp);
+  EXPECT_TRUE(Ethernet.subnetMask() == IPAddress(255, 255, 255, 0));
+  EXPECT_TRUE(Ethernet.gatewayIP() == kLabGateway);
+  EXPECT_TRUE(Ethernet.dnsServerIP() == IPAddress(10, 1, 2, 53));
+  EXPECT_TRUE(server.profile() == lab);
+  EXPECT_EQ(strcmp(server.profile().name, "lab"), 0);
+  uint8_t mac[6];
+  Ethernet.MACAddress(mac);
+  EXPECT_EQ(memcmp(mac, kLabMac, 6), 0);
+  EXPECT_EQ(lan.probesFor(link_local_ip), ArpProber::kProbeNum);
+  EXPECT_EQ(lan.announcementsOf(link_local_ip), 0);
+  EXPECT_EQ(lan.announcementsOf(kLabIp), ArpProber::kAnnounceNum);
+  EXPECT_EQ(memcmp(&lan.frames.back()[6], kLabMac, 6), 0);
+  EXPECT_EQ(W5100.readSnSR(0), SnSR::CLOSED);
+  Addresses reloaded;
+  ASSERT_TRUE(reloaded.load(nullptr));
+  EXPECT_EQ(reloaded.order[0], 1);
+  EXPECT_EQ(reloaded.order[1], 0);
+
+  // Rebooted in the lab: the lab profile is tried first.
+  lan.start();
+  elapsed_ms = timeSetup();
+  Serial.print("Boot in the lab, lab profile first: ");
+  Serial.print(elapsed_ms);
+  Serial.println(" ms");
+  EXPECT_TRUE(elapsed_ms <= ArpProber::kMaxFinishMs + 50);
+  EXPECT_TRUE(Ethernet.localIP() == kLabIp);
+  EXPECT_EQ(lan.probesFor(link_local_ip), 0);
+
+  // Moved back, to a network without the lab's gateway (or a DHCP server):
+  // neither is confirmed, so the DHCP profile is used, as DHCP carries on in
+  // loop; the order is unchanged until it gets a lease.
+  lan.has_device = false;
+  lan.start();
+  elapsed_ms = timeSetup();
+  Serial.print("Boot elsewhere, lab profile first: ");
+  Serial.print(elapsed_ms);
+  Serial.println(" ms");
+  EXPECT_TRUE(elapsed_ms <= 2 * ArpProber::kMaxFinishMs + 100);
+  EXPECT_TRUE(Ethernet.localIP() == link_local_ip);
+  EXPECT_TRUE(server.profile().use_dhcp);
+  EXPECT_EQ(lan.announcementsOf(link_local_ip), ArpProber::kAnnounceNum);
+  EXPECT_EQ(lan.probesFor(kLabGateway), ArpProber::kProbeNum);
+  EXPECT_EQ(lan.probesFor(kLabIp), 0);
+  ASSERT_TRUE(reloaded.load(nullptr));
+  EXPECT_EQ(reloaded.order[0], 1);
+
+  // With the jumper, the DHCP profile is used without trying the lab's.
+  arduino_host::setPinInput(kJumperPin, LOW);
+  lan.has_device = true;
+  lan.start();
+  elapsed_ms = timeSetup();
+  Serial.print("Boot in the lab, jumpered to the DHCP profile: ");
+  Serial.print(elapsed_ms);
+  Serial.println(" ms");
+  EXPECT_TRUE(elapsed_ms <= ArpProber::kMaxFinishMs + 50);
+  EXPECT_TRUE(Ethernet.localIP() == link_local_ip);
+  EXPECT_EQ(lan.probesFor(kLabGateway), 0);
+  arduino_host::setPinInput(kJumperPin, HIGH);
+  arduino_host::setMicrosPerClockCall(0);
+}
+
+void setup() {
+  Serial.begin(9600);
+  testBuildRequest();
+  testIsConflict();
+  testNoConflict();
+  testConflict();
+  testSimultaneousProbe();
+  testBusyLan();
+  testSetup();
+  testProfiles();
+}
+
+void loop() {}
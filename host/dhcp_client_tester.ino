@@ -0,0 +1,585 @@
+// Host-only test of DhcpClient and DhcpLease, and of SimpleHttpServer::setup
+// and loop's use of them, against a DHCP server stand-in which receives the
+// datagrams sent by EthernetUDP and replies as a real one would. Also
+// measures the time from boot to the first HTTP response, in various
+// situations; see CMakeLists.txt.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Ethernet.h>
+#include <utility/w5100.h>
+
+#include <string>
+#include <vector>
+
+#include "arduino_host.h"
+#include "arp_prober.h"
+#include "dhcp_client.h"
+#include "http_test_client.h"
+#include "simple_http_server.h"
+#include "test.h"
+
+const uint8_t kMac[6] = {0x52, 0xC4, 0x05, 0x0A, 0x0B, 0x0C};
+const IPAddress kServerIp(192, 168, 1, 1);
+const IPAddress kBroadcast(255, 255, 255, 255);
+// Not INADDR_NONE, which <netinet/in.h> defines as 255.255.255.255.
+const IPAddress kNoAddress(0, 0, 0, 0);
+
+// A message sent by the client, as seen by the server.
+struct Message {
+  uint32_t ms;
+  IPAddress dest_ip;
+  size_t size;
+  uint8_t type;
+  uint32_t xid;
+  bool broadcast_flag;
+  IPAddress ciaddr;
+  IPAddress requested_ip;
+  IPAddress server_id;
+  uint8_t chaddr[6];
+};
+
+// A DHCP server on the LAN, leasing addresses from 192.168.1.100 up.
+struct DhcpServer {
+  void start() {
+    messages.clear();
+    arduino_host::setUdpHandler(
+        [this](const IPAddress& dest_ip, uint16_t dest_port,
+               uint16_t src_port, const uint8_t* data, size_t size) {
+          if (dest_port == 67 && src_port == 68) {
+            receive(dest_ip, data, size);
+          }
+        });
+  }
+
+  void receive(const IPAddress& dest_ip, const uint8_t* data, size_t size) {
+    Message m = {};
+    m.ms = millis();
+    m.dest_ip = dest_ip;
+    m.size = size;
+    ASSERT_TRUE(size >= 240);
+    EXPECT_EQ(data[0], 1);
+    memcpy(m.chaddr, data + 28, 6);
+    m.xid = (uint32_t(data[4]) << 24) | (uint32_t(data[5]) << 16) |
+            (data[6] << 8) | data[7];
+    m.broadcast_flag = data[10] & 0x80;
+    m.ciaddr = data + 12;
+    EXPECT_EQ(data[236], 99);
+    for (size_t i = 240; i < size && data[i] != 255;) {
+      if (data[i] == 0) {
+        ++i;
+        continue;
+      }
+      const uint8_t code = data[i];
+      const uint8_t* value = data + i + 2;
+      if (code == 53) {
+        m.type = value[0];
+      } else if (code == 50) {
+        m.requested_ip = value;
+      } else if (code == 54) {
+        m.server_id = value;
+      }
+      i += 2 + data[i + 1];
+    }
+    messages.push_back(m);
+    if (!running || millis() < answer_from_ms) {
+      return;
+    }
+
+    if (m.type == 1) {
+      // DISCOVER: offer the client's lease, or the address it asks for.
+      if (leased == kNoAddress) {
+        leased = m.requested_ip != kNoAddress &&
+                         m.requested_ip[2] == kServerIp[2]
+                     ? m.requested_ip
+                     : IPAddress(192, 168, 1, next_host++);
+      }
+      reply(m, 2, leased);
+    } else if (m.type == 3) {
+      if (m.server_id != kNoAddress) {
+        // REQUESTING.
+        if (m.server_id == kServerIp) {
+          reply(m, m.requested_ip == leased ? 5 : 6, leased);
+        }
+      } else if (m.ciaddr == kNoAddress) {
+        // INIT-REBOOT.
+        if (m.requested_ip == leased) {
+          reply(m, 5, leased);
+        } else if (authoritative) {
+          reply(m, 6, kNoAddress);
+        }
+      } else if (!nak_renewals) {
+        // RENEWING or REBINDING.
+        reply(m, m.ciaddr == leased ? 5 : 6, leased);
+      } else {
+        reply(m, 6, kNoAddress);
+      }
+    }
+  }
+
+  void reply(const Message& m, uint8_t type, const IPAddress& yiaddr) {
+    std::vector<uint8_t> r(240);
+    r[0] = 2;
+    r[1] = 1;
+    r[2] = 6;
+    r[4] = m.xid >> 24;
+    r[5] = m.xid >> 16;
+    r[6] = m.xid >> 8;
+    r[7] = m.xid;
+    for (int i = 0; i < 4; ++i) {
+      r[16 + i] = yiaddr[i];
+    }
+    memcpy(&r[28], m.chaddr, 6);
+    r[236] = 99;
+    r[237] = 130;
+    r[238] = 83;
+    r[239] = 99;
+    auto option = [&r](uint8_t code, std::vector<uint8_t> value) {
+      r.push_back(code);
+      r.push_back(value.size());
+      r.insert(r.end(), value.begin(), value.end());
+    };
+    auto ip = [](const IPAddress& a) {
+      return std::vector<uint8_t>{a[0], a[1], a[2], a[3]};
+    };
+    option(53, {type});
+    option(54, ip(kServerIp));
+    if (type != 6) {
+      option(51, {uint8_t(lease_secs >> 24), uint8_t(lease_secs >> 16),
+                  uint8_t(lease_secs >> 8), uint8_t(lease_secs)});
+      option(1, {255, 255, 255, 0});
+      // Two routers, of which only the first is used.
+      option(3, {192, 168, 1, 1, 192, 168, 1, 2});
+      option(6, {192, 168, 1, 53});
+    }
+    r.push_back(255);
+    EXPECT_TRUE(arduino_host::injectUdpPacket(kServerIp, 67, 68, r.data(),
+                                              r.size()));
+  }
+
+  int count(uint8_t type) const {
+    int n = 0;
+    for (const Message& m : messages) {
+      n += m.type == type;
+    }
+    return n;
+  }
+
+  bool running = true;
+  bool authoritative = true;
+  bool nak_renewals = false;
+  // Ignores messages until then, e.g. while the router is booting.
+  uint32_t answer_from_ms = 0;
+  uint32_t lease_secs = 3600;
+  uint8_t next_host = 100;
+  // The address leased to the client (the only one); 0.0.0.0 if none.
+  IPAddress leased;
+  std::vector<Message> messages;
+};
+
+DhcpServer dhcp_server;
+
+// Returns the number of the chip's sockets in use.
+int socketsInUse() {
+  int n = 0;
+  for (uint8_t s = 0; s < MAX_SOCK_NUM; ++s) {
+    n += W5100.readSnSR(s) != SnSR::CLOSED;
+  }
+  return n;
+}
+
+// Polls the client every 10ms until the event, or until timeout_ms has
+// passed, returning the event.
+DhcpClient::Event pollFor(DhcpClient* client, DhcpClient::Event event,
+                          uint32_t timeout_ms) {
+  const uint32_t start = millis();
+  while (millis() - start < timeout_ms) {
+    const DhcpClient::Event e = client->poll();
+    if (e == event) {
+      return e;
+    }
+    delay(10);
+  }
+  return DhcpClient::Event::kNone;
+}
+
+void resetServer() {
+  dhcp_server = DhcpServer();
+  dhcp_server.start();
+}
+
+void testLeaseSaveLoad() {
+  EEPROM.erase();
+  DhcpLease lease;
+  EXPECT_FALSE(lease.load());
+
+  lease.ip = IPAddress(10, 1, 2, 3);
+  lease.subnet = IPAddress(255, 0, 0, 0);
+  lease.gateway = IPAddress(10, 0, 0, 1);
+  lease.dns = IPAddress(10, 0, 0, 53);
+  lease.server = IPAddress(10, 0, 0, 2);
+  lease.save();
+  DhcpLease loaded;
+  EXPECT_TRUE(loaded.load());
+  EXPECT_TRUE(loaded == lease);
+
+  // Saved after the Addresses, which are unaffected.
+  Addresses addresses;
+  addresses.loadOrGenAndSave(nullptr);
+  loaded = DhcpLease();
+  EXPECT_TRUE(loaded.load());
+  EXPECT_TRUE(loaded == lease);
+
+  // Saving the same lease again writes nothing.
+  EEPROM.resetCounts();
+  lease.save();
+  EXPECT_EQ(EEPROM.bytesWritten(), 0);
+  // A new address writes just that.
+  lease.ip[3] = 4;
+  lease.save();
+  EXPECT_TRUE(EEPROM.bytesWritten() <= 5);
+  EXPECT_TRUE(loaded.load());
+  EXPECT_TRUE(loaded == lease);
+
+  // Corruption is detected.
+  EEPROM.write(Addresses::kEepromBytes + 6, 99);
+  loaded = DhcpLease();
+  EXPECT_FALSE(loaded.load());
+}
+
+void testDiscovery() {
+  resetServer();
+  DhcpClient client;
+  client.begin(kMac, nullptr);
+  EXPECT_TRUE(client.state() == DhcpClient::State::kSelecting);
+  ASSERT_EQ(dhcp_server.messages.size(), 1);
+  const Message& discover = dhcp_server.messages[0];
+  EXPECT_EQ(discover.type, 1);
+  EXPECT_TRUE(discover.dest_ip == kBroadcast);
+  EXPECT_TRUE(discover.broadcast_flag);
+  EXPECT_TRUE(discover.size >= 300);
+  EXPECT_TRUE(discover.requested_ip == kNoAddress);
+  EXPECT_EQ(memcmp(discover.chaddr, kMac, 6), 0);
+
+  // The offer was received meanwhile, and the request sent and acknowledged
+  // in the same call.
+  EXPECT_TRUE(client.poll() == DhcpClient::Event::kBound);
+  EXPECT_TRUE(client.bound());
+  ASSERT_EQ(dhcp_server.messages.size(), 2);
+  const Message& request = dhcp_server.messages[1];
+  EXPECT_EQ(request.type, 3);
+  EXPECT_EQ(request.xid, discover.xid);
+  EXPECT_TRUE(request.dest_ip == kBroadcast);
+  EXPECT_TRUE(request.requested_ip == IPAddress(192, 168, 1, 100));
+  EXPECT_TRUE(request.server_id == kServerIp);
+
+  const DhcpLease& lease = client.lease();
+  EXPECT_TRUE(lease.ip == IPAddress(192, 168, 1, 100));
+  EXPECT_TRUE(lease.subnet == IPAddress(255, 255, 255, 0));
+  EXPECT_TRUE(lease.gateway == IPAddress(192, 168, 1, 1));
+  EXPECT_TRUE(lease.dns == IPAddress(192, 168, 1, 53));
+  EXPECT_TRUE(lease.server == kServerIp);
+  EXPECT_EQ(client.leaseSecs(), 3600);
+  // The socket is closed until it is time to renew.
+  EXPECT_EQ(socketsInUse(), 0);
+  EXPECT_TRUE(client.poll() == DhcpClient::Event::kNone);
+  client.end();
+}
+
+void testInitReboot() {
+  resetServer();
+  dhcp_server.leased = IPAddress(192, 168, 1, 77);
+  DhcpLease cached;
+  cached.ip = IPAddress(192, 168, 1, 77);
+  cached.server = kServerIp;
+  DhcpClient client;
+  client.begin(kMac, &cached);
+  EXPECT_TRUE(client.state() == DhcpClient::State::kRebooting);
+  EXPECT_TRUE(client.poll() == DhcpClient::Event::kBound);
+  // A single request, broadcast without a server identifier.
+  ASSERT_EQ(dhcp_server.messages.size(), 1);
+  const Message& request = dhcp_server.messages[0];
+  EXPECT_EQ(request.type, 3);
+  EXPECT_TRUE(request.dest_ip == kBroadcast);
+  EXPECT_TRUE(request.ciaddr == kNoAddress);
+  EXPECT_TRUE(request.requested_ip == cached.ip);
+  EXPECT_TRUE(request.server_id == kNoAddress);
+  EXPECT_TRUE(client.lease().ip == cached.ip);
+  client.end();
+}
+
+// The device has moved to another network, whose server refuses the cached
+// lease.
+void testInitRebootNak() {
+  resetServer();
+  DhcpLease cached;
+  cached.ip = IPAddress(10, 0, 0, 9);
+  DhcpClient client;
+  client.begin(kMac, &cached);
+  EXPECT_TRUE(client.poll() == DhcpClient::Event::kBound);
+  ASSERT_EQ(dhcp_server.messages.size(), 3);
+  EXPECT_EQ(dhcp_server.messages[1].type, 1);
+  EXPECT_TRUE(client.lease().ip == IPAddress(192, 168, 1, 100));
+  client.end();
+}
+
+// A server which doesn't know the lease, and isn't authoritative, stays
+// silent; the client falls back to discovery.
+void testInitRebootSilent() {
+  resetServer();
+  dhcp_server.authoritative = false;
+  DhcpLease cached;
+  cached.ip = IPAddress(10, 0, 0, 9);
+  DhcpClient client;
+  const uint32_t start = millis();
+  client.begin(kMac, &cached);
+  EXPECT_TRUE(pollFor(&client, DhcpClient::Event::kBound, 10000) ==
+              DhcpClient::Event::kBound);
+  const uint32_t elapsed = millis() - start;
+  EXPECT_TRUE(elapsed >=
+              DhcpClient::kRebootAttempts * DhcpClient::kRebootTimeoutMs);
+  EXPECT_TRUE(elapsed <
+              DhcpClient::kRebootAttempts * DhcpClient::kRebootTimeoutMs + 50);
+  EXPECT_EQ(dhcp_server.messages.size(), 4);
+  // The discovery asks for the cached address, but the server declines.
+  EXPECT_TRUE(dhcp_server.messages[2].requested_ip == cached.ip);
+  EXPECT_TRUE(client.lease().ip == IPAddress(192, 168, 1, 100));
+  client.end();
+}
+
+// Without a server, the DISCOVERs back off, and then the socket is freed for
+// a while.
+void testRetransmission() {
+  resetServer();
+  dhcp_server.running = false;
+  DhcpClient client;
+  client.begin(kMac, nullptr);
+  EXPECT_EQ(socketsInUse(), 1);
+  pollFor(&client, DhcpClient::Event::kBound, 140000);
+  ASSERT_EQ(dhcp_server.messages.size(), DhcpClient::kMaxAttempts);
+  uint32_t expected_ms = 4000;
+  for (int i = 1; i < DhcpClient::kMaxAttempts; ++i) {
+    const Message& m = dhcp_server.messages[i];
+    EXPECT_EQ(m.type, 1);
+    // Retransmissions are of the same message.
+    EXPECT_EQ(m.xid, dhcp_server.messages[0].xid);
+    const uint32_t gap = m.ms - dhcp_server.messages[i - 1].ms;
+    EXPECT_TRUE(gap + 1000 >= expected_ms && gap <= expected_ms + 1010);
+    expected_ms *= 2;
+  }
+  EXPECT_TRUE(client.state() == DhcpClient::State::kIdle);
+  EXPECT_EQ(socketsInUse(), 0);
+
+  // The server comes up; it is found when the client tries again.
+  dhcp_server.running = true;
+  EXPECT_TRUE(pollFor(&client, DhcpClient::Event::kBound,
+                      DhcpClient::kIdleMs + 100000) ==
+              DhcpClient::Event::kBound);
+  EXPECT_EQ(dhcp_server.count(1), DhcpClient::kMaxAttempts + 1);
+  client.end();
+}
+
+void testRenewal() {
+  resetServer();
+  dhcp_server.lease_secs = 100;
+  DhcpClient client;
+  client.begin(kMac, nullptr);
+  EXPECT_TRUE(client.poll() == DhcpClient::Event::kBound);
+  const uint32_t bound_ms = millis();
+  dhcp_server.messages.clear();
+
+  // At T1 (half the lease), the lease is renewed with the server directly.
+  // The same lease doesn't need applying.
+  EXPECT_TRUE(pollFor(&client, DhcpClient::Event::kBound, 60000) ==
+              DhcpClient::Event::kNone);
+  ASSERT_TRUE(dhcp_server.messages.size() >= 1);
+  const Message& renew = dhcp_server.messages[0];
+  EXPECT_TRUE(renew.ms - bound_ms >= 50000 && renew.ms - bound_ms < 51000);
+  EXPECT_EQ(renew.type, 3);
+  EXPECT_TRUE(renew.dest_ip == kServerIp);
+  EXPECT_FALSE(renew.broadcast_flag);
+  EXPECT_TRUE(renew.ciaddr == IPAddress(192, 168, 1, 100));
+  EXPECT_TRUE(renew.requested_ip == kNoAddress);
+  EXPECT_TRUE(client.state() == DhcpClient::State::kBound);
+  EXPECT_EQ(socketsInUse(), 0);
+
+  // The server goes away: the client renews, then rebinds (broadcast) at T2,
+  // then the lease expires.
+  const uint32_t renewed_ms = renew.ms;
+  dhcp_server.running = false;
+  dhcp_server.messages.clear();
+  EXPECT_TRUE(pollFor(&client, DhcpClient::Event::kExpired, 200000) ==
+              DhcpClient::Event::kExpired);
+  const uint32_t expired_ms = millis();
+  EXPECT_TRUE(expired_ms - renewed_ms >= 100000 &&
+              expired_ms - renewed_ms < 101000);
+  bool renewed = false, rebound = false;
+  for (const Message& m : dhcp_server.messages) {
+    if (m.type == 3 && m.dest_ip == kServerIp) {
+      renewed = true;
+      EXPECT_FALSE(rebound);
+    } else if (m.type == 3 && m.dest_ip == kBroadcast) {
+      rebound = true;
+      EXPECT_TRUE(m.ciaddr == IPAddress(192, 168, 1, 100));
+      EXPECT_TRUE(m.ms - renewed_ms >= 87500);
+    }
+  }
+  EXPECT_TRUE(renewed);
+  EXPECT_TRUE(rebound);
+  // And starts over.
+  EXPECT_TRUE(client.state() == DhcpClient::State::kSelecting);
+  EXPECT_EQ(dhcp_server.messages.back().type, 1);
+  EXPECT_TRUE(dhcp_server.messages.back().requested_ip ==
+              IPAddress(192, 168, 1, 100));
+
+  // A renewal refused by the server ends the lease at once.
+  dhcp_server.running = true;
+  EXPECT_TRUE(pollFor(&client, DhcpClient::Event::kBound, 10000) ==
+              DhcpClient::Event::kBound);
+  dhcp_server.nak_renewals = true;
+  EXPECT_TRUE(pollFor(&client, DhcpClient::Event::kExpired, 60000) ==
+              DhcpClient::Event::kExpired);
+  client.end();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SimpleHttpServer: the time from boot (i.e. the start of setup) until the
+// first response to a request, measured with the virtual clock.
+
+SimpleHttpServer server(kEthernetShieldCS);
+uint16_t server_port = 0;
+
+void handler(const HttpRequest& request, EthernetClient* client) {
+  client->println("HTTP/1.1 200 OK");
+  client->println("Connection: close");
+  client->println();
+  client->print(Ethernet.localIP());
+}
+
+// Runs loop until the response to a request has arrived, returning the
+// response.
+std::string request() {
+  int fd = connectToServer(server_port);
+  EXPECT_TRUE(fd >= 0);
+  sendString(fd, "GET / HTTP/1.1\r\n\r\n");
+  char buf[256];
+  size_t len = 0;
+  while (!readSome(fd, buf, sizeof buf, &len)) {
+    server.loop(handler);
+    delay(1);
+  }
+  close(fd);
+  return buf;
+}
+
+// The time taken to write n bytes to the EEPROM, which is included in the
+// boot times below when the addresses or the lease are saved.
+constexpr uint32_t eepromWriteMs(uint32_t n) {
+  return (n * EEPROMClass::kMicrosPerWrite + 999) / 1000;
+}
+
+// Boots, and returns the time until the first response, printing it with
+// the label.
+uint32_t measureBoot(const char* label) {
+  dhcp_server.messages.clear();
+  const uint32_t start = millis();
+  EXPECT_TRUE(server.setup());
+  server_port = arduino_host::listeningPort(80);
+  const std::string response = request();
+  const uint32_t elapsed_ms = millis() - start;
+  EXPECT_TRUE(response.find("HTTP/1.1 200 OK") == 0);
+  Serial.print(label);
+  Serial.print(": first response after ");
+  Serial.print(elapsed_ms);
+  Serial.print(" ms, from ");
+  Serial.println(Ethernet.localIP());
+  return elapsed_ms;
+}
+
+void testBootTimes() {
+  arduino_host::setUseEphemeralPorts(true);
+  arduino_host::setRawFrameHandler(nullptr);
+  arduino_host::setMicrosPerClockCall(10);
+
+  // For comparison, the Ethernet library waits a minute before giving up.
+  EEPROM.erase();
+  resetServer();
+  dhcp_server.running = false;
+  uint32_t elapsed_ms = measureBoot("No DHCP server");
+  EXPECT_TRUE(elapsed_ms <= ArpProber::kMaxFinishMs +
+                                eepromWriteMs(Addresses::kEepromBytes) + 50);
+  EXPECT_EQ(Ethernet.localIP()[0], 169);
+  // The address was announced, and the socket freed.
+  EXPECT_EQ(W5100.readSnSR(0), SnSR::CLOSED);
+  DhcpLease lease;
+  EXPECT_FALSE(lease.load());
+
+  // A DHCP server, but no lease saved (e.g. a new device).
+  resetServer();
+  elapsed_ms = measureBoot("DHCP, no cached lease");
+  EXPECT_TRUE(elapsed_ms < eepromWriteMs(32) + 50);
+  EXPECT_TRUE(Ethernet.localIP() == IPAddress(192, 168, 1, 100));
+  EXPECT_TRUE(Ethernet.subnetMask() == IPAddress(255, 255, 255, 0));
+  EXPECT_TRUE(Ethernet.gatewayIP() == IPAddress(192, 168, 1, 1));
+  EXPECT_TRUE(Ethernet.dnsServerIP() == IPAddress(192, 168, 1, 53));
+  EXPECT_EQ(dhcp_server.count(1), 1);
+  // The probing was abandoned, without announcing the link-local address.
+  EXPECT_EQ(W5100.readSnSR(0), SnSR::CLOSED);
+  EXPECT_TRUE(lease.load());
+  EXPECT_TRUE(lease.ip == IPAddress(192, 168, 1, 100));
+
+  // Rebooted (e.g. after a power blip): the lease is reclaimed with a single
+  // request.
+  elapsed_ms = measureBoot("DHCP, cached lease");
+  EXPECT_TRUE(elapsed_ms < 50);
+  EXPECT_TRUE(Ethernet.localIP() == IPAddress(192, 168, 1, 100));
+  EXPECT_EQ(dhcp_server.messages.size(), 1);
+  EXPECT_EQ(dhcp_server.count(1), 0);
+
+  // The router was also power cycled, and takes 20 seconds to boot: the
+  // device serves on its link-local address meanwhile, then switches.
+  dhcp_server.answer_from_ms = millis() + 20000;
+  elapsed_ms = measureBoot("DHCP server booting");
+  EXPECT_TRUE(elapsed_ms <= ArpProber::kMaxFinishMs + 50);
+  EXPECT_EQ(Ethernet.localIP()[0], 169);
+  const uint32_t start = millis();
+  while (Ethernet.localIP()[0] == 169 && millis() - start < 60000) {
+    server.loop(handler);
+    delay(10);
+  }
+  EXPECT_TRUE(Ethernet.localIP() == IPAddress(192, 168, 1, 100));
+  Serial.print("  ... switched to the lease after ");
+  Serial.print(millis() - start + elapsed_ms);
+  Serial.println(" ms");
+  EXPECT_TRUE(request().find("192.168.1.100") != std::string::npos);
+
+  // The lease is lost, and the link-local address is used again until
+  // another is granted.
+  dhcp_server.nak_renewals = true;
+  bool lost = false;
+  const uint32_t renew_start = millis();
+  while (!lost && millis() - renew_start < 3600000) {
+    lost = !server.loop(handler);
+    delay(100);
+  }
+  EXPECT_TRUE(lost);
+  EXPECT_EQ(Ethernet.localIP()[0], 169);
+  EXPECT_TRUE(Ethernet.subnetMask() == IPAddress(255, 255, 0, 0));
+  dhcp_server.nak_renewals = false;
+
+  arduino_host::setMicrosPerClockCall(0);
+}
+
+void setup() {
+  Serial.begin(9600);
+  testLeaseSaveLoad();
+  testDiscovery();
+  testInitReboot();
+  testInitRebootNak();
+  testInitRebootSilent();
+  testRetransmission();
+  testRenewal();
+  testBootTimes();
+}
+
+void loop() {}
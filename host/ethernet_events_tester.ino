@@ -0,0 +1,207 @@
+// Host-only test of EthernetEvents, using the host's simulation of the
+// Wiznet chip's interrupts, and a benchmark of the CPU time used by a server
+// sketch when it polls versus when it sleeps between events; see
+// CMakeLists.txt.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Ethernet.h>
+
+#include <poll.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <thread>
+
+#include "arduino_host.h"
+#include "ethernet_events.h"
+#include "http_request.h"
+#include "http_test_client.h"
+#include "response_writer.h"
+#include "simple_http_server.h"
+#include "test.h"
+
+const uint8_t kInterruptPin = 2;
+
+int handled_requests = 0;
+
+void handleRequest(const HttpRequest& request, EthernetClient* client) {
+  ++handled_requests;
+  ResponseWriterBuffer<128> writer(client);
+  writer.beginResponse("200 OK", request);
+  writer.header("Content-Type", "text/plain");
+  writer.beginBody();
+  writer.print("Hello");
+  writer.endResponse();
+}
+
+SimpleHttpServer server(kEthernetShieldCS);
+uint16_t server_port = 0;
+
+void testBegin() {
+  EEPROM.erase();
+  arduino_host::setUseEphemeralPorts(true);
+  ASSERT_TRUE(server.setup());
+  server_port = arduino_host::listeningPort(80);
+  ASSERT_TRUE(server_port != 0);
+
+  // Pin 4 has no external interrupt.
+  EXPECT_FALSE(EthernetEvents::begin(4));
+  arduino_host::setEthernetInterruptPin(kInterruptPin);
+  ASSERT_TRUE(EthernetEvents::begin(kInterruptPin));
+  // Nothing has happened yet, though sleep returns at once after begin, in
+  // case INTn was already low.
+  EXPECT_TRUE(EthernetEvents::sleep(10));
+  EXPECT_FALSE(EthernetEvents::acknowledge());
+  EXPECT_EQ(digitalRead(kInterruptPin), HIGH);
+}
+
+void testSleepTimesOut() {
+  const unsigned long start_ms = millis();
+  const uint32_t sleeps = arduino_host::sleepCount();
+  EXPECT_FALSE(EthernetEvents::sleep(20));
+  EXPECT_TRUE(millis() - start_ms >= 20);
+  // Woken by each tick of the timer, though how many ticks that takes
+  // depends on how promptly the host wakes the (real) sleeps.
+  EXPECT_TRUE(arduino_host::sleepCount() - sleeps >= 1);
+}
+
+// Sleeps until woken by the chip, returning the (real) time taken.
+uint64_t sleepUntilWoken() {
+  const uint64_t start_us = arduino_host::hostMicros();
+  EXPECT_TRUE(EthernetEvents::sleep(1000));
+  return arduino_host::hostMicros() - start_us;
+}
+
+void testWakeForRequest() {
+  const uint32_t interrupts_before = EthernetEvents::interruptCount();
+  int fd = connectToServer(server_port);
+  ASSERT_TRUE(fd >= 0);
+  // Woken by the connection.
+  EXPECT_TRUE(sleepUntilWoken() < 100000);
+  EXPECT_EQ(digitalRead(kInterruptPin), LOW);
+  EXPECT_TRUE(EthernetEvents::acknowledge());
+  EXPECT_EQ(digitalRead(kInterruptPin), HIGH);
+  EXPECT_EQ(EthernetEvents::interruptCount(), interrupts_before + 1);
+  server.loop(handleRequest);
+  EXPECT_TRUE(server.idle());
+  EXPECT_EQ(server.activeConnections(), 1);
+  EXPECT_FALSE(EthernetEvents::sleep(5));
+
+  // Woken by the request, which is longer than the server reads per loop,
+  // so the server isn't idle until it has read all of it.
+  sendString(fd,
+             "GET /a/longer/path HTTP/1.1\r\nHost: arduino\r\n"
+             "User-Agent: curl/7.68.0\r\nAccept: */*\r\n\r\n");
+  EXPECT_TRUE(sleepUntilWoken() < 100000);
+  EXPECT_TRUE(EthernetEvents::acknowledge());
+  server.loop(handleRequest);
+  EXPECT_FALSE(server.idle());
+  int loops = 1;
+  while (!server.idle() && loops < 100) {
+    EthernetEvents::acknowledge();
+    server.loop(handleRequest);
+    ++loops;
+  }
+  EXPECT_TRUE(loops > 2);
+  EXPECT_EQ(handled_requests, 1);
+
+  char response[256];
+  size_t len = 0;
+  while (!readSome(fd, response, sizeof response, &len)) {
+  }
+  close(fd);
+  EXPECT_TRUE(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+
+  // The server was told of the disconnection.
+  EthernetEvents::sleep(1000);
+  EthernetEvents::acknowledge();
+  server.loop(handleRequest);
+  EXPECT_EQ(server.activeConnections(), 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark: a client polling the server every few milliseconds, as a sensor
+// dashboard might; the server either spins in loop() as usual, or sleeps
+// between events. Measures the CPU time used by the server, and the latency
+// of each request, from connecting to receiving the whole response.
+
+const int kPollRequests = 200;
+const int kPollIntervalMs = 5;
+uint32_t latencies_us[kPollRequests];
+std::atomic<bool> client_done;
+std::atomic<int> client_failures;
+
+void pollingClient() {
+  for (int r = 0; r < kPollRequests; ++r) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMs));
+    const uint64_t start_us = arduino_host::hostMicros();
+    int fd = connectToServer(server_port);
+    sendString(fd, "GET / HTTP/1.1\r\nConnection: close\r\n\r\n");
+    char response[256];
+    size_t len = 0;
+    while (!readSome(fd, response, sizeof response, &len)) {
+      pollfd pfd = {fd, POLLIN, 0};
+      poll(&pfd, 1, 100);
+    }
+    close(fd);
+    latencies_us[r] = arduino_host::hostMicros() - start_us;
+    if (strstr(response, "\r\n\r\nHello") == nullptr) {
+      ++client_failures;
+    }
+  }
+  client_done = true;
+}
+
+uint64_t threadCpuMicros() {
+  rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+void benchmark(const char* label, bool use_events) {
+  client_done = false;
+  client_failures = 0;
+  uint32_t loops = 0;
+  const uint32_t interrupts_before = EthernetEvents::interruptCount();
+  const uint64_t slept_before = arduino_host::sleptMicros();
+  const uint64_t cpu_before = threadCpuMicros();
+  const uint64_t start_us = arduino_host::hostMicros();
+  std::thread client(pollingClient);
+  while (!client_done) {
+    ++loops;
+    EthernetEvents::acknowledge();
+    server.loop(handleRequest);
+    if (use_events && server.idle()) {
+      EthernetEvents::sleep(100);
+    }
+  }
+  client.join();
+  const uint64_t elapsed_us = arduino_host::hostMicros() - start_us;
+  const uint64_t cpu_us = threadCpuMicros() - cpu_before;
+  const uint64_t slept_us = arduino_host::sleptMicros() - slept_before;
+  EXPECT_EQ(client_failures, 0);
+
+  printLatencies(label, latencies_us, kPollRequests, elapsed_us);
+  Serial.print("; loops/sec ");
+  Serial.print(static_cast<unsigned long>(loops * 1e6 / elapsed_us));
+  Serial.print(", CPU busy ");
+  Serial.print(100.0 * cpu_us / elapsed_us);
+  Serial.print("%, asleep ");
+  Serial.print(100.0 * slept_us / elapsed_us);
+  Serial.print("%, interrupts ");
+  Serial.println(EthernetEvents::interruptCount() - interrupts_before);
+}
+
+void setup() {
+  Serial.begin(9600);
+  testBegin();
+  testSleepTimesOut();
+  testWakeForRequest();
+
+  benchmark("Polling", false);
+  benchmark("Sleeping between events", true);
+}
+
+void loop() {}
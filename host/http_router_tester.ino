@@ -0,0 +1,330 @@
+// Host-only test and benchmark of HttpRouter; see CMakeLists.txt.
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <avr/pgmspace.h>
+
+#include "http_request.h"
+#include "http_router.h"
+#include "test.h"
+
+void handleRoute(const HttpRequest& request, EthernetClient* client) {}
+void handleOther(const HttpRequest& request, EthernetClient* client) {}
+
+#define ROUTE_PATH(name) constexpr char k_##name[] PROGMEM = "/" #name;
+
+ROUTE_PATH(a)
+ROUTE_PATH(b)
+constexpr char k_root[] PROGMEM = "/";
+constexpr char k_a_b[] PROGMEM = "/a/b";
+constexpr char k_ab[] PROGMEM = "/ab";
+
+constexpr HttpRoute kNestedRoutes[] PROGMEM = {
+    {k_root, handleOther},
+    {k_a, handleRoute},
+    {k_a_b, handleOther},
+    {k_ab, handleRoute},
+    {k_b, handleRoute},
+};
+static_assert(HttpRouter::isSorted(kNestedRoutes), "Not sorted");
+
+constexpr HttpRoute kUnsortedRoutes[] PROGMEM = {
+    {k_a, handleRoute},
+    {k_root, handleRoute},
+};
+static_assert(!HttpRouter::isSorted(kUnsortedRoutes), "Should be unsorted");
+constexpr HttpRoute kDuplicateRoutes[] PROGMEM = {
+    {k_a, handleRoute},
+    {k_a, handleRoute},
+};
+static_assert(!HttpRouter::isSorted(kDuplicateRoutes), "Has duplicates");
+
+void testFind() {
+  const HttpRouter router(kNestedRoutes);
+  EXPECT_EQ(router.find("/"), 0);
+  EXPECT_EQ(router.find("/?x=1"), 0);
+  EXPECT_EQ(router.find("/a"), 1);
+  EXPECT_EQ(router.find("/a/"), 1);
+  EXPECT_EQ(router.find("/a?b=c"), 1);
+  EXPECT_EQ(router.find("/a/c/b"), 1);
+  EXPECT_EQ(router.find("/a/b"), 2);
+  EXPECT_EQ(router.find("/a/b/c/d?e"), 2);
+  EXPECT_EQ(router.find("/a/bc"), 1);
+  EXPECT_EQ(router.find("/ab"), 3);
+  EXPECT_EQ(router.find("/ab/a"), 3);
+  EXPECT_EQ(router.find("/b"), 4);
+  // No match, and "/" isn't a prefix route.
+  EXPECT_EQ(router.find("/abc"), -1);
+  EXPECT_EQ(router.find("/c"), -1);
+  EXPECT_EQ(router.find("/c/a"), -1);
+  EXPECT_EQ(router.find(""), -1);
+  EXPECT_EQ(router.find("?a"), -1);
+  EXPECT_EQ(router.find("a"), -1);
+  EXPECT_TRUE(router.handler(0) == handleOther);
+  EXPECT_TRUE(router.handler(1) == handleRoute);
+  EXPECT_TRUE(router.handler(2) == handleOther);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark of HttpRouter::find against comparing the path with each route
+// in turn (i.e. a chain of if (strcmp...) else if ...), for tables of 4, 16
+// and 64 routes.
+
+ROUTE_PATH(alarm)
+ROUTE_PATH(ambient)
+ROUTE_PATH(api)
+ROUTE_PATH(battery)
+ROUTE_PATH(beacon)
+ROUTE_PATH(boot)
+ROUTE_PATH(calibrate)
+ROUTE_PATH(camera)
+ROUTE_PATH(clock)
+ROUTE_PATH(config)
+ROUTE_PATH(counters)
+ROUTE_PATH(debug)
+ROUTE_PATH(device)
+ROUTE_PATH(dew)
+ROUTE_PATH(door)
+ROUTE_PATH(eeprom)
+ROUTE_PATH(events)
+ROUTE_PATH(fan)
+ROUTE_PATH(firmware)
+ROUTE_PATH(flow)
+ROUTE_PATH(gate)
+ROUTE_PATH(gpio)
+ROUTE_PATH(health)
+ROUTE_PATH(heater)
+ROUTE_PATH(history)
+ROUTE_PATH(humidity)
+ROUTE_PATH(info)
+ROUTE_PATH(ir)
+ROUTE_PATH(lamp)
+ROUTE_PATH(leak)
+ROUTE_PATH(led)
+ROUTE_PATH(light)
+ROUTE_PATH(log)
+ROUTE_PATH(mac)
+ROUTE_PATH(metrics)
+ROUTE_PATH(moisture)
+ROUTE_PATH(motion)
+ROUTE_PATH(network)
+ROUTE_PATH(ota)
+ROUTE_PATH(power)
+ROUTE_PATH(pressure)
+ROUTE_PATH(pump)
+ROUTE_PATH(rain)
+ROUTE_PATH(relay)
+ROUTE_PATH(reset)
+ROUTE_PATH(rssi)
+ROUTE_PATH(schedule)
+ROUTE_PATH(sensors)
+ROUTE_PATH(servo)
+ROUTE_PATH(siren)
+ROUTE_PATH(soil)
+ROUTE_PATH(solar)
+ROUTE_PATH(status)
+ROUTE_PATH(switch)
+ROUTE_PATH(temperature)
+ROUTE_PATH(time)
+ROUTE_PATH(timers)
+ROUTE_PATH(uptime)
+ROUTE_PATH(valve)
+ROUTE_PATH(version)
+ROUTE_PATH(voltage)
+ROUTE_PATH(water)
+ROUTE_PATH(wind)
+ROUTE_PATH(zone)
+
+constexpr HttpRoute kRoutes4[] PROGMEM = {
+    {k_alarm, handleRoute},
+    {k_events, handleRoute},
+    {k_log, handleRoute},
+    {k_servo, handleRoute},
+};
+static_assert(HttpRouter::isSorted(kRoutes4), "kRoutes4 isn't sorted");
+
+constexpr HttpRoute kRoutes16[] PROGMEM = {
+    {k_alarm, handleRoute},
+    {k_beacon, handleRoute},
+    {k_clock, handleRoute},
+    {k_device, handleRoute},
+    {k_events, handleRoute},
+    {k_gate, handleRoute},
+    {k_history, handleRoute},
+    {k_lamp, handleRoute},
+    {k_log, handleRoute},
+    {k_motion, handleRoute},
+    {k_pressure, handleRoute},
+    {k_reset, handleRoute},
+    {k_servo, handleRoute},
+    {k_status, handleRoute},
+    {k_timers, handleRoute},
+    {k_voltage, handleRoute},
+};
+static_assert(HttpRouter::isSorted(kRoutes16), "kRoutes16 isn't sorted");
+
+constexpr HttpRoute kRoutes64[] PROGMEM = {
+    {k_alarm, handleRoute},
+    {k_ambient, handleRoute},
+    {k_api, handleRoute},
+    {k_battery, handleRoute},
+    {k_beacon, handleRoute},
+    {k_boot, handleRoute},
+    {k_calibrate, handleRoute},
+    {k_camera, handleRoute},
+    {k_clock, handleRoute},
+    {k_config, handleRoute},
+    {k_counters, handleRoute},
+    {k_debug, handleRoute},
+    {k_device, handleRoute},
+    {k_dew, handleRoute},
+    {k_door, handleRoute},
+    {k_eeprom, handleRoute},
+    {k_events, handleRoute},
+    {k_fan, handleRoute},
+    {k_firmware, handleRoute},
+    {k_flow, handleRoute},
+    {k_gate, handleRoute},
+    {k_gpio, handleRoute},
+    {k_health, handleRoute},
+    {k_heater, handleRoute},
+    {k_history, handleRoute},
+    {k_humidity, handleRoute},
+    {k_info, handleRoute},
+    {k_ir, handleRoute},
+    {k_lamp, handleRoute},
+    {k_leak, handleRoute},
+    {k_led, handleRoute},
+    {k_light, handleRoute},
+    {k_log, handleRoute},
+    {k_mac, handleRoute},
+    {k_metrics, handleRoute},
+    {k_moisture, handleRoute},
+    {k_motion, handleRoute},
+    {k_network, handleRoute},
+    {k_ota, handleRoute},
+    {k_power, handleRoute},
+    {k_pressure, handleRoute},
+    {k_pump, handleRoute},
+    {k_rain, handleRoute},
+    {k_relay, handleRoute},
+    {k_reset, handleRoute},
+    {k_rssi, handleRoute},
+    {k_schedule, handleRoute},
+    {k_sensors, handleRoute},
+    {k_servo, handleRoute},
+    {k_siren, handleRoute},
+    {k_soil, handleRoute},
+    {k_solar, handleRoute},
+    {k_status, handleRoute},
+    {k_switch, handleRoute},
+    {k_temperature, handleRoute},
+    {k_time, handleRoute},
+    {k_timers, handleRoute},
+    {k_uptime, handleRoute},
+    {k_valve, handleRoute},
+    {k_version, handleRoute},
+    {k_voltage, handleRoute},
+    {k_water, handleRoute},
+    {k_wind, handleRoute},
+    {k_zone, handleRoute},
+};
+static_assert(HttpRouter::isSorted(kRoutes64), "kRoutes64 isn't sorted");
+
+// The equivalent of a chain of comparisons of the path with each route.
+int8_t linearFind(const HttpRoute* routes, uint8_t num_routes,
+                  const char* path) {
+  int8_t result = -1;
+  size_t result_len = 0;
+  for (uint8_t i = 0; i < num_routes; ++i) {
+    const char* route = static_cast<const char*>(pgm_read_ptr(&routes[i].path));
+    const size_t len = strlen_P(route);
+    if (strncmp_P(path, route, len) != 0) {
+      continue;
+    }
+    const char c = path[len];
+    const bool is_root = len == 1;
+    if ((c == 0 || c == '?' || (c == '/' && !is_root)) && len > result_len) {
+      result = i;
+      result_len = len;
+    }
+  }
+  return result;
+}
+
+// Paths to look up: each of the routes of kRoutes64 (hence some which aren't
+// in the smaller tables), with a sub-path or query, plus some which match no
+// route.
+const int kMaxQueries = 64 * 3 + 4;
+char query_storage[kMaxQueries][24];
+const char* queries[kMaxQueries];
+int num_queries = 0;
+
+void addQuery(const char* a, const char* b) {
+  strcpy(query_storage[num_queries], a);
+  strcat(query_storage[num_queries], b);
+  queries[num_queries] = query_storage[num_queries];
+  ++num_queries;
+}
+
+void makeQueries() {
+  for (const HttpRoute& route : kRoutes64) {
+    addQuery(route.path, "");
+    addQuery(route.path, "/sub/path");
+    addQuery(route.path, "?q=1");
+  }
+  addQuery("/", "");
+  addQuery("/zzz", "");
+  addQuery("/relay", "s");
+  addQuery("/a", "/b/c");
+}
+
+volatile int benchmark_sink;
+
+template <size_t N>
+void benchmarkRoutes(const HttpRoute (&routes)[N]) {
+  const HttpRouter router(routes);
+  for (int q = 0; q < num_queries; ++q) {
+    if (router.find(queries[q]) != linearFind(routes, N, queries[q])) {
+      EXPECT_EQ(router.find(queries[q]), linearFind(routes, N, queries[q]));
+      Serial.println(queries[q]);
+    }
+  }
+
+  const int kRounds = 2000;
+  int sum = 0;
+  unsigned long start = BenchmarkMicros();
+  for (int round = 0; round < kRounds; ++round) {
+    for (int q = 0; q < num_queries; ++q) {
+      sum += router.find(queries[q]);
+    }
+  }
+  const unsigned long router_us = BenchmarkMicros() - start;
+  start = BenchmarkMicros();
+  for (int round = 0; round < kRounds; ++round) {
+    for (int q = 0; q < num_queries; ++q) {
+      sum += linearFind(routes, N, queries[q]);
+    }
+  }
+  const unsigned long linear_us = BenchmarkMicros() - start;
+  benchmark_sink = sum;
+
+  const float lookups = static_cast<float>(kRounds) * num_queries;
+  Serial.print(N);
+  Serial.print(" routes: HttpRouter::find ");
+  Serial.print(router_us * 1000.0 / lookups);
+  Serial.print(" ns/lookup, linear ");
+  Serial.print(linear_us * 1000.0 / lookups);
+  Serial.println(" ns/lookup");
+}
+
+void setup() {
+  Serial.begin(9600);
+  testFind();
+  makeQueries();
+  benchmarkRoutes(kRoutes4);
+  benchmarkRoutes(kRoutes16);
+  benchmarkRoutes(kRoutes64);
+}
+
+void loop() {}
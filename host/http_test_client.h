@@ -0,0 +1,86 @@
+#ifndef _ARDUINO_HOST_HTTP_TEST_CLIENT_H_
+#define _ARDUINO_HOST_HTTP_TEST_CLIENT_H_
+
+// Helpers for host-only testers which make HTTP requests of a server in the
+// same process. They use the host's sockets directly, rather than
+// EthernetClient, so that they don't take up any of the (simulated) chip's
+// sockets, which are all available to the server, as they would be on a
+// board.
+
+#include <Arduino.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Returns a socket connected to port on the loopback interface, and then made
+// non-blocking, or -1.
+inline int connectToServer(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  return fd;
+}
+
+inline void sendString(int fd, const char* str) {
+  send(fd, str, strlen(str), MSG_NOSIGNAL);
+}
+
+// Reads what has arrived on fd into buf (at *len), keeping it NUL
+// terminated. Returns true once the server has closed the connection (or
+// buf is full).
+inline bool readSome(int fd, char* buf, size_t size, size_t* len) {
+  while (true) {
+    ssize_t n = recv(fd, buf + *len, size - 1 - *len, MSG_DONTWAIT);
+    if (n > 0) {
+      *len += n;
+      buf[*len] = 0;
+      if (*len + 1 >= size) {
+        return true;
+      }
+    } else {
+      return n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+  }
+}
+
+inline int compareUint32(const void* a, const void* b) {
+  const uint32_t x = *static_cast<const uint32_t*>(a);
+  const uint32_t y = *static_cast<const uint32_t*>(b);
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Prints the rate of requests, and the median, 99th percentile and maximum
+// of the latencies, which are sorted in the process. Ends without a newline,
+// so that the caller can add more.
+inline void printLatencies(const char* label, uint32_t* latencies_us,
+                           long count, uint64_t elapsed_us) {
+  qsort(latencies_us, count, sizeof latencies_us[0], compareUint32);
+  Serial.print(label);
+  Serial.print(": ");
+  Serial.print(count * 1e6 / elapsed_us);
+  Serial.print(" requests/sec; latency us p50=");
+  Serial.print(latencies_us[count / 2]);
+  Serial.print(" p99=");
+  Serial.print(latencies_us[count * 99 / 100]);
+  Serial.print(" max=");
+  Serial.print(latencies_us[count - 1]);
+}
+
+}  // namespace
+
+#endif  // _ARDUINO_HOST_HTTP_TEST_CLIENT_H_
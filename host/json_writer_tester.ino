@@ -0,0 +1,586 @@
+// Host-only test of JsonWriter, including a fuzz test which checks that
+// randomly generated documents are parsed back (by a strict parser here, and
+// by Python's json module, if python3 is installed) to what was written, and
+// a benchmark of the bytes/sec written with it versus with a print call per
+// field; see CMakeLists.txt.
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "arduino_host.h"
+#include "json_writer.h"
+#include "test.h"
+#include "test_print.h"
+
+// Returns what f writes with a JsonWriter, or "MISUSED" if the writer
+// reports that it was misused.
+template <typename F>
+std::string json(F f) {
+  CapturePrint out;
+  JsonWriter writer(&out);
+  f(writer);
+  writer.flush();
+  return writer.ok() ? out.text : "MISUSED";
+}
+
+#define EXPECT_JSON(expected, ...) \
+  EXPECT_TRUE(json([](JsonWriter& w) { __VA_ARGS__; }) == expected)
+
+void testStructure() {
+  EXPECT_JSON("{}", w.beginObject(); w.endObject());
+  EXPECT_JSON("[]", w.beginArray(); w.endArray());
+  EXPECT_JSON("{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"e\"}}",
+              w.beginObject();
+              w.property("a", 1);
+              w.key(F("b"));
+              w.beginArray();
+              w.value(true);
+              w.value(false);
+              w.nullValue();
+              w.endArray();
+              w.key("c");
+              w.beginObject();
+              w.property(F("d"), F("e"));
+              w.endObject();
+              w.endObject());
+  EXPECT_JSON("[[],{},[[1]]]", w.beginArray(); w.beginArray(); w.endArray();
+              w.beginObject(); w.endObject(); w.beginArray(); w.beginArray();
+              w.value(1); w.endArray(); w.endArray(); w.endArray());
+  // Top level values.
+  EXPECT_JSON("\"x\"", w.value("x"));
+  EXPECT_JSON("null", w.value(static_cast<const char*>(nullptr)));
+
+  // Nested as deep as allowed.
+  CapturePrint out;
+  JsonWriter writer(&out);
+  for (int i = 0; i < JsonWriter::kMaxDepth; ++i) {
+    writer.beginArray();
+  }
+  EXPECT_FALSE(writer.complete());
+  for (int i = 0; i < JsonWriter::kMaxDepth; ++i) {
+    writer.endArray();
+  }
+  EXPECT_TRUE(writer.ok());
+  EXPECT_TRUE(writer.complete());
+  EXPECT_EQ(out.text.size(), 2 * JsonWriter::kMaxDepth);
+}
+
+void testMisuse() {
+  // Too deep.
+  EXPECT_JSON("MISUSED", for (int i = 0; i <= JsonWriter::kMaxDepth; ++i) {
+    w.beginArray();
+  });
+  // Ended, but not begun.
+  EXPECT_JSON("MISUSED", w.endObject());
+  EXPECT_JSON("MISUSED", w.beginArray(); w.endObject());
+  EXPECT_JSON("MISUSED", w.beginObject(); w.endArray());
+  // Keys outside of an object, and values without keys in one.
+  EXPECT_JSON("MISUSED", w.key("a"));
+  EXPECT_JSON("MISUSED", w.beginArray(); w.key("a"));
+  EXPECT_JSON("MISUSED", w.beginObject(); w.value(1));
+  // A key without a value.
+  EXPECT_JSON("MISUSED", w.beginObject(); w.key("a"); w.key("b"));
+  EXPECT_JSON("MISUSED", w.beginObject(); w.key("a"); w.endObject());
+}
+
+void testIntegers() {
+  EXPECT_JSON("[0,-1,32767,-32768,2147483647,-2147483648,4294967295]",
+              w.beginArray();
+              w.value(0);
+              w.value(-1);
+              w.value(32767);
+              w.value(-32768);
+              w.value(2147483647L);
+              w.value(-2147483647L - 1);
+              w.value(4294967295UL);
+              w.endArray());
+  EXPECT_JSON("[21.37,-21.37,0.05,-0.05,0.000000001,123]",
+              w.beginArray();
+              w.fixedValue(2137, 2);
+              w.fixedValue(-2137, 2);
+              w.fixedValue(5, 2);
+              w.fixedValue(-5, 2);
+              w.fixedValue(1, 9);
+              w.fixedValue(123, 0);
+              w.endArray());
+}
+
+void testFloats() {
+  // Rounded to nearest, unlike Print::print(double).
+  EXPECT_JSON("21.38", w.value(21.375f));
+  EXPECT_JSON("21.4", w.value(21.375f, 1));
+  EXPECT_JSON("21", w.value(21.375f, 0));
+  EXPECT_JSON("-21.375", w.value(-21.375f, 3));
+  EXPECT_JSON("0.10", w.value(0.1f));
+  EXPECT_JSON("0.00", w.value(0.0f));
+  // No negative zero.
+  EXPECT_JSON("0.00", w.value(-0.001f));
+  EXPECT_JSON("-0.01", w.value(-0.005f));
+  EXPECT_JSON("1.0000", w.value(0.99999f, 4));
+  EXPECT_JSON("67.30", w.value(67.3));
+  // Fewer digits for large values, and null if too large for any.
+  EXPECT_JSON("50000000.0", w.value(5e7f));
+  EXPECT_JSON("4000000000", w.value(4e9f));
+  EXPECT_JSON("null", w.value(5e9f));
+  EXPECT_JSON("[null,null,null]", w.beginArray(); w.value(NAN);
+              w.value(INFINITY); w.value(-INFINITY); w.endArray());
+  // Digits are limited to kMaxDigits.
+  EXPECT_JSON("0.500000000", w.value(0.5f, 20));
+}
+
+void testStrings() {
+  EXPECT_JSON("\"\"", w.value(""));
+  EXPECT_JSON("\"a\\\"b\\\\c/\"", w.value("a\"b\\c/"));
+  EXPECT_JSON("\"\\b\\f\\n\\r\\t\\u0001\\u001f \x7f\xc2\xb0\"",
+              w.value("\b\f\n\r\t\x01\x1f \x7f\xc2\xb0"));
+  // From flash, longer than the piece copied to RAM at a time.
+  EXPECT_JSON("{\"a long key, of more than 16 chars\\n\":\"0123456789abcdef\"}",
+              w.beginObject();
+              w.property(F("a long key, of more than 16 chars\n"),
+                         F("0123456789abcdef"));
+              w.endObject());
+  EXPECT_JSON("{\"ip\":\"192.168.1.20\"}", w.beginObject();
+              w.property("ip", IPAddress(192, 168, 1, 20)); w.endObject());
+
+}
+
+void testBuffering() {
+  CapturePrint out;
+  JsonWriter writer(&out);
+  writer.beginObject();
+  writer.property("twenty one chars", 1);
+  EXPECT_EQ(out.writes, 0);
+  // Fills the buffer.
+  writer.property("b", "more than the buffer has room for");
+  EXPECT_EQ(out.writes, 2);
+  EXPECT_TRUE(out.text ==
+              "{\"twenty one chars\":1,\"b\":"
+              "\"more than the buffer has room for");
+  writer.endObject();
+  // The top level value is complete.
+  EXPECT_EQ(out.writes, 3);
+  EXPECT_TRUE(out.text ==
+              "{\"twenty one chars\":1,\"b\":"
+              "\"more than the buffer has room for\"}");
+
+  out.text.clear();
+  writer.value(1);
+  EXPECT_TRUE(out.text == "1");
+  writer.beginArray();
+  writer.value(2);
+  writer.flush();
+  EXPECT_TRUE(out.text == "1[2");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Fuzz test: writes random documents (from a tree of Nodes), and checks that
+// a strict parser produces the same tree from the JSON.
+
+struct Node {
+  enum Type { kNull, kBool, kInteger, kFloat, kString, kArray, kObject };
+  Type type = kNull;
+  bool b = false;
+  double number = 0;
+  // For kFloat: the digits after the decimal point requested.
+  int digits = 0;
+  std::string str;
+  // Elements of an array, or values of an object.
+  std::vector<Node> children;
+  std::vector<std::string> keys;
+};
+
+std::string randomString() {
+  static const char* const kPieces[] = {
+      "a", "Z", "0", " ", "\"", "\\", "/", "\n", "\t", "\x01", "\x1f", "\x7f",
+      "\xc2\xb0", "\xe2\x82\xac", "\xf0\x9f\x8c\xa7", "temperature",
+  };
+  std::string s;
+  const int n = random(8);
+  for (int i = 0; i < n; ++i) {
+    s += kPieces[random(sizeof kPieces / sizeof kPieces[0])];
+  }
+  return s;
+}
+
+Node randomNode(int depth) {
+  Node node;
+  int type = random(depth < 5 ? 7 : 5);
+  node.type = static_cast<Node::Type>(type);
+  switch (node.type) {
+    case Node::kNull:
+      break;
+    case Node::kBool:
+      node.b = random(2);
+      break;
+    case Node::kInteger:
+      node.number =
+          random(2) ? random(-100, 100) : random(-2147483647L, 2147483647L);
+      break;
+    case Node::kFloat:
+      node.digits = random(5);
+      node.number = static_cast<float>((random(2000001) - 1000000) /
+                                       pow(10, random(7)));
+      break;
+    case Node::kString:
+      node.str = randomString();
+      break;
+    case Node::kArray:
+    case Node::kObject: {
+      const int n = random(5);
+      for (int i = 0; i < n; ++i) {
+        node.children.push_back(randomNode(depth + 1));
+        if (node.type == Node::kObject) {
+          node.keys.push_back(randomString());
+        }
+      }
+      break;
+    }
+  }
+  return node;
+}
+
+void writeNode(const Node& node, JsonWriter* writer) {
+  switch (node.type) {
+    case Node::kNull:
+      writer->nullValue();
+      break;
+    case Node::kBool:
+      writer->value(node.b);
+      break;
+    case Node::kInteger:
+      writer->value(static_cast<long>(node.number));
+      break;
+    case Node::kFloat:
+      writer->value(static_cast<float>(node.number), node.digits);
+      break;
+    case Node::kString:
+      writer->value(node.str.c_str());
+      break;
+    case Node::kArray:
+      writer->beginArray();
+      for (const Node& child : node.children) {
+        writeNode(child, writer);
+      }
+      writer->endArray();
+      break;
+    case Node::kObject:
+      writer->beginObject();
+      for (size_t i = 0; i < node.children.size(); ++i) {
+        writer->key(node.keys[i].c_str());
+        writeNode(node.children[i], writer);
+      }
+      writer->endObject();
+      break;
+  }
+}
+
+// A strict (RFC 8259) parser, apart from not validating UTF-8.
+class Parser {
+ public:
+  explicit Parser(const std::string& text) : p_(text.c_str()) {}
+
+  // Returns true if the text is a single JSON value.
+  bool parse(Node* node) { return parseValue(node) && *p_ == 0; }
+
+ private:
+  bool parseValue(Node* node) {
+    switch (*p_) {
+      case 'n':
+        node->type = Node::kNull;
+        return literal("null");
+      case 't':
+        node->type = Node::kBool;
+        node->b = true;
+        return literal("true");
+      case 'f':
+        node->type = Node::kBool;
+        node->b = false;
+        return literal("false");
+      case '"':
+        node->type = Node::kString;
+        return parseString(&node->str);
+      case '[':
+        node->type = Node::kArray;
+        ++p_;
+        if (*p_ == ']') {
+          ++p_;
+          return true;
+        }
+        while (true) {
+          node->children.emplace_back();
+          if (!parseValue(&node->children.back())) {
+            return false;
+          }
+          if (*p_ == ']') {
+            ++p_;
+            return true;
+          }
+          if (*p_++ != ',') {
+            return false;
+          }
+        }
+      case '{':
+        node->type = Node::kObject;
+        ++p_;
+        if (*p_ == '}') {
+          ++p_;
+          return true;
+        }
+        while (true) {
+          node->keys.emplace_back();
+          node->children.emplace_back();
+          if (!parseString(&node->keys.back()) || *p_++ != ':' ||
+              !parseValue(&node->children.back())) {
+            return false;
+          }
+          if (*p_ == '}') {
+            ++p_;
+            return true;
+          }
+          if (*p_++ != ',') {
+            return false;
+          }
+        }
+      default:
+        return parseNumber(node);
+    }
+  }
+
+  bool literal(const char* s) {
+    const size_t n = strlen(s);
+    if (strncmp(p_, s, n) != 0) {
+      return false;
+    }
+    p_ += n;
+    return true;
+  }
+
+  bool parseString(std::string* s) {
+    if (*p_++ != '"') {
+      return false;
+    }
+    while (true) {
+      const uint8_t c = *p_++;
+      if (c == '"') {
+        return true;
+      } else if (c < 0x20) {
+        return false;
+      } else if (c != '\\') {
+        *s += c;
+        continue;
+      }
+      switch (*p_++) {
+        case '"': *s += '"'; break;
+        case '\\': *s += '\\'; break;
+        case '/': *s += '/'; break;
+        case 'b': *s += '\b'; break;
+        case 'f': *s += '\f'; break;
+        case 'n': *s += '\n'; break;
+        case 'r': *s += '\r'; break;
+        case 't': *s += '\t'; break;
+        case 'u': {
+          char hex[5] = {0};
+          for (int i = 0; i < 4; ++i) {
+            if (!isxdigit(*p_)) {
+              return false;
+            }
+            hex[i] = *p_++;
+          }
+          const unsigned long code = strtoul(hex, nullptr, 16);
+          // Only control characters are escaped by JsonWriter.
+          if (code >= 0x80) {
+            return false;
+          }
+          *s += static_cast<char>(code);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+  }
+
+  bool parseNumber(Node* node) {
+    const char* start = p_;
+    if (*p_ == '-') {
+      ++p_;
+    }
+    if (*p_ == '0') {
+      ++p_;
+    } else if (*p_ >= '1' && *p_ <= '9') {
+      while (isdigit(*p_)) {
+        ++p_;
+      }
+    } else {
+      return false;
+    }
+    node->type = Node::kInteger;
+    if (*p_ == '.') {
+      ++p_;
+      if (!isdigit(*p_)) {
+        return false;
+      }
+      node->type = Node::kFloat;
+      while (isdigit(*p_)) {
+        ++p_;
+        ++node->digits;
+      }
+    }
+    // JsonWriter never writes exponents.
+    node->number = strtod(start, nullptr);
+    return true;
+  }
+
+  const char* p_;
+};
+
+// Returns true if actual (parsed) matches expected (written).
+bool sameNode(const Node& expected, const Node& actual) {
+  if (expected.type == Node::kFloat) {
+    // Written with the digits requested, or fewer if too large (and then
+    // perhaps as an integer).
+    const double tolerance =
+        0.5 / pow(10, actual.digits) + fabs(expected.number) * 1e-6;
+    return (actual.type == Node::kFloat || actual.type == Node::kInteger) &&
+           actual.digits <= expected.digits &&
+           fabs(actual.number - expected.number) <= tolerance;
+  }
+  if (expected.type != actual.type || expected.b != actual.b ||
+      expected.number != actual.number || expected.str != actual.str ||
+      expected.keys != actual.keys ||
+      expected.children.size() != actual.children.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < expected.children.size(); ++i) {
+    if (!sameNode(expected.children[i], actual.children[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void testFuzz() {
+  randomSeed(1234);
+  const int kDocuments = 2000;
+  std::string all;
+  int failures = 0;
+  for (int i = 0; i < kDocuments; ++i) {
+    const Node document = randomNode(0);
+    CapturePrint out;
+    JsonWriter writer(&out);
+    writeNode(document, &writer);
+    EXPECT_TRUE(writer.ok() && writer.complete());
+    Node parsed;
+    if (!Parser(out.text).parse(&parsed) || !sameNode(document, parsed)) {
+      if (++failures <= 3) {
+        Serial.print("Mismatch: ");
+        Serial.println(out.text.c_str());
+      }
+    }
+    all += out.text;
+    all += '\n';
+  }
+  EXPECT_EQ(failures, 0);
+
+  // Python's parser, as a reference; skipped if there's no python3.
+  FILE* python = popen(
+      "python3 -c 'import json, sys\n"
+      "for line in sys.stdin.buffer: json.loads(line)' 2>&1",
+      "w");
+  ASSERT_TRUE(python != nullptr);
+  fwrite(all.data(), 1, all.size(), python);
+  const int status = pclose(python);
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+    Serial.println("python3 not found; skipped checking with its parser");
+  } else {
+    EXPECT_EQ(status, 0);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark: writes an array of readings, as in a response with the sensor's
+// history, with JsonWriter and with a print call per field.
+
+const int kReadings = 1000;
+float temperatures[kReadings];
+float pressures[kReadings];
+
+void writeReadingsByHand(Print* out) {
+  out->print("[");
+  for (int i = 0; i < kReadings; ++i) {
+    if (i > 0) {
+      out->print(",");
+    }
+    out->print("{\"t\":");
+    out->print(i);
+    out->print(",\"temperature\":");
+    out->print(temperatures[i]);
+    out->print(",\"pressure\":");
+    out->print(pressures[i], 1);
+    out->print("}");
+  }
+  out->print("]");
+}
+
+void writeReadingsWithJsonWriter(Print* out) {
+  JsonWriter json(out);
+  json.beginArray();
+  for (int i = 0; i < kReadings; ++i) {
+    json.beginObject();
+    json.property(F("t"), i);
+    json.property(F("temperature"), temperatures[i]);
+    json.property(F("pressure"), pressures[i], 1);
+    json.endObject();
+  }
+  json.endArray();
+}
+
+void benchmark(const char* label, void (*write_readings)(Print*)) {
+  const int kRepeats = 20;
+  CountingPrint out;
+  const unsigned long start_us = BenchmarkMicros();
+  for (int r = 0; r < kRepeats; ++r) {
+    write_readings(&out);
+  }
+  const unsigned long elapsed_us = BenchmarkMicros() - start_us;
+  Serial.print(label);
+  Serial.print(": ");
+  Serial.print(out.bytes / kRepeats);
+  Serial.print(" bytes, ");
+  Serial.print(out.writes / kRepeats);
+  Serial.print(" writes, ");
+  Serial.print(static_cast<float>(out.bytes) / elapsed_us);
+  Serial.println(" MB/sec");
+}
+
+void benchmarks() {
+  randomSeed(42);
+  for (int i = 0; i < kReadings; ++i) {
+    temperatures[i] = random(-4000, 4000) / 100.0;
+    pressures[i] = random(950000, 1050000) / 10.0;
+  }
+  benchmark("Print per field", writeReadingsByHand);
+  benchmark("JsonWriter     ", writeReadingsWithJsonWriter);
+}
+
+void setup() {
+  Serial.begin(9600);
+  testStructure();
+  testMisuse();
+  testIntegers();
+  testFloats();
+  testStrings();
+  testBuffering();
+  testFuzz();
+  benchmarks();
+}
+
+void loop() {}
@@ -0,0 +1,176 @@
+// Host-only test of MetricRegistry and the metrics, including those updated
+// by SimpleHttpServer; see CMakeLists.txt.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Ethernet.h>
+
+#include <string>
+
+#include "arduino_host.h"
+#include "http_request.h"
+#include "http_test_client.h"
+#include "metrics.h"
+#include "simple_http_server.h"
+#include "test.h"
+#include "test_print.h"
+
+constexpr char kRelayName[] PROGMEM = "relay";
+constexpr char kRelayHelp[] PROGMEM = "1 if it is raining.";
+constexpr char kTempName[] PROGMEM = "temperature_celsius";
+constexpr char kReadsName[] PROGMEM = "sensor_reads_total";
+constexpr char kReadsHelp[] PROGMEM = "Reads of the sensor.";
+constexpr char kReadTimeName[] PROGMEM = "sensor_read_microseconds";
+constexpr uint32_t kReadTimeBounds[] PROGMEM = {100, 1000, 10000};
+
+void testExposition() {
+  MetricRegistry registry;
+  Gauge relay(&registry, kRelayName, kRelayHelp, 0);
+  Gauge temperature(&registry, kTempName, nullptr);
+  Counter reads(&registry, kReadsName, kReadsHelp);
+  HistogramBuffer<3> read_time(&registry, kReadTimeName, nullptr,
+                               kReadTimeBounds);
+
+  CapturePrint out;
+  registry.printTo(&out);
+  EXPECT_TRUE(out.text ==
+              "# HELP relay 1 if it is raining.\n"
+              "# TYPE relay gauge\n"
+              "relay NaN\n"
+              "# TYPE temperature_celsius gauge\n"
+              "temperature_celsius NaN\n"
+              "# HELP sensor_reads_total Reads of the sensor.\n"
+              "# TYPE sensor_reads_total counter\n"
+              "sensor_reads_total 0\n"
+              "# TYPE sensor_read_microseconds histogram\n"
+              "sensor_read_microseconds_bucket{le=\"100\"} 0\n"
+              "sensor_read_microseconds_bucket{le=\"1000\"} 0\n"
+              "sensor_read_microseconds_bucket{le=\"10000\"} 0\n"
+              "sensor_read_microseconds_bucket{le=\"+Inf\"} 0\n"
+              "sensor_read_microseconds_sum 0\n"
+              "sensor_read_microseconds_count 0\n");
+
+  relay.set(1);
+  temperature.set(21.25);
+  reads.increment();
+  reads.increment(2);
+  EXPECT_EQ(reads.value(), 3);
+  // Bounds are inclusive.
+  read_time.observe(100);
+  read_time.observe(1100);
+  read_time.observe(1000);
+  read_time.observe(4000000000UL);
+  read_time.observe(4000000000UL);
+  EXPECT_EQ(read_time.count(), 5);
+  EXPECT_TRUE(read_time.sum() == 8000002200ULL);
+
+  out.text.clear();
+  registry.printTo(&out);
+  EXPECT_TRUE(out.text ==
+              "# HELP relay 1 if it is raining.\n"
+              "# TYPE relay gauge\n"
+              "relay 1\n"
+              "# TYPE temperature_celsius gauge\n"
+              "temperature_celsius 21.25\n"
+              "# HELP sensor_reads_total Reads of the sensor.\n"
+              "# TYPE sensor_reads_total counter\n"
+              "sensor_reads_total 3\n"
+              "# TYPE sensor_read_microseconds histogram\n"
+              "sensor_read_microseconds_bucket{le=\"100\"} 1\n"
+              "sensor_read_microseconds_bucket{le=\"1000\"} 2\n"
+              "sensor_read_microseconds_bucket{le=\"10000\"} 3\n"
+              "sensor_read_microseconds_bucket{le=\"+Inf\"} 5\n"
+              "sensor_read_microseconds_sum 8000002200\n"
+              "sensor_read_microseconds_count 5\n");
+
+  temperature.set(-INFINITY);
+  out.text.clear();
+  registry.printTo(&out);
+  EXPECT_TRUE(out.text.find("\ntemperature_celsius -Inf\n") !=
+              std::string::npos);
+}
+
+void testEmptyRegistry() {
+  MetricRegistry registry;
+  CapturePrint out;
+  registry.printTo(&out);
+  EXPECT_TRUE(out.text.empty());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Serving the metrics of a SimpleHttpServer.
+
+MetricRegistry metrics;
+HttpServerMetrics server_metrics(&metrics);
+SimpleHttpServer server(kEthernetShieldCS);
+uint16_t server_port = 0;
+
+void handleRequest(const HttpRequest& request, EthernetClient* client) {
+  metrics.sendResponse(request, client);
+}
+
+// Makes the request, returning the response.
+std::string makeRequest(const char* request) {
+  int fd = connectToServer(server_port);
+  if (fd < 0) {
+    return "";
+  }
+  sendString(fd, request);
+  static char response[4096];
+  size_t len = 0;
+  response[0] = 0;
+  for (int i = 0; i < 10000; ++i) {
+    server.loop(handleRequest);
+    if (readSome(fd, response, sizeof response, &len)) {
+      break;
+    }
+  }
+  close(fd);
+  return response;
+}
+
+void testServerMetrics() {
+  EEPROM.erase();
+  arduino_host::setUseEphemeralPorts(true);
+  ASSERT_TRUE(server.setup());
+  server_port = arduino_host::listeningPort(80);
+  ASSERT_TRUE(server_port != 0);
+  server.setMetrics(&server_metrics);
+
+  makeRequest("GET / HTTP/1.1\r\nNo colon\r\n\r\n");
+  EXPECT_EQ(server_metrics.parse_errors.value(), 1);
+  EXPECT_EQ(server_metrics.requests.value(), 0);
+
+  const std::string response = makeRequest("GET /metrics HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(server_metrics.requests.value(), 1);
+  EXPECT_TRUE(response.find("HTTP/1.1 200 OK\r\n") == 0);
+  EXPECT_TRUE(
+      response.find("\r\nContent-Type: text/plain; version=0.0.4\r\n") !=
+      std::string::npos);
+  // Too large for one write, so chunked.
+  EXPECT_TRUE(response.find("\r\nTransfer-Encoding: chunked\r\n") !=
+              std::string::npos);
+  EXPECT_TRUE(response.size() > 5 &&
+              response.compare(response.size() - 5, 5, "0\r\n\r\n") == 0);
+
+  CapturePrint out;
+  metrics.printTo(&out);
+  EXPECT_TRUE(out.text.find("\nhttp_requests_total 1\n") != std::string::npos);
+  EXPECT_TRUE(out.text.find("\nhttp_request_parse_errors_total 1\n") !=
+              std::string::npos);
+  EXPECT_TRUE(out.text.find("\ndhcp_renew_failures_total 0\n") !=
+              std::string::npos);
+  // Every call of loop after the first is recorded.
+  EXPECT_TRUE(server_metrics.loop_time.count() > 0);
+  EXPECT_TRUE(out.text.find("\nloop_iteration_microseconds_count ") !=
+              std::string::npos);
+}
+
+void setup() {
+  Serial.begin(9600);
+  testExposition();
+  testEmptyRegistry();
+  testServerMetrics();
+}
+
+void loop() {}
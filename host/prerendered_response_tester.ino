@@ -0,0 +1,226 @@
+// Host-only test of PrerenderedResponse, including a load test comparing the
+// latency of requests served from a PrerenderedResponse with that of requests
+// which read a (simulated) sensor and format the response each time, as
+// RainSensorWebServer used to; see CMakeLists.txt.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Ethernet.h>
+
+#include "arduino_host.h"
+#include "http_request.h"
+#include "http_test_client.h"
+#include "prerendered_response.h"
+#include "simple_http_server.h"
+#include "test.h"
+
+void testRender() {
+  PrerenderedResponseBuffer<128> response;
+  EXPECT_FALSE(response.ready());
+  EXPECT_EQ(response.size(), 0);
+
+  response.startBody();
+  response.print("{\"relay\":");
+  response.print(1);
+  response.print(", \"object\":");
+  response.print(12.5);
+  response.print("}");
+  EXPECT_FALSE(response.ready());
+  ASSERT_TRUE(response.finish("application/json"));
+  EXPECT_TRUE(response.ready());
+  const char kExpected[] =
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: 27\r\n"
+      "\r\n"
+      "{\"relay\":1, \"object\":12.50}";
+  EXPECT_EQ(response.size(), strlen(kExpected));
+  EXPECT_EQ(strncmp(response.data(), kExpected, response.size()), 0);
+
+  // Can't add to a finished response.
+  EXPECT_EQ(response.print("x"), 0);
+  EXPECT_EQ(response.size(), strlen(kExpected));
+
+  // Starting again discards the response.
+  response.startBody();
+  EXPECT_FALSE(response.ready());
+  ASSERT_TRUE(response.finish("text/plain"));
+  const char kEmpty[] =
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: text/plain\r\n"
+      "Content-Length: 0\r\n\r\n";
+  EXPECT_EQ(response.size(), strlen(kEmpty));
+  EXPECT_EQ(strncmp(response.data(), kEmpty, response.size()), 0);
+}
+
+void testOverflow() {
+  // Room for a body of 4 bytes.
+  PrerenderedResponseBuffer<PrerenderedResponse::kHeaderSpace + 4> response;
+  response.startBody();
+  EXPECT_EQ(response.print("1234"), 4);
+  EXPECT_TRUE(response.finish("text/plain"));
+  EXPECT_EQ(strncmp(response.data(), "HTTP/1.1 200 OK\r\n"
+                                     "Content-Type: text/plain\r\n"
+                                     "Content-Length: 4\r\n\r\n1234",
+                    response.size()),
+            0);
+
+  response.startBody();
+  EXPECT_EQ(response.print("12345"), 0);
+  EXPECT_FALSE(response.finish("text/plain"));
+  EXPECT_FALSE(response.ready());
+
+  // The headers don't fit.
+  response.startBody();
+  EXPECT_FALSE(response.finish(
+      "application/a-very-long-content-type-that-will-not-fit-in-the-space"));
+  EXPECT_FALSE(response.ready());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Load test: several monitoring hosts polling at once, served either by
+// reading the sensor and formatting the response for each request, or from a
+// PrerenderedResponse.
+
+// Reading the MLX90614 over I2C takes just over a millisecond.
+const uint32_t kSensorReadMicros = 1100;
+
+struct Readings {
+  int relay;
+  float object;
+  float ambient;
+};
+
+Readings readSensors() {
+  const uint64_t start = arduino_host::hostMicros();
+  while (arduino_host::hostMicros() - start < kSensorReadMicros) {
+  }
+  return Readings{1, 21.37, 19.02};
+}
+
+void handleUncached(const HttpRequest& request, EthernetClient* client) {
+  const Readings readings = readSensors();
+  client->println("HTTP/1.1 200 OK");
+  client->println("Content-Type: application/json");
+  client->println();
+  client->print("{\"relay\":");
+  client->print(readings.relay);
+  client->print(", \"object\":");
+  client->print(readings.object);
+  client->print(", \"ambient\":");
+  client->print(readings.ambient);
+  client->println("}");
+}
+
+PrerenderedResponseBuffer<160> cached_response;
+
+void renderReadings() {
+  const Readings readings = readSensors();
+  cached_response.startBody();
+  cached_response.print("{\"relay\":");
+  cached_response.print(readings.relay);
+  cached_response.print(", \"object\":");
+  cached_response.print(readings.object);
+  cached_response.print(", \"ambient\":");
+  cached_response.print(readings.ambient);
+  cached_response.print("}");
+  cached_response.finish("application/json");
+}
+
+void handleCached(const HttpRequest& request, EthernetClient* client) {
+  cached_response.send(client);
+}
+
+SimpleHttpServer server(kEthernetShieldCS);
+uint16_t server_port = 0;
+
+void testServeCached() {
+  renderReadings();
+  int fd = connectToServer(server_port);
+  ASSERT_TRUE(fd >= 0);
+  sendString(fd, "GET / HTTP/1.1\r\n\r\n");
+  char response[256];
+  size_t len = 0;
+  for (int i = 0; i < 10000; ++i) {
+    server.loop(handleCached);
+    if (readSome(fd, response, sizeof response, &len)) {
+      break;
+    }
+  }
+  close(fd);
+  EXPECT_EQ(len, cached_response.size());
+  const char* body = strstr(response, "\r\n\r\n");
+  ASSERT_TRUE(body != nullptr);
+  body += 4;
+  EXPECT_TRUE(strstr(response, "Content-Length: 44\r\n") != nullptr);
+  EXPECT_EQ(strlen(body), 44);
+}
+
+void loadTest(const char* label, SimpleHttpServer::RequestFunc handler) {
+  const int kClients = 4;
+  const long kRequests = 1000;
+  static uint32_t latencies_us[kRequests];
+  long completed = 0;
+  long failures = 0;
+  int fds[kClients];
+  uint64_t start_us[kClients];
+  size_t received[kClients];
+  char responses[kClients][256];
+  for (int c = 0; c < kClients; ++c) {
+    fds[c] = -1;
+  }
+
+  const uint64_t begin_us = arduino_host::hostMicros();
+  while (completed < kRequests) {
+    for (int c = 0; c < kClients; ++c) {
+      if (fds[c] < 0) {
+        fds[c] = connectToServer(server_port);
+        start_us[c] = arduino_host::hostMicros();
+        received[c] = 0;
+        sendString(fds[c], "GET / HTTP/1.1\r\nHost: rainsensor\r\n\r\n");
+      }
+      if (readSome(fds[c], responses[c], sizeof responses[c], &received[c])) {
+        const uint32_t latency_us = arduino_host::hostMicros() - start_us[c];
+        if (strstr(responses[c], "\"ambient\":19.02}") == nullptr) {
+          ++failures;
+        }
+        close(fds[c]);
+        fds[c] = -1;
+        if (completed < kRequests) {
+          latencies_us[completed++] = latency_us;
+        }
+      }
+      server.loop(handler);
+    }
+  }
+  const uint64_t elapsed_us = arduino_host::hostMicros() - begin_us;
+  for (int c = 0; c < kClients; ++c) {
+    if (fds[c] >= 0) {
+      close(fds[c]);
+    }
+  }
+  for (int i = 0; i < 100; ++i) {
+    server.loop(handler);
+  }
+  EXPECT_EQ(failures, 0);
+  printLatencies(label, latencies_us, kRequests, elapsed_us);
+  Serial.println();
+}
+
+void setup() {
+  Serial.begin(9600);
+  testRender();
+  testOverflow();
+
+  EEPROM.erase();
+  arduino_host::setUseEphemeralPorts(true);
+  ASSERT_TRUE(server.setup());
+  server_port = arduino_host::listeningPort(80);
+  ASSERT_TRUE(server_port != 0);
+
+  testServeCached();
+  loadTest("4 clients, uncached", handleUncached);
+  loadTest("4 clients, cached", handleCached);
+}
+
+void loop() {}
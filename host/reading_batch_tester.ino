@@ -0,0 +1,362 @@
+// Host-only test of ReadingBatch, and a simulation of a battery powered
+// sensor using it (as in sketch_dec25a_report_to_adafruit), against a fake
+// access point and HTTP server, which reports the modeled energy used per
+// reading for several batch sizes; see CMakeLists.txt.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "arduino_host.h"
+#include "json_writer.h"
+#include "reading_batch.h"
+#include "test.h"
+#include "test_print.h"
+
+// The RTC user memory, which survives deep sleep, but not power off.
+uint32_t rtc_memory[128];
+
+// Copies the batch in and out of rtc_memory, as a sketch would with
+// ESP.rtcUserMemoryRead and rtcUserMemoryWrite.
+void readRtc(ReadingBatch* batch) {
+  memcpy(batch->words(), rtc_memory, sizeof *batch);
+}
+void writeRtc(ReadingBatch* batch) {
+  memcpy(rtc_memory, batch->words(), sizeof *batch);
+}
+
+void testBeginAfterPowerOn() {
+  memset(rtc_memory, 0xA5, sizeof rtc_memory);
+  ReadingBatch batch;
+  readRtc(&batch);
+  EXPECT_FALSE(batch.begin(4));
+  EXPECT_EQ(batch.count(), 0);
+  EXPECT_EQ(batch.wakes(), 0);
+  EXPECT_EQ(batch.dropped(), 0);
+
+  const int16_t values[ReadingBatch::kChannels] = {2150, 4312, 4400, 3380};
+  batch.startWake();
+  batch.add(values);
+  batch.seal();
+  writeRtc(&batch);
+
+  // As after a deep sleep.
+  ReadingBatch batch2;
+  readRtc(&batch2);
+  EXPECT_TRUE(batch2.begin(4));
+  EXPECT_EQ(batch2.count(), 1);
+  EXPECT_EQ(batch2.wakes(), 1);
+  EXPECT_EQ(batch2.reading(0).values[1], 4312);
+
+  // A corrupted byte is detected.
+  reinterpret_cast<uint8_t*>(rtc_memory)[30] ^= 1;
+  readRtc(&batch2);
+  EXPECT_FALSE(batch2.begin(4));
+  EXPECT_EQ(batch2.count(), 0);
+}
+
+void testSchedule() {
+  ReadingBatch batch;
+  batch.reset(3);
+  const int16_t values[ReadingBatch::kChannels] = {};
+  // Uploads every 3rd wake, and the radio is needed only for those.
+  std::string radio, due;
+  for (int i = 0; i < 7; ++i) {
+    radio += batch.radioNeededNextWake() ? 'R' : '-';
+    batch.startWake();
+    batch.add(values);
+    due += batch.uploadDue() ? 'U' : '-';
+    if (batch.uploadDue()) {
+      EXPECT_EQ(batch.count(), 3);
+      batch.uploadSucceeded();
+      EXPECT_EQ(batch.count(), 0);
+    }
+  }
+  EXPECT_TRUE(due == "--U--U-");
+  EXPECT_TRUE(radio == "--R--R-");
+
+  // A batch size of 1 reports every wake, as before batching.
+  batch.reset(1);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(batch.radioNeededNextWake());
+    batch.startWake();
+    EXPECT_TRUE(batch.uploadDue());
+    batch.uploadSucceeded();
+  }
+}
+
+void testRetries() {
+  ReadingBatch batch;
+  batch.reset(8);
+  int16_t values[ReadingBatch::kChannels] = {};
+  // Fail every upload: retries after 1, 2, 4 and then every 8 wakes.
+  std::string due;
+  for (int i = 0; i < 40; ++i) {
+    batch.startWake();
+    values[0] = i;
+    batch.add(values);
+    if (batch.uploadDue()) {
+      due += std::to_string(i) + ",";
+      batch.uploadFailed();
+    }
+  }
+  EXPECT_TRUE(due == "7,8,10,14,22,30,38,");
+  EXPECT_EQ(batch.failures(), 7);
+  EXPECT_EQ(batch.count(), 40);
+  EXPECT_EQ(batch.dropped(), 0);
+
+  // Once the queue is full, the oldest readings are discarded.
+  for (int i = 40; i < 70; ++i) {
+    batch.startWake();
+    values[0] = i;
+    batch.add(values);
+  }
+  EXPECT_EQ(batch.count(), ReadingBatch::kCapacity);
+  EXPECT_EQ(batch.dropped(), 70 - ReadingBatch::kCapacity);
+  EXPECT_EQ(batch.reading(0).values[0], 70 - ReadingBatch::kCapacity);
+  EXPECT_EQ(batch.reading(ReadingBatch::kCapacity - 1).values[0], 69);
+
+  // A success resets the schedule.
+  batch.uploadSucceeded();
+  EXPECT_EQ(batch.failures(), 0);
+  EXPECT_EQ(batch.count(), 0);
+  EXPECT_FALSE(batch.radioNeededNextWake());
+}
+
+void testWriteJson() {
+  ReadingBatch batch;
+  batch.reset(4);
+  const uint8_t kDigits[ReadingBatch::kChannels] = {2, 2, 2, 3};
+  int16_t values[ReadingBatch::kChannels] = {2164, 3112, 3180, 3380};
+  batch.startWake();
+  batch.add(values);
+  batch.startWake();
+  batch.startWake();
+  values[0] = -5;
+  batch.add(values);
+
+  CapturePrint out;
+  JsonWriter json(&out);
+  batch.writeJson(&json, kDigits);
+  EXPECT_TRUE(out.text == "[[2,21.64,31.12,31.80,3.380],"
+                         "[0,-0.05,31.12,31.80,3.380]]");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The simulation. The currents and durations are rough figures for an
+// Adafruit Feather HUZZAH ESP8266 with an HTU21D-F, from the ESP8266
+// datasheet and the timings noted in the sketches (e.g. around 10 seconds
+// awake per report, most of it connecting to the access point); what
+// matters here is how they add up for different batch sizes.
+
+constexpr float kVolts = 3.3;
+constexpr float kSleepMa = 0.02;
+constexpr float kCpuMa = 15;   // Awake, with the radio disabled.
+constexpr float kRadioMa = 75;  // Awake, with the radio on (mostly receiving).
+constexpr float kTransmitMa = 170;
+constexpr float kBootSecs = 0.1;
+constexpr float kRfCalibrationSecs = 0.2;  // Skipped if WAKE_RF_DISABLED.
+constexpr float kMeasureSecs = 1.1;        // 16 readings of each.
+constexpr float kAssociateSecs = 4;        // Access point and DHCP.
+constexpr float kAssociateTimeoutSecs = 10;
+constexpr float kRequestSecs = 0.8;  // Connect, send, and wait for the reply.
+constexpr float kTransmitBytesPerSec = 125000;
+constexpr float kIntervalSecs = 124;
+
+// The modeled charge used, in mA seconds.
+struct Energy {
+  void add(float ma, float secs) {
+    mas += ma * secs;
+    awake_secs += secs;
+  }
+  float mas = 0;
+  float awake_secs = 0;
+};
+
+// A fake access point and HTTP server, which receives the batches, and
+// checks that each reading is received once, in order.
+class FakeNetwork {
+ public:
+  // Returns true if the access point is reachable (with probability
+  // 1 - failure_rate, unless down), adding the time spent to energy.
+  bool associate(bool radio_enabled, Energy* energy) {
+    if (!radio_enabled || down || random(1000) < failure_rate * 1000) {
+      energy->add(kRadioMa, kAssociateTimeoutSecs);
+      return false;
+    }
+    energy->add(kRadioMa, kAssociateSecs);
+    return true;
+  }
+
+  // POSTs the body, returning true if it was received.
+  bool post(const std::string& body, Energy* energy) {
+    // Request line and headers.
+    const size_t bytes = body.size() + 200;
+    energy->add(kRadioMa, kRequestSecs);
+    energy->add(kTransmitMa - kRadioMa, bytes / kTransmitBytesPerSec);
+    ++posts;
+    receive(body);
+    return true;
+  }
+
+  // Parses the readings, [[age,value,...],...], where the first value is the
+  // wake on which it was taken, and checks that the age agrees.
+  void receive(const std::string& body) {
+    const char* p = strstr(body.c_str(), "\"wake\":");
+    const long wake = strtol(p + 7, nullptr, 10);
+    p = strstr(body.c_str(), "\"readings\":[");
+    p += 12;
+    while (*p == '[' || *p == ',') {
+      if (*p == ',') {
+        ++p;
+      }
+      char* end;
+      const long age = strtol(p + 1, &end, 10);
+      const long taken = static_cast<long>(strtod(end + 1, &end) + 0.5);
+      if (taken != wake - age || taken <= last_received) {
+        ++errors;
+      }
+      last_received = taken;
+      ++received;
+      p = strchr(end, ']') + 1;
+    }
+  }
+
+  float failure_rate = 0;
+  bool down = false;
+  long posts = 0;
+  long received = 0;
+  long last_received = 0;
+  long errors = 0;
+};
+
+struct SimulationResult {
+  float ua_hours_per_reading;
+  float mj_per_reading;
+  float awake_secs_per_wake;
+  long radio_wakes;
+  long posts;
+  long received;
+  long dropped;
+  long errors;
+};
+
+// Simulates wakes of a sensor using ReadingBatch, as in the sketch.
+SimulationResult simulate(uint8_t batch_size, float failure_rate, long wakes,
+                          long down_from = -1, long down_to = -1) {
+  const uint8_t kDigits[ReadingBatch::kChannels] = {0, 2, 2, 3};
+  FakeNetwork network;
+  network.failure_rate = failure_rate;
+  Energy energy;
+  memset(rtc_memory, 0, sizeof rtc_memory);
+  bool radio_enabled = true;  // As at power on.
+  long radio_wakes = 0;
+  ReadingBatch batch;
+  for (long w = 1; w <= wakes; ++w) {
+    network.down = down_from <= w && w < down_to;
+    energy.add(radio_enabled ? kRadioMa : kCpuMa, kBootSecs);
+    if (radio_enabled) {
+      energy.add(kRadioMa, kRfCalibrationSecs);
+      ++radio_wakes;
+    }
+    readRtc(&batch);
+    batch.begin(batch_size);
+    batch.startWake();
+    const int16_t values[ReadingBatch::kChannels] = {
+        static_cast<int16_t>(w), 4312, 4400, 3380};
+    batch.add(values);
+    if (batch.uploadDue()) {
+      // Measuring overlaps with connecting to the access point.
+      CapturePrint body;
+      JsonWriter json(&body);
+      json.beginObject();
+      json.property(F("sensor"), F("rs1"));
+      json.property(F("wake"), batch.wakes());
+      json.key(F("readings"));
+      batch.writeJson(&json, kDigits);
+      json.endObject();
+      if (network.associate(radio_enabled, &energy) &&
+          network.post(body.text, &energy)) {
+        batch.uploadSucceeded();
+      } else {
+        batch.uploadFailed();
+      }
+    } else {
+      energy.add(kCpuMa, kMeasureSecs);
+    }
+    batch.seal();
+    writeRtc(&batch);
+    radio_enabled = batch.radioNeededNextWake();
+    energy.add(kSleepMa, kIntervalSecs);
+  }
+  SimulationResult result;
+  result.ua_hours_per_reading = energy.mas * 1000 / 3600 / wakes;
+  result.mj_per_reading = energy.mas * kVolts / wakes;
+  result.awake_secs_per_wake = energy.awake_secs / wakes - kIntervalSecs;
+  result.radio_wakes = radio_wakes;
+  result.posts = network.posts;
+  result.received = network.received;
+  result.dropped = batch.dropped();
+  result.errors = network.errors;
+  return result;
+}
+
+void printResult(uint8_t batch_size, const SimulationResult& r) {
+  char line[120];
+  snprintf(line, sizeof line,
+           "%10d %12.2f %12.1f %10.2f %11ld %7ld %9ld %8ld", batch_size,
+           r.ua_hours_per_reading, r.mj_per_reading, r.awake_secs_per_wake,
+           r.radio_wakes, r.posts, r.received, r.dropped);
+  Serial.println(line);
+}
+
+void testSimulation() {
+  const long kWakes = 10000;
+  const uint8_t kBatchSizes[] = {1, 2, 4, 8, 16, 24};
+  for (float failure_rate : {0.0f, 0.1f}) {
+    Serial.print("Modeled energy per reading, ");
+    Serial.print(kWakes);
+    Serial.print(" wakes every ");
+    Serial.print(kIntervalSecs, 0);
+    Serial.print(" seconds, ");
+    Serial.print(failure_rate * 100, 0);
+    Serial.println("% of connections failing:");
+    Serial.println(
+        "batch size  uAh/reading  mJ/reading  awake secs  radio wakes   posts"
+        "  received  dropped");
+    float previous = 1e9;
+    for (uint8_t batch_size : kBatchSizes) {
+      const SimulationResult r = simulate(batch_size, failure_rate, kWakes);
+      printResult(batch_size, r);
+      EXPECT_EQ(r.errors, 0);
+      EXPECT_EQ(r.dropped, 0);
+      // All but the last, partial, batch were received.
+      EXPECT_TRUE(r.received > kWakes - ReadingBatch::kCapacity);
+      EXPECT_TRUE(r.ua_hours_per_reading < previous);
+      previous = r.ua_hours_per_reading;
+    }
+  }
+
+  // The access point is down for a day: the queue stays bounded, and the
+  // newest readings are uploaded when it returns.
+  const SimulationResult r = simulate(8, 0, 2000, 1000, 1700);
+  Serial.println("Access point down for 700 wakes, batch size 8:");
+  printResult(8, r);
+  EXPECT_EQ(r.errors, 0);
+  EXPECT_TRUE(r.dropped >= 700 - ReadingBatch::kCapacity);
+  EXPECT_TRUE(r.dropped < 700 - ReadingBatch::kCapacity + 2 * 8);
+  EXPECT_TRUE(r.received + r.dropped > 2000 - 8);
+}
+
+void setup() {
+  Serial.begin(9600);
+  testBeginAfterPowerOn();
+  testSchedule();
+  testRetries();
+  testWriteJson();
+  testSimulation();
+}
+
+void loop() {}
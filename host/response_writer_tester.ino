@@ -0,0 +1,272 @@
+// Host-only test of ResponseWriter, and a benchmark of the number of writes
+// (i.e. SEND commands to the chip, and hence TCP segments) and throughput of
+// responses sent with it versus with a print call per field; see
+// CMakeLists.txt.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Ethernet.h>
+
+#include <string>
+
+#include "arduino_host.h"
+#include "http_request.h"
+#include "http_test_client.h"
+#include "response_writer.h"
+#include "simple_http_server.h"
+#include "test.h"
+#include "test_print.h"
+
+// Returns the body of a chunked response (after the headers), or "ERROR".
+std::string decodeChunks(const std::string& chunked) {
+  std::string body;
+  size_t pos = 0;
+  while (true) {
+    const size_t eol = chunked.find("\r\n", pos);
+    if (eol == std::string::npos) {
+      return "ERROR";
+    }
+    const size_t size = strtoul(chunked.substr(pos, eol - pos).c_str(),
+                                nullptr, 16);
+    pos = eol + 2;
+    if (size == 0) {
+      return chunked.substr(pos) == "\r\n" ? body : "ERROR";
+    }
+    if (chunked.compare(pos + size, 2, "\r\n") != 0) {
+      return "ERROR";
+    }
+    body += chunked.substr(pos, size);
+    pos += size + 2;
+  }
+}
+
+std::string makeBody(size_t size) {
+  std::string body;
+  while (body.size() < size) {
+    body += "Temperature: 21.37 degrees C<br/>\r\n";
+  }
+  body.resize(size);
+  return body;
+}
+
+void testSmallResponse() {
+  CapturePrint client;
+  ResponseWriterBuffer<128> writer(&client);
+  writer.beginResponse("200 OK");
+  writer.header("Content-Type", "text/html");
+  writer.beginBody();
+  writer.print("Temperature: ");
+  writer.print(21.25);
+  writer.println(" degrees C<br/>");
+  EXPECT_EQ(client.writes, 0);
+  EXPECT_TRUE(writer.endResponse());
+  EXPECT_EQ(client.writes, 1);
+  EXPECT_EQ(writer.clientWrites(), 1);
+  EXPECT_TRUE(client.text ==
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: text/html\r\n"
+              "Content-Length: 35\r\n"
+              "\r\n"
+              "Temperature: 21.25 degrees C<br/>\r\n");
+
+  // Without a body, or even a call to beginBody.
+  client.text.clear();
+  writer.beginResponse("404 Not Found");
+  EXPECT_TRUE(writer.endResponse());
+  EXPECT_TRUE(client.text ==
+              "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+
+  // Nothing more can be written.
+  EXPECT_EQ(writer.print("x"), 0);
+}
+
+void testBodySizes() {
+  // Bodies of sizes around the multiples of the room in the buffer.
+  for (int size = 0; size < 700; size += (size % 50 == 0 ? 1 : 7)) {
+    for (int http_1_0 = 0; http_1_0 < 2; ++http_1_0) {
+      const std::string body = makeBody(size);
+      CapturePrint client;
+      ResponseWriterBuffer<128> writer(&client);
+      writer.beginResponse("200 OK", http_1_0);
+      writer.header("Content-Type", "text/plain");
+      writer.beginBody();
+      // In pieces of various sizes, some larger than the buffer.
+      for (size_t pos = 0, piece = 1; pos < body.size(); piece = piece * 3 + 1) {
+        const size_t n = std::min(piece % 200, body.size() - pos);
+        EXPECT_EQ(writer.write(body.data() + pos, n), n);
+        pos += n;
+      }
+      EXPECT_TRUE(writer.endResponse());
+
+      const size_t headers_end = client.text.find("\r\n\r\n") + 4;
+      const std::string headers = client.text.substr(0, headers_end);
+      const std::string rest = client.text.substr(headers_end);
+      std::string received;
+      if (headers.find("Content-Length: " + std::to_string(size) + "\r\n") !=
+          std::string::npos) {
+        // The whole response fit in the buffer.
+        EXPECT_EQ(client.writes, 1);
+        received = rest;
+      } else if (http_1_0) {
+        EXPECT_TRUE(headers.find("Transfer-Encoding") == std::string::npos);
+        received = rest;
+      } else {
+        EXPECT_TRUE(headers.find("Transfer-Encoding: chunked\r\n") !=
+                    std::string::npos);
+        received = decodeChunks(rest);
+      }
+      EXPECT_TRUE(headers.find("HTTP/1.1 200 OK\r\n") == 0);
+      if (received != body) {
+        EXPECT_TRUE(received == body);
+        Serial.print("size=");
+        Serial.print(size);
+        Serial.print(" http_1_0=");
+        Serial.println(http_1_0);
+      }
+      // Each write (except perhaps the last) fills the buffer.
+      EXPECT_TRUE(client.writes <= 1 + static_cast<int>(client.text.size()) /
+                                           (128 - ResponseWriter::kFramingSpace -
+                                            ResponseWriter::kTrailerSpace));
+    }
+  }
+}
+
+void testLongHeaders() {
+  CapturePrint client;
+  ResponseWriterBuffer<64> writer(&client);
+  writer.beginResponse("200 OK");
+  writer.header("X-Long", "0123456789012345678901234567890123456789");
+  writer.header("Content-Type", "text/plain");
+  writer.beginBody();
+  writer.print("Hello");
+  EXPECT_TRUE(writer.endResponse());
+  EXPECT_TRUE(client.text ==
+              "HTTP/1.1 200 OK\r\n"
+              "X-Long: 0123456789012345678901234567890123456789\r\n"
+              "Content-Type: text/plain\r\n"
+              "Content-Length: 5\r\n"
+              "\r\n"
+              "Hello");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark: sensor_ether_server's response, as it used to be sent (a print
+// per field) and with a ResponseWriter, and a larger (2KB) response, which
+// needs several chunks.
+
+float temperature = 21.37;
+float pressure = 1013.25;
+const int kLargeLines = 60;
+
+void handlePrints(const HttpRequest& request, EthernetClient* client) {
+  client->println("HTTP/1.1 200 OK");
+  client->println("Content-Type: text/html");
+  client->println();
+  client->print("Temperature: ");
+  client->print(temperature);
+  client->print(" degrees C");
+  client->println("<br/>");
+  // The sketch used "Pressure: " + String(pressure), i.e. one print, but the
+  // host's core has no String.
+  client->print("Pressure: ");
+  client->print(pressure);
+  client->print(" Pa");
+  client->println("<br/>");
+}
+
+void handleWriter(const HttpRequest& request, EthernetClient* client) {
+  ResponseWriterBuffer<256> writer(client);
+  writer.beginResponse("200 OK", request.http_1_0);
+  writer.header("Content-Type", "text/html");
+  writer.beginBody();
+  writer.print("Temperature: ");
+  writer.print(temperature);
+  writer.println(" degrees C<br/>");
+  writer.print("Pressure: ");
+  writer.print(pressure);
+  writer.println(" Pa<br/>");
+  writer.endResponse();
+}
+
+void handleLargePrints(const HttpRequest& request, EthernetClient* client) {
+  client->println("HTTP/1.1 200 OK");
+  client->println("Content-Type: text/html");
+  client->println();
+  for (int i = 0; i < kLargeLines; ++i) {
+    client->print("Temperature: ");
+    client->print(temperature);
+    client->println(" degrees C<br/>");
+  }
+}
+
+void handleLargeWriter(const HttpRequest& request, EthernetClient* client) {
+  ResponseWriterBuffer<256> writer(client);
+  writer.beginResponse("200 OK", request.http_1_0);
+  writer.header("Content-Type", "text/html");
+  writer.beginBody();
+  for (int i = 0; i < kLargeLines; ++i) {
+    writer.print("Temperature: ");
+    writer.print(temperature);
+    writer.println(" degrees C<br/>");
+  }
+  writer.endResponse();
+}
+
+SimpleHttpServer server(kEthernetShieldCS);
+uint16_t server_port = 0;
+
+void benchmark(const char* label, SimpleHttpServer::RequestFunc handler) {
+  const int kRequests = 1000;
+  uint64_t bytes = 0;
+  int failures = 0;
+  const uint32_t sends_before = arduino_host::ethernetSendCount();
+  const uint64_t start_us = arduino_host::hostMicros();
+  for (int r = 0; r < kRequests; ++r) {
+    int fd = connectToServer(server_port);
+    sendString(fd, "GET / HTTP/1.1\r\n\r\n");
+    static char response[4096];
+    size_t len = 0;
+    for (int i = 0; i < 10000; ++i) {
+      server.loop(handler);
+      if (readSome(fd, response, sizeof response, &len)) {
+        break;
+      }
+    }
+    close(fd);
+    if (strncmp(response, "HTTP/1.1 200 OK\r\n", 17) != 0) {
+      ++failures;
+    }
+    bytes += len;
+  }
+  const uint64_t elapsed_us = arduino_host::hostMicros() - start_us;
+  const uint32_t sends = arduino_host::ethernetSendCount() - sends_before;
+  EXPECT_EQ(failures, 0);
+  Serial.print(label);
+  Serial.print(": ");
+  Serial.print(static_cast<float>(sends) / kRequests);
+  Serial.print(" writes/response, ");
+  Serial.print(bytes / kRequests);
+  Serial.print(" bytes/response, ");
+  Serial.print(kRequests * 1e6 / elapsed_us);
+  Serial.println(" responses/sec");
+}
+
+void setup() {
+  Serial.begin(9600);
+  testSmallResponse();
+  testBodySizes();
+  testLongHeaders();
+
+  EEPROM.erase();
+  arduino_host::setUseEphemeralPorts(true);
+  ASSERT_TRUE(server.setup());
+  server_port = arduino_host::listeningPort(80);
+  ASSERT_TRUE(server_port != 0);
+
+  benchmark("Small, print per field", handlePrints);
+  benchmark("Small, ResponseWriter ", handleWriter);
+  benchmark("Large, print per field", handleLargePrints);
+  benchmark("Large, ResponseWriter ", handleLargeWriter);
+}
+
+void loop() {}
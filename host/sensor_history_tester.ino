@@ -0,0 +1,258 @@
+// Host-only test of SensorHistory, and benchmarks of the cost of adding a
+// sample to a full history, and of writing a full history as JSON; see
+// CMakeLists.txt.
+
+#include <Arduino.h>
+
+#include <deque>
+#include <string>
+
+#include "arduino_host.h"
+#include "json_writer.h"
+#include "sensor_history.h"
+#include "test.h"
+#include "test_print.h"
+#include "time.h"
+
+using jamessynge::ArdTime;
+using jamessynge::Milliseconds;
+using jamessynge::internal::repr;
+using jamessynge::internal::repr_to_ard_time;
+
+struct Sample {
+  uint32_t ms;
+  int16_t values[SensorHistory::kMaxChannels];
+};
+
+// Returns true if history holds the newest samples of expected, as many as
+// fit.
+bool matches(const SensorHistory& history, const std::deque<Sample>& expected) {
+  if (history.count() > expected.size() || history.count() == 0) {
+    return false;
+  }
+  SensorHistory::Reader reader = history.read();
+  size_t i = expected.size() - history.count();
+  ArdTime t;
+  int16_t values[SensorHistory::kMaxChannels];
+  while (reader.next(&t, values)) {
+    if (repr(t) != expected[i].ms ||
+        memcmp(values, expected[i].values,
+               history.channels() * sizeof values[0]) != 0) {
+      return false;
+    }
+    ++i;
+  }
+  return i == expected.size() && reader.remaining() == 0;
+}
+
+void testEmpty() {
+  SensorHistoryBuffer<32> history(2);
+  EXPECT_EQ(history.count(), 0);
+  ArdTime t;
+  int16_t values[2];
+  SensorHistory::Reader reader = history.read();
+  EXPECT_EQ(reader.remaining(), 0);
+  EXPECT_FALSE(reader.next(&t, values));
+}
+
+void testSampleSizes() {
+  SensorHistoryBuffer<64> history(2);
+  int16_t values[2] = {215, 10013};
+  // The first is relative to zero, so takes the most room.
+  history.add(repr_to_ard_time(100000), values);
+  EXPECT_EQ(history.usedBytes(), SensorHistory::maxSampleSize(2));
+  // Small changes.
+  values[0] = 216;
+  values[1] = 10013 - 127;
+  history.add(repr_to_ard_time(110000), values);
+  EXPECT_EQ(history.usedBytes(), SensorHistory::maxSampleSize(2) +
+                                     SensorHistory::typicalSampleSize(2));
+  // A large change of one value.
+  values[1] = 10013 + 1;
+  history.add(repr_to_ard_time(120000), values);
+  EXPECT_EQ(history.usedBytes(), SensorHistory::maxSampleSize(2) +
+                                     2 * SensorHistory::typicalSampleSize(2) +
+                                     2);
+  // A long gap.
+  history.add(repr_to_ard_time(120000 + 65535), values);
+  EXPECT_EQ(history.usedBytes(), SensorHistory::maxSampleSize(2) +
+                                     3 * SensorHistory::typicalSampleSize(2) +
+                                     6);
+  EXPECT_EQ(history.count(), 4);
+
+  // Discarding the oldest makes room for the next, until there are only
+  // small samples.
+  for (int i = 0; i < 20; ++i) {
+    values[0] += 1;
+    history.add(repr_to_ard_time(200000 + i), values);
+  }
+  EXPECT_EQ(history.count(), 64 / SensorHistory::typicalSampleSize(2));
+  EXPECT_EQ(history.usedBytes(), 64);
+}
+
+// Adds random samples, with occasional large changes and gaps, and a
+// wrap around of millis(), checking that the history always has the newest.
+void testRandomSamples(uint8_t channels) {
+  SensorHistoryBuffer<200> history(channels);
+  std::deque<Sample> expected;
+  Sample sample = {0xFFFF0000UL, {}};
+  int failures = 0;
+  for (int i = 0; i < 5000; ++i) {
+    sample.ms += random(10) == 0 ? random(70000) : random(1000, 2000);
+    for (uint8_t c = 0; c < channels; ++c) {
+      sample.values[c] += random(10) == 0 ? random(-40000, 40000)
+                                          : random(-127, 128);
+    }
+    history.add(repr_to_ard_time(sample.ms), sample.values);
+    expected.push_back(sample);
+    if (!matches(history, expected)) {
+      ++failures;
+    }
+    if (history.usedBytes() > history.capacityBytes()) {
+      ++failures;
+    }
+    // Once samples have been discarded, no more were discarded than were
+    // needed to make room.
+    if (history.count() < expected.size() &&
+        history.capacityBytes() - history.usedBytes() >=
+            SensorHistory::maxSampleSize(channels)) {
+      ++failures;
+    }
+  }
+  EXPECT_EQ(failures, 0);
+
+  history.clear();
+  EXPECT_EQ(history.count(), 0);
+  EXPECT_EQ(history.usedBytes(), 0);
+  expected.clear();
+  expected.push_back(sample);
+  history.add(repr_to_ard_time(sample.ms), sample.values);
+  EXPECT_TRUE(matches(history, expected));
+}
+
+void testReadSince() {
+  SensorHistoryBuffer<64> history(1);
+  // Times from just before millis() wraps around to just after.
+  const uint32_t kTimes[] = {0xFFFFFC18UL, 0xFFFFFFFFUL, 0, 1000};
+  for (int16_t i = 0; i < 4; ++i) {
+    history.add(repr_to_ard_time(kTimes[i]), &i);
+  }
+  // Returns the value of the first sample read, -1 if none, and the number
+  // of samples after it.
+  auto first = [&history](unsigned long since, int* remaining) {
+    SensorHistory::Reader reader =
+        history.readSince(repr_to_ard_time(since));
+    ArdTime t;
+    int16_t value = -1;
+    reader.next(&t, &value);
+    *remaining = reader.remaining();
+    return value;
+  };
+  int remaining;
+  EXPECT_EQ(first(0xFFFF0000UL, &remaining), 0);
+  EXPECT_EQ(remaining, 3);
+  EXPECT_EQ(first(0xFFFFFC18UL, &remaining), 1);
+  EXPECT_EQ(remaining, 2);
+  EXPECT_EQ(first(0xFFFFFFFEUL, &remaining), 1);
+  EXPECT_EQ(first(0xFFFFFFFFUL, &remaining), 2);
+  EXPECT_EQ(first(999, &remaining), 3);
+  EXPECT_EQ(remaining, 0);
+  EXPECT_EQ(first(1000, &remaining), -1);
+  EXPECT_EQ(first(5000, &remaining), -1);
+}
+
+void testWriteJson() {
+  SensorHistoryBuffer<64> history(2);
+  const uint8_t kDigits[] = {1, 0};
+  int16_t values[2] = {215, -5};
+  history.add(repr_to_ard_time(1000), values);
+  values[0] = -3;
+  history.add(repr_to_ard_time(2000), values);
+
+  CapturePrint out;
+  JsonWriter json(&out);
+  history.readSince(repr_to_ard_time(0)).writeJson(&json, kDigits);
+  EXPECT_TRUE(out.text == "[[1000,21.5,-5],[2000,-0.3,-5]]");
+
+  out.text.clear();
+  history.readSince(repr_to_ard_time(2000)).writeJson(&json, kDigits);
+  EXPECT_TRUE(out.text == "[]");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks, with a history of 1KB (e.g. as on a Mega) of two channels of
+// slowly changing readings, as from sensor_ether_server.
+
+SensorHistoryBuffer<1024> big_history(2);
+uint32_t sample_ms = 0;
+int16_t sample_values[2] = {215, 10013};
+
+// Precomputed, so that random() isn't part of the cost of add.
+int8_t deltas[1024];
+uint16_t next_delta = 0;
+
+void addSlowlyChangingSample() {
+  sample_ms += 10000;
+  sample_values[0] += deltas[next_delta++ & 1023] / 32;
+  sample_values[1] += deltas[next_delta++ & 1023] / 8;
+  big_history.add(repr_to_ard_time(sample_ms), sample_values);
+}
+
+void benchmarkAdd() {
+  for (int8_t& delta : deltas) {
+    delta = random(-128, 128);
+  }
+  // Fill it, so that each add discards the oldest sample.
+  while (big_history.capacityBytes() - big_history.usedBytes() >=
+         SensorHistory::typicalSampleSize(2)) {
+    addSlowlyChangingSample();
+  }
+  const long kAdds = 1000000;
+  const unsigned long start_us = BenchmarkMicros();
+  for (long i = 0; i < kAdds; ++i) {
+    addSlowlyChangingSample();
+  }
+  const unsigned long elapsed_us = BenchmarkMicros() - start_us;
+  Serial.print("Add to full history: ");
+  Serial.print(elapsed_us * 1000.0 / kAdds);
+  Serial.print(" ns/sample; ");
+  Serial.print(big_history.count());
+  Serial.print(" samples in ");
+  Serial.print(big_history.capacityBytes());
+  Serial.println(" bytes");
+}
+
+void benchmarkWriteJson() {
+  const uint8_t kDigits[] = {1, 1};
+  const int kRepeats = 2000;
+  CountingPrint out;
+  const unsigned long start_us = BenchmarkMicros();
+  for (int r = 0; r < kRepeats; ++r) {
+    JsonWriter json(&out);
+    big_history.read().writeJson(&json, kDigits);
+  }
+  const unsigned long elapsed_us = BenchmarkMicros() - start_us;
+  Serial.print("Write full history as JSON: ");
+  Serial.print(out.bytes / kRepeats);
+  Serial.print(" bytes, ");
+  Serial.print(static_cast<float>(kRepeats) * big_history.count() /
+               elapsed_us);
+  Serial.print(" M samples/sec, ");
+  Serial.print(static_cast<float>(out.bytes) / elapsed_us);
+  Serial.println(" MB/sec");
+}
+
+void setup() {
+  Serial.begin(9600);
+  testEmpty();
+  testSampleSizes();
+  testRandomSamples(1);
+  testRandomSamples(2);
+  testRandomSamples(SensorHistory::kMaxChannels);
+  testReadSince();
+  testWriteJson();
+  benchmarkAdd();
+  benchmarkWriteJson();
+}
+
+void loop() {}
@@ -0,0 +1,651 @@
+// Host-only test of SimpleHttpServer and HttpRequestParser, using sockets to
+// make requests of the server in the same process (see http_test_client.h),
+// and benchmarks with and without keep-alive; see CMakeLists.txt.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Ethernet.h>
+
+#include "addresses.h"
+#include "arduino_host.h"
+#include "http_request.h"
+#include "http_test_client.h"
+#include "response_writer.h"
+#include "simple_http_server.h"
+#include "test.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// HttpRequestParser.
+
+const char kFullRequest[] =
+    "GET /path?q=1 HTTP/1.1\r\n"
+    "Host: arduino\r\n"
+    "User-Agent: curl/7.68.0\r\n"
+    "CONNECTION:  Keep-Alive \r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+void expectFullRequest(const HttpRequestParser& parser) {
+  EXPECT_EQ(parser.status(), HttpRequestParser::kComplete);
+  const HttpRequest& request = parser.request();
+  EXPECT_EQ(request.method, HttpRequest::kGet);
+  EXPECT_EQ(strcmp(request.path, "/path?q=1"), 0);
+  EXPECT_FALSE(request.http_1_0);
+  EXPECT_TRUE(request.connection_keep_alive);
+  EXPECT_FALSE(request.connection_close);
+  EXPECT_EQ(request.content_length, 0);
+}
+
+size_t consumeString(HttpRequestParser* parser, const char* str) {
+  return parser->consume(reinterpret_cast<const uint8_t*>(str), strlen(str));
+}
+
+void testParserSplits() {
+  const size_t len = strlen(kFullRequest);
+  HttpRequestParser parser;
+  EXPECT_EQ(consumeString(&parser, kFullRequest), len);
+  expectFullRequest(parser);
+
+  // Split into two pieces at every possible point.
+  for (size_t split = 0; split <= len; ++split) {
+    parser.reset();
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(kFullRequest);
+    EXPECT_EQ(parser.consume(bytes, split), split);
+    EXPECT_EQ(parser.consume(bytes + split, len - split), len - split);
+    expectFullRequest(parser);
+  }
+
+  // One byte at a time.
+  parser.reset();
+  for (size_t i = 0; i < len; ++i) {
+    EXPECT_EQ(parser.status(), HttpRequestParser::kIncomplete);
+    parser.consume(reinterpret_cast<const uint8_t*>(kFullRequest + i), 1);
+  }
+  expectFullRequest(parser);
+}
+
+void testParserBodyAndVersion() {
+  HttpRequestParser parser;
+  const char kPost[] =
+      "POST /config HTTP/1.0\n"
+      "Content-Length: 5\n"
+      "Connection: close\n"
+      "\n"
+      "hello"
+      "GET / HTTP/1.1\r\n";
+  const size_t n = consumeString(&parser, kPost);
+  EXPECT_EQ(parser.status(), HttpRequestParser::kComplete);
+  // Stops at the end of the body.
+  EXPECT_EQ(strncmp(kPost + n, "GET", 3), 0);
+  const HttpRequest& request = parser.request();
+  EXPECT_EQ(request.method, HttpRequest::kPost);
+  EXPECT_EQ(strcmp(request.path, "/config"), 0);
+  EXPECT_TRUE(request.http_1_0);
+  EXPECT_TRUE(request.connection_close);
+  EXPECT_EQ(request.content_length, 5);
+
+  // Not "11": each Content-Length header is parsed afresh.
+  parser.reset();
+  consumeString(&parser,
+                "POST / HTTP/1.1\r\nContent-Length: 1\r\n"
+                "Content-Length:  1 \r\n\r\nx");
+  EXPECT_EQ(parser.status(), HttpRequestParser::kComplete);
+  EXPECT_EQ(parser.request().content_length, 1);
+
+  parser.reset();
+  consumeString(&parser, "BREW /pot HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(parser.status(), HttpRequestParser::kComplete);
+  EXPECT_EQ(parser.request().method, HttpRequest::kUnknownMethod);
+  parser.reset();
+  consumeString(&parser, "GETS / HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(parser.request().method, HttpRequest::kUnknownMethod);
+}
+
+void expectStatus(const char* request, HttpRequestParser::Status status) {
+  HttpRequestParser parser;
+  consumeString(&parser, request);
+  if (parser.status() != status) {
+    EXPECT_EQ(parser.status(), status);
+    Serial.println(request);
+  }
+}
+
+void testParserErrors() {
+  expectStatus("\r\n", HttpRequestParser::kBadRequest);
+  expectStatus(" / HTTP/1.1\r\n", HttpRequestParser::kBadRequest);
+  expectStatus("GET  HTTP/1.1\r\n", HttpRequestParser::kBadRequest);
+  expectStatus("GET /\r\n", HttpRequestParser::kBadRequest);
+  expectStatus("GET / HTTP/1.1\r\nHost\r\n\r\n",
+               HttpRequestParser::kBadRequest);
+  expectStatus("GET / HTTP/1.1\r\nContent-Length: x\r\n\r\n",
+               HttpRequestParser::kBadRequest);
+  expectStatus("GET / HTTP/1.1\r\nContent-Length: 65536\r\n\r\n",
+               HttpRequestParser::kBadRequest);
+  expectStatus("GET / HTTP/1.1\r\nContent-Length:\r\n\r\n",
+               HttpRequestParser::kBadRequest);
+  expectStatus("GET / HTTP/1.1\r\nContent-Length: 1 2\r\n\r\n12",
+               HttpRequestParser::kBadRequest);
+  // A repeated Content-Length must have the same value.
+  expectStatus("GET / HTTP/1.1\r\nContent-Length: 1\r\n"
+               "Content-Length: 1\r\n\r\nx",
+               HttpRequestParser::kComplete);
+  expectStatus("GET / HTTP/1.1\r\nContent-Length: 1\r\n"
+               "Content-Length: 2\r\n\r\nxx",
+               HttpRequestParser::kBadRequest);
+  expectStatus("GET / HTTP/1.1\r\nContent-Length: 0\r\n"
+               "Content-Length: 1\r\n\r\nx",
+               HttpRequestParser::kBadRequest);
+  expectStatus("GET / HTTP/1.1\r\n\rX", HttpRequestParser::kBadRequest);
+  expectStatus("GET /012345678901234567890123456789 HTTP/1.1\r\n\r\n",
+               HttpRequestParser::kComplete);
+  expectStatus("GET /0123456789012345678901234567890 HTTP/1.1\r\n\r\n",
+               HttpRequestParser::kUriTooLong);
+  expectStatus("GET / HTTP/1.1\r\nHost: x\r\n", HttpRequestParser::kIncomplete);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SimpleHttpServer.
+
+const char kBody[] = "Hello from SimpleHttpServer";
+int handled_requests = 0;
+
+void handleRequest(const HttpRequest& request, EthernetClient* client) {
+  ++handled_requests;
+  client->println("HTTP/1.1 200 OK");
+  client->println("Content-Type: text/plain");
+  client->println("Connection: close");
+  client->println();
+  client->print(kBody);
+  client->print(" ");
+  client->print(request.path);
+}
+
+SimpleHttpServer server(kEthernetShieldCS);
+uint16_t server_port = 0;
+
+// Calls server.loop until the server closes fd, or a lot of loops pass.
+size_t awaitResponse(int fd, char* buf, size_t size) {
+  size_t len = 0;
+  buf[0] = 0;
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_TRUE(server.loop(handleRequest));
+    if (readSome(fd, buf, size, &len)) {
+      break;
+    }
+  }
+  return len;
+}
+
+void testSetup() {
+  EEPROM.erase();
+  arduino_host::setUseEphemeralPorts(true);
+
+  // There is no DHCP server, so a link-local address is used.
+  ASSERT_TRUE(server.setup());
+  EXPECT_EQ(Ethernet.localIP()[0], 169);
+  EXPECT_EQ(Ethernet.localIP()[1], 254);
+  server_port = arduino_host::listeningPort(80);
+  ASSERT_TRUE(server_port != 0);
+
+  // Nothing to do yet.
+  EXPECT_TRUE(server.loop(handleRequest));
+  EXPECT_EQ(handled_requests, 0);
+
+  // setup() saved the addresses it generated in the EEPROM.
+  Addresses saved;
+  EXPECT_TRUE(saved.load(nullptr));
+  EXPECT_EQ(saved.profiles[0].ip, Ethernet.localIP());
+  EXPECT_TRUE(server.profile() == saved.profiles[0]);
+}
+
+void testRequest() {
+  int fd = connectToServer(server_port);
+  ASSERT_TRUE(fd >= 0);
+  sendString(fd, "GET /abc HTTP/1.1\r\nHost: arduino\r\n\r\n");
+  char response[256];
+  awaitResponse(fd, response, sizeof response);
+  close(fd);
+  EXPECT_EQ(handled_requests, 1);
+  EXPECT_TRUE(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+  EXPECT_TRUE(strstr(response, "Hello from SimpleHttpServer /abc") != nullptr);
+}
+
+// A client that sends its request slowly doesn't hold up another, and is
+// eventually timed out.
+void testSlowClient() {
+  const int before = handled_requests;
+  int slow = connectToServer(server_port);
+  ASSERT_TRUE(slow >= 0);
+  sendString(slow, "GET /slow HTTP/1.1\r\nHo");
+  for (int i = 0; i < 10; ++i) {
+    server.loop(handleRequest);
+  }
+  EXPECT_EQ(server.activeConnections(), 1);
+
+  int fast = connectToServer(server_port);
+  ASSERT_TRUE(fast >= 0);
+  sendString(fast, "GET /fast HTTP/1.1\r\n\r\n");
+  char response[256];
+  awaitResponse(fast, response, sizeof response);
+  close(fast);
+  EXPECT_TRUE(strstr(response, "/fast") != nullptr);
+  EXPECT_EQ(handled_requests, before + 1);
+  EXPECT_EQ(server.activeConnections(), 1);
+
+  arduino_host::advanceMillis(SimpleHttpServer::kRequestTimeoutMs);
+  awaitResponse(slow, response, sizeof response);
+  close(slow);
+  EXPECT_TRUE(strncmp(response, "HTTP/1.1 408 ", 13) == 0);
+  EXPECT_EQ(handled_requests, before + 1);
+  EXPECT_EQ(server.activeConnections(), 0);
+}
+
+void testErrorResponses() {
+  // Each error response is sent with one write.
+  char response[256];
+  int fd = connectToServer(server_port);
+  ASSERT_TRUE(fd >= 0);
+  uint32_t sends_before = arduino_host::ethernetSendCount();
+  sendString(fd, "GET /a-path-which-is-far-too-long-to-keep HTTP/1.1\r\n");
+  awaitResponse(fd, response, sizeof response);
+  close(fd);
+  EXPECT_EQ(strcmp(response,
+                   "HTTP/1.1 414 URI Too Long\r\nContent-Length: 0\r\n"
+                   "Connection: close\r\n\r\n"),
+            0);
+  EXPECT_EQ(arduino_host::ethernetSendCount() - sends_before, 1);
+
+  fd = connectToServer(server_port);
+  ASSERT_TRUE(fd >= 0);
+  sends_before = arduino_host::ethernetSendCount();
+  sendString(fd, "GET / HTTP/1.1\r\nNo colon\r\n\r\n");
+  awaitResponse(fd, response, sizeof response);
+  close(fd);
+  EXPECT_TRUE(strncmp(response, "HTTP/1.1 400 ", 13) == 0);
+  EXPECT_EQ(arduino_host::ethernetSendCount() - sends_before, 1);
+
+  // A client that disconnects before sending the whole request.
+  fd = connectToServer(server_port);
+  ASSERT_TRUE(fd >= 0);
+  sendString(fd, "GET / HT");
+  for (int i = 0; i < 10; ++i) {
+    server.loop(handleRequest);
+  }
+  close(fd);
+  for (int i = 0; i < 10; ++i) {
+    server.loop(handleRequest);
+  }
+  EXPECT_EQ(server.activeConnections(), 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark: many clients making requests at once, as quickly as they can,
+// plus one which dribbles its requests out a byte per loop (as a client on a
+// slow or lossy link might), measuring requests per second and the latency
+// of each request, from sending it to the server closing the connection.
+
+struct BenchmarkClient {
+  int fd = -1;
+  uint64_t start_us;
+  size_t sent;
+  size_t received;
+  char response[128];
+};
+
+void benchmarkConcurrentClients() {
+  const int kClients = 12;
+  const long kRequests = 4000;
+  const char kRequest[] =
+      "GET /bench HTTP/1.1\r\nHost: arduino\r\nUser-Agent: curl/7.68.0\r\n"
+      "Accept: */*\r\n\r\n";
+  const size_t kRequestLength = strlen(kRequest);
+  static uint32_t latencies_us[kRequests];
+  long completed = 0;
+  long slow_completed = 0;
+  long failures = 0;
+  BenchmarkClient clients[kClients];
+
+  const uint64_t begin_us = arduino_host::hostMicros();
+  while (completed < kRequests) {
+    for (int c = 0; c < kClients; ++c) {
+      BenchmarkClient& client = clients[c];
+      const bool slow = c == 0;
+      if (client.fd < 0) {
+        client.fd = connectToServer(server_port);
+        client.start_us = arduino_host::hostMicros();
+        client.sent = 0;
+        client.received = 0;
+        client.response[0] = 0;
+      }
+      if (client.sent < kRequestLength) {
+        const size_t n = slow ? 1 : kRequestLength;
+        send(client.fd, kRequest + client.sent, n, MSG_NOSIGNAL);
+        client.sent += n;
+      }
+      if (readSome(client.fd, client.response, sizeof client.response,
+                   &client.received)) {
+        const uint32_t latency_us = arduino_host::hostMicros() - client.start_us;
+        if (strncmp(client.response, "HTTP/1.1 200 OK", 15) != 0) {
+          ++failures;
+        }
+        close(client.fd);
+        client.fd = -1;
+        if (slow) {
+          ++slow_completed;
+        } else if (completed < kRequests) {
+          latencies_us[completed++] = latency_us;
+        }
+      }
+      // Between each client's turn, so that no more connections are pending
+      // than the server's sockets and the host's listen backlog can hold.
+      server.loop(handleRequest);
+    }
+  }
+  const uint64_t elapsed_us = arduino_host::hostMicros() - begin_us;
+  for (BenchmarkClient& client : clients) {
+    if (client.fd >= 0) {
+      close(client.fd);
+    }
+  }
+  for (int i = 0; i < 100; ++i) {
+    server.loop(handleRequest);
+  }
+  EXPECT_EQ(failures, 0);
+  EXPECT_TRUE(slow_completed > 0);
+
+  printLatencies("11 clients and 1 slow client", latencies_us, kRequests,
+                 elapsed_us);
+  Serial.print("; slow client completed ");
+  Serial.println(slow_completed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Keep-alive.
+
+const unsigned long kIdleTimeoutMs = 1000;
+
+void handleKeepAlive(const HttpRequest& request, EthernetClient* client) {
+  ++handled_requests;
+  ResponseWriterBuffer<192> writer(client);
+  writer.beginResponse("200 OK", request);
+  writer.header("Content-Type", "text/plain");
+  writer.beginBody();
+  writer.print(kBody);
+  writer.print(" ");
+  writer.print(request.path);
+  writer.endResponse();
+}
+
+// Returns true if buf holds the whole of a response framed by Content-Length.
+bool responseComplete(const char* buf, size_t len) {
+  const char* body = strstr(buf, "\r\n\r\n");
+  const char* content_length = strstr(buf, "Content-Length: ");
+  if (body == nullptr || content_length == nullptr || content_length > body) {
+    return false;
+  }
+  return buf + len >= body + 4 + atoi(content_length + 16);
+}
+
+// Calls server.loop until a whole response has arrived on fd, or the server
+// has closed it. Returns true if the server has closed it.
+bool awaitKeepAliveResponse(int fd, char* buf, size_t size) {
+  size_t len = 0;
+  buf[0] = 0;
+  for (int i = 0; i < 10000; ++i) {
+    server.loop(handleKeepAlive);
+    if (readSome(fd, buf, size, &len)) {
+      return true;
+    }
+    if (responseComplete(buf, len)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Calls server.loop a few times, returning true if the server closes fd,
+// without sending anything more.
+bool serverCloses(int fd) {
+  char buf[64];
+  size_t len = 0;
+  for (int i = 0; i < 100; ++i) {
+    server.loop(handleKeepAlive);
+    if (readSome(fd, buf, sizeof buf, &len)) {
+      return len == 0;
+    }
+  }
+  return false;
+}
+
+bool hasConnectionClose(const char* response) {
+  return strstr(response, "\r\nConnection: close\r\n") != nullptr;
+}
+
+void testKeepAlive() {
+  server.enableKeepAlive(kIdleTimeoutMs, 3, 2);
+  const int before = handled_requests;
+  char response[256];
+  int fd = connectToServer(server_port);
+  ASSERT_TRUE(fd >= 0);
+  for (int r = 0; r < 3; ++r) {
+    sendString(fd, "GET /again HTTP/1.1\r\nHost: arduino\r\n\r\n");
+    const bool closed = awaitKeepAliveResponse(fd, response, sizeof response);
+    EXPECT_TRUE(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    EXPECT_TRUE(strstr(response, "Hello from SimpleHttpServer /again") !=
+                nullptr);
+    EXPECT_EQ(handled_requests, before + r + 1);
+    if (r < 2) {
+      EXPECT_FALSE(closed);
+      EXPECT_FALSE(hasConnectionClose(response));
+      EXPECT_EQ(server.activeConnections(), 1);
+    } else {
+      // The third request is the last allowed on a connection.
+      EXPECT_TRUE(hasConnectionClose(response));
+      EXPECT_TRUE(serverCloses(fd));
+    }
+  }
+  close(fd);
+  EXPECT_EQ(server.activeConnections(), 0);
+}
+
+void testKeepAliveNotWanted() {
+  const char* kRequests[] = {
+      "GET /1.0 HTTP/1.0\r\n\r\n",
+      "GET /close HTTP/1.1\r\nConnection: close\r\n\r\n",
+      // Pipelined: the second request arrives with the first, and is dropped.
+      "GET /first HTTP/1.1\r\n\r\nGET /second HTTP/1.1\r\n\r\n",
+  };
+  for (const char* request : kRequests) {
+    const int before = handled_requests;
+    char response[256];
+    int fd = connectToServer(server_port);
+    ASSERT_TRUE(fd >= 0);
+    sendString(fd, request);
+    awaitKeepAliveResponse(fd, response, sizeof response);
+    EXPECT_TRUE(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    EXPECT_TRUE(hasConnectionClose(response));
+    EXPECT_TRUE(serverCloses(fd));
+    close(fd);
+    EXPECT_EQ(handled_requests, before + 1);
+    EXPECT_EQ(server.activeConnections(), 0);
+  }
+}
+
+void testIdleTimeout() {
+  char response[256];
+  int fd = connectToServer(server_port);
+  ASSERT_TRUE(fd >= 0);
+  sendString(fd, "GET / HTTP/1.1\r\n\r\n");
+  EXPECT_FALSE(awaitKeepAliveResponse(fd, response, sizeof response));
+
+  arduino_host::advanceMillis(kIdleTimeoutMs - 1);
+  for (int i = 0; i < 10; ++i) {
+    server.loop(handleKeepAlive);
+  }
+  EXPECT_EQ(server.activeConnections(), 1);
+
+  // Closed without a 408 response, as no request has been started.
+  arduino_host::advanceMillis(1);
+  EXPECT_TRUE(serverCloses(fd));
+  close(fd);
+  EXPECT_EQ(server.activeConnections(), 0);
+}
+
+// Idle connections are closed to make room for new ones, the least recently
+// used first.
+void testIdleEviction() {
+  char response[256];
+  int fds[3];
+  for (int c = 0; c < 3; ++c) {
+    fds[c] = connectToServer(server_port);
+    ASSERT_TRUE(fds[c] >= 0);
+    arduino_host::advanceMillis(10);
+    if (c == 2) {
+      // Accepting the third closes the least recently used.
+      EXPECT_TRUE(serverCloses(fds[0]));
+      EXPECT_EQ(server.activeConnections(), 2);
+    }
+    sendString(fds[c], "GET / HTTP/1.1\r\n\r\n");
+    EXPECT_FALSE(awaitKeepAliveResponse(fds[c], response, sizeof response));
+    EXPECT_FALSE(hasConnectionClose(response));
+  }
+  close(fds[0]);
+
+  // Once there are more than max_persistent connections reading requests,
+  // none of which can be closed, responses close their connections.
+  int more[2];
+  for (int c = 0; c < 2; ++c) {
+    more[c] = connectToServer(server_port);
+    ASSERT_TRUE(more[c] >= 0);
+  }
+  EXPECT_TRUE(serverCloses(fds[1]));
+  EXPECT_TRUE(serverCloses(fds[2]));
+  close(fds[1]);
+  close(fds[2]);
+  EXPECT_EQ(server.activeConnections(), 2);
+  int third = connectToServer(server_port);
+  ASSERT_TRUE(third >= 0);
+  for (int i = 0; i < 10; ++i) {
+    server.loop(handleKeepAlive);
+  }
+  EXPECT_EQ(server.activeConnections(), 3);
+  sendString(third, "GET / HTTP/1.1\r\n\r\n");
+  awaitKeepAliveResponse(third, response, sizeof response);
+  EXPECT_TRUE(hasConnectionClose(response));
+  EXPECT_TRUE(serverCloses(third));
+  close(third);
+
+  // Now there are just 2, so they can be kept open.
+  for (int c = 0; c < 2; ++c) {
+    sendString(more[c], "GET / HTTP/1.1\r\n\r\n");
+    EXPECT_FALSE(awaitKeepAliveResponse(more[c], response, sizeof response));
+    EXPECT_FALSE(hasConnectionClose(response));
+    close(more[c]);
+  }
+  for (int i = 0; i < 10; ++i) {
+    server.loop(handleKeepAlive);
+  }
+  EXPECT_EQ(server.activeConnections(), 0);
+}
+
+// Benchmark: several clients, each making requests one after another (as a
+// monitoring host polling the sketch would), either opening a connection for
+// each request, or keeping one open; measuring the latency of each request,
+// from connecting (if necessary) to receiving the whole response.
+void benchmarkKeepAlive(bool keep_alive) {
+  const int kClients = 4;
+  const long kRequests = 4000;
+  static uint32_t latencies_us[kRequests];
+  long completed = 0;
+  long failures = 0;
+  long connections = 0;
+  BenchmarkClient clients[kClients];
+  const char* request =
+      keep_alive ? "GET /poll HTTP/1.1\r\nHost: arduino\r\n\r\n"
+                 : "GET /poll HTTP/1.1\r\nHost: arduino\r\n"
+                   "Connection: close\r\n\r\n";
+  for (BenchmarkClient& client : clients) {
+    client.sent = 0;
+  }
+
+  const uint64_t begin_us = arduino_host::hostMicros();
+  while (completed < kRequests) {
+    for (BenchmarkClient& client : clients) {
+      if (client.sent == 0) {
+        client.start_us = arduino_host::hostMicros();
+        if (client.fd < 0) {
+          client.fd = connectToServer(server_port);
+          ++connections;
+        }
+        sendString(client.fd, request);
+        client.sent = 1;
+        client.received = 0;
+        client.response[0] = 0;
+      }
+      const bool closed = readSome(client.fd, client.response,
+                                   sizeof client.response, &client.received);
+      if (responseComplete(client.response, client.received)) {
+        const uint32_t latency_us = arduino_host::hostMicros() - client.start_us;
+        if (strncmp(client.response, "HTTP/1.1 200 OK", 15) != 0) {
+          ++failures;
+        }
+        if (closed || hasConnectionClose(client.response)) {
+          close(client.fd);
+          client.fd = -1;
+        }
+        client.sent = 0;
+        if (completed < kRequests) {
+          latencies_us[completed++] = latency_us;
+        }
+      } else if (closed) {
+        ++failures;
+        close(client.fd);
+        client.fd = -1;
+        client.sent = 0;
+      }
+      server.loop(handleKeepAlive);
+    }
+  }
+  const uint64_t elapsed_us = arduino_host::hostMicros() - begin_us;
+  for (BenchmarkClient& client : clients) {
+    if (client.fd >= 0) {
+      close(client.fd);
+    }
+  }
+  for (int i = 0; i < 100; ++i) {
+    server.loop(handleKeepAlive);
+  }
+  EXPECT_EQ(failures, 0);
+  EXPECT_EQ(server.activeConnections(), 0);
+
+  printLatencies(keep_alive ? "4 polling clients, keep-alive"
+                            : "4 polling clients, connection per request",
+                 latencies_us, kRequests, elapsed_us);
+  Serial.print("; connections ");
+  Serial.println(connections);
+}
+
+void setup() {
+  Serial.begin(9600);
+
+  testParserSplits();
+  testParserBodyAndVersion();
+  testParserErrors();
+
+  testSetup();
+  testRequest();
+  testSlowClient();
+  testErrorResponses();
+  benchmarkConcurrentClients();
+
+  testKeepAlive();
+  testKeepAliveNotWanted();
+  testIdleTimeout();
+  testIdleEviction();
+
+  server.enableKeepAlive(5000, 100, 4);
+  benchmarkKeepAlive(false);
+  benchmarkKeepAlive(true);
+}
+
+void loop() {}
@@ -0,0 +1,32 @@
+// Runs a sketch on the host: SKETCH_INO is the path of the .ino file, which is
+// compiled as part of this file (so, as with the Arduino IDE, the functions
+// it defines need to be declared before they're used, and test.h's failure
+// count is visible here). Calls setup() once, then loop() SKETCH_LOOPS times.
+//
+// Exits with status 1 if the sketch includes test.h and any EXPECT_ or
+// ASSERT_ check failed.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+
+#include SKETCH_INO
+
+#ifndef SKETCH_LOOPS
+#define SKETCH_LOOPS 0
+#endif
+
+int main(int argc, char** argv) {
+  setup();
+  for (long i = 0; i < SKETCH_LOOPS; ++i) {
+    loop();
+  }
+  Serial.flush();
+#ifdef _JAMES_SYNGE_TEST_H_
+  if (test_failure_count > 0) {
+    fprintf(stderr, "%s: %d check(s) failed\n", argv[0], test_failure_count);
+    return 1;
+  }
+#endif  // _JAMES_SYNGE_TEST_H_
+  return 0;
+}
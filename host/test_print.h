@@ -0,0 +1,46 @@
+#ifndef _ARDUINO_HOST_TEST_PRINT_H_
+#define _ARDUINO_HOST_TEST_PRINT_H_
+
+// Print implementations for host-only testers, which check what code under
+// test prints, or how it writes it (e.g. the number of writes, each of which
+// would be a packet from a ResponseWriter).
+
+#include <Arduino.h>
+
+#include <string>
+
+namespace {
+
+// Captures what is written to it, as a client would receive it.
+class CapturePrint : public Print {
+ public:
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    ++writes;
+    text.append(reinterpret_cast<const char*>(buffer), size);
+    return size;
+  }
+  using Print::write;
+
+  std::string text;
+  int writes = 0;
+};
+
+// Counts what is written to it, without keeping it, for benchmarks.
+class CountingPrint : public Print {
+ public:
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    ++writes;
+    bytes += size;
+    return size;
+  }
+  using Print::write;
+
+  unsigned long writes = 0;
+  unsigned long bytes = 0;
+};
+
+}  // namespace
+
+#endif  // _ARDUINO_HOST_TEST_PRINT_H_
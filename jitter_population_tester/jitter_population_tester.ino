@@ -31,14 +31,9 @@ class DurationEstimator {
   DurationEstimator(ArdDuration elapsed, uint32_t completed_operations)
     : elapsed_(elapsed), completed_operations_(completed_operations) {}
 
-  DurationEstimator operator=(const DurationEstimator& other) {
-    elapsed_ = other.elapsed_;
-    completed_operations_ = other.completed_operations_;
-  }
-
   ArdDuration estimate_duration_for(uint32_t operations_to_go) const {
-    double ratio = double(operations_to_go) / double(completed_operations_);
-    return elapsed_ * ratio;
+    return jamessynge::ScaleDuration(elapsed_, operations_to_go,
+                                     completed_operations_);
   }
 
   uint32_t completed_operations() const { return completed_operations_; }
@@ -64,8 +59,8 @@ uint32_t estimated_wd_time_ms = 0;
 ArdDuration estimate_duration(ArdDuration elapsed_dur,
                               uint32_t collected_samples,
                               uint32_t samples_to_go) {
-  double ratio = double(samples_to_go) / double(collected_samples);
-  return elapsed_dur * ratio;
+  return jamessynge::ScaleDuration(elapsed_dur, samples_to_go,
+                                   collected_samples);
 }
 
 ArdDuration choose_next_heartbeat_interval(
@@ -0,0 +1 @@
+../utilities/http_request.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/metrics.cpp
\ No newline at end of file
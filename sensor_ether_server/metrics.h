@@ -0,0 +1 @@
+../utilities/metrics.h
\ No newline at end of file
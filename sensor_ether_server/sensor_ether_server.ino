@@ -57,9 +57,29 @@ TO USE:
   Temperature: 34.47 degrees C<br />
   Pressure: 953.67 Pa<br />
 
+  Or, in the format that Prometheus scrapes:
+
+  $ curl sensor_ether_server.local/metrics
+  # HELP temperature_celsius Temperature (fake).
+  # TYPE temperature_celsius gauge
+  temperature_celsius 34.47
+  ...
+
+  Or the readings of the last few minutes (a sample every 10 seconds), as
+  JSON, where t is millis() when the sample was taken; pass the t of the last
+  sample received as since, and only the newer samples are returned:
+
+  $ curl 'sensor_ether_server.local/history?since=170000'
+  {"now":183512,"columns":["t","temperature","pressure"],
+   "samples":[[180000,34.4,953.6]]}
+
 NOTE: Due to the size of the libraries, and all the print statements, this
-sketch uses most of the memory in a 32KB flash. If you are adapting it for
-working with your actual sensors, you may want to drop the print statements.
+sketch has long used most of the memory in a 32KB flash, and it has since
+grown: the request parser, the /metrics and /history handlers (with
+ResponseWriter, JsonWriter and SensorHistory), EthernetEvents and ArdTime64
+all add code, so check the flash and RAM usage that the IDE reports after
+compiling for your board. If it doesn't fit (e.g. on an Uno), drop the print
+statements first, then /history or /metrics; a Mega has room for all of it.
 
 TODO:
 * Determine if there is a way to detect whether our generated addresses
@@ -79,6 +99,18 @@ TODO:
 #include "addresses.h"
 #include "analog_random.h"
 #include "eeprom_io.h"
+#include "ethernet_events.h"
+#include "http_request.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "response_writer.h"
+#include "sensor_history.h"
+#include "time.h"
+
+using jamessynge::ArdTime;
+using jamessynge::ArdTime64;
+using jamessynge::Milliseconds;
+using jamessynge::Seconds;
 
 // Name we'll advertise using mDNS (Apple's Bonjour protocol).
 const char* kMulticastDnsName = "sensor_ether_server";
@@ -91,10 +123,43 @@ bool using_dhcp = true;
 // (port 80 is default for HTTP):
 EthernetServer server(80);
 
+// Pin connected to the Ethernet chip's INTn output, or -1 if it isn't
+// connected. If it is, loop() sleeps until there is a client to serve (or
+// 100ms have passed, for the housekeeping), rather than polling the chip
+// continuously. Read more in ethernet_events.h.
+const int kEthernetIntPin = -1;
+bool sleep_between_events = false;
+
 // Fake sensor values.
 float temperature;
 float pressure;
 
+// The sensor values, and statistics about the server, served at /metrics for
+// monitoring by Prometheus.
+MetricRegistry metrics;
+HttpServerMetrics server_metrics(&metrics);
+constexpr char kTemperatureMetric[] PROGMEM = "temperature_celsius";
+constexpr char kTemperatureMetricHelp[] PROGMEM = "Temperature (fake).";
+constexpr char kPressureMetric[] PROGMEM = "pressure_pascals";
+constexpr char kPressureMetricHelp[] PROGMEM = "Pressure (fake).";
+Gauge temperature_gauge(&metrics, kTemperatureMetric, kTemperatureMetricHelp);
+Gauge pressure_gauge(&metrics, kPressureMetric, kPressureMetricHelp);
+
+// The history of the sensor values, served at /history, so that a client that
+// misses a poll doesn't lose data. It is sized to hold the last 5 minutes of
+// samples, taken every 10 seconds, while the readings change slowly: 30
+// samples of about 4 bytes each (see sensor_history.h), i.e. 120 bytes of
+// RAM, whatever the board. When the readings jump about, samples are larger,
+// so fewer are kept.
+constexpr jamessynge::ArdDuration kHistoryInterval = Seconds(10);
+constexpr uint8_t kHistorySamples = 30;
+constexpr uint8_t kHistoryChannels = 2;
+constexpr uint16_t kHistoryBytes =
+    kHistorySamples * SensorHistory::typicalSampleSize(kHistoryChannels);
+// The values are stored in tenths of a degree and tenths of a Pa.
+constexpr uint8_t kHistoryDigits[kHistoryChannels] = {1, 1};
+SensorHistoryBuffer<kHistoryBytes> history(kHistoryChannels);
+
 void setup() {
   // As described on the freetronics website, there is a delay between the reset
   // of the EtherTen board and the time when the Ethernet chip is allowed to
@@ -230,6 +295,12 @@ void setup() {
 
   // Start listening for clients
   server.begin();
+
+  if (kEthernetIntPin >= 0) {
+    sleep_between_events = EthernetEvents::begin(kEthernetIntPin);
+    Serial.print("Sleeping between events: ");
+    Serial.println(sleep_between_events ? "yes" : "NO");
+  }
 }
 
 void printChangedLinkStatus() {
@@ -262,6 +333,12 @@ void printChangedLinkStatus() {
 }
 
 void loop() {
+  server_metrics.loopIteration();
+  // Before checking the sockets, so that any event after this ends the sleep
+  // below.
+  if (sleep_between_events) {
+    EthernetEvents::acknowledge();
+  }
   printChangedLinkStatus();
 
   // If we're using an IP address assigned via DHCP, renew the lease
@@ -272,6 +349,7 @@ void loop() {
       case 1: // Renew failed
       case 3: // Rebind failed
         Serial.println("WARNING! lost our DHCP assigned address!");
+        server_metrics.dhcp_failures.increment();
         // MIGHT want to just return at this point, since the rest won't work.
         // Or for a very robust product, use a digital output pin connected to
         // the RESET pin, and force the Arduino to reset if it loses its lease.
@@ -287,19 +365,25 @@ void loop() {
   readFakeSensors();
   blink(1000);
 
-  // listen for incoming Ethernet connections:
-  listenForEthernetClients();
+  // listen for incoming Ethernet connections, and if there were none, sleep
+  // until there is one; if there was one, there may be another waiting.
+  if (!listenForEthernetClients() && sleep_between_events) {
+    EthernetEvents::sleep(100);
+  }
 }
 
 // Something is odd about the behavior here. If I just run blink(1000) and
 // nothing else, all is well, but if I run the rest of the demo too, then D13
 // blinks really fast, an is off most of the time. Not sure why yet.
 void blink(unsigned long interval) {
-  static unsigned long lastBlink = 0;
+  static ArdTime64 lastBlink;
   static bool ledIsOn = false;
 
-  unsigned long nextBlink = lastBlink + interval;
-  unsigned long now = millis();
+  // ArdTime64 doesn't wrap around, so there is no need to handle millis()
+  // rolling over.
+  const ArdTime64 nextBlink =
+      lastBlink + Milliseconds(static_cast<long>(interval));
+  const ArdTime64 now = ArdTime64::Now();
 
 //#define DEBUG_BLINK
 #ifdef DEBUG_BLINK
@@ -313,22 +397,7 @@ void blink(unsigned long interval) {
   Serial.print(now);
 #endif  // DEBUG_BLINK
 
-  if (nextBlink < lastBlink) {
-    // Wrapped around.
-    if (now >= lastBlink) {
-#ifdef DEBUG_BLINK
-      Serial.println("   millis hasn't wrapped yet, so not time.");
-#endif  // DEBUG_BLINK
-      return;
-    } else if (now < nextBlink) {
-#ifdef DEBUG_BLINK
-      Serial.println("   Wrapped, but not time yet.");
-#endif  // DEBUG_BLINK
-      return;
-    }
-  } else if (now < lastBlink) {
-    // Clock has wrapped around, so past due for blinking!
-  } else if (now < nextBlink) {
+  if (now < nextBlink) {
     // Not time yet.
 #ifdef DEBUG_BLINK
     Serial.println("   Not time yet.");
@@ -347,50 +416,65 @@ void blink(unsigned long interval) {
 #endif  // DEBUG_BLINK
 }
 
-void listenForEthernetClients() {
+// A client that sends nothing for this long is sent a 408 (Request Timeout)
+// response, as SimpleHttpServer does, so that it can't hold up the loop.
+constexpr unsigned long kRequestTimeoutMs = 5000;
+
+// Returns true if there was a client to serve.
+bool listenForEthernetClients() {
   // Is there a client that connected since we last checked?
   EthernetClient client = server.available();
   if (!client) {
-    return;
+    return false;
   }
   Serial.println("Got a client!!");
-  // We take an EXTREMELY simple approach to "parsing" (consuming) the HTTP
-  // request: we read until we get a blank line, as every HTTP request header
-  // block ends with \r\n\r\n (i.e. two line endings). We assume that the
-  // request is not a PUT or POST, i.e. has no body, and we certainly don't
-  // try to read it.
-  boolean currentLineIsBlank = true;
-  while (client.connected()) {
-    if (client.available()) {
-      char c = client.read();
-      // As a debugging aid, print every character in the HTTP request header.
-      Serial.print(c);
-      // If you've gotten to the end of the line (received a newline
-      // character) and the line is blank, the HTTP request has ended,
-      // so you can send a reply.
-      if (c == '\n' && currentLineIsBlank) {
-        // Send a standard http response header
-        client.println("HTTP/1.1 200 OK");
-        client.println("Content-Type: text/html");
-        client.println();
-        // Print the current readings, in HTML format:
-        client.print("Temperature: ");
-        client.print(temperature);
-        client.print(" degrees C");
-        client.println("<br/>");
-        client.print("Pressure: " + String(pressure));
-        client.print(" Pa");
-        client.println("<br/>");
-        break;
+  // Parse the request as it arrives, until we have the whole of the request
+  // header block (which ends with a blank line), so that we know which path
+  // was requested. We assume that the request is not a PUT or POST, i.e. has
+  // no body, and we certainly don't try to read it.
+  HttpRequestParser parser;
+  unsigned long lastReadMs = millis();
+  bool timedOut = false;
+  while (client.connected() &&
+         parser.status() == HttpRequestParser::kIncomplete) {
+    uint8_t buf[32];
+    const int n = client.read(buf, sizeof buf);
+    if (n > 0) {
+      parser.consume(buf, n);
+      lastReadMs = millis();
+    } else if (millis() - lastReadMs >= kRequestTimeoutMs) {
+      timedOut = true;
+      break;
+    }
+  }
+  const HttpRequest& request = parser.request();
+  switch (parser.status()) {
+    case HttpRequestParser::kIncomplete:
+      // Either the client closed the connection before sending the whole
+      // request, or it stopped sending.
+      if (timedOut) {
+        client.print("HTTP/1.1 408 Request Timeout\r\n"
+                     "Content-Length: 0\r\nConnection: close\r\n\r\n");
       }
-      if (c == '\n') {
-        // you're starting a new line
-        currentLineIsBlank = true;
-      } else if (c != '\r') {
-        // you've gotten a character on the current line
-        currentLineIsBlank = false;
+      break;
+    case HttpRequestParser::kComplete:
+      server_metrics.requests.increment();
+      // As a debugging aid, print the path that was requested.
+      Serial.println(request.path);
+      if (strcmp(request.path, "/metrics") == 0) {
+        metrics.sendResponse(request, &client);
+      } else if (strncmp(request.path, "/history", 8) == 0 &&
+                 (request.path[8] == 0 || request.path[8] == '?')) {
+        sendHistory(request, &client);
+      } else {
+        sendReadings(request, &client);
       }
-    }
+      break;
+    default:
+      server_metrics.parse_errors.increment();
+      client.print("HTTP/1.1 400 Bad Request\r\n"
+                   "Content-Length: 0\r\nConnection: close\r\n\r\n");
+      break;
   }
   // Give the web browser time to receive the data.
   // NOT SURE WHY THIS IS HERE. Maybe the Ethernet chip will drop pending data
@@ -398,6 +482,56 @@ void listenForEthernetClients() {
   delay(1);
   // Close the TCP connection.
   client.stop();
+  return true;
+}
+
+// Send a standard http response header, and the current readings, in HTML
+// format. The writer buffers the response so that it is sent in one packet,
+// rather than one per print.
+void sendReadings(const HttpRequest& request, EthernetClient* client) {
+  ResponseWriterBuffer<128> writer(client);
+  writer.beginResponse("200 OK", request);
+  writer.header("Content-Type", "text/html");
+  writer.beginBody();
+  writer.print("Temperature: ");
+  writer.print(temperature);
+  writer.println(" degrees C<br/>");
+  writer.print("Pressure: ");
+  writer.print(pressure);
+  writer.println(" Pa<br/>");
+  writer.endResponse();
+}
+
+// Sends the samples in the history, or if the query parameter since (i.e.
+// /history?since=<ms>) is given, those taken after that time.
+void sendHistory(const HttpRequest& request, EthernetClient* client) {
+  const char* since = strstr(request.path, "?since=");
+  SensorHistory::Reader reader =
+      since == nullptr
+          ? history.read()
+          : history.readSince(jamessynge::internal::repr_to_ard_time(
+                strtoul(since + 7, nullptr, 10)));
+
+  // Even a short history is too large for the buffer, so is sent in chunks;
+  // the buffer is kept small as it is on the stack, alongside the rest of
+  // the request handling.
+  ResponseWriterBuffer<128> writer(client);
+  writer.beginResponse("200 OK", request);
+  writer.header("Content-Type", "application/json");
+  writer.beginBody();
+  JsonWriter json(&writer);
+  json.beginObject();
+  json.property(F("now"), millis());
+  json.key(F("columns"));
+  json.beginArray();
+  json.value(F("t"));
+  json.value(F("temperature"));
+  json.value(F("pressure"));
+  json.endArray();
+  json.key(F("samples"));
+  reader.writeJson(&json, kHistoryDigits);
+  json.endObject();
+  writer.endResponse();
 }
 
 void seedRNG() {
@@ -411,21 +545,16 @@ void seedRNG() {
 
 void readFakeSensors() {
   static bool first = true;
-  static unsigned long lastReadingTime = 0;
+  static ArdTime64 lastReadingTime;
 
-  unsigned long now = millis();
+  const ArdTime64 now = ArdTime64::Now();
   if (!first) {
     // Check for a reading no more than once a second.
-    if (lastReadingTime > now) {
-      // The clock has wrapped. Not attempting perfect spacing here.
-      lastReadingTime = 0;
-    }
-    unsigned long elapsed = now - lastReadingTime;
-    if (elapsed < 1000) {
+    if (now - lastReadingTime < Seconds(1)) {
       // Too soon.
       return;
     }
-  } 
+  }
   lastReadingTime = now;
 
   float t = random(-400, 1200) / 10.0;
@@ -439,6 +568,18 @@ void readFakeSensors() {
     temperature = (temperature * 99 + t) / 100;
     pressure = (pressure * 99 + p) / 100;
   }
+  temperature_gauge.set(temperature);
+  pressure_gauge.set(pressure);
+
+  static ArdTime64 lastHistoryTime;
+  if (history.count() == 0 || now - lastHistoryTime >= kHistoryInterval) {
+    lastHistoryTime = now;
+    const int16_t values[] = {
+        static_cast<int16_t>(lround(temperature * 10)),
+        static_cast<int16_t>(lround(pressure * 10)),
+    };
+    history.add(ArdTime::Now(), values);
+  }
 
 //  Serial.print("Temperature: ");
 //  Serial.print(temperature);
@@ -0,0 +1 @@
+../utilities/sensor_history.cpp
\ No newline at end of file
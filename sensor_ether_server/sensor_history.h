@@ -0,0 +1 @@
+../utilities/sensor_history.h
\ No newline at end of file
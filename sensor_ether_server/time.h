@@ -0,0 +1 @@
+../utilities/time.h
\ No newline at end of file
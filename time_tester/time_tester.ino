@@ -0,0 +1,300 @@
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "test.h"
+#include "time.h"
+
+using jamessynge::ArdDuration;
+using jamessynge::ArdTime;
+using jamessynge::ArdTime64;
+using jamessynge::Hours;
+using jamessynge::Milliseconds;
+using jamessynge::Minutes;
+using jamessynge::MonotonicClock;
+using jamessynge::ScaleDuration;
+using jamessynge::Seconds;
+
+// Durations are computed at compile time.
+constexpr ArdDuration kFiveMinutes = Minutes(5);
+static_assert(kFiveMinutes == Seconds(300), "Minutes");
+static_assert(Hours(2) - Minutes(30) == Seconds(90 * 60), "Hours");
+static_assert(ScaleDuration(Seconds(261), 16384UL * 3, 16384UL) ==
+                  Seconds(783),
+              "ScaleDuration");
+static_assert(Milliseconds(10) * 3L / 2L == Milliseconds(15), "Arithmetic");
+static_assert((ArdTime64() + Seconds(5)) - ArdTime64() == Seconds(5),
+              "ArdTime64");
+static_assert(ArdTime64() - Seconds(1) > ArdTime64(), "ArdTime64 wraps");
+
+// Captures printed output in a buffer.
+class BufferPrint : public Print {
+public:
+  size_t write(uint8_t b) override {
+    if (len_ + 1 < sizeof buf_) {
+      buf_[len_++] = b;
+      buf_[len_] = 0;
+      return 1;
+    }
+    return 0;
+  }
+  const char* str() const { return buf_; }
+  void clear() {
+    len_ = 0;
+    buf_[0] = 0;
+  }
+
+private:
+  char buf_[32] = {0};
+  size_t len_ = 0;
+};
+
+void testArithmetic() {
+  ArdTime t0;
+  ArdTime t1 = t0 + Seconds(10);
+  EXPECT_TRUE((t1 - t0) == Seconds(10));
+  EXPECT_TRUE((t0 - t1) == Seconds(-10));
+  EXPECT_TRUE(t1 >= t0);
+  EXPECT_FALSE(t0 >= t1);
+  t0 += Milliseconds(10001);
+  EXPECT_TRUE(t0 - t1 == Milliseconds(1));
+
+  // Large ratios that would overflow 32 bits.
+  EXPECT_TRUE(ScaleDuration(Hours(24), 1000000UL, 1000UL) == Hours(24000));
+  EXPECT_TRUE(ScaleDuration(Seconds(-9), 1, 2) == Milliseconds(-4500));
+}
+
+void testPrinting() {
+  BufferPrint p;
+  p.print(Hours(25) + Minutes(2) + Seconds(3) + Milliseconds(4));
+  EXPECT_EQ(strcmp(p.str(), "1d 01:02:03.004"), 0);
+  p.clear();
+  p.print(Milliseconds(-61001));
+  EXPECT_EQ(strcmp(p.str(), "-01:01.001"), 0);
+  p.clear();
+  p.print(ArdTime() + Hours(3));
+  EXPECT_EQ(strcmp(p.str(), "03:00:00.000"), 0);
+}
+
+void testTime64() {
+  // Unlike ArdTime, ArdTime64 goes well past 49.7 days.
+  ArdTime64 t;
+  for (int day = 0; day < 300; ++day) {
+    t += Hours(24);
+  }
+  const ArdTime64 t1 = t + Hours(1);
+  EXPECT_TRUE(t1 > t);
+  EXPECT_TRUE(t1 >= t);
+  EXPECT_TRUE(t < t1);
+  EXPECT_TRUE(t != t1);
+  EXPECT_TRUE(t1 - t == Hours(1));
+  EXPECT_TRUE(t - t1 == Hours(-1));
+  EXPECT_TRUE(t1 - Hours(1) == t);
+
+  BufferPrint p;
+  p.print(t1 + Milliseconds(5));
+  EXPECT_EQ(strcmp(p.str(), "300d 01:00:00.005"), 0);
+}
+
+#ifdef ARDUINO_HOST
+// Moves the virtual clock to just before millis() and micros() wrap around,
+// and checks that the 64-bit clocks keep counting up.
+void testMonotonicClockWraps() {
+  MonotonicClock::Micros64();
+  arduino_host::setVirtualMicros(0xFFFFF000UL);
+  const uint64_t us_before = MonotonicClock::Micros64();
+  arduino_host::advanceMicros(0x2000);
+  const uint64_t us_after = MonotonicClock::Micros64();
+  EXPECT_TRUE(us_before < 0x100000000ULL);
+  EXPECT_TRUE(us_after > 0x100000000ULL);
+  EXPECT_TRUE(us_after - us_before >= 0x2000);
+  EXPECT_TRUE(us_after - us_before < 0x2100);
+
+  MonotonicClock::Millis64();
+  arduino_host::setVirtualMicros((0xFFFFFFFFULL - 5) * 1000);
+  const ArdTime64 before = ArdTime64::Now();
+  const ArdTime before32 = ArdTime::Now();
+  arduino_host::advanceMillis(10);
+  const ArdTime64 after = ArdTime64::Now();
+  const ArdTime after32 = ArdTime::Now();
+  EXPECT_TRUE(after > before);
+  EXPECT_TRUE(after - before == Milliseconds(10));
+  // Whereas the 32-bit time has wrapped around.
+  EXPECT_FALSE(after32 >= before32);
+
+  BufferPrint p;
+  p.print(after);
+  EXPECT_EQ(strcmp(p.str(), "49d 17:02:47.300"), 0);
+}
+#endif  // ARDUINO_HOST
+
+void testPrintingAllFields() {
+  BufferPrint p;
+  p.print(Milliseconds(0));
+  EXPECT_EQ(strcmp(p.str(), "00:00.000"), 0);
+  p.clear();
+  p.print(Hours(23) + Minutes(59) + Seconds(59) + Milliseconds(999));
+  EXPECT_EQ(strcmp(p.str(), "23:59:59.999"), 0);
+  p.clear();
+  p.print(Hours(-24 * 24) - Milliseconds(90));
+  EXPECT_EQ(strcmp(p.str(), "-24d 00:00:00.090"), 0);
+  p.clear();
+  p.print(Minutes(9) + Seconds(10) + Milliseconds(100));
+  EXPECT_EQ(strcmp(p.str(), "09:10.100"), 0);
+}
+
+// Counts the calls made to it, discarding the output.
+class CountingPrint : public Print {
+public:
+  size_t write(uint8_t b) override {
+    ++calls;
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    ++calls;
+    return size;
+  }
+  using Print::write;
+
+  unsigned long calls = 0;
+};
+
+// How ArdTimeParts::printTo used to work, one print call per field or digit,
+// for comparison.
+size_t printWithLeadingZeros(Print& p, unsigned long value, int min_width) {
+  size_t result = 0;
+  if (value >= 10) {
+    result += printWithLeadingZeros(p, value / 10, min_width - 1);
+    value = value % 10;
+    min_width = 0;
+  }
+  while (min_width > 1) {
+    result += p.print('0');
+    --min_width;
+  }
+  return result + p.print(value, DEC);
+}
+
+size_t printPerDigit(Print& p, const jamessynge::ArdTimeParts& parts) {
+  size_t result = 0;
+  if (parts.negative) {
+    result += p.print('-');
+  }
+  bool first = true;
+  if (parts.days > 0) {
+    first = false;
+    result += p.print(parts.days, DEC);
+    result += p.print("d ");
+  }
+  if (!first || parts.hours > 0) {
+    first = false;
+    result += printWithLeadingZeros(p, parts.hours, 2);
+    result += p.print(":");
+  }
+  result += printWithLeadingZeros(p, parts.minutes, 2);
+  result += p.print(":");
+  result += printWithLeadingZeros(p, parts.seconds, 2);
+  result += p.print(".");
+  result += printWithLeadingZeros(p, parts.milliseconds, 3);
+  return result;
+}
+
+void reportPrintBenchmark(const char* name, unsigned long elapsed_us,
+                          unsigned long calls, long timestamps) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(elapsed_us * 1000.0 / timestamps);
+  Serial.print(" ns");
+#ifndef ARDUINO_HOST
+  Serial.print(" (");
+  Serial.print(elapsed_us * (F_CPU / 1000000.0) / timestamps);
+  Serial.print(" cycles)");
+#endif
+  Serial.print(" and ");
+  Serial.print(static_cast<double>(calls) / timestamps);
+  Serial.println(" Print calls per timestamp");
+}
+
+void benchmarkPrinting() {
+  const long kTimestamps = 10000;
+  // Spread across a few days, so some of each form are printed.
+  const ArdDuration kStep = Seconds(37) + Milliseconds(123);
+
+  CountingPrint per_digit;
+  ArdTime64 t;
+  unsigned long begin = BenchmarkMicros();
+  for (long i = 0; i < kTimestamps; ++i) {
+    printPerDigit(per_digit, t.Split());
+    t += kStep;
+  }
+  reportPrintBenchmark("Per digit printing", BenchmarkMicros() - begin,
+                       per_digit.calls, kTimestamps);
+
+  CountingPrint buffered;
+  t = ArdTime64();
+  begin = BenchmarkMicros();
+  for (long i = 0; i < kTimestamps; ++i) {
+    buffered.print(t);
+    t += kStep;
+  }
+  reportPrintBenchmark("Buffered printing", BenchmarkMicros() - begin,
+                       buffered.calls, kTimestamps);
+  EXPECT_EQ(buffered.calls, static_cast<unsigned long>(kTimestamps));
+}
+
+// The arithmetic done for a heartbeat by jitter_population_tester: estimate
+// the time remaining from the fraction of the work done, then choose the
+// interval until the next heartbeat.
+ArdDuration chooseNextHeartbeatInterval(ArdDuration estimated_remaining) {
+  if (estimated_remaining >= Hours(12)) {
+    return Hours(6);
+  } else if (estimated_remaining >= Minutes(90)) {
+    return Hours(1);
+  } else if (estimated_remaining >= Minutes(30)) {
+    return Minutes(20);
+  }
+  return Minutes(5);
+}
+
+volatile uint32_t samples_to_go = 12345;
+
+void benchmarkHeartbeat() {
+  const long kLoops = 10000;
+  const ArdTime start;
+  ArdTime next_heartbeat;
+  const unsigned long begin = BenchmarkMicros();
+  for (long i = 0; i < kLoops; ++i) {
+    const ArdTime now = start + Milliseconds(i);
+    const ArdDuration remaining =
+        ScaleDuration(now - start, samples_to_go, 16384UL + i);
+    next_heartbeat += chooseNextHeartbeatInterval(remaining);
+  }
+  const unsigned long elapsed = BenchmarkMicros() - begin;
+
+  Serial.print("Heartbeat arithmetic: ");
+  Serial.print(elapsed * 1000.0 / kLoops);
+  Serial.print(" ns per heartbeat; next=");
+  Serial.println(next_heartbeat);
+}
+
+void setup() {
+  Serial.begin(9600);
+  delay(500);
+
+  testArithmetic();
+  testPrinting();
+  testPrintingAllFields();
+  testTime64();
+#ifdef ARDUINO_HOST
+  testMonotonicClockWraps();
+#endif
+  benchmarkHeartbeat();
+  benchmarkPrinting();
+
+  Serial.println();
+  Serial.println("##############################################");
+  Serial.println("Test complete");
+  Serial.println("##############################################");
+  Serial.println();
+}
+
+void loop() {}
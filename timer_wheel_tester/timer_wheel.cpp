@@ -0,0 +1 @@
+../utilities/timer_wheel.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../utilities/timer_wheel.h
\ No newline at end of file
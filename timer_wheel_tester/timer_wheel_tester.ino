@@ -0,0 +1,359 @@
+// Tests and benchmarks for TimerWheel. Prints the results to Serial.
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "test.h"
+#include "time.h"
+#include "timer_wheel.h"
+
+using jamessynge::ArdDuration;
+using jamessynge::ArdTime64;
+using jamessynge::Hours;
+using jamessynge::Milliseconds;
+using jamessynge::Minutes;
+using jamessynge::Seconds;
+using jamessynge::TimerWheel;
+using jamessynge::TimerWheelBuffer;
+
+// A deterministic pseudo-random sequence, so that failures can be reproduced.
+uint32_t rng_state = 12345;
+uint32_t nextRandom() {
+  rng_state = rng_state * 1103515245 + 12345;
+  return rng_state >> 8;
+}
+
+// The time passed to the current call of runExpired, and that of the
+// previous call.
+ArdTime64 run_now;
+ArdTime64 prev_run_now;
+
+// What happened to one timer.
+struct TimerRecord {
+  ArdTime64 deadline;
+  TimerWheel::TimerId id;
+  bool cancelled;
+  int fired;
+  ArdTime64 fired_at;
+};
+
+ArdTime64 last_fired_deadline;
+
+void recordFiring(void* context) {
+  TimerRecord* record = static_cast<TimerRecord*>(context);
+  ++record->fired;
+  record->fired_at = run_now;
+  // Called in deadline order, at the first run at or after the deadline.
+  EXPECT_TRUE(record->deadline >= last_fired_deadline);
+  EXPECT_TRUE(record->deadline <= run_now);
+  EXPECT_TRUE(record->deadline > prev_run_now);
+  last_fired_deadline = record->deadline;
+}
+
+void runTo(TimerWheel& wheel, ArdTime64 now) {
+  prev_run_now = run_now;
+  run_now = now;
+  wheel.runExpired(now);
+}
+
+void testEmpty() {
+  TimerWheelBuffer<4> wheel;
+  ArdTime64 deadline;
+  EXPECT_FALSE(wheel.nextDeadline(&deadline));
+  EXPECT_EQ(wheel.runExpired(ArdTime64() + Hours(1)), 0);
+  EXPECT_TRUE(wheel.now() == ArdTime64() + Hours(1));
+  EXPECT_FALSE(wheel.cancel(0));
+  EXPECT_FALSE(wheel.cancel(TimerWheel::kNoTimer));
+}
+
+void testFull() {
+  TimerWheelBuffer<2> wheel;
+  TimerRecord records[3] = {};
+  ASSERT_NE(wheel.schedule(ArdTime64() + Seconds(1), recordFiring, &records[0]),
+            TimerWheel::kNoTimer);
+  const TimerWheel::TimerId id =
+      wheel.schedule(ArdTime64() + Seconds(2), recordFiring, &records[1]);
+  EXPECT_EQ(wheel.schedule(ArdTime64() + Seconds(3), recordFiring, &records[2]),
+            TimerWheel::kNoTimer);
+  EXPECT_EQ(wheel.size(), 2);
+  EXPECT_TRUE(wheel.cancel(id));
+  EXPECT_FALSE(wheel.isPending(id));
+  EXPECT_FALSE(wheel.cancel(id));
+  ASSERT_NE(wheel.schedule(ArdTime64() + Seconds(3), recordFiring, &records[2]),
+            TimerWheel::kNoTimer);
+}
+
+// Schedules timers across the whole range of the wheels, and beyond, cancels
+// some of them, then advances time in random steps, checking that each
+// timer fires exactly once, in order, and that nextDeadline is always right.
+// Returns the number of steps taken.
+int testRandomTimers() {
+  const int kTimers = 48;
+  // Start at an arbitrary time, so that the spans of the slots are not
+  // aligned with the start.
+  TimerWheelBuffer<kTimers> wheel(ArdTime64() +
+                                  Milliseconds(static_cast<long>(nextRandom())));
+  TimerRecord records[kTimers] = {};
+  run_now = wheel.now();
+  prev_run_now = run_now - Milliseconds(1);
+  last_fired_deadline = ArdTime64();
+
+  for (int i = 0; i < kTimers; ++i) {
+    // Spread over powers of 2 up to about 4 hours, so that all of the levels
+    // are used, and the overflow list too.
+    const long range = 1L << (nextRandom() % 24);
+    records[i].deadline = run_now + Milliseconds(static_cast<long>(
+                                       1 + nextRandom() % range));
+    records[i].id = wheel.schedule(records[i].deadline, recordFiring,
+                                   &records[i]);
+    if (records[i].id == TimerWheel::kNoTimer) {
+      ASSERT_FAILED_AT;
+      return 0;
+    }
+  }
+  for (int i = 0; i < kTimers; i += 3) {
+    EXPECT_TRUE(wheel.cancel(records[i].id));
+    records[i].cancelled = true;
+  }
+
+  int steps = 0;
+  while (wheel.size() > 0) {
+    ArdTime64 expected;
+    bool have_expected = false;
+    for (int i = 0; i < kTimers; ++i) {
+      if (!records[i].cancelled && records[i].fired == 0 &&
+          (!have_expected || records[i].deadline < expected)) {
+        expected = records[i].deadline;
+        have_expected = true;
+      }
+    }
+    ArdTime64 deadline;
+    if (!wheel.nextDeadline(&deadline) || !have_expected) {
+      ASSERT_FAILED_AT;
+      return steps;
+    }
+    EXPECT_TRUE(deadline == expected);
+
+    // Mostly small steps, sometimes to just before or at the next deadline,
+    // or a big jump.
+    const uint32_t kind = nextRandom() % 16;
+    ArdTime64 next;
+    if (kind == 0) {
+      next = deadline > run_now ? deadline - Milliseconds(1) : run_now;
+    } else if (kind == 1) {
+      next = deadline;
+    } else if (kind == 2) {
+      next = run_now + Minutes(static_cast<long>(nextRandom() % 30));
+    } else {
+      next = run_now + Milliseconds(static_cast<long>(nextRandom() % 5000));
+    }
+    if (next <= run_now) {
+      next = run_now + Milliseconds(1);
+    }
+    runTo(wheel, next);
+    ++steps;
+
+  }
+  for (int i = 0; i < kTimers; ++i) {
+    EXPECT_EQ(records[i].fired, records[i].cancelled ? 0 : 1);
+  }
+  return steps;
+}
+
+// A periodic timer, which reschedules itself from its callback.
+struct Periodic {
+  TimerWheel* wheel;
+  ArdTime64 next;
+  ArdDuration period;
+  int count;
+};
+
+void periodicCallback(void* context) {
+  Periodic* p = static_cast<Periodic*>(context);
+  ++p->count;
+  p->next += p->period;
+  p->wheel->schedule(p->next, periodicCallback, p);
+}
+
+void immediateCallback(void* context) {
+  ++*static_cast<int*>(context);
+}
+
+void testRescheduleFromCallback() {
+  TimerWheelBuffer<4> wheel;
+  Periodic blink{&wheel, ArdTime64() + Seconds(1), Seconds(1), 0};
+  wheel.schedule(blink.next, periodicCallback, &blink);
+  // Each run catches up with one period at most, as the rescheduled timer is
+  // placed relative to the time being run to.
+  for (long ms = 0; ms <= 10000; ms += 10) {
+    wheel.runExpired(ArdTime64() + Milliseconds(ms));
+  }
+  EXPECT_EQ(blink.count, 10);
+  EXPECT_EQ(wheel.size(), 1);
+
+  // A timer scheduled for a time already reached runs on the next call.
+  int immediate = 0;
+  wheel.schedule(wheel.now(), immediateCallback, &immediate);
+  wheel.schedule(wheel.now() - Seconds(5), immediateCallback, &immediate);
+  ArdTime64 deadline;
+  EXPECT_TRUE(wheel.nextDeadline(&deadline));
+  EXPECT_TRUE(deadline == wheel.now());
+  EXPECT_EQ(wheel.runExpired(wheel.now()), 2);
+  EXPECT_EQ(immediate, 2);
+}
+
+// A timer that cancels another from its callback, as when one event (e.g. a
+// person passing) makes a pending one (an alert) moot.
+TimerWheel::TimerId victim;
+bool victim_cancelled = false;
+int victim_fired = 0;
+
+void cancelVictim(void* context) {
+  victim_cancelled = static_cast<TimerWheel*>(context)->cancel(victim);
+}
+
+void victimCallback(void* context) { ++victim_fired; }
+
+void testCancelFromCallback() {
+  TimerWheelBuffer<4> wheel;
+  // Due in the same millisecond, so they're run by the same call, in either
+  // order; the victim must either fire or be cancelled, not both.
+  const ArdTime64 when = ArdTime64() + Milliseconds(100);
+  victim = wheel.schedule(when, victimCallback, nullptr);
+  wheel.schedule(when, cancelVictim, &wheel);
+  const int count = wheel.runExpired(when);
+  EXPECT_EQ(victim_fired + (victim_cancelled ? 1 : 0), 1);
+  EXPECT_EQ(count, 2 - (victim_cancelled ? 1 : 0));
+  EXPECT_EQ(wheel.size(), 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks.
+
+void countFiring(void*) {}
+
+void printNanosPer(const char* what, unsigned long elapsed_us, long count) {
+  Serial.print(", ");
+  Serial.print(what);
+  Serial.print(" ");
+  Serial.print(elapsed_us * 1000.0 / count);
+  Serial.print(" ns");
+}
+
+// Schedules N timers with deadlines spread over a minute, then cancels and
+// reschedules half of them. Then, in alternate rounds, runs the wheel either
+// in 10ms steps (as a sketch's loop with a delay(10) would) or by sleeping
+// until the next deadline each time, until all have fired.
+template <uint16_t N>
+void benchmarkWheel(TimerWheelBuffer<N>& wheel) {
+  static TimerWheel::TimerId ids[N];
+#ifdef ARDUINO_HOST
+  const long kRounds = 200;
+#else
+  const long kRounds = 4;
+#endif
+  unsigned long schedule_us = 0, cancel_us = 0, next_us = 0;
+  unsigned long poll_us = 0, sleep_us = 0;
+  long polls = 0;
+  long benchmark_fired = 0;
+  for (long round = 0; round < kRounds; ++round) {
+    const ArdTime64 start = wheel.now();
+    unsigned long begin = BenchmarkMicros();
+    for (uint16_t i = 0; i < N; ++i) {
+      ids[i] = wheel.schedule(start + Milliseconds(static_cast<long>(
+                                          1 + nextRandom() % 60000)),
+                              countFiring, nullptr);
+    }
+    schedule_us += BenchmarkMicros() - begin;
+
+    begin = BenchmarkMicros();
+    for (uint16_t i = 0; i < N; i += 2) {
+      wheel.cancel(ids[i]);
+    }
+    cancel_us += BenchmarkMicros() - begin;
+    for (uint16_t i = 0; i < N; i += 2) {
+      wheel.schedule(start + Milliseconds(static_cast<long>(
+                                 1 + nextRandom() % 60000)),
+                     countFiring, nullptr);
+    }
+
+    ArdTime64 deadline;
+    begin = BenchmarkMicros();
+    for (uint16_t i = 0; i < N; ++i) {
+      wheel.nextDeadline(&deadline);
+    }
+    next_us += BenchmarkMicros() - begin;
+
+    begin = BenchmarkMicros();
+    if (round % 2 == 0) {
+      for (ArdTime64 t = start; wheel.size() > 0; t += Milliseconds(10)) {
+        benchmark_fired += wheel.runExpired(t);
+        ++polls;
+      }
+      poll_us += BenchmarkMicros() - begin;
+    } else {
+      while (wheel.nextDeadline(&deadline)) {
+        benchmark_fired += wheel.runExpired(deadline);
+      }
+      sleep_us += BenchmarkMicros() - begin;
+    }
+  }
+  EXPECT_EQ(benchmark_fired, N * kRounds);
+
+  Serial.print(N);
+  Serial.print(" timers");
+  printNanosPer("schedule", schedule_us, N * kRounds);
+  printNanosPer("cancel", cancel_us, (N / 2) * kRounds);
+  printNanosPer("nextDeadline", next_us, N * kRounds);
+  printNanosPer("polling (per runExpired)", poll_us, polls);
+  printNanosPer("sleeping (per timer)", sleep_us, N * (kRounds / 2));
+  Serial.println();
+}
+
+#if defined(ARDUINO_HOST) || RAMEND > 0x8FF
+#define BENCHMARK_64_TIMERS
+#endif
+#ifdef ARDUINO_HOST
+#define BENCHMARK_512_TIMERS
+#endif
+
+TimerWheelBuffer<8> wheel8;
+#ifdef BENCHMARK_64_TIMERS
+TimerWheelBuffer<64> wheel64;
+#endif
+#ifdef BENCHMARK_512_TIMERS
+TimerWheelBuffer<512> wheel512;
+#endif
+
+void setup() {
+  Serial.begin(9600);
+  delay(500);
+
+  testEmpty();
+  testFull();
+  long steps = 0;
+  for (int round = 0; round < 20; ++round) {
+    steps += testRandomTimers();
+  }
+  Serial.print("testRandomTimers took ");
+  Serial.print(steps);
+  Serial.println(" steps");
+  testRescheduleFromCallback();
+  testCancelFromCallback();
+
+  benchmarkWheel(wheel8);
+#ifdef BENCHMARK_64_TIMERS
+  benchmarkWheel(wheel64);
+#endif
+#ifdef BENCHMARK_512_TIMERS
+  benchmarkWheel(wheel512);
+#endif
+
+  Serial.println();
+  Serial.println("##############################################");
+  Serial.println("Test complete");
+  Serial.println("##############################################");
+  Serial.println();
+}
+
+void loop() {}
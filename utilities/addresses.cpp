@@ -5,17 +5,41 @@
 #include "eeprom_io.h"
 
 using eeprom_io::Crc32;
+using eeprom_io::EepromTransaction;
 
 //#define DO_DEBUG
 #include "debug.h"
 
 namespace {
 // This is the name used to identify the data stored in the EEPROM. Changing the
-// value (e.g. between "addrs" and "Addrs") has the effect of invalidating the
+// value (e.g. between "nets" and "Nets") has the effect of invalidating the
 // currently stored values, which can be useful if you want to change the
 // OuiPrefix, or to debug this code.
-const char kName[] = "addrs";
+const char kName[] = "nets";
 
+// The count of profiles and the order are saved after the name, then the
+// profiles in use, followed by the CRC of all of them.
+constexpr size_t kHeaderBytes = 1 + Addresses::kMaxProfiles;
+
+// Bit in the flags byte of a saved profile.
+constexpr uint8_t kStaticFlag = 1;
+
+// Number of EEPROM bytes reserved for Addresses::save: the name (without the
+// terminating NUL), the header, the profiles and the CRC.
+constexpr size_t kSavedBytes =
+    (sizeof kName - 1) + kHeaderBytes +
+    Addresses::kMaxProfiles * Addresses::kProfileBytes + sizeof(uint32_t);
+static_assert(kSavedBytes == Addresses::kEepromBytes,
+              "Update Addresses::kEepromBytes");
+
+// The order is validated with a bitmask.
+static_assert(Addresses::kMaxProfiles <= 8, "Too many profiles");
+
+// The name used by earlier versions, which saved a single IP and MAC address
+// after it, followed by the CRC.
+const char kLegacyName[] = "addrs";
+constexpr size_t kLegacyPayloadBytes = 4 + 6;
+constexpr size_t kLegacyMacOffset = 4;
 
 // A link-local address is in the range 169.254.1.0 to 169.254.254.255,
 // inclusive. Learn more: https://tools.ietf.org/html/rfc3927
@@ -34,6 +58,80 @@ void pickIPAddress(IPAddress* output) {
   (*output)[3] = d;
 }
 
+const char kHexDigits[] = "0123456789ABCDEF";
+
+// Appends the decimal digits of b to out, returning the end of them. Uses
+// comparisons and subtraction, as the AVR has no divide instruction.
+char* appendDecimal(uint8_t b, char* out) {
+  const bool has_tens = b >= 10;
+  if (b >= 200) {
+    *out++ = '2';
+    b -= 200;
+  } else if (b >= 100) {
+    *out++ = '1';
+    b -= 100;
+  }
+  if (has_tens) {
+    // Including a zero after the hundreds digit (e.g. 205).
+    uint8_t tens = 0;
+    while (b >= 10) {
+      ++tens;
+      b -= 10;
+    }
+    *out++ = '0' + tens;
+  }
+  *out++ = '0' + b;
+  return out;
+}
+
+// Appends the NUL terminated string s to out, returning the end of it.
+char* appendString(const char* s, char* out) {
+  while (*s != 0) {
+    *out++ = *s++;
+  }
+  return out;
+}
+
+// Appends label and the address to out, returning the end of them.
+char* appendIPAddress(const char* label, const IPAddress& ip, char* out) {
+  out = appendString(label, out);
+  return out + formatIPAddress(ip, out);
+}
+
+// Stages saving profile at address in txn; returns the address after it.
+int saveProfile(const NetworkProfile& profile, int address,
+                EepromTransaction* txn) {
+  address = profile.mac.save(address, txn);
+  address = txn->putByte(address, profile.use_dhcp ? 0 : kStaticFlag);
+  address = profile.ip.save(address, txn);
+  address = profile.subnet.save(address, txn);
+  address = profile.gateway.save(address, txn);
+  address = profile.dns.save(address, txn);
+  return txn->putBytes(address, reinterpret_cast<const uint8_t*>(profile.name),
+                       sizeof profile.name);
+}
+
+// Reads 4 bytes of src into ip, returning the address after them.
+const uint8_t* decodeIPAddress(const uint8_t* src, IPAddress* ip) {
+  for (int i = 0; i < 4; ++i) {
+    (*ip)[i] = *src++;
+  }
+  return src;
+}
+
+// The inverse of saveProfile, from the kProfileBytes at src.
+void decodeProfile(const uint8_t* src, NetworkProfile* profile) {
+  memcpy(profile->mac.mac, src, 6);
+  src += 6;
+  profile->use_dhcp = (*src++ & kStaticFlag) == 0;
+  src = decodeIPAddress(src, &profile->ip);
+  src = decodeIPAddress(src, &profile->subnet);
+  src = decodeIPAddress(src, &profile->gateway);
+  src = decodeIPAddress(src, &profile->dns);
+  memcpy(profile->name, src, sizeof profile->name);
+  profile->name[NetworkProfile::kMaxNameLength] = 0;
+}
+
 // Will modify the first byte of a MAC address so that it is in the
 // Organizationally Unique Identifier space, and that it is a unicast
 // (rather than multicast) address.
@@ -47,6 +145,35 @@ uint8_t toOuiUnicast(uint8_t macByte1) {
 
 }  // namespace
 
+size_t formatHexBytes(const uint8_t* bytes, size_t size, char sep,
+                      char* out) {
+  char* p = out;
+  for (size_t i = 0; i < size; ++i) {
+    if (i > 0) {
+      *p++ = sep;
+    }
+    *p++ = kHexDigits[bytes[i] >> 4];
+    *p++ = kHexDigits[bytes[i] & 0xF];
+  }
+  *p = 0;
+  return p - out;
+}
+
+size_t formatIPAddress(const IPAddress& ip, char* out) {
+  char* p = appendDecimal(ip[0], out);
+  for (int i = 1; i < 4; ++i) {
+    *p++ = '.';
+    p = appendDecimal(ip[i], p);
+  }
+  *p = 0;
+  return p - out;
+}
+
+size_t printIPAddress(Print& p, const IPAddress& ip) {
+  char buf[kIPAddressChars];
+  return p.write(buf, formatIPAddress(ip, buf));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // An Arduino Ethernet shield (or an freetronics EtherTen board, which I've used
 // to test this code) does not have its own MAC address (the unique identifier
@@ -55,7 +182,8 @@ uint8_t toOuiUnicast(uint8_t macByte1) {
 // the factory, unique world-wide) and locally unique addresses. This code will
 // generate an address in the range allowed for local administered addresses and
 // store it in EEPROM. Note though that there is no support here for probing to
-// ensure that the allocated address is free. Read more about the issue here:
+// ensure that the allocated address is free (ArpProber does that for the IP
+// address, but not for the MAC address). Read more about the issue here:
 //
 //     https://serverfault.com/a/40720
 //     https://en.wikipedia.org/wiki/MAC_address#Universal_vs._local
@@ -80,12 +208,8 @@ OuiPrefix::OuiPrefix(uint8_t a, uint8_t b, uint8_t c) {
 }
 
 size_t OuiPrefix::printTo(Print& p) const {
-  size_t result = p.print(bytes[0], HEX);
-  for (int i = 1; i < 3; ++i) {
-    result += p.print("-");
-    result += p.print(bytes[i], HEX);
-  }
-  return result;
+  char buf[kOuiPrefixChars];
+  return p.write(buf, formatHexBytes(bytes, 3, '-', buf));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -114,12 +238,8 @@ void MacAddress::generateAddress(const OuiPrefix* oui_prefix) {
 };
 
 size_t MacAddress::printTo(Print& p) const {
-  size_t result = p.print(mac[0], HEX);
-  for (int i = 1; i < 6; ++i) {
-    result += p.print("-");
-    result += p.print(mac[i], HEX);
-  }
-  return result;
+  char buf[kMacAddressChars];
+  return p.write(buf, formatHexBytes(mac, 6, '-', buf));
 }
 
 int MacAddress::save(int toAddress, Crc32* crc) const {
@@ -130,6 +250,10 @@ int MacAddress::save(int toAddress, Crc32* crc) const {
   return toAddress + 6;
 }
 
+int MacAddress::save(int toAddress, EepromTransaction* txn) const {
+  return txn->putBytes(toAddress, &mac[0], 6);
+}
+
 int MacAddress::read(int fromAddress, Crc32* crc) {
   eeprom_io::getBytes(fromAddress, 6, &mac[0], crc);
   // for (int i = 0; i < 6; ++i) {
@@ -169,6 +293,13 @@ int SaveableIPAddress::save(int toAddress, Crc32* crc) const {
   return toAddress;
 }
 
+int SaveableIPAddress::save(int toAddress, EepromTransaction* txn) const {
+  for (int i = 0; i < 4; ++i) {
+    toAddress = txn->putByte(toAddress, (*this)[i]);
+  }
+  return toAddress;
+}
+
 int SaveableIPAddress::read(int fromAddress, Crc32* crc) {
   for (int i = 0; i < 4; ++i) {
     const uint8_t b = EEPROM.read(fromAddress++);
@@ -180,6 +311,63 @@ int SaveableIPAddress::read(int fromAddress, Crc32* crc) {
   return fromAddress;
 }
 
+size_t SaveableIPAddress::printTo(Print& p) const {
+  return printIPAddress(p, *this);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void NetworkProfile::generate(const OuiPrefix* oui_prefix) {
+  mac.generateAddress(oui_prefix);
+  use_dhcp = true;
+  pickIPAddress(&ip);
+  subnet = SaveableIPAddress();
+  gateway = SaveableIPAddress();
+  dns = SaveableIPAddress();
+  name[0] = 0;
+}
+
+void NetworkProfile::regenerateIP() {
+  const IPAddress old_ip = ip;
+  do {
+    pickIPAddress(&ip);
+  } while (ip == old_ip);
+}
+
+void NetworkProfile::setName(const char* new_name) {
+  strncpy(name, new_name, kMaxNameLength);
+  name[kMaxNameLength] = 0;
+}
+
+size_t NetworkProfile::format(char* out) const {
+  char* const start = out;
+  out = appendString("MAC=", out);
+  out += formatHexBytes(mac.mac, 6, '-', out);
+  out = appendIPAddress(", IP=", ip, out);
+  if (!use_dhcp) {
+    out = appendIPAddress(", mask=", subnet, out);
+    out = appendIPAddress(", gw=", gateway, out);
+    out = appendIPAddress(", dns=", dns, out);
+  }
+  if (name[0] != 0) {
+    out = appendString(", name=", out);
+    out = appendString(name, out);
+  }
+  *out = 0;
+  return out - start;
+}
+
+size_t NetworkProfile::printTo(Print& p) const {
+  char buf[kMaxChars];
+  return p.write(buf, format(buf));
+}
+
+bool NetworkProfile::operator==(const NetworkProfile& other) const {
+  return mac == other.mac && use_dhcp == other.use_dhcp && ip == other.ip &&
+         subnet == other.subnet && gateway == other.gateway &&
+         dns == other.dns && strcmp(name, other.name) == 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 #ifdef DO_DEBUG
@@ -190,9 +378,20 @@ int SaveableIPAddress::read(int fromAddress, Crc32* crc) {
 
 void Addresses::loadOrGenAndSave(const OuiPrefix* oui_prefix) {
   DBGLN("Entered loadOrGenAndSave");
-  if (load(oui_prefix)) {
+  const LoadStatus status = loadWithStatus(oui_prefix);
+  if (status == LoadStatus::kLoaded) {
     return;
   }
+  if (status == LoadStatus::kNameMismatch && loadLegacy(oui_prefix)) {
+    Serial.print("Converting ");
+    Serial.println(kLegacyName);
+    save();
+    return;
+  }
+  Serial.print("Unable to load ");
+  Serial.print(kName);
+  Serial.print(": ");
+  Serial.println(toString(status));
   // Need to generate a new address.
   generateAddresses(oui_prefix);
   save();
@@ -200,7 +399,7 @@ void Addresses::loadOrGenAndSave(const OuiPrefix* oui_prefix) {
 #ifdef DO_DEBUG
   Addresses loader;
   ASSERT(loader.load(oui_prefix));
-  ASSERT(loader.ip == ip);
+  ASSERT(loader == *this);
 #endif
 
   return;
@@ -210,40 +409,137 @@ void Addresses::save() const {
   Serial.print("Saving ");
   Serial.println(kName);
 
-  int ipAddress = eeprom_io::saveName(0, kName);
-  Crc32 crc;
-  int macAddress = ip.save(ipAddress, &crc);
-  int crcAddress = mac.save(macAddress, &crc);
-  crc.put(crcAddress);
-  // int dataStartAddress = crcAddress + 4;
-  // int dataAddress = ip.save(dataStartAddress, &crc);
-  // dataAddress = mac.save(dataAddress, &crc);
-  // eeprom_io::putCrc(crcAddress, crc);
+  // Only the profiles in use are staged, so the bytes after them are left
+  // alone.
+  eeprom_io::EepromTransactionBuffer<kSavedBytes> txn(0);
+  const int headerAddress = txn.putName(0, kName);
+  int address = txn.putByte(headerAddress, count);
+  address = txn.putBytes(address, order, sizeof order);
+  for (uint8_t i = 0; i < count; ++i) {
+    address = saveProfile(profiles[i], address, &txn);
+  }
+  txn.putCrc(headerAddress, address);
+  txn.commit();
+}
+
+const char* Addresses::toString(LoadStatus status) {
+  switch (status) {
+    case LoadStatus::kLoaded:
+      return "loaded";
+    case LoadStatus::kNameMismatch:
+      return "name mismatch";
+    case LoadStatus::kCrcMismatch:
+      return "CRC mismatch";
+    case LoadStatus::kOuiMismatch:
+      return "OUI prefix mismatch";
+  }
+  return "unknown";
 }
 
 bool Addresses::load(const OuiPrefix* oui_prefix) {
-  int ipAddress;
-  if (!eeprom_io::verifyName(0, kName, &ipAddress)) {
+  return loadWithStatus(oui_prefix) == LoadStatus::kLoaded;
+}
+
+Addresses::LoadStatus Addresses::loadWithStatus(const OuiPrefix* oui_prefix) {
+  int headerAddress;
+  if (!eeprom_io::verifyName(0, kName, &headerAddress)) {
     DBGLN("Stored name mismatch");
-    return false;
+    return LoadStatus::kNameMismatch;
   }
+  // The count determines how many bytes the CRC covers, so is checked first.
   Crc32 crc;
-  int macAddress = ip.read(ipAddress, &crc);
-  int crcAddress = mac.read(macAddress, &crc);
-  if (!crc.verify(crcAddress)) {
+  uint8_t header[kHeaderBytes];
+  eeprom_io::getBytes(headerAddress, sizeof header, header, &crc);
+  const uint8_t loaded_count = header[0];
+  if (loaded_count == 0 || loaded_count > kMaxProfiles) {
+    DBGLN("Stored count invalid");
+    return LoadStatus::kCrcMismatch;
+  }
+  uint8_t payload[kMaxProfiles * kProfileBytes];
+  const int payloadAddress = headerAddress + sizeof header;
+  const size_t payloadBytes = loaded_count * kProfileBytes;
+  eeprom_io::getBytes(payloadAddress, payloadBytes, payload, &crc);
+  if (!eeprom_io::verifyCrc(payloadAddress + payloadBytes, crc)) {
     DBGLN("Stored crc mismatch");
+    return LoadStatus::kCrcMismatch;
+  }
+  // The order must list each profile once.
+  const uint8_t* const loaded_order = header + 1;
+  uint8_t seen = 0;
+  for (uint8_t i = 0; i < loaded_count; ++i) {
+    const uint8_t index = loaded_order[i];
+    if (index >= loaded_count || (seen & (1 << index)) != 0) {
+      DBGLN("Stored order invalid");
+      return LoadStatus::kCrcMismatch;
+    }
+    seen |= 1 << index;
+  }
+  // Only the generated MAC addresses (i.e. of profiles using DHCP) need have
+  // the prefix.
+  if (oui_prefix) {
+    for (uint8_t i = 0; i < loaded_count; ++i) {
+      const uint8_t* const saved = payload + i * kProfileBytes;
+      if ((saved[6] & kStaticFlag) == 0 &&
+          memcmp(saved, oui_prefix->bytes, 3) != 0) {
+        DBGLN("Stored OUI prefix mismatch");
+        return LoadStatus::kOuiMismatch;
+      }
+    }
+  }
+  for (uint8_t i = 0; i < loaded_count; ++i) {
+    decodeProfile(payload + i * kProfileBytes, &profiles[i]);
+  }
+  count = loaded_count;
+  memcpy(order, loaded_order, sizeof order);
+  return LoadStatus::kLoaded;
+}
+
+bool Addresses::loadLegacy(const OuiPrefix* oui_prefix) {
+  uint8_t payload[kLegacyPayloadBytes];
+  if (eeprom_io::readNamedBytes(0, kLegacyName, payload, sizeof payload) !=
+      eeprom_io::ReadStatus::kOk) {
     return false;
   }
-  if (oui_prefix && !mac.hasOuiPrefix(*oui_prefix)) {
-    DBGLN("Stored OUI prefix mismatch");
+  NetworkProfile profile;
+  memcpy(profile.mac.mac, payload + kLegacyMacOffset, 6);
+  if (oui_prefix && !profile.mac.hasOuiPrefix(*oui_prefix)) {
     return false;
   }
+  decodeIPAddress(payload, &profile.ip);
+  count = 0;
+  addProfile(profile);
   return true;
 }
 
 void Addresses::generateAddresses(const OuiPrefix* oui_prefix) {
-  mac.generateAddress(oui_prefix);
-  pickIPAddress(&ip);
+  count = 0;
+  NetworkProfile profile;
+  profile.generate(oui_prefix);
+  addProfile(profile);
+}
+
+uint8_t Addresses::addProfile(const NetworkProfile& profile) {
+  if (count >= kMaxProfiles) {
+    return kMaxProfiles;
+  }
+  profiles[count] = profile;
+  order[count] = count;
+  return count++;
+}
+
+bool Addresses::markSuccessful(uint8_t index) {
+  uint8_t pos = 0;
+  while (pos < count && order[pos] != index) {
+    ++pos;
+  }
+  if (pos == 0 || pos == count) {
+    return false;
+  }
+  for (; pos > 0; --pos) {
+    order[pos] = order[pos - 1];
+  }
+  order[0] = index;
+  return true;
 }
 
 void Addresses::println(const char* prefix) const {
@@ -254,15 +550,31 @@ void Addresses::println(const char* prefix) const {
 }
 
 size_t Addresses::printTo(Print& p) const {
-  size_t result = p.print(kName);
-  result += p.print(": MAC=");
-  result += p.print(mac);
-  result += p.print(", IP=");
-  result += p.print(ip);
-  return result;
+  // The whole line is formatted first, so that it is printed with one write.
+  // The profiles are listed in order, most recently used first, each
+  // preceded by "; #", its index (at most 3 digits) and a space.
+  constexpr char kSeparator[] = "; #";
+  char buf[sizeof kName + kMaxProfiles * (sizeof kSeparator + 3 +
+                                          NetworkProfile::kMaxChars)];
+  char* out = appendString(kName, buf);
+  *out++ = ':';
+  for (uint8_t i = 0; i < count; ++i) {
+    out = appendString(i == 0 ? " #" : kSeparator, out);
+    out = appendDecimal(order[i], out);
+    *out++ = ' ';
+    out += profiles[order[i]].format(out);
+  }
+  return p.write(buf, out - buf);
 }
 
-
 bool Addresses::operator==(const Addresses& other) const {
-  return ip == other.ip && mac == other.mac;
+  if (count != other.count) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; ++i) {
+    if (order[i] != other.order[i] || !(profiles[i] == other.profiles[i])) {
+      return false;
+    }
+  }
+  return true;
 }
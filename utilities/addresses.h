@@ -14,6 +14,29 @@
 
 void printMACAddress(byte mac[6]);
 
+// Formatting of addresses as text in a buffer (e.g. on the stack), so that
+// each is printed with a single write, rather than a print call per byte,
+// each of which may be a separate packet if the Print is an EthernetClient.
+// Hex bytes always have two digits (i.e. 52-C4-05-..., not 52-C4-5-...).
+// The buffer sizes include the terminating NUL.
+constexpr size_t kOuiPrefixChars = 9;    // 52-C4-05
+constexpr size_t kMacAddressChars = 18;  // 52-C4-05-0A-0B-0C
+constexpr size_t kIPAddressChars = 16;   // 255.255.255.255
+
+// Writes size bytes to out as pairs of upper case hex digits, separated by
+// sep, followed by a NUL; out must have room for 3 * size chars (or 1 if
+// size is 0). Returns the number of chars before the NUL.
+size_t formatHexBytes(const uint8_t* bytes, size_t size, char sep, char* out);
+
+// Writes ip to out in dotted-quad form (e.g. 169.254.1.23), followed by a
+// NUL; out must have room for kIPAddressChars. Returns the number of chars
+// before the NUL.
+size_t formatIPAddress(const IPAddress& ip, char* out);
+
+// Prints ip in dotted-quad form with a single write; IPAddress::printTo
+// makes 7 print calls.
+size_t printIPAddress(Print& p, const IPAddress& ip);
+
 
 // Organizationally Unique Identifier: first 3 bytes of a MAC address that is
 // NOT a globally unique address. The 
@@ -42,6 +65,10 @@ struct MacAddress : Printable {
   // the saved MAC address.
   int save(int toAddress, eeprom_io::Crc32* crc) const;
 
+  // Stages saving to the specified address in txn; returns the address after
+  // the MAC address.
+  int save(int toAddress, eeprom_io::EepromTransaction* txn) const;
+
   // Reads from the specified address in the EEPROM; returns the address after
   // the restored MAC address.
   int read(int fromAddress, eeprom_io::Crc32* crc);
@@ -60,55 +87,178 @@ class SaveableIPAddress : public IPAddress {
 public:
   // Inherit the base class constructors.
   using IPAddress::IPAddress;
+  SaveableIPAddress() = default;
+  SaveableIPAddress(const IPAddress& ip) : IPAddress(ip) {}
 
   // Saves to the specified address in the EEPROM; returns the address after
   // the saved value.
   int save(int toAddress, eeprom_io::Crc32* crc) const;
 
+  // Stages saving to the specified address in txn; returns the address after
+  // the value.
+  int save(int toAddress, eeprom_io::EepromTransaction* txn) const;
+
   // Reads from the specified address in the EEPROM; returns the address after
   // the restored value.
   int read(int fromAddress, eeprom_io::Crc32* crc);
+
+  // Prints with a single write; see printIPAddress.
+  size_t printTo(Print& p) const override;
+};
+
+// The maximum number of profiles in Addresses. Each costs about 50 bytes of
+// RAM while loaded (e.g. during SimpleHttpServer::setup), and 39 bytes of
+// EEPROM.
+#ifndef ADDRESSES_MAX_PROFILES
+#define ADDRESSES_MAX_PROFILES 3
+#endif
+
+// A network identity for the device: its MAC address, and either a
+// link-local IP address to use until (or unless) DHCP provides one, or a
+// static IP configuration. Boards moved between networks (e.g. a lab and
+// production subnets) can have a profile for each; see Addresses.
+struct NetworkProfile : Printable {
+  static constexpr uint8_t kMaxNameLength = 15;
+
+  // Randomly generate the MAC address (with the specified OuiPrefix if
+  // supplied) and a link-local IP address, and use DHCP; see
+  // Addresses::generateAddresses.
+  void generate(const OuiPrefix* oui_prefix);
+
+  // Picks another link-local IP address, keeping the MAC address, e.g.
+  // because the current one is in use by another device. Doesn't save it.
+  void regenerateIP();
+
+  // Copies name, truncated to kMaxNameLength chars.
+  void setName(const char* name);
+
+  // The most chars that format produces, including the terminating NUL.
+  static constexpr size_t kMaxChars =
+      sizeof "MAC=, IP=, mask=, gw=, dns=, name=" + (kMacAddressChars - 1) +
+      4 * (kIPAddressChars - 1) + kMaxNameLength;
+
+  // Formats the MAC and IP addresses, and for a static profile the netmask,
+  // gateway and DNS server, followed by the name if not empty, into out,
+  // which must have room for kMaxChars, terminated by a NUL. Returns the
+  // number of chars before the NUL.
+  size_t format(char* out) const;
+
+  // Prints what format produces with a single write.
+  size_t printTo(Print&) const override;
+
+  bool operator==(const NetworkProfile& other) const;
+
+  MacAddress mac;
+  // If true, ip is a link-local address, used until DHCP provides a lease,
+  // and the other addresses come from the lease. Else the 4 addresses are
+  // a static configuration, and DHCP isn't used.
+  bool use_dhcp = true;
+  SaveableIPAddress ip;
+  SaveableIPAddress subnet;
+  SaveableIPAddress gateway;
+  SaveableIPAddress dns;
+  // The name to advertise with mDNS; empty if the sketch's default is to be
+  // used.
+  char name[kMaxNameLength + 1] = "";
 };
 
-// A pair of addresses (MAC and IP); the two are needed togther when working
-// with the Arduino Ethernet library. Supports saving to EEPROM and later
-// reading it back from EEPROM. This is useful because it allows us to generate
-// random addresses when we first boot up a sketch, and then use those same
-// addresses each time the sketch boots up in the future; this may make it
-// easier for the person using the sketch to find their device on the LAN.
+// A table of network profiles (e.g. one with generated addresses, using
+// DHCP, and one with a static configuration for a lab), and the order in
+// which they were last used successfully. Supports saving to EEPROM and later
+// reading it back from EEPROM. This is useful because it allows us to
+// generate random addresses when we first boot up a sketch, and then use
+// those same addresses each time the sketch boots up in the future; this may
+// make it easier for the person using the sketch to find their device on the
+// LAN. See SimpleHttpServer::setup for how the profile is chosen.
+//
+// The table is saved as a single record: the name, the number of profiles,
+// the order, the profiles in use, and one CRC over all of them, so it is
+// loaded in one pass over the EEPROM, and unused profiles aren't written.
+// Addresses saved by an earlier version of this code (a single MAC and IP
+// address) are loaded as the first profile.
 struct Addresses : Printable {
-  // Load the saved addresses, which must have the oui_prefix if specified;
-  // if unable to load them (not stored or wrong prefix), generate addresses
-  // and store them in the EEPROM.
+  static constexpr uint8_t kMaxProfiles = ADDRESSES_MAX_PROFILES;
+  static_assert(kMaxProfiles > 0, "Need at least one profile");
+
+  // The number of bytes saved per profile: MAC address, a byte of flags,
+  // 4 IP addresses, and the name.
+  static constexpr int kProfileBytes =
+      6 + 1 + 4 * 4 + NetworkProfile::kMaxNameLength + 1;
+
+  // The number of bytes of EEPROM, from address 0, reserved for save (i.e.
+  // with kMaxProfiles profiles); other records (e.g. DhcpLease) are saved
+  // after them.
+  static constexpr int kEepromBytes =
+      4 + 1 + kMaxProfiles + kMaxProfiles * kProfileBytes + 4;
+
+  // Load the saved profiles, of which those using DHCP must have the
+  // oui_prefix if specified; if unable to load them (not stored or wrong
+  // prefix), generate a single profile and store it in the EEPROM.
   void loadOrGenAndSave(const OuiPrefix* oui_prefix);
 
-  // Save this struct's fields to EEPROM at address 0.
+  // Save this struct's fields to EEPROM at address 0. Only the bytes that
+  // have changed are written.
   void save() const;
 
+  // Identifies the check that failed when loading.
+  enum class LoadStatus : uint8_t {
+    kLoaded,
+    kNameMismatch,
+    // Also reported if the number of profiles or their order is invalid.
+    kCrcMismatch,
+    kOuiMismatch,
+  };
+  static const char* toString(LoadStatus status);
+
   // Restore this struct's fields from EEPROM, starting at address 0.
   // Returns true if successful (i.e. the named and CRC matched),
   // false otherwse.
   bool load(const OuiPrefix* oui_prefix);
 
-  // Randomly generate MAC and IPAddress. The MAC address has the specified OuiPrefix
-  // if supplied (else it is random), and the IPAddress is in the link local
-  // address range (169.254.1.0 to 169.254.254.255, according to RFC 3927).
-  // No support is provided for detecting conflicts with other users of the
-  // generated addresses.
+  // Like load, but reports which check failed. The EEPROM is read in a single
+  // pass, and the fields are only modified if all the checks pass.
+  LoadStatus loadWithStatus(const OuiPrefix* oui_prefix);
+
+  // Replaces the table with a single profile, with a randomly generated MAC
+  // address (with the specified OuiPrefix if supplied, else random) and an
+  // IP address in the link local address range (169.254.1.0 to
+  // 169.254.254.255, according to RFC 3927), using DHCP.
+  // Conflicts with other users of the IP address are detected by ArpProber
+  // when it is used (see SimpleHttpServer::setup), which then calls
+  // NetworkProfile::regenerateIP.
   // The Arduino random number library is used, so be sure to seed it according
   // to the level or randomness you want in the generated address; if you don't
   // set the seed, the same sequence of numbers is always produced.
   void generateAddresses(const OuiPrefix* oui_prefix);
 
+  // Appends profile to the table, as the least recently used. Returns its
+  // index, or kMaxProfiles if the table is full. Doesn't save it.
+  uint8_t addProfile(const NetworkProfile& profile);
+
+  // Makes the profile at index the most recently used. Returns true if the
+  // order changed (i.e. needs saving).
+  bool markSuccessful(uint8_t index);
+
   // Print the addresses, preceded by a prefix (if provided) and followed by a
   // newline.
   void println(const char* prefix=nullptr) const;
+
+  // Prints the profiles, most recently used first, with a single write. The
+  // line is formatted on the stack, which takes about 135 bytes per profile.
   size_t printTo(Print&) const override;
 
   bool operator==(const Addresses& other) const;
 
-  SaveableIPAddress ip;
-  MacAddress mac;
+  NetworkProfile profiles[kMaxProfiles];
+  uint8_t count = 0;
+  // Indices into profiles, the most recently used successfully first; the
+  // first count are valid.
+  uint8_t order[kMaxProfiles] = {};
+
+ private:
+  // Loads the single MAC and IP address saved by earlier versions as the
+  // only profile. Returns false if they aren't there, or lack oui_prefix.
+  bool loadLegacy(const OuiPrefix* oui_prefix);
 };
 
 #endif  // SENSOR_ETHER_SERVER_ADDRESSES_H
@@ -59,12 +59,7 @@ int AnalogRandom::randomBit(int readLimit) {
   // even when reading a pin that is hooked up to a fairly stable voltage). The
   // idea is that we can "debias" a biased source of numbers (e.g. an unfair
   // coin) by taking two readings of the source at a time rather than one, each
-  // reading producing 1 bit. Our action table is:
-  //
-  //   0,0: Try again
-  //   0,1: Output a 1
-  //   1,0, Output a 0
-  //   1,1: Try again.
+  // reading producing 1 bit; see extract.
   //
   // We don't know what is hooked up to our analog pins, so it is possible that
   // there is more correlation on some pins than on others (e.g. a slowly rising
@@ -78,8 +73,35 @@ int AnalogRandom::randomBit(int readLimit) {
   // which in turn is based on earlier work, at least back to Alan Turing.
   // I first read about this in either C/C++ Users Journal or Dr. Dobbs,
   // but haven't found the original reference.
+  if (pool_count_ == 0 && !refill(readLimit)) {
+    // Not good, didn't find enough randomness.
+    return -1;
+  }
+  const int bit = pool_ & 1;
+  pool_ >>= 1;
+  --pool_count_;
+  return bit;
+}
 
+bool AnalogRandom::refill(int readLimit) {
   do {
+    extract(readBlock(), kBlockReads, kExtractDepth, &pool_, &pool_count_);
+    if (pool_count_ > 0) {
+      return true;
+    }
+    // Nothing extracted (e.g. all the readings were the same), so we'll try
+    // again until we've read at least readLimit times.
+    readLimit -= kBlockReads;
+  } while (readLimit > 0);
+  return false;
+}
+
+uint32_t AnalogRandom::readBlock() {
+  if (free_running_block_ != nullptr) {
+    return free_running_block_();
+  }
+  uint32_t raw = 0;
+  for (uint8_t i = 0; i < kBlockReads; i += 2) {
     // Cycle through the pin numbers.
     int pinNum = next_pin_++ % kNumAnalogPins;
     if (next_pin_ >= kNumAnalogPins) {
@@ -88,18 +110,52 @@ int AnalogRandom::randomBit(int readLimit) {
     // Translate from pin number to pin identifier (e.g. from 3 to A3).
     int pinId = kAnalogPinTable[pinNum];
     // Read the analog pin twice, keeping just the low order bit each time.
-    int bit0 = analogRead(pinId) & 1;
-    int bit1 = analogRead(pinId) & 1;
-    // And if they are different, output bit1.
-    if (bit1 != bit0) {
-      return bit1;
+    raw |= static_cast<uint32_t>(analogRead(pinId) & 1) << i;
+    raw |= static_cast<uint32_t>(analogRead(pinId) & 1) << (i + 1);
+  }
+  return raw;
+}
+
+void AnalogRandom::extract(uint32_t raw, uint8_t numBits, uint8_t depth,
+                           uint32_t* pool, uint8_t* poolCount) {
+  // Our action table for each pair of bits (a, b) is:
+  //
+  //   0,0: Output nothing; pass 0 to the "equal" iteration
+  //   0,1: Output a 0
+  //   1,0, Output a 1
+  //   1,1: Output nothing; pass 1 to the "equal" iteration
+  //
+  // and a^b is passed to the "xor" iteration. Those two iterations only get
+  // what the Von Neumann extractor throws away: the xor bits say which pairs
+  // differed (and so have the same bias as each other), and the equal bits,
+  // given which pairs were equal, are independent of what was output, so
+  // their randomness isn't spent twice. See Y. Peres, "Iterating von
+  // Neumann's procedure for extracting random bits", Annals of Statistics,
+  // 1992.
+  uint32_t xors = 0;
+  uint32_t equals = 0;
+  uint8_t numXors = 0;
+  uint8_t numEquals = 0;
+  for (uint8_t i = 1; i < numBits; i += 2) {
+    const uint8_t a = raw & 1;
+    const uint8_t b = (raw >> 1) & 1;
+    raw >>= 2;
+    if (a != b) {
+      *pool |= static_cast<uint32_t>(a) << (*poolCount)++;
+    } else {
+      equals |= static_cast<uint32_t>(a) << numEquals++;
     }
-    // Not different, so we'll try again until we've called analogRead at
-    // least readLimit times.
-    readLimit -= 2;
-  } while (readLimit > 0);
-  // Not good, didn't find enough randomness.
-  return -1;
+    xors |= static_cast<uint32_t>(a ^ b) << numXors++;
+  }
+  if (depth == 0) {
+    return;
+  }
+  if (numXors >= 2) {
+    extract(xors, numXors & ~1, depth - 1, pool, poolCount);
+  }
+  if (numEquals >= 2) {
+    extract(equals, numEquals & ~1, depth - 1, pool, poolCount);
+  }
 }
 
 int AnalogRandom::randomByte(int perBitReadLimit) {
@@ -120,6 +176,10 @@ uint32_t AnalogRandom::random32(int perBitReadLimit) {
   }
 }
 
+int AnalogRandom::analogPinId(uint8_t pinNum) {
+  return pinNum < kNumAnalogPins ? kAnalogPinTable[pinNum] : -1;
+}
+
 bool AnalogRandom::randomBits(int numBits, int perBitReadLimit, uint32_t* output) {
   uint32_t result = 0;
   for (int i = 0; i < numBits; ++i) {
@@ -3,11 +3,32 @@
 
 #include <inttypes.h>
 
+// Produces random bits from the low bit of analog pin readings, which is
+// noisy but biased (and how biased depends on what the pin is connected to).
+// The bias is removed with Peres's iterated Von Neumann extractor (see
+// extract), which yields several times as many bits per reading as the plain
+// Von Neumann extractor (~0.65 rather than 0.25 bits per reading when the low
+// bit is unbiased, and ~0.47 rather than 0.16 when it is 1 four times in
+// five; see host/analog_random_extractor_tester.ino).
+//
+// Readings are taken with analogRead (~110us each on an AVR at 16MHz), unless
+// startFreeRunning has been called, in which case the ADC converts
+// continuously and an interrupt handler collects the low bits (~26us each),
+// so randomBit rarely waits.
 class AnalogRandom {
   public:
+    // The readings are taken, and their bits extracted, in blocks of this
+    // many. Each pair of readings is taken from the same pin.
+    static constexpr uint8_t kBlockReads = 32;
+
+    // The number of times extract iterates, each time on what the previous
+    // iteration discarded. Each costs a little more stack and time per block,
+    // for ever smaller gains.
+    static constexpr uint8_t kExtractDepth = 4;
+
     // Return a random bit (0 or 1), determined by reading the analog pins.
     // Returns -1 if unable to find enough randomness within readLimit reads
-    // of analog pins.
+    // of analog pins (rounded up to a multiple of kBlockReads).
     int randomBit(int readLimit=100);
 
     // Returns an 8-bit random value, produced by calling randomBit
@@ -26,11 +47,62 @@ class AnalogRandom {
     // randomness, false otherwise.
     bool seedArduinoRNG();
 
+    // startFreeRunning and stopFreeRunning are defined, along with the ADC
+    // interrupt handler (ADC_vect), in analog_random_free_running.cpp, so a
+    // sketch that uses them must include that file too (e.g. with a symlink,
+    // as for analog_random.cpp). Other sketches don't get the handler, and
+    // may define their own.
+    //
+    // Starts the ADC converting analog pin number pinNum (0 for A0, etc.)
+    // continuously ("free-running" mode), with an interrupt handler keeping
+    // the low bit of each conversion in a small pool, from which randomBit
+    // takes its readings. The sketch must not call analogRead until
+    // stopFreeRunning has been called, and only one AnalogRandom may be
+    // free-running at a time. The interrupt handler takes ~10% of the CPU
+    // (on an AVR at 16MHz), so stop once the random bits needed (e.g. a seed
+    // for seedArduinoRNG) have been produced. Returns false if not supported
+    // (i.e. other than on AVR boards) or pinNum isn't an analog pin.
+    bool startFreeRunning(uint8_t pinNum=0);
+
+    // Stops the ADC, restoring the Arduino core's settings for analogRead.
+    void stopFreeRunning();
+
+    // Peres's iterated Von Neumann extractor: appends to *pool (from bit
+    // *poolCount up) the unbiased bits extracted from the low numBits (even,
+    // at most 32) of raw, which are assumed to be independent and equally
+    // biased. At most numBits bits are appended. The first iteration is the
+    // Von Neumann extractor: of each pair of bits, the first is output if
+    // they differ. Each further iteration (up to depth) extracts from the
+    // XORs of the pairs, and from the first of each equal pair.
+    static void extract(uint32_t raw, uint8_t numBits, uint8_t depth,
+                        uint32_t* pool, uint8_t* poolCount);
+
   private:
     bool randomBits(int numBits, int perBitReadLimit, uint32_t* output);
 
+    // Takes kBlockReads readings, and extracts their bits into pool_. Returns
+    // false if none were extracted from the blocks read within readLimit.
+    bool refill(int readLimit);
+
+    // Reads kBlockReads low bits, with analogRead or from the free-running
+    // pool.
+    uint32_t readBlock();
+
+    // Returns the pin identifier (e.g. A3) of analog pin number pinNum (e.g.
+    // 3), or -1 if there is no such pin.
+    static int analogPinId(uint8_t pinNum);
+
+    // Extracted bits not yet returned by randomBit, from the low bit up.
+    uint32_t pool_ = 0;
+    uint8_t pool_count_ = 0;
+
     // We cycle through the analog pins; this is the next one to read.
     uint8_t next_pin_ = 0;
+
+    // Set by startFreeRunning to the function which takes the readings from
+    // the interrupt handler's pool, so that the handler is linked only into
+    // sketches that use it.
+    uint32_t (*free_running_block_)() = nullptr;
 };
 
-#endif  // SENSOR_ETHER_SERVER_ANALOG_RANDOM_H
\ No newline at end of file
+#endif  // SENSOR_ETHER_SERVER_ANALOG_RANDOM_H
@@ -0,0 +1,104 @@
+// AnalogRandom's free-running mode, in which the ADC converts continuously,
+// and an interrupt handler collects the low bit of each conversion. This is
+// separate from analog_random.cpp so that only the sketches which use it get
+// the handler for ADC_vect; see AnalogRandom::startFreeRunning.
+
+#include "analog_random.h"
+
+#include "Arduino.h"
+
+#if defined(__AVR__) && defined(ADATE)
+#include <avr/interrupt.h>
+
+namespace {
+
+// The conversions made in free-running mode, 8 per byte, oldest first.
+// raw_head is written only by the interrupt handler, raw_tail only by
+// readFreeRunningBlock, so no locking is needed.
+constexpr uint8_t kRawRingBytes = 8;  // A power of 2.
+volatile uint8_t raw_ring[kRawRingBytes];
+volatile uint8_t raw_head = 0;
+volatile uint8_t raw_tail = 0;
+uint8_t raw_byte;
+uint8_t raw_bits = 0;
+
+// The ADC clock prescaler for free-running mode, 32 (rather than the Arduino
+// core's 128): at 16MHz the ADC is clocked at 500kHz, so a conversion takes
+// 26us, i.e. over 400 CPU cycles, of which the interrupt handler takes ~40.
+// That is above the 200kHz at which the ADC is accurate to 10 bits, which
+// only adds noise to the low bit.
+constexpr uint8_t kFreeRunningPrescaler = _BV(ADPS2) | _BV(ADPS0);
+
+// ADCSRA as it was before startFreeRunning, for stopFreeRunning to restore.
+uint8_t saved_adcsra;
+
+// Returns AnalogRandom::kBlockReads low bits from the ring, waiting for the
+// interrupt handler as needed.
+uint32_t readFreeRunningBlock() {
+  uint32_t raw = 0;
+  for (uint8_t i = 0; i < AnalogRandom::kBlockReads; i += 8) {
+    while (raw_tail == raw_head) {
+      // Waiting for the interrupt handler.
+    }
+    raw = (raw << 8) | raw_ring[raw_tail];
+    raw_tail = (raw_tail + 1) & (kRawRingBytes - 1);
+  }
+  return raw;
+}
+
+}  // namespace
+
+// Called at the end of each conversion; the next has already started.
+ISR(ADC_vect) {
+  const uint8_t low = ADCL;
+  // Reading ADCL locks the result registers until ADCH is read.
+  const uint8_t high = ADCH;
+  (void)high;
+  raw_byte = (raw_byte << 1) | (low & 1);
+  if (++raw_bits == 8) {
+    raw_bits = 0;
+    const uint8_t next = (raw_head + 1) & (kRawRingBytes - 1);
+    // If the ring is full, the byte is dropped.
+    if (next != raw_tail) {
+      raw_ring[raw_head] = raw_byte;
+      raw_head = next;
+    }
+  }
+}
+
+bool AnalogRandom::startFreeRunning(uint8_t pinNum) {
+  const int pinId = analogPinId(pinNum);
+  if (pinId < 0) {
+    return false;
+  }
+  // Let the Arduino core select the pin's channel and the reference voltage
+  // (which differ from board to board).
+  analogRead(pinId);
+  raw_tail = raw_head;
+  raw_bits = 0;
+  saved_adcsra = ADCSRA;
+  // Auto trigger source: free running.
+  ADCSRB &= ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0));
+  ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) |
+           kFreeRunningPrescaler;
+  free_running_block_ = &readFreeRunningBlock;
+  return true;
+}
+
+void AnalogRandom::stopFreeRunning() {
+  if (free_running_block_ != nullptr) {
+    ADCSRA = saved_adcsra;
+  }
+  free_running_block_ = nullptr;
+}
+
+#else  // Not an AVR board.
+
+bool AnalogRandom::startFreeRunning(uint8_t pinNum) {
+  (void)pinNum;
+  return false;
+}
+
+void AnalogRandom::stopFreeRunning() {}
+
+#endif  // __AVR__ && ADATE
@@ -0,0 +1,254 @@
+#include "arp_prober.h"
+
+#include <Ethernet.h>
+#include <SPI.h>
+#include <utility/w5100.h>
+
+namespace {
+
+// MACRAW mode is only available on socket 0.
+constexpr SOCKET kSocket = 0;
+
+// Offsets within an Ethernet frame carrying an ARP packet for IPv4 over
+// Ethernet.
+constexpr uint8_t kDestMac = 0;
+constexpr uint8_t kSrcMac = 6;
+constexpr uint8_t kEtherType = 12;
+constexpr uint8_t kArp = 14;
+constexpr uint8_t kArpOper = kArp + 6;
+constexpr uint8_t kSenderMac = kArp + 8;
+constexpr uint8_t kSenderIp = kArp + 14;
+constexpr uint8_t kTargetIp = kArp + 24;
+constexpr uint8_t kArpEnd = kArp + 28;
+
+// Hardware type 1 (Ethernet), protocol type 0x0800 (IPv4), hardware address
+// length 6, and protocol address length 4.
+const uint8_t kArpHeader[6] = {0x00, 0x01, 0x08, 0x00, 6, 4};
+
+bool isZero(const uint8_t* p, uint8_t size) {
+  while (size-- > 0) {
+    if (*p++ != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ipEquals(const uint8_t* p, const IPAddress& ip) {
+  for (uint8_t i = 0; i < 4; ++i) {
+    if (p[i] != ip[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void putIp(uint8_t* p, const IPAddress& ip) {
+  for (uint8_t i = 0; i < 4; ++i) {
+    p[i] = ip[i];
+  }
+}
+
+// The socket's 16 bit registers are read a byte at a time, so may change
+// between the bytes; as in the Ethernet library, read until two reads agree.
+uint16_t readFreeSize() {
+  uint16_t value, previous = W5100.readSnTX_FSR(kSocket);
+  while ((value = W5100.readSnTX_FSR(kSocket)) != previous) {
+    previous = value;
+  }
+  return value;
+}
+
+uint16_t readReceivedSize() {
+  uint16_t value, previous = W5100.readSnRX_RSR(kSocket);
+  while ((value = W5100.readSnRX_RSR(kSocket)) != previous) {
+    previous = value;
+  }
+  return value;
+}
+
+// Reads size bytes from the socket's receive buffer at ptr (which wraps
+// around), as the Ethernet library does.
+void readData(uint16_t ptr, uint8_t* dst, uint16_t size) {
+  const uint16_t offset = ptr & W5100.SMASK;
+  const uint16_t src = W5100.RBASE(kSocket) + offset;
+  if (W5100.hasOffsetAddressMapping() || offset + size <= W5100.SSIZE) {
+    W5100.read(src, dst, size);
+  } else {
+    const uint16_t first = W5100.SSIZE - offset;
+    W5100.read(src, dst, first);
+    W5100.read(W5100.RBASE(kSocket), dst + first, size - first);
+  }
+}
+
+void writeData(uint16_t ptr, const uint8_t* src, uint16_t size) {
+  const uint16_t offset = ptr & W5100.SMASK;
+  const uint16_t dst = W5100.SBASE(kSocket) + offset;
+  if (W5100.hasOffsetAddressMapping() || offset + size <= W5100.SSIZE) {
+    W5100.write(dst, src, size);
+  } else {
+    const uint16_t first = W5100.SSIZE - offset;
+    W5100.write(dst, src, first);
+    W5100.write(W5100.SBASE(kSocket), src + first, size - first);
+  }
+}
+
+}  // namespace
+
+void ArpProber::buildRequest(uint8_t* frame, const uint8_t* mac,
+                             const IPAddress& sender_ip,
+                             const IPAddress& target_ip) {
+  memset(frame, 0, kFrameSize);
+  memset(frame + kDestMac, 0xFF, 6);
+  memcpy(frame + kSrcMac, mac, 6);
+  frame[kEtherType] = 0x08;
+  frame[kEtherType + 1] = 0x06;
+  memcpy(frame + kArp, kArpHeader, sizeof kArpHeader);
+  frame[kArpOper + 1] = 1;  // Request.
+  memcpy(frame + kSenderMac, mac, 6);
+  putIp(frame + kSenderIp, sender_ip);
+  // The target MAC is left as zero, as it is unknown.
+  putIp(frame + kTargetIp, target_ip);
+}
+
+bool ArpProber::isConflict(const uint8_t* frame, uint16_t size,
+                           const uint8_t* mac, const IPAddress& ip) {
+  if (size < kArpEnd || frame[kEtherType] != 0x08 ||
+      frame[kEtherType + 1] != 0x06 ||
+      memcmp(frame + kArp, kArpHeader, sizeof kArpHeader) != 0) {
+    return false;
+  }
+  if (memcmp(frame + kSenderMac, mac, 6) == 0) {
+    // Ours, e.g. looped back.
+    return false;
+  }
+  if (ipEquals(frame + kSenderIp, ip)) {
+    // A reply to our probe, or another device announcing or using ip.
+    return true;
+  }
+  // Another device probing for the same address (RFC 5227, section 2.1.1).
+  return isZero(frame + kSenderIp, 4) && ipEquals(frame + kTargetIp, ip) &&
+         frame[kArpOper] == 0 && frame[kArpOper + 1] == 1;
+}
+
+ArpProber::Result ArpProber::begin(const uint8_t* mac, const IPAddress& ip) {
+  memcpy(mac_, mac, sizeof mac_);
+  conflicts_ = 0;
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  if (W5100.readSnSR(kSocket) != SnSR::CLOSED) {
+    SPI.endTransaction();
+    return state_ = Result::kNoSocket;
+  }
+  W5100.writeSnMR(kSocket, SnMR::MACRAW);
+  W5100.execCmdSn(kSocket, Sock_OPEN);
+  const bool opened = W5100.readSnSR(kSocket) == SnSR::MACRAW;
+  SPI.endTransaction();
+  if (!opened) {
+    return state_ = Result::kNoSocket;
+  }
+  open_ = true;
+  restart(ip);
+  return state_;
+}
+
+void ArpProber::restart(const IPAddress& ip) {
+  ip_ = ip;
+  probes_sent_ = 0;
+  state_ = Result::kProbing;
+  // Frames received so far were about the previous address.
+  uint8_t frame[kArpEnd];
+  while (receiveFrame(frame, sizeof frame) > 0) {
+  }
+  sendProbe();
+}
+
+ArpProber::Result ArpProber::poll() {
+  if (state_ != Result::kProbing) {
+    return state_;
+  }
+  uint8_t frame[kArpEnd];
+  uint16_t size;
+  while ((size = receiveFrame(frame, sizeof frame)) > 0) {
+    if (isConflict(frame, size < sizeof frame ? size : sizeof frame, mac_,
+                   ip_)) {
+      if (conflicts_ < 0xFF) {
+        ++conflicts_;
+      }
+      return state_ = Result::kConflict;
+    }
+  }
+  const uint32_t elapsed = static_cast<uint32_t>(millis()) - last_probe_ms_;
+  if (probes_sent_ < kProbeNum) {
+    if (elapsed >= kProbeIntervalMs) {
+      sendProbe();
+    }
+  } else if (elapsed >= kAnnounceWaitMs) {
+    state_ = Result::kAvailable;
+  }
+  return state_;
+}
+
+void ArpProber::announce() {
+  if (open_) {
+    uint8_t frame[kFrameSize];
+    buildRequest(frame, mac_, ip_, ip_);
+    for (uint8_t i = 0; i < kAnnounceNum; ++i) {
+      sendFrame(frame, sizeof frame);
+    }
+  }
+  end();
+}
+
+void ArpProber::end() {
+  if (open_) {
+    SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+    W5100.execCmdSn(kSocket, Sock_CLOSE);
+    SPI.endTransaction();
+    open_ = false;
+  }
+}
+
+void ArpProber::sendProbe() {
+  uint8_t frame[kFrameSize];
+  buildRequest(frame, mac_, IPAddress(0, 0, 0, 0), ip_);
+  sendFrame(frame, sizeof frame);
+  ++probes_sent_;
+  last_probe_ms_ = millis();
+}
+
+uint16_t ArpProber::receiveFrame(uint8_t* buf, uint16_t size) {
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  uint16_t frame_size = 0;
+  if (readReceivedSize() > 0) {
+    // Each frame is preceded by its size, including the 2 bytes of the size.
+    uint16_t ptr = W5100.readSnRX_RD(kSocket);
+    uint8_t header[2];
+    readData(ptr, header, 2);
+    const uint16_t total = (header[0] << 8) | header[1];
+    frame_size = total > 2 ? total - 2 : 0;
+    readData(ptr + 2, buf, frame_size < size ? frame_size : size);
+    W5100.writeSnRX_RD(kSocket, ptr + total);
+    W5100.execCmdSn(kSocket, Sock_RECV);
+  }
+  SPI.endTransaction();
+  return frame_size;
+}
+
+void ArpProber::sendFrame(const uint8_t* frame, uint16_t size) {
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  if (readFreeSize() >= size) {
+    const uint16_t ptr = W5100.readSnTX_WR(kSocket);
+    writeData(ptr, frame, size);
+    W5100.writeSnTX_WR(kSocket, ptr + size);
+    W5100.execCmdSn(kSocket, Sock_SEND);
+    // Wait for the frame to go, so that the next isn't merged with it; that
+    // takes a few microseconds, as there is no ARP or retransmission.
+    for (uint16_t i = 0; i < 1000; ++i) {
+      if (W5100.readSnIR(kSocket) & SnIR::SEND_OK) {
+        break;
+      }
+    }
+    W5100.writeSnIR(kSocket, SnIR::SEND_OK);
+  }
+  SPI.endTransaction();
+}
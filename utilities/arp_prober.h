@@ -0,0 +1,127 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_ARP_PROBER_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_ARP_PROBER_H_
+
+// Checks that a randomly generated link-local address (see Addresses) isn't
+// already in use by another device on the LAN, as described in RFC 3927
+// (section 2.2) and RFC 5227: before using the address, send ARP probes for
+// it (requests with a sender IP address of 0.0.0.0, so that they don't
+// disturb anyone's ARP cache), and if any device replies, or is itself
+// probing for or announcing the address, pick another. Once the address is
+// found to be free, announce it with gratuitous ARP requests.
+//
+// The Arduino Ethernet library has no access to raw frames, so the Wiznet
+// chip's socket 0 is opened in MACRAW mode, which receives the frames not
+// claimed by the other sockets (including ARP, which the chip otherwise
+// handles itself). Socket 0 must therefore be free while probing, i.e.
+// before any server or client is begun.
+//
+// Probing doesn't block: begin sends the first probe, and poll sends the
+// rest and checks the frames received. The replies are buffered by the chip
+// meanwhile, so other work (e.g. DHCP) can be done between calls; for
+// example, in SimpleHttpServer::setup:
+//
+//     ArpProber prober;
+//     prober.begin(mac, ip);
+//     dhcp.begin(mac, cached_lease);
+//     while (prober.poll() == ArpProber::Result::kProbing) {
+//       if (dhcp.poll() == DhcpClient::Event::kBound) {
+//         break;  // Don't need the link-local address.
+//       }
+//     }
+//
+// The RFC's timings (probes 1 to 2 seconds apart, then 2 seconds before
+// using the address) are meant for hosts on WiFi and busy networks; they
+// are shortened here, so that a device without DHCP is serving on its
+// link-local address in under half a second.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "IPAddress.h"
+
+class ArpProber {
+ public:
+  // The number of probes sent for an address, and the time between them.
+  static constexpr uint8_t kProbeNum = 3;
+  static constexpr uint16_t kProbeIntervalMs = 100;
+  // The time after the last probe during which a reply still means that the
+  // address is in use.
+  static constexpr uint16_t kAnnounceWaitMs = 250;
+  // The number of announcements sent once the address is ours.
+  static constexpr uint8_t kAnnounceNum = 2;
+  // The longest that poll can take to decide, from the time begin was
+  // called, if all but the first probe are yet to be sent.
+  static constexpr uint16_t kMaxFinishMs =
+      (kProbeNum - 1) * kProbeIntervalMs + kAnnounceWaitMs;
+
+  // The size of the ARP frames sent: an Ethernet header and an ARP packet,
+  // padded to the minimum Ethernet frame size.
+  static constexpr uint8_t kFrameSize = 60;
+
+  enum class Result : uint8_t {
+    kProbing,
+    // No other device claimed the address.
+    kAvailable,
+    // Another device is using (or probing for) the address.
+    kConflict,
+    // Socket 0 couldn't be opened in MACRAW mode.
+    kNoSocket,
+  };
+
+  // Opens socket 0 in MACRAW mode, and sends the first probe for ip.
+  // mac is copied.
+  Result begin(const uint8_t* mac, const IPAddress& ip);
+
+  // Starts over with another address (e.g. after a conflict).
+  void restart(const IPAddress& ip);
+
+  // Sends the next probe if it is due, and checks the frames received since
+  // the last call for a conflict. Returns kProbing until all of the probes
+  // have been sent and kAnnounceWaitMs has passed, or there is a conflict.
+  Result poll();
+
+  // Sends the announcements (the address should be in use by now, i.e. set
+  // with Ethernet.setLocalIP), and closes socket 0.
+  void announce();
+
+  // Closes socket 0.
+  void end();
+
+  // The number of conflicts detected since begin.
+  uint8_t conflicts() const { return conflicts_; }
+
+  // Writes an ARP request to frame (which must have room for kFrameSize
+  // bytes), broadcast from mac. A probe has a sender IP address of 0.0.0.0,
+  // and an announcement has the same sender and target IP address.
+  static void buildRequest(uint8_t* frame, const uint8_t* mac,
+                           const IPAddress& sender_ip,
+                           const IPAddress& target_ip);
+
+  // Returns true if frame (size bytes, starting with the Ethernet header) is
+  // an ARP packet, from a MAC other than mac, which uses ip as its sender
+  // address (i.e. the device has the address), or is a probe for ip (i.e.
+  // the device wants it too).
+  static bool isConflict(const uint8_t* frame, uint16_t size,
+                         const uint8_t* mac, const IPAddress& ip);
+
+ private:
+  void sendProbe();
+
+  // Reads the next frame received, if any, into buf, returning the size of
+  // the frame (which may be larger than size, in which case only the first
+  // size bytes are read), or 0 if there are none.
+  static uint16_t receiveFrame(uint8_t* buf, uint16_t size);
+  static void sendFrame(const uint8_t* frame, uint16_t size);
+
+  uint8_t mac_[6];
+  IPAddress ip_;
+  uint32_t last_probe_ms_ = 0;
+  uint8_t probes_sent_ = 0;
+  uint8_t conflicts_ = 0;
+  Result state_ = Result::kNoSocket;
+  bool open_ = false;
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_ARP_PROBER_H_
@@ -0,0 +1,143 @@
+#include "crc32.h"
+
+namespace eeprom_io {
+namespace {
+
+// Based on https://www.arduino.cc/en/Tutorial/EEPROMCrc:
+static const uint32_t kCrcTable[16] = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+  0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+  0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+// The 256 entry tables are generated at compile time from the polynomial, so
+// there aren't 1280 hex constants to get wrong. These functions are C++11
+// constexpr (i.e. just a return statement), which is what the AVR toolchain
+// supports.
+constexpr uint32_t kPolynomial = 0xedb88320;
+
+constexpr uint32_t crcBits(uint32_t c, int k) {
+  return k == 0 ? c : crcBits((c & 1) ? (c >> 1) ^ kPolynomial : c >> 1, k - 1);
+}
+
+// Entry i of slice table n: the CRC of byte i followed by n zero bytes.
+constexpr uint32_t sliceEntry(int n, uint32_t i) {
+  return n == 0 ? crcBits(i, 8)
+                : (sliceEntry(n - 1, i) >> 8) ^
+                      crcBits(sliceEntry(n - 1, i) & 0xff, 8);
+}
+
+#define CRC_E1(n, i) sliceEntry(n, i)
+#define CRC_E4(n, i) CRC_E1(n, i), CRC_E1(n, i + 1), CRC_E1(n, i + 2), \
+                     CRC_E1(n, i + 3)
+#define CRC_E16(n, i) CRC_E4(n, i), CRC_E4(n, i + 4), CRC_E4(n, i + 8), \
+                      CRC_E4(n, i + 12)
+#define CRC_E64(n, i) CRC_E16(n, i), CRC_E16(n, i + 16), \
+                      CRC_E16(n, i + 32), CRC_E16(n, i + 48)
+#define CRC_E256(n) CRC_E64(n, 0), CRC_E64(n, 64), CRC_E64(n, 128), \
+                    CRC_E64(n, 192)
+
+static const uint32_t kByteCrcTable[256] PROGMEM = { CRC_E256(0) };
+
+static const uint32_t kSlice4CrcTable[4][256] PROGMEM = {
+  { CRC_E256(0) }, { CRC_E256(1) }, { CRC_E256(2) }, { CRC_E256(3) },
+};
+
+#undef CRC_E1
+#undef CRC_E4
+#undef CRC_E16
+#undef CRC_E64
+#undef CRC_E256
+
+static_assert(sizeof kCrcTable == kNibbleTableBytes, "kNibbleTableBytes");
+static_assert(sizeof kByteCrcTable == kByteTableBytes, "kByteTableBytes");
+static_assert(sizeof kSlice4CrcTable == kSlice4TableBytes, "kSlice4TableBytes");
+
+// Crc32 has always inverted the value after each byte, rather than just once
+// at the end as in the tutorial. It isn't a standard CRC-32 as a result, but
+// we need to keep computing the same values so that the CRCs already stored in
+// the EEPROM of deployed boards remain valid.
+//
+// The byte-at-a-time step without the inversion is linear in the value, so
+// inverting after each of 4 bytes is the same as applying 4 plain steps and
+// then XOR-ing in this constant, which is what lets slice-by-4 match the
+// others:
+//     ~0 ^ L(~0) ^ L(L(~0)) ^ L(L(L(~0)))
+// where L(x) is one plain step with a zero byte.
+constexpr uint32_t plainStep(uint32_t c) {
+  return crcBits(c & 0xff, 8) ^ (c >> 8);
+}
+constexpr uint32_t kOnes = 0xffffffff;
+constexpr uint32_t kSlice4Inversions =
+    kOnes ^ plainStep(kOnes) ^ plainStep(plainStep(kOnes)) ^
+    plainStep(plainStep(plainStep(kOnes)));
+
+inline uint32_t byteTableEntry(uint32_t ndx) {
+  return pgm_read_dword(&kByteCrcTable[ndx]);
+}
+
+inline uint32_t slice4TableEntry(int n, uint32_t ndx) {
+  return pgm_read_dword(&kSlice4CrcTable[n][ndx]);
+}
+
+}  // namespace
+
+uint32_t appendBytesNibbleTable(uint32_t value, const uint8_t* src,
+                                size_t numBytes) {
+  while (numBytes-- > 0) {
+    const uint8_t v = *src++;
+    value = kCrcTable[(value ^ v) & 0x0f] ^ (value >> 4);
+    value = kCrcTable[(value ^ (v >> 4)) & 0x0f] ^ (value >> 4);
+    value = ~value;
+  }
+  return value;
+}
+
+uint32_t appendBytesByteTable(uint32_t value, const uint8_t* src,
+                              size_t numBytes) {
+  while (numBytes-- > 0) {
+    value = ~(byteTableEntry((value ^ *src++) & 0xff) ^ (value >> 8));
+  }
+  return value;
+}
+
+uint32_t appendBytesSlice4(uint32_t value, const uint8_t* src,
+                           size_t numBytes) {
+  while (numBytes >= 4) {
+    // Assemble the word byte by byte so that neither alignment nor byte order
+    // matters.
+    value ^= static_cast<uint32_t>(src[0]) |
+             (static_cast<uint32_t>(src[1]) << 8) |
+             (static_cast<uint32_t>(src[2]) << 16) |
+             (static_cast<uint32_t>(src[3]) << 24);
+    value = slice4TableEntry(3, value & 0xff) ^
+            slice4TableEntry(2, (value >> 8) & 0xff) ^
+            slice4TableEntry(1, (value >> 16) & 0xff) ^
+            slice4TableEntry(0, value >> 24) ^ kSlice4Inversions;
+    src += 4;
+    numBytes -= 4;
+  }
+  while (numBytes-- > 0) {
+    value = ~(slice4TableEntry(0, (value ^ *src++) & 0xff) ^ (value >> 8));
+  }
+  return value;
+}
+
+Crc32::Crc32() : value_(~0L) {}
+
+void Crc32::appendByte(uint8_t v) { append(&v, 1); }
+
+void Crc32::append(const uint8_t* src, size_t numBytes) {
+#if EEPROM_IO_CRC32_BACKEND == EEPROM_IO_CRC32_NIBBLE
+  value_ = appendBytesNibbleTable(value_, src, numBytes);
+#elif EEPROM_IO_CRC32_BACKEND == EEPROM_IO_CRC32_BYTE
+  value_ = appendBytesByteTable(value_, src, numBytes);
+#elif EEPROM_IO_CRC32_BACKEND == EEPROM_IO_CRC32_SLICE4
+  value_ = appendBytesSlice4(value_, src, numBytes);
+#else
+#error "Unknown EEPROM_IO_CRC32_BACKEND"
+#endif
+}
+
+}  // namespace eeprom_io
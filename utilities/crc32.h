@@ -0,0 +1,71 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_CRC32_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_CRC32_H_
+
+// Crc32 doesn't depend on the EEPROM library, so that it can be used without
+// eeprom_io.cpp (e.g. on the ESP8266, whose EEPROMClass has no update()).
+// It is in namespace eeprom_io, where it started out.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+// There are several implementations of the CRC computation below. They all
+// produce the same values, but trade off flash and RAM for speed, so the
+// choice can be made per board by defining EEPROM_IO_CRC32_BACKEND before
+// this file is included (e.g. with a -D flag):
+//
+//   EEPROM_IO_CRC32_NIBBLE: 16 entry table, 64 bytes. Smallest, slowest.
+//   EEPROM_IO_CRC32_BYTE:   256 entry table in PROGMEM, 1KB.
+//   EEPROM_IO_CRC32_SLICE4: 4 tables of 256 entries in PROGMEM, 4KB; reads
+//                           4 bytes per step, so best on 32-bit processors.
+//
+// The default is the nibble table on AVR boards (where flash is precious),
+// and slice-by-4 elsewhere.
+#define EEPROM_IO_CRC32_NIBBLE 1
+#define EEPROM_IO_CRC32_BYTE 2
+#define EEPROM_IO_CRC32_SLICE4 3
+
+#ifndef EEPROM_IO_CRC32_BACKEND
+#ifdef __AVR__
+#define EEPROM_IO_CRC32_BACKEND EEPROM_IO_CRC32_NIBBLE
+#else
+#define EEPROM_IO_CRC32_BACKEND EEPROM_IO_CRC32_SLICE4
+#endif
+#endif  // EEPROM_IO_CRC32_BACKEND
+
+namespace eeprom_io {
+
+// Each of these appends numBytes from src to a CRC with the current value
+// `value`, returning the new value. They're exposed so that the
+// implementations can be compared (see eeprom_io_tester.ino); most code should
+// use class Crc32 instead.
+uint32_t appendBytesNibbleTable(uint32_t value, const uint8_t* src,
+                                size_t numBytes);
+uint32_t appendBytesByteTable(uint32_t value, const uint8_t* src,
+                              size_t numBytes);
+uint32_t appendBytesSlice4(uint32_t value, const uint8_t* src,
+                           size_t numBytes);
+
+// Size in bytes of the table(s) used by each of the above functions.
+constexpr size_t kNibbleTableBytes = 16 * sizeof(uint32_t);
+constexpr size_t kByteTableBytes = 256 * sizeof(uint32_t);
+constexpr size_t kSlice4TableBytes = 4 * 256 * sizeof(uint32_t);
+
+// Class for computing a Cyclic Redundancy Check (a hash).
+// Used for verifying that the EEPROM (see eeprom_io::saveCrc and verifyCrc)
+// or RTC memory (see ReadingBatch) is uncorrupted.
+class Crc32 {
+public:
+  Crc32();
+  void appendByte(uint8_t v);
+  void append(const uint8_t* src, size_t numBytes);
+  uint32_t value() const { return value_; }
+
+private:
+  uint32_t value_ = ~0L;
+};
+
+}  // namespace eeprom_io
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_CRC32_H_
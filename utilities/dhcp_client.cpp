@@ -0,0 +1,501 @@
+#include "dhcp_client.h"
+
+#include "addresses.h"
+#include "eeprom_io.h"
+
+constexpr uint8_t DhcpClient::kMaxAttempts;
+constexpr uint8_t DhcpClient::kRebootAttempts;
+constexpr uint16_t DhcpClient::kRebootTimeoutMs;
+constexpr uint32_t DhcpClient::kIdleMs;
+
+namespace {
+
+// The name of the lease record in the EEPROM, which is saved after the
+// Addresses, as the name, the payload (the 5 addresses) and the CRC.
+const char kLeaseName[] = "lease";
+constexpr int kLeaseAddress = Addresses::kEepromBytes;
+constexpr size_t kLeasePayloadBytes = 5 * 4;
+constexpr size_t kLeaseSavedBytes =
+    (sizeof kLeaseName - 1) + kLeasePayloadBytes + sizeof(uint32_t);
+
+constexpr uint16_t kServerPort = 67;
+constexpr uint16_t kClientPort = 68;
+
+// Message types (option 53).
+constexpr uint8_t kDiscover = 1;
+constexpr uint8_t kOffer = 2;
+constexpr uint8_t kRequest = 3;
+constexpr uint8_t kAck = 5;
+constexpr uint8_t kNak = 6;
+
+// Options.
+constexpr uint8_t kPadOption = 0;
+constexpr uint8_t kSubnetOption = 1;
+constexpr uint8_t kRouterOption = 3;
+constexpr uint8_t kDnsOption = 6;
+constexpr uint8_t kRequestedIpOption = 50;
+constexpr uint8_t kLeaseTimeOption = 51;
+constexpr uint8_t kMessageTypeOption = 53;
+constexpr uint8_t kServerIdOption = 54;
+constexpr uint8_t kParameterListOption = 55;
+constexpr uint8_t kRenewalTimeOption = 58;
+constexpr uint8_t kRebindingTimeOption = 59;
+constexpr uint8_t kClientIdOption = 61;
+constexpr uint8_t kEndOption = 255;
+
+const uint8_t kMagicCookie[4] = {99, 130, 83, 99};
+
+// The fixed part of a message, up to the options, is the header (op to
+// chaddr; 44 bytes), then sname and file (192 bytes, unused), then the
+// magic cookie.
+constexpr uint8_t kHeaderBytes = 44;
+constexpr uint8_t kUnusedBytes = 192;
+constexpr int kOptionsOffset = kHeaderBytes + kUnusedBytes + 4;
+// BOOTP relays may drop shorter messages (RFC 1542, section 2.1).
+constexpr int kMinMessageBytes = 300;
+
+constexpr uint32_t kInfinite = 0xFFFFFFFF;
+
+uint32_t getUint32(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void putIp(uint8_t* p, const IPAddress& ip) {
+  for (uint8_t i = 0; i < 4; ++i) {
+    p[i] = ip[i];
+  }
+}
+
+// Writes n zeros.
+size_t writeZeros(EthernetUDP* udp, int n) {
+  const uint8_t zeros[16] = {};
+  size_t result = 0;
+  while (n > 0) {
+    const int chunk = n < 16 ? n : 16;
+    result += udp->write(zeros, chunk);
+    n -= chunk;
+  }
+  return result;
+}
+
+// Discards n bytes.
+void skip(EthernetUDP* udp, int n) {
+  uint8_t buf[16];
+  while (n > 0) {
+    const int chunk = n < 16 ? n : 16;
+    if (udp->read(buf, chunk) <= 0) {
+      return;
+    }
+    n -= chunk;
+  }
+}
+
+}  // namespace
+
+bool DhcpLease::load() {
+  uint8_t payload[kLeasePayloadBytes];
+  if (eeprom_io::readNamedBytes(kLeaseAddress, kLeaseName, payload,
+                                sizeof payload) != eeprom_io::ReadStatus::kOk) {
+    return false;
+  }
+  ip = &payload[0];
+  subnet = &payload[4];
+  gateway = &payload[8];
+  dns = &payload[12];
+  server = &payload[16];
+  return true;
+}
+
+void DhcpLease::save() const {
+  uint8_t payload[kLeasePayloadBytes];
+  putIp(&payload[0], ip);
+  putIp(&payload[4], subnet);
+  putIp(&payload[8], gateway);
+  putIp(&payload[12], dns);
+  putIp(&payload[16], server);
+  eeprom_io::EepromTransactionBuffer<kLeaseSavedBytes> txn(kLeaseAddress);
+  const int data_address = txn.putName(kLeaseAddress, kLeaseName);
+  const int crc_address = txn.putBytes(data_address, payload, sizeof payload);
+  txn.putCrc(data_address, crc_address);
+  txn.commit();
+}
+
+bool DhcpLease::operator==(const DhcpLease& other) const {
+  return ip == other.ip && subnet == other.subnet &&
+         gateway == other.gateway && dns == other.dns &&
+         server == other.server;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The fields of a reply that are used.
+struct DhcpClient::Reply {
+  uint8_t type = 0;
+  IPAddress yiaddr;
+  IPAddress subnet;
+  IPAddress router;
+  IPAddress dns;
+  IPAddress server;
+  uint32_t lease_secs = 0;
+  uint32_t t1_secs = 0;
+  uint32_t t2_secs = 0;
+};
+
+void DhcpClient::begin(const uint8_t* mac, const DhcpLease* cached) {
+  end();
+  memcpy(mac_, mac, sizeof mac_);
+  if (cached != nullptr && cached->ip != INADDR_NONE) {
+    lease_ = *cached;
+    startExchange(State::kRebooting);
+  } else {
+    lease_ = DhcpLease();
+    startDiscovery();
+  }
+}
+
+void DhcpClient::end() {
+  if (socket_open_) {
+    udp_.stop();
+    socket_open_ = false;
+  }
+  state_ = State::kStopped;
+}
+
+DhcpClient::Event DhcpClient::poll() {
+  const uint32_t now = millis();
+  if (state_ == State::kStopped) {
+    return Event::kNone;
+  }
+  if (state_ == State::kIdle) {
+    if (now - sent_ms_ >= wait_ms_) {
+      startDiscovery();
+    }
+    return Event::kNone;
+  }
+  if (bound() && lease_secs_ != kInfinite) {
+    while (now - tick_ms_ >= 1000) {
+      tick_ms_ += 1000;
+      ++bound_secs_;
+    }
+    if (bound_secs_ >= lease_secs_) {
+      return expire();
+    } else if (bound_secs_ >= t2_secs_ && state_ != State::kRebinding) {
+      startExchange(State::kRebinding);
+    } else if (bound_secs_ >= t1_secs_ && state_ == State::kBound) {
+      startExchange(State::kRenewing);
+    }
+  }
+  if (!socket_open_) {
+    // Bound, or waiting for a free socket.
+    if (state_ != State::kBound && now - sent_ms_ >= wait_ms_) {
+      transmit();
+    }
+    return Event::kNone;
+  }
+  while (udp_.parsePacket() > 0) {
+    Reply reply;
+    if (readReply(&reply)) {
+      const Event event = handleReply(reply);
+      if (event != Event::kNone || !socket_open_) {
+        return event;
+      }
+    }
+  }
+  if (now - sent_ms_ < wait_ms_) {
+    return Event::kNone;
+  }
+  // No reply in time.
+  switch (state_) {
+    case State::kRebooting:
+      if (attempts_ >= kRebootAttempts) {
+        startDiscovery();
+        return Event::kNone;
+      }
+      break;
+    case State::kSelecting:
+      if (attempts_ >= kMaxAttempts) {
+        // Try again later, freeing the socket meanwhile.
+        udp_.stop();
+        socket_open_ = false;
+        state_ = State::kIdle;
+        sent_ms_ = now;
+        wait_ms_ = kIdleMs;
+        return Event::kNone;
+      }
+      break;
+    case State::kRequesting:
+      if (attempts_ >= kMaxAttempts) {
+        startDiscovery();
+        return Event::kNone;
+      }
+      break;
+    default:
+      break;
+  }
+  transmit();
+  return Event::kNone;
+}
+
+void DhcpClient::startDiscovery() {
+  startExchange(State::kSelecting);
+}
+
+void DhcpClient::startExchange(State state) {
+  state_ = state;
+  attempts_ = 0;
+  // A new transaction ID for each exchange, so that late replies to an
+  // earlier one are ignored.
+  xid_ = (static_cast<uint32_t>(random(0x10000)) << 16) | random(0x10000);
+  exchange_ms_ = millis();
+  transmit();
+}
+
+void DhcpClient::transmit() {
+  const uint32_t now = millis();
+  sent_ms_ = now;
+  if (!socket_open_) {
+    if (!udp_.begin(kClientPort)) {
+      // No free socket; try again in a second.
+      wait_ms_ = 1000;
+      return;
+    }
+    socket_open_ = true;
+  }
+
+  uint8_t type = kRequest;
+  bool broadcast = true;
+  IPAddress ciaddr;
+  IPAddress requested_ip;
+  IPAddress server_id;
+  switch (state_) {
+    case State::kRebooting:
+      requested_ip = lease_.ip;
+      break;
+    case State::kSelecting:
+      type = kDiscover;
+      // Ask for the previous address, which the server may honor.
+      requested_ip = lease_.ip;
+      break;
+    case State::kRequesting:
+      requested_ip = offered_ip_;
+      server_id = lease_.server;
+      break;
+    case State::kRenewing:
+      broadcast = false;
+      ciaddr = lease_.ip;
+      break;
+    case State::kRebinding:
+      ciaddr = lease_.ip;
+      break;
+    default:
+      return;
+  }
+
+  udp_.beginPacket(broadcast ? IPAddress(255, 255, 255, 255) : lease_.server,
+                   kServerPort);
+  uint8_t buf[kHeaderBytes] = {};
+  buf[0] = 1;  // BOOTREQUEST
+  buf[1] = 1;  // Ethernet
+  buf[2] = 6;
+  buf[4] = xid_ >> 24;
+  buf[5] = xid_ >> 16;
+  buf[6] = xid_ >> 8;
+  buf[7] = xid_;
+  const uint32_t secs = (now - exchange_ms_) / 1000;
+  buf[8] = secs > 0xFFFF ? 0xFF : secs >> 8;
+  buf[9] = secs > 0xFFFF ? 0xFF : secs;
+  if (broadcast) {
+    buf[10] = 0x80;
+  }
+  putIp(&buf[12], ciaddr);
+  memcpy(&buf[28], mac_, sizeof mac_);
+  int size = udp_.write(buf, sizeof buf);
+  size += writeZeros(&udp_, kUnusedBytes);
+  size += udp_.write(kMagicCookie, sizeof kMagicCookie);
+
+  uint8_t* p = buf;
+  *p++ = kMessageTypeOption;
+  *p++ = 1;
+  *p++ = type;
+  *p++ = kClientIdOption;
+  *p++ = 7;
+  *p++ = 1;  // Ethernet
+  memcpy(p, mac_, sizeof mac_);
+  p += sizeof mac_;
+  if (requested_ip != INADDR_NONE) {
+    *p++ = kRequestedIpOption;
+    *p++ = 4;
+    putIp(p, requested_ip);
+    p += 4;
+  }
+  if (server_id != INADDR_NONE) {
+    *p++ = kServerIdOption;
+    *p++ = 4;
+    putIp(p, server_id);
+    p += 4;
+  }
+  *p++ = kParameterListOption;
+  *p++ = 6;
+  *p++ = kSubnetOption;
+  *p++ = kRouterOption;
+  *p++ = kDnsOption;
+  *p++ = kLeaseTimeOption;
+  *p++ = kRenewalTimeOption;
+  *p++ = kRebindingTimeOption;
+  *p++ = kEndOption;
+  size += udp_.write(buf, p - buf);
+  if (size < kMinMessageBytes) {
+    writeZeros(&udp_, kMinMessageBytes - size);
+  }
+  udp_.endPacket();
+  ++attempts_;
+
+  switch (state_) {
+    case State::kRebooting:
+      wait_ms_ = kRebootTimeoutMs;
+      break;
+    case State::kRenewing:
+    case State::kRebinding: {
+      // Half of the time left until rebinding or expiry, but at least a
+      // minute (RFC 2131, section 4.4.5).
+      const uint32_t deadline =
+          state_ == State::kRenewing ? t2_secs_ : lease_secs_;
+      const uint32_t left = deadline > bound_secs_ ? deadline - bound_secs_ : 0;
+      uint32_t wait_secs = left / 2;
+      if (wait_secs < 60) {
+        wait_secs = 60;
+      } else if (wait_secs > 3600) {
+        // Rather than overflow.
+        wait_secs = 3600;
+      }
+      wait_ms_ = wait_secs * 1000;
+      break;
+    }
+    default: {
+      const uint8_t shift = attempts_ - 1 < 4 ? attempts_ - 1 : 4;
+      wait_ms_ = (4000UL << shift) - 1000 + random(2001);
+      break;
+    }
+  }
+}
+
+bool DhcpClient::readReply(Reply* reply) {
+  if (udp_.available() < kOptionsOffset) {
+    return false;
+  }
+  uint8_t buf[kHeaderBytes];
+  udp_.read(buf, sizeof buf);
+  if (buf[0] != 2 ||  // BOOTREPLY
+      getUint32(&buf[4]) != xid_ || memcmp(&buf[28], mac_, sizeof mac_) != 0) {
+    return false;
+  }
+  reply->yiaddr = &buf[16];
+  skip(&udp_, kUnusedBytes);
+  udp_.read(buf, 4);
+  if (memcmp(buf, kMagicCookie, 4) != 0) {
+    return false;
+  }
+  while (udp_.available() > 0) {
+    const int code = udp_.read();
+    if (code == kPadOption) {
+      continue;
+    } else if (code == kEndOption || code < 0) {
+      break;
+    }
+    const int len = udp_.read();
+    if (len < 0) {
+      break;
+    }
+    // Only the first 4 bytes of any option are used (e.g. the first router).
+    uint8_t value[4] = {};
+    const int used = len < 4 ? len : 4;
+    udp_.read(value, used);
+    skip(&udp_, len - used);
+    switch (code) {
+      case kMessageTypeOption:
+        reply->type = value[0];
+        break;
+      case kSubnetOption:
+        reply->subnet = value;
+        break;
+      case kRouterOption:
+        reply->router = value;
+        break;
+      case kDnsOption:
+        reply->dns = value;
+        break;
+      case kServerIdOption:
+        reply->server = value;
+        break;
+      case kLeaseTimeOption:
+        reply->lease_secs = getUint32(value);
+        break;
+      case kRenewalTimeOption:
+        reply->t1_secs = getUint32(value);
+        break;
+      case kRebindingTimeOption:
+        reply->t2_secs = getUint32(value);
+        break;
+    }
+  }
+  if (reply->server == INADDR_NONE) {
+    reply->server = udp_.remoteIP();
+  }
+  return reply->type != 0;
+}
+
+DhcpClient::Event DhcpClient::handleReply(const Reply& reply) {
+  if (reply.type == kOffer) {
+    if (state_ == State::kSelecting) {
+      // Take the first offer.
+      offered_ip_ = reply.yiaddr;
+      lease_.server = reply.server;
+      // The REQUEST is part of the same exchange, so has the same
+      // transaction ID as the DISCOVER.
+      state_ = State::kRequesting;
+      attempts_ = 0;
+      transmit();
+    }
+    return Event::kNone;
+  }
+  if (reply.type == kNak) {
+    if (state_ == State::kRenewing || state_ == State::kRebinding) {
+      return expire();
+    }
+    if (state_ == State::kRebooting || state_ == State::kRequesting) {
+      startDiscovery();
+    }
+    return Event::kNone;
+  }
+  if (reply.type != kAck || state_ == State::kSelecting) {
+    return Event::kNone;
+  }
+
+  DhcpLease lease;
+  lease.ip = reply.yiaddr;
+  lease.subnet = reply.subnet;
+  lease.gateway = reply.router;
+  lease.dns = reply.dns;
+  lease.server = reply.server;
+  const bool changed = !bound() || lease != lease_;
+  lease_ = lease;
+  lease_secs_ = reply.lease_secs != 0 ? reply.lease_secs : kInfinite;
+  t1_secs_ = reply.t1_secs != 0 ? reply.t1_secs : lease_secs_ / 2;
+  t2_secs_ = reply.t2_secs != 0 ? reply.t2_secs
+                                : lease_secs_ - lease_secs_ / 8;
+  bound_secs_ = 0;
+  tick_ms_ = millis();
+  state_ = State::kBound;
+  // Nothing more is expected until T1.
+  udp_.stop();
+  socket_open_ = false;
+  return changed ? Event::kBound : Event::kNone;
+}
+
+DhcpClient::Event DhcpClient::expire() {
+  // Ask for the same address again.
+  startDiscovery();
+  return Event::kExpired;
+}
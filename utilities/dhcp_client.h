@@ -0,0 +1,152 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_DHCP_CLIENT_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_DHCP_CLIENT_H_
+
+// A DHCP client (RFC 2131) which never blocks. The Ethernet library's client
+// (i.e. Ethernet.begin(mac)) waits up to a minute for a lease, so a device
+// rebooted by a power blip is unreachable for that long if the DHCP server
+// is slow to answer (e.g. the router is also rebooting), or absent. With
+// this client, a sketch can instead serve on a link-local address while DHCP
+// proceeds in the background, calling poll from loop; see
+// SimpleHttpServer::setup.
+//
+// The lease is saved in the EEPROM (see DhcpLease) when it changes, and after
+// a reboot the client reclaims it with an INIT-REBOOT request (a REQUEST for
+// the cached address, broadcast without a server identifier), which takes a
+// single round trip, rather than the four messages of a new lease. If the
+// server NAKs that (e.g. the device has been moved to another network), or
+// doesn't answer, the client falls back to discovery.
+//
+// Messages are retransmitted after 4 seconds, then 8, 16, ..., each plus or
+// minus up to a second at random (RFC 2131, section 4.1), so that devices
+// rebooted at the same time don't keep sending at the same time. If discovery
+// gets no answer after kMaxAttempts, the client closes its UDP socket (the
+// chip has few) for kIdleMs, then starts over. While bound the socket is also
+// closed, until it is time to renew the lease (T1), with a REQUEST unicast to
+// the server, or failing that to rebind it (T2), with a broadcast REQUEST.
+//
+// Replies are requested as broadcasts, as the Ethernet library does, so they
+// arrive whatever address the chip is configured with.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "Ethernet.h"
+#include "IPAddress.h"
+
+// The settings of a DHCP lease.
+struct DhcpLease {
+  IPAddress ip;
+  IPAddress subnet;
+  IPAddress gateway;
+  IPAddress dns;
+  // The DHCP server which granted the lease.
+  IPAddress server;
+
+  // Reads the lease saved by save, returning false (and leaving this
+  // unchanged) if there isn't one.
+  bool load();
+
+  // Saves the lease in the EEPROM, after the Addresses. Only the bytes that
+  // have changed are written.
+  void save() const;
+
+  bool operator==(const DhcpLease& other) const;
+  bool operator!=(const DhcpLease& other) const { return !(*this == other); }
+};
+
+class DhcpClient {
+ public:
+  // The number of times a DISCOVER or REQUEST is sent before giving up.
+  static constexpr uint8_t kMaxAttempts = 5;
+  // The number of times an INIT-REBOOT request is sent, and the time waited
+  // for a reply to each, before falling back to discovery. These are
+  // shorter than for the other messages, as a server which doesn't know the
+  // lease doesn't reply.
+  static constexpr uint8_t kRebootAttempts = 2;
+  static constexpr uint16_t kRebootTimeoutMs = 2000;
+  // How long the client waits after discovery has failed, before starting
+  // over.
+  static constexpr uint32_t kIdleMs = 60000;
+
+  enum class State : uint8_t {
+    kStopped,
+    // Reclaiming the cached lease.
+    kRebooting,
+    kSelecting,
+    kRequesting,
+    // Waiting to start over.
+    kIdle,
+    kBound,
+    kRenewing,
+    kRebinding,
+  };
+
+  enum class Event : uint8_t {
+    kNone,
+    // A lease was granted, or renewed with different settings; they should
+    // be applied (e.g. with Ethernet.setLocalIP), and saved.
+    kBound,
+    // The lease has expired (or was refused when renewing), so the address
+    // must no longer be used; discovery has started over.
+    kExpired,
+  };
+
+  // Starts getting a lease for mac (which is copied), reclaiming cached if
+  // it isn't null. Sends the first message if a socket is free.
+  void begin(const uint8_t* mac, const DhcpLease* cached);
+
+  // Stops, closing the socket, without releasing the lease.
+  void end();
+
+  // Handles any replies, and sends the next message if one is due.
+  Event poll();
+
+  State state() const { return state_; }
+  bool bound() const { return state_ >= State::kBound; }
+
+  // The current lease, or the one being reclaimed or requested.
+  const DhcpLease& lease() const { return lease_; }
+
+  // The number of seconds for which the lease was granted, or 0xFFFFFFFF if
+  // it doesn't expire.
+  uint32_t leaseSecs() const { return lease_secs_; }
+
+ private:
+  struct Reply;
+
+  void startDiscovery();
+  // Switches to state (resetting the count of attempts), and sends its first
+  // message.
+  void startExchange(State state);
+  void transmit();
+  // Returns false if the reply isn't for us.
+  bool readReply(Reply* reply);
+  Event handleReply(const Reply& reply);
+  Event expire();
+
+  EthernetUDP udp_;
+  uint8_t mac_[6];
+  DhcpLease lease_;
+  // The address offered, while requesting it.
+  IPAddress offered_ip_;
+  uint32_t xid_ = 0;
+  // When the exchange started, and when the last message was sent, and the
+  // time until it is retransmitted.
+  uint32_t exchange_ms_ = 0;
+  uint32_t sent_ms_ = 0;
+  uint32_t wait_ms_ = 0;
+  // Times since the lease was granted are counted in seconds, as a lease
+  // may be longer than the 49 days for which millis() runs.
+  uint32_t tick_ms_ = 0;
+  uint32_t bound_secs_ = 0;
+  uint32_t lease_secs_ = 0;
+  uint32_t t1_secs_ = 0;
+  uint32_t t2_secs_ = 0;
+  uint8_t attempts_ = 0;
+  State state_ = State::kStopped;
+  bool socket_open_ = false;
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_DHCP_CLIENT_H_
@@ -6,86 +6,38 @@
 #include "debug.h"
 
 namespace eeprom_io {
-namespace {
-
-// Based on https://www.arduino.cc/en/Tutorial/EEPROMCrc:
-static const uint32_t kCrcTable[16] = {
-  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
-  0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
-  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
-  0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
-};
-
-// uint32_t crcEEPROMRange(int start, int length) {
-//   CRC crc;
-//   for (int offset = 0; offset < length; ++offset) {
-//     crc.appendByte(EEPROM[start + offset]);
-//   }
-//   return crc.value();
-// }
-
-// uint32_t crcBytes(const uint8_t* src, size_t numBytes) {
-//   CRC crc;
-//   for (int offset = 0; offset < numBytes; ++offset) {
-//     crc.appendByte(*src++);
-//   }
-//   return crc.value();
-// }
-
-// int putName(const char* name) {
-//   int numBytes = 0;
-//   while (*name != 0) {
-//     EEPROM.put(numBytes++, *name++);
-//   }
-//   return numBytes;
-// }
-
-}  // namespace
-
-Crc32::Crc32() : value_(~0L) {}
-
-void Crc32::appendByte(uint8_t v) {
-  DBG("Crc32::appendByte(");
-  DBG2(v, DEC);
-  DBG(") old value=0x");
-  DBG2(value_, HEX);
-  value_ = kCrcTable[(value_ ^ v) & 0x0f] ^ (value_ >> 4);
-  value_ = kCrcTable[(value_ ^ (v >> 4)) & 0x0f] ^ (value_ >> 4);
-  value_ = ~value_;
-  DBG(", new value=0x");
-  DBGLN2(value_, HEX);
-}
 
 // Store the value at the specified address.
-int Crc32::put(int crcAddress) const {
-  static_assert(4 == sizeof value_, "sizeof value_ is not 4");
+int saveCrc(int crcAddress, const Crc32& crc) {
+  const uint32_t value = crc.value();
+  static_assert(4 == sizeof value, "sizeof value is not 4");
 
-  DBG("Crc32::put(");
+  DBG("saveCrc(");
   DBG(crcAddress);
   DBG(") value=0x");
-  DBGLN2(value_, HEX);
+  DBGLN2(value, HEX);
 
-  EEPROM.put(crcAddress, value_);
+  EEPROM.put(crcAddress, value);
 
-  ASSERT(verify(crcAddress));
+  ASSERT(verifyCrc(crcAddress, crc));
 
-  return crcAddress + static_cast<int>(sizeof value_);
+  return crcAddress + static_cast<int>(sizeof value);
 }
 
-// Validate that the computed value (value_) matches the value stored
-// at the specified address.
-bool Crc32::verify(int crcAddress) const {
-  DBG("Crc32::verify(");
+// Validate that the computed value matches the value stored at the specified
+// address.
+bool verifyCrc(int crcAddress, const Crc32& crc) {
+  DBG("verifyCrc(");
   DBG(crcAddress);
   DBG(") computed value=0x");
-  DBG2(value_, HEX);
+  DBG2(crc.value(), HEX);
 
   uint32_t stored=0;
   EEPROM.get(crcAddress, stored);
   DBG(" stored value=0x");
   DBGLN2(stored, HEX);
 
-  return value_ == stored;
+  return crc.value() == stored;
 }
 
 int saveName(int toAddress, const char* name) {
@@ -98,9 +50,7 @@ int saveName(int toAddress, const char* name) {
 bool verifyName(int atAddress, const char* name, int* afterAddress) {
   // Confirm the name matches.
   while (*name != 0) {
-    char c;
-    EEPROM.get(atAddress++, c);
-    if (c != *name++) {
+    if (EEPROM.read(atAddress++) != static_cast<uint8_t>(*name++)) {
       // Names don't match.
       return false;
     }
@@ -109,112 +59,184 @@ bool verifyName(int atAddress, const char* name, int* afterAddress) {
   return true;
 }
 
+ReadStatus readNamedBytes(int atAddress, const char* name, uint8_t* dest,
+                          size_t numBytes) {
+  int payloadAddress;
+  if (!verifyName(atAddress, name, &payloadAddress)) {
+    return ReadStatus::kNameMismatch;
+  }
+  Crc32 crc;
+  getBytes(payloadAddress, numBytes, dest, &crc);
+  if (!verifyCrc(payloadAddress + static_cast<int>(numBytes), crc)) {
+    return ReadStatus::kCrcMismatch;
+  }
+  return ReadStatus::kOk;
+}
+
 void putBytes(int address, const uint8_t* src, size_t numBytes, Crc32* crc) {
+  if (crc) {
+    crc->append(src, numBytes);
+  }
   while (numBytes-- > 0) {
-    uint8_t b = *src++;
-    if (crc) {
-      crc->appendByte(b);
-    }
-    EEPROM.update(address++, b);
+    EEPROM.update(address++, *src++);
   }
 }
 
 void getBytes(int address, size_t numBytes, uint8_t* dest, Crc32* crc) {
-  while (numBytes-- > 0) {
-    uint8_t b = EEPROM.read(address++);
-    if (crc) {
-      crc->appendByte(b);
+  uint8_t* const start = dest;
+  for (size_t n = numBytes; n > 0; --n) {
+    *dest++ = EEPROM.read(address++);
+  }
+  if (crc) {
+    crc->append(start, numBytes);
+  }
+}
+
+constexpr size_t EepromTransaction::kCommitFailed;
+
+EepromTransaction::EepromTransaction(int baseAddress, uint8_t* shadow,
+                                     size_t numBytes)
+    : baseAddress_(baseAddress), shadow_(shadow), numBytes_(numBytes) {
+  getBytes(baseAddress, numBytes, shadow, nullptr);
+}
+
+int EepromTransaction::putBytes(int address, const uint8_t* src,
+                                size_t numBytes) {
+  if (!inRegion(address, numBytes)) {
+    DBG("EepromTransaction::putBytes outside the region, at ");
+    DBGLN(address);
+    failed_ = true;
+    return address + static_cast<int>(numBytes);
+  }
+  uint8_t* dest = shadow_ + (address - baseAddress_);
+  // Only the span from the first to the last changed byte is marked dirty.
+  int firstChanged = -1;
+  int lastChanged = -1;
+  for (size_t i = 0; i < numBytes; ++i) {
+    if (dest[i] != src[i]) {
+      dest[i] = src[i];
+      if (firstChanged < 0) {
+        firstChanged = address + static_cast<int>(i);
+      }
+      lastChanged = address + static_cast<int>(i);
     }
-    *dest++ = b;
   }
+  if (firstChanged >= 0) {
+    markDirty(firstChanged, lastChanged + 1);
+  }
+  return address + static_cast<int>(numBytes);
+}
+
+int EepromTransaction::putByte(int address, uint8_t b) {
+  return putBytes(address, &b, 1);
+}
+
+int EepromTransaction::putName(int address, const char* name) {
+  return putBytes(address, reinterpret_cast<const uint8_t*>(name),
+                  strlen(name));
+}
+
+int EepromTransaction::putCrc(int dataAddress, int crcAddress) {
+  if (dataAddress > crcAddress ||
+      !inRegion(dataAddress, crcAddress - dataAddress) ||
+      !inRegion(crcAddress, sizeof(uint32_t))) {
+    DBG("EepromTransaction::putCrc outside the region, at ");
+    DBGLN(crcAddress);
+    failed_ = true;
+    return crcAddress + static_cast<int>(sizeof(uint32_t));
+  }
+  crcDataAddress_ = dataAddress;
+  crcAddress_ = crcAddress;
+  return crcAddress + static_cast<int>(sizeof(uint32_t));
 }
 
-// void putCrc(int address, const Crc32& crc) {
-//   uint32_t value = crc.value();
-//   putBytes(address, reinterpret_cast<const uint8_t*>(&value), 4, nullptr);
-// }
+bool EepromTransaction::inRegion(int address, size_t numBytes) const {
+  if (address < baseAddress_) {
+    return false;
+  }
+  const size_t offset = address - baseAddress_;
+  return offset <= numBytes_ && numBytes <= numBytes_ - offset;
+}
 
-// bool validateCrc(int crcAddress, const Crc32& crc) {
-//   const uint32_t expectedValue = crc.value();
-//   uint32_t actualValue;
-//   getBytes(crcAddress, 4, reinterpret_cast<uint8_t*>(&actualValue), nullptr);
-//   return expectedValue == actualValue;
-// }
+size_t EepromTransaction::commit() {
+  if (failed_) {
+    numDirtyRanges_ = 0;
+    crcAddress_ = -1;
+    return kCommitFailed;
+  }
+  if (crcAddress_ >= 0) {
+    Crc32 crc;
+    crc.append(shadow_ + (crcDataAddress_ - baseAddress_),
+               crcAddress_ - crcDataAddress_);
+    // Same byte order as used by Crc32::put (i.e. EEPROM.put).
+    const uint32_t value = crc.value();
+    putBytes(crcAddress_, reinterpret_cast<const uint8_t*>(&value),
+             sizeof value);
+    crcAddress_ = -1;
+  }
 
+  size_t written = 0;
+  for (int r = 0; r < numDirtyRanges_; ++r) {
+    for (int address = dirtyRanges_[r].start; address < dirtyRanges_[r].end;
+         ++address) {
+      const uint8_t b = shadow_[address - baseAddress_];
+      if (EEPROM.read(address) != b) {
+        EEPROM.write(address, b);
+        ++written;
+      }
+    }
+  }
+  numDirtyRanges_ = 0;
 
+  DBG("EepromTransaction::commit wrote ");
+  DBG(written);
+  DBGLN(" bytes");
+  return written;
+}
 
-}  // namespace eeprom_io
+void EepromTransaction::markDirty(int start, int end) {
+  // Skip the ranges entirely before the new one (and not adjacent to it).
+  int i = 0;
+  while (i < numDirtyRanges_ && dirtyRanges_[i].end < start) {
+    ++i;
+  }
+
+  // Absorb all the ranges that overlap or are adjacent to the new one.
+  int j = i;
+  while (j < numDirtyRanges_ && dirtyRanges_[j].start <= end) {
+    if (dirtyRanges_[j].start < start) {
+      start = dirtyRanges_[j].start;
+    }
+    if (dirtyRanges_[j].end > end) {
+      end = dirtyRanges_[j].end;
+    }
+    ++j;
+  }
 
+  if (j > i) {
+    // Replace ranges i through j-1 with the merged range.
+    dirtyRanges_[i] = {start, end};
+    const int removed = j - i - 1;
+    for (int k = i + 1; k + removed < numDirtyRanges_; ++k) {
+      dirtyRanges_[k] = dirtyRanges_[k + removed];
+    }
+    numDirtyRanges_ -= removed;
+  } else if (numDirtyRanges_ < kMaxDirtyRanges) {
+    // Insert the new range before range i.
+    for (int k = numDirtyRanges_; k > i; --k) {
+      dirtyRanges_[k] = dirtyRanges_[k - 1];
+    }
+    dirtyRanges_[i] = {start, end};
+    ++numDirtyRanges_;
+  } else if (i == numDirtyRanges_ ||
+             (i > 0 && start - dirtyRanges_[i - 1].end <
+                           dirtyRanges_[i].start - end)) {
+    // No room, and the previous range is the nearest, so extend it.
+    dirtyRanges_[i - 1].end = end;
+  } else {
+    // No room, and the next range is the nearest, so extend it.
+    dirtyRanges_[i].start = start;
+  }
+}
 
-// void saveBytesToEEPROM(const char* name, const uint8_t* src, size_t numBytes) {
-//   int nameLen = putName(name);
-//   unsigned long crc = crcBytes(src, numBytes);
-//   EEPROM.put(nameLen, crc);
-//   putBytes(nameLen + kSizeOfCrcValue, src, numBytes);
-// }
-
-// bool readBytesFromEEPROM(const char* name, size_t numBytes, uint8_t* dest) {
-//   // Confirm the name matches.
-//   int nameLen = 0;
-//   while (*name != 0) {
-//     char c;
-//     EEPROM.get(nameLen++, c);
-//     if (c != *name++) {
-//       // Names don't match.
-//       return false;
-//     }
-//   }
-//   // Yup, the name matches. Read the CRC value.
-//   unsigned long stored_crc;
-//   EEPROM.get(nameLen, stored_crc);
-//   // Confirm that the stored data has the same CRC.
-//   int dataStart = nameLen + kSizeOfCrcValue;
-//   unsigned long computed_crc = crcEEPROMRange(dataStart, numBytes);
-//   if (stored_crc != computed_crc) {
-//     // CRC values don't match. Might mean that the struct has changed size,
-//     // i.e. there might be missing values.
-//     return false;
-//   }
-//   // Looks good, copy numBytes from the EEPROM into dest.
-//   getBytes(dataStart, numBytes, dest);
-//   return true;
-// }
-
-// void PersistableWrapper ::ReadFrom(EEPROMCursor* cursor) {}
-// void PersistableWrapper ::SaveTo(EEPROMCursor* cursor) const override {}
-
-
-
-// void EEPROMCursor::readBytes(size_t numBytes, uint8_t* dest) {
-//   while (numBytes-- > 0) {
-//     *dest++ = EEPROM.read(address_++);
-//   }
-// }
-
-// bool EEPROMCursor::readNamedPersistable(const char* name, Persistable* dest) {
-//   unsigned long stored_crc;
-//   readPart(&stored_crc);
-//   int nameStartAddr = address_;
-//   if (!verifyName(name)) {
-//     return false;
-//   }
-  
-//     dest->ReadFrom(this);
-//   }
-
-
-// }
-
-// bool EEPROMCursor::verifyName(const char* name) {
-//   // Confirm the name matches.
-//   int nameLen = 0;
-//   while (*name != 0) {
-//     char c;
-//     EEPROM.get(nameLen++, c);
-//     if (c != *name++) {
-//       // Names don't match.
-//       return false;
-//     }
-//   }
-//   return true;
-// }
+}  // namespace eeprom_io
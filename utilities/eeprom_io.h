@@ -5,30 +5,35 @@
 #include "Arduino.h"
 #include <inttypes.h>
 
+#include "crc32.h"
+
 namespace eeprom_io {
 
-// Class for computing a Cyclic Redundancy Check (a hash).
-// Used for verifying that the EEPROM is uncorrupted.
-class Crc32 {
-public:
-  Crc32();
-  void appendByte(uint8_t v);
-  uint32_t value() const { return value_; }
+// Store the CRC at the specified address. Returns the address after the
+// stored CRC.
+int saveCrc(int crcAddress, const Crc32& crc);
 
-  // Store the CRC (value_) at the specified address. Returns the address after
-  // the stored CRC.
-  int put(int crcAddress) const;
+// Validate that the computed CRC matches the CRC stored at the specified
+// address.
+bool verifyCrc(int crcAddress, const Crc32& crc);
 
-  // Validate that the computed CRC (value_) matches the CRC stored at the
-  // specified address.
-  bool verify(int crcAddress) const;
+int saveName(int toAddress, const char* name);
+bool verifyName(int atAddress, const char* name, int* afterAddress);
 
-private:
-  uint32_t value_ = ~0L;
+// Identifies which check failed when reading a record.
+enum class ReadStatus : uint8_t {
+  kOk,
+  kNameMismatch,
+  kCrcMismatch,
 };
 
-int saveName(int toAddress, const char* name);
-bool verifyName(int atAddress, const char* name, int* afterAddress);
+// Reads a record saved as the name (without the terminating NUL), numBytes of
+// payload and the CRC of the payload, as written by saveName, putBytes and
+// saveCrc (or by EepromTransaction). Each byte is read once, in address
+// order, stopping at the first byte of the name that doesn't match. The
+// payload is read into dest even if the CRC doesn't match.
+ReadStatus readNamedBytes(int atAddress, const char* name, uint8_t* dest,
+                          size_t numBytes);
 
 // By passing all of the bytes written to a CRC instance as we save to the
 // EEPROM, we can ensure that the CRC value is computed from the same bytes
@@ -38,133 +43,96 @@ void putBytes(int address, const uint8_t* src, size_t numBytes, Crc32* crc);
 // Similarly, we can validate during restore.
 void getBytes(int address, size_t numBytes, uint8_t* dest, Crc32* crc);
 
-// // Write a CRC value (uint32_t) to EEPROM (4 bytes).
-// void putCrc(int address, const Crc32& crc);
-
-// // Validate a CRC value, either by computing it from the EEPROM contents,
-// // or from a passed in object.
-// bool validateCrc(int crcAddress, const Crc32& crc);
-// //bool validateCrc(int crcAddress, int dataStartAddress, int length);
-
-}  // namespace eeprom_io
+// Stages writes to a region of the EEPROM in a RAM buffer (the shadow), then
+// writes only the bytes that have changed, in address order, when committed.
+// Writing a byte takes about 3.3ms (and wears out the EEPROM a little), while
+// reading one is very fast, so avoiding writes matters far more than avoiding
+// reads.
+//
+// The shadow is loaded from the EEPROM by the constructor; the put methods
+// then record which ranges of the shadow have changed (are dirty), so that
+// commit need only visit those. If requested with putCrc, the CRC of a range
+// of the region is computed from the shadow during commit, so the data
+// doesn't have to be read back from the EEPROM.
+//
+// The shadow is supplied by the caller, usually via EepromTransactionBuffer,
+// so no heap is used.
+class EepromTransaction {
+public:
+  // The region covers numBytes starting at baseAddress; shadow must have room
+  // for numBytes.
+  EepromTransaction(int baseAddress, uint8_t* shadow, size_t numBytes);
+
+  // Stage a write of numBytes from src to address, which must be within the
+  // region. Returns the address after the last byte. If any of the bytes are
+  // outside the region, nothing is staged, and the transaction fails (see
+  // failed).
+  int putBytes(int address, const uint8_t* src, size_t numBytes);
+  int putByte(int address, uint8_t b);
+
+  // Like saveName, but staged.
+  int putName(int address, const char* name);
+
+  // At commit time, compute the CRC of the bytes from dataAddress up to (but
+  // not including) crcAddress, and store it at crcAddress. Returns the address
+  // after the CRC. The transaction fails if the data or the CRC would be
+  // outside the region.
+  int putCrc(int dataAddress, int crcAddress);
+
+  // Returns true if commit may need to write to the EEPROM, i.e. if there are
+  // changed bytes or a pending CRC.
+  bool isDirty() const { return numDirtyRanges_ > 0 || crcAddress_ >= 0; }
+
+  // Returns true if a put was outside the region, i.e. the caller's idea of
+  // the layout is wrong, so none of it should be written.
+  bool failed() const { return failed_; }
+
+  // Write the changed bytes to the EEPROM. Returns the number of bytes
+  // written, i.e. those that differed from the EEPROM. If the transaction
+  // failed, nothing is written, and kCommitFailed is returned.
+  size_t commit();
+  static constexpr size_t kCommitFailed = static_cast<size_t>(-1);
 
+private:
+  struct Range {
+    int start;
+    int end;  // Exclusive.
+  };
+
+  // The dirty ranges are kept sorted, and are merged if they overlap or are
+  // adjacent. If there are already kMaxDirtyRanges, a new range is merged
+  // with its nearest neighbor; that may mean visiting some clean bytes during
+  // commit, which costs only a read each.
+  static constexpr int kMaxDirtyRanges = 4;
+  void markDirty(int start, int end);
+
+  // Returns true if numBytes at address are all within the region.
+  bool inRegion(int address, size_t numBytes) const;
+
+  const int baseAddress_;
+  uint8_t* const shadow_;
+  const size_t numBytes_;
+  bool failed_ = false;
+  Range dirtyRanges_[kMaxDirtyRanges];
+  int numDirtyRanges_ = 0;
+  int crcDataAddress_ = -1;
+  int crcAddress_ = -1;
+};
 
-// // Helpers for writing an object to EEPROM and later reading it back.
-// //
-// // We store 3 values:
-// // 1) CRC of the name and the value (4 bytes)
-// // 2) Name (without trailing nul), which is used later to confirm that
-// //    the correct object is being read.
-// // 3) The object.
-// //
-// // There is no check that the data fits in the EEPROM; the caller must
-// // ensure that.
-
-// // There is no check that the data fits in the EEPROM; the caller must
-// // ensure that.
-// void saveBytesToEEPROM(const char* name, const uint8_t* src, size_t numBytes);
-// template <class T>
-// void saveStructToEEPROM(const char* name, const T& src) {
-//   saveBytesToEEPROM(name, reinterpret_cast<const uint8_t*>(&src), sizeof src);
-// }
-
-// // 
-// bool readBytesFromEEPROM(const char* name, size_t numBytes, uint8_t* dest);
-// template <class T>
-// bool readStructFromEEPROM(const char* name, T* dest) {
-//   return readBytesFromEEPROM(name, sizeof *dest, reinterpret_cast<uint8_t*>(dest));
-// }
-
-// class Persistable {
-// public:
-//   virtual ~Persistable() {}
-
-//   virtual void ReadFrom(EEPROMCursor* cursor) = 0;
-//   virtual void SaveTo(EEPROMCursor* cursor) const = 0;
-// };
-
-// class PersistableWrapper : public Persistable {
-// public:
-//   PersistableWrapper(uint8_t* data, size_t numBytes)
-//       : data_(data), numBytes_(numBytes) {}
-
-//   void ReadFrom(EEPROMCursor* cursor) override;
-//   void SaveTo(EEPROMCursor* cursor) const override;
-
-// private:
-//   uint8_t* data_;
-//   size_t numBytes_;
-// };
-
-// class EepromIo {
-// public:
-//   EepromIo(int address=0) : address_(address) {}
-
-//   void set_address(int address) { address_ = address; }
-//   int address() { return address_; }
-
-// private:
-//   void readBytes(size_t numBytes, uint8_t* dest);
-//   int address_;
-// };
-
-// class EEPROMCursor : EepromIo {
-// public:
-//   EEPROMCursor(int address=0) : EepromIo(address) {}
-
-//   using set_address;
-//   using address;
-
-//   // Read a part of an object into *dest. The object must not be polymorphic
-//   // (i.e. must not have virtual functions).
-//   template<typename T>
-//   bool readNamedObject(const char* name, T* dest) {
-//     PersistableWrapper pw(dest, sizeof(T));
-//     return readNamedObject(name, &pw);
-//   }
-
-//   template<>
-//   bool readNamedObject(const char* name, Persistable* dest);
-
-
-
-//   template<typename T>
-//   void readPart(T* dest) {
-
-//   }
-
-//   template<>
-//   void readPart(Persistable* dest) {
-//     dest->ReadFrom(this);
-//   }
-
-// Persistable
-
-//    T &get( int idx, T &t ){
-//     EEPtr e = idx;
-//     uint8_t *ptr = (uint8_t*) &t;
-//     for( int count = sizeof(T) ; count ; --count, ++e )  *ptr++ = *e;
-//     return t;
-//   }
-  
-//   template< typename T > const T &put( int idx, const T &t ){
-//     EEPtr e = idx;
-//     const uint8_t *ptr = (const uint8_t*) &t;
-//     for( int count = sizeof(T) ; count ; --count, ++e )  (*e).update( *ptr++ );
-//     return t;
-//   }
-
-// private:
-//   void readBytes(size_t numBytes, uint8_t* dest);
-//   bool readNamedPersistable(const char* name, Persistable* dest);
-//   // Returns the length of the name if matches starting at address_;
-//   // returns -1 if the name doesn't match. name must be non-null.
-//   int verifyName(const char* name);
-
-//   int address_;
-// };
+// An EepromTransaction which contains its own shadow buffer of N bytes.
+template <size_t N>
+class EepromTransactionBuffer : public EepromTransaction {
+public:
+  explicit EepromTransactionBuffer(int baseAddress)
+      : EepromTransaction(baseAddress, shadow_, N) {}
 
+private:
+  uint8_t shadow_[N];
+};
 
+}  // namespace eeprom_io
 
+// See eeprom_schema.h for storing several versioned structs together, and
+// eeprom_ring_store.h for a record that is saved often.
 
 #endif  // SENSOR_ETHER_SERVER_EEPROM_IO_H
@@ -0,0 +1,142 @@
+#include "eeprom_ring_store.h"
+
+#include <EEPROM.h>
+
+#include "eeprom_io.h"
+
+//#define DO_DEBUG
+#include "debug.h"
+
+namespace eeprom_io {
+namespace {
+
+// Sequence numbers wrap around, so compare them using serial number
+// arithmetic (RFC 1982): a is newer than b if it is less than half the
+// sequence space ahead of b. That works as long as there are fewer than 32768
+// slots, which is far more than any Arduino's EEPROM can hold.
+bool isNewer(uint16_t a, uint16_t b) {
+  return static_cast<int16_t>(a - b) > 0;
+}
+
+}  // namespace
+
+RingStore::RingStore(const char* name, int regionStart, int regionSize,
+                     size_t payloadSize)
+    : name_(name),
+      regionStart_(regionStart),
+      regionSize_(regionSize),
+      payloadSize_(payloadSize),
+      nameLength_(strlen(name)) {}
+
+int RingStore::slotSize() const {
+  return nameLength_ + sizeof(uint16_t) + payloadSize_ + sizeof(uint32_t);
+}
+
+bool RingStore::begin() {
+  newestSlot_ = -1;
+  newestSequence_ = 0;
+
+  // Records at or newer than this have failed the CRC check.
+  bool haveBound = false;
+  uint16_t bound = 0;
+
+  for (int attempt = 0; attempt < numSlots(); ++attempt) {
+    int candidate = -1;
+    uint16_t candidateSequence = 0;
+    for (int slot = 0; slot < numSlots(); ++slot) {
+      uint16_t sequence;
+      if (!readSequence(slot, &sequence)) {
+        continue;
+      }
+      if (haveBound && !isNewer(bound, sequence)) {
+        continue;
+      }
+      if (candidate < 0 || isNewer(sequence, candidateSequence)) {
+        candidate = slot;
+        candidateSequence = sequence;
+      }
+    }
+    if (candidate < 0) {
+      DBGLN("RingStore::begin found no record");
+      return false;
+    }
+    if (verifySlot(candidate)) {
+      DBG("RingStore::begin found sequence ");
+      DBG(candidateSequence);
+      DBG(" in slot ");
+      DBGLN(candidate);
+      newestSlot_ = candidate;
+      newestSequence_ = candidateSequence;
+      return true;
+    }
+    DBG("RingStore::begin CRC mismatch in slot ");
+    DBGLN(candidate);
+    haveBound = true;
+    bound = candidateSequence;
+  }
+  return false;
+}
+
+bool RingStore::read(uint8_t* dest) const {
+  if (newestSlot_ < 0) {
+    return false;
+  }
+  const int payloadAddress =
+      slotAddress(newestSlot_) + nameLength_ + sizeof(uint16_t);
+  getBytes(payloadAddress, payloadSize_, dest, nullptr);
+  return true;
+}
+
+bool RingStore::write(const uint8_t* src) {
+  if (numSlots() == 0) {
+    DBGLN("RingStore::write region too small for a record");
+    return false;
+  }
+  int slot = 0;
+  uint16_t sequence = 0;
+  if (newestSlot_ >= 0) {
+    slot = (newestSlot_ + 1) % numSlots();
+    sequence = newestSequence_ + 1;
+  }
+  DBG("RingStore::write sequence ");
+  DBG(sequence);
+  DBG(" to slot ");
+  DBGLN(slot);
+
+  // The name is usually unchanged from the last time around the ring, so
+  // saveName won't need to write it. The CRC is written last, so a record
+  // that was only partially written will fail the check in begin.
+  const int sequenceAddress = saveName(slotAddress(slot), name_);
+  const int payloadAddress = sequenceAddress + sizeof sequence;
+  Crc32 crc;
+  putBytes(sequenceAddress, reinterpret_cast<const uint8_t*>(&sequence),
+           sizeof sequence, &crc);
+  putBytes(payloadAddress, src, payloadSize_, &crc);
+  saveCrc(payloadAddress + payloadSize_, crc);
+
+  newestSlot_ = slot;
+  newestSequence_ = sequence;
+  return true;
+}
+
+bool RingStore::readSequence(int slot, uint16_t* sequence) const {
+  int sequenceAddress;
+  if (!verifyName(slotAddress(slot), name_, &sequenceAddress)) {
+    return false;
+  }
+  EEPROM.get(sequenceAddress, *sequence);
+  return true;
+}
+
+bool RingStore::verifySlot(int slot) const {
+  const int sequenceAddress = slotAddress(slot) + nameLength_;
+  Crc32 crc;
+  int address = sequenceAddress;
+  const int crcAddress = sequenceAddress + sizeof(uint16_t) + payloadSize_;
+  while (address < crcAddress) {
+    crc.appendByte(EEPROM.read(address++));
+  }
+  return verifyCrc(crcAddress, crc);
+}
+
+}  // namespace eeprom_io
@@ -0,0 +1,90 @@
+#ifndef _JAMES_SYNGE_EEPROM_RING_STORE_H_
+#define _JAMES_SYNGE_EEPROM_RING_STORE_H_
+
+// A log-structured store for a record that is saved often (e.g. calibration
+// values), spreading the writes across a region of the EEPROM so that the
+// same cells aren't worn out by every save. Each EEPROM cell is only good
+// for about 100,000 writes.
+//
+// The region is divided into fixed size slots, each able to hold one record:
+//
+//     name (without trailing NUL), sequence number (2 bytes), payload, CRC
+//
+// The CRC covers the sequence number and the payload; the name and CRC are
+// the same framing as used by Addresses (see eeprom_io.h). Each save goes
+// into the slot after the newest record (wrapping around at the end of the
+// region), with the next sequence number, so the region always holds the
+// last numSlots() records.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+namespace eeprom_io {
+
+class RingStore {
+public:
+  // Records with payloadSize bytes are stored in the region of regionSize
+  // bytes starting at regionStart. name must outlive the RingStore.
+  RingStore(const char* name, int regionStart, int regionSize,
+            size_t payloadSize);
+
+  // Scans the region for the newest valid record; must be called before read
+  // or write. Returns true if one was found, so false if the region is too
+  // small to hold a record (i.e. numSlots() is zero).
+  //
+  // To keep the scan short, only the name and sequence number of each slot
+  // are read, and then just the newest record is checked against its CRC. If
+  // that fails (e.g. power was lost while it was being written), the scan is
+  // repeated for the next newest, so the worst case is bounded at numSlots()
+  // scans, but in practice it is one, or two after a power failure.
+  bool begin();
+
+  // Returns true if begin found a record, or one has since been written.
+  bool hasRecord() const { return newestSlot_ >= 0; }
+
+  // Copies the payload of the newest record into dest, which must have room
+  // for payloadSize bytes. Returns false if there is no record.
+  bool read(uint8_t* dest) const;
+
+  // Saves a new record in the slot after the newest one. Returns false, having
+  // written nothing, if the region is too small to hold even one record.
+  bool write(const uint8_t* src);
+
+  // Helpers for when the payload is a struct (of payloadSize bytes).
+  template <class T>
+  bool readStruct(T* dest) const {
+    return read(reinterpret_cast<uint8_t*>(dest));
+  }
+  template <class T>
+  bool writeStruct(const T& src) {
+    return write(reinterpret_cast<const uint8_t*>(&src));
+  }
+
+  int numSlots() const { return regionSize_ / slotSize(); }
+  int slotSize() const;
+  uint16_t sequence() const { return newestSequence_; }
+
+private:
+  int slotAddress(int slot) const { return regionStart_ + slot * slotSize(); }
+
+  // Returns true if the name in the slot matches, in which case *sequence is
+  // set to the sequence number of the record in the slot.
+  bool readSequence(int slot, uint16_t* sequence) const;
+
+  // Returns true if the slot's CRC matches its contents.
+  bool verifySlot(int slot) const;
+
+  const char* const name_;
+  const int regionStart_;
+  const int regionSize_;
+  const size_t payloadSize_;
+  const uint8_t nameLength_;
+  int newestSlot_ = -1;
+  uint16_t newestSequence_ = 0;
+};
+
+}  // namespace eeprom_io
+
+#endif  // _JAMES_SYNGE_EEPROM_RING_STORE_H_
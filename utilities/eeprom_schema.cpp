@@ -0,0 +1,43 @@
+#include "eeprom_schema.h"
+
+//#define DO_DEBUG
+#include "debug.h"
+
+namespace eeprom_io {
+
+bool loadRecordBytes(int address, uint8_t version, uint8_t* dest,
+                     size_t size) {
+  Crc32 crc;
+  uint8_t header[2];
+  getBytes(address, sizeof header, header, &crc);
+  if (header[0] != version || header[1] != size) {
+    DBG("loadRecordBytes(");
+    DBG(address);
+    DBG(") stored version ");
+    DBG(header[0]);
+    DBG(" size ");
+    DBG(header[1]);
+    DBG("; expected version ");
+    DBG(version);
+    DBG(" size ");
+    DBGLN(size);
+    return false;
+  }
+  getBytes(address + sizeof header, size, dest, &crc);
+  return verifyCrc(address + sizeof header + size, crc);
+}
+
+int saveRecordBytes(EepromTransaction* txn, int address, uint8_t version,
+                    const uint8_t* src, size_t size) {
+  const uint8_t header[2] = {version, static_cast<uint8_t>(size)};
+  Crc32 crc;
+  crc.append(header, sizeof header);
+  crc.append(src, size);
+  const uint32_t value = crc.value();
+  address = txn->putBytes(address, header, sizeof header);
+  address = txn->putBytes(address, src, size);
+  return txn->putBytes(address, reinterpret_cast<const uint8_t*>(&value),
+                       sizeof value);
+}
+
+}  // namespace eeprom_io
@@ -0,0 +1,170 @@
+#ifndef _JAMES_SYNGE_EEPROM_SCHEMA_H_
+#define _JAMES_SYNGE_EEPROM_SCHEMA_H_
+
+// Describes the layout of several records (structs) stored together in the
+// EEPROM, so that sketches don't have to hand-code the address of each one.
+// For example:
+//
+//     struct Thresholds { uint16_t low, medium, high; };
+//     struct Settings { uint8_t volume; bool enabled; };
+//
+//     using Schema = eeprom_io::EepromSchema<
+//         0,  // Address of the first record.
+//         eeprom_io::Record<Thresholds, 1>,
+//         eeprom_io::Record<Settings, 3>>;
+//
+//     Thresholds thresholds = {...defaults...};
+//     Settings settings = {...defaults...};
+//     uint32_t loaded = Schema::load(&thresholds, &settings);
+//     if (loaded != Schema::kAllLoaded) { ... }
+//     ...
+//     Schema::save(thresholds, settings);
+//
+// The address of each record is computed at compile time from the sizes of the
+// records before it. Each record is stored as:
+//
+//     version (1 byte), size (1 byte), the bytes of the struct, CRC (4 bytes)
+//
+// where the CRC covers the version, size and struct. A record is only loaded
+// if all three match, so changing a struct (and bumping its version number)
+// causes the old value to be ignored, leaving the default in place, rather
+// than being misinterpreted. load reads the EEPROM in one pass from the first
+// record to the last, and save writes only the bytes that have changed (see
+// EepromTransaction). No heap is used.
+//
+// The structs are copied byte for byte, so must not have virtual functions or
+// pointers; the version number should be bumped whenever the layout changes.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "eeprom_io.h"
+
+namespace eeprom_io {
+
+// Reads one stored record from address into dest (size bytes). Returns true
+// if the stored version and size match, and the CRC is valid. Only reads the
+// payload if the version and size match.
+bool loadRecordBytes(int address, uint8_t version, uint8_t* dest, size_t size);
+
+// Stages one record at address in txn, with the CRC computed from src.
+// Returns the address after the record.
+int saveRecordBytes(EepromTransaction* txn, int address, uint8_t version,
+                    const uint8_t* src, size_t size);
+
+// Declares a record of type T in an EepromSchema; kVersion should be changed
+// whenever the layout of T changes.
+template <typename T, uint8_t kVersion>
+struct Record {
+  using Type = T;
+  static constexpr uint8_t kRecordVersion = kVersion;
+  // Version, size, the struct, CRC.
+  static constexpr int kStoredSize = 2 + sizeof(T) + sizeof(uint32_t);
+  static_assert(sizeof(T) <= 255, "Record type is too large");
+};
+
+namespace internal {
+
+template <typename... Records>
+struct RecordList;
+
+template <>
+struct RecordList<> {
+  static constexpr int kStoredSize = 0;
+  static uint32_t load(int, uint32_t) { return 0; }
+  static void save(EepromTransaction*, int) {}
+};
+
+template <typename R, typename... Rest>
+struct RecordList<R, Rest...> {
+  using Type = typename R::Type;
+  static constexpr int kStoredSize =
+      R::kStoredSize + RecordList<Rest...>::kStoredSize;
+
+  static uint32_t load(int address, uint32_t bit, Type* dest,
+                       typename Rest::Type*... rest) {
+    // Read into a temporary so that dest keeps its value (e.g. a default)
+    // if the record isn't valid.
+    uint8_t tmp[sizeof(Type)];
+    uint32_t loaded = 0;
+    if (loadRecordBytes(address, R::kRecordVersion, tmp, sizeof tmp)) {
+      memcpy(reinterpret_cast<uint8_t*>(dest), tmp, sizeof tmp);
+      loaded = bit;
+    }
+    return loaded | RecordList<Rest...>::load(address + R::kStoredSize,
+                                              bit << 1, rest...);
+  }
+
+  static void save(EepromTransaction* txn, int address, const Type& src,
+                   const typename Rest::Type&... rest) {
+    address = saveRecordBytes(txn, address, R::kRecordVersion,
+                              reinterpret_cast<const uint8_t*>(&src),
+                              sizeof src);
+    RecordList<Rest...>::save(txn, address, rest...);
+  }
+};
+
+// Offset of record I from the start of the schema.
+template <size_t I, typename... Records>
+struct RecordOffset;
+
+template <typename R, typename... Rest>
+struct RecordOffset<0, R, Rest...> {
+  static constexpr int value = 0;
+};
+
+template <size_t I, typename R, typename... Rest>
+struct RecordOffset<I, R, Rest...> {
+  static constexpr int value =
+      R::kStoredSize + RecordOffset<I - 1, Rest...>::value;
+};
+
+}  // namespace internal
+
+template <int kBaseAddress, typename... Records>
+class EepromSchema {
+  using List = internal::RecordList<Records...>;
+
+public:
+  static constexpr int kNumRecords = sizeof...(Records);
+  static_assert(kNumRecords > 0, "A schema needs at least one record");
+  static_assert(kNumRecords <= 32, "Too many records for the load bitmask");
+
+  // Number of bytes of EEPROM used by the schema, and the address after it
+  // (i.e. where another schema could start).
+  static constexpr int kSize = List::kStoredSize;
+  static constexpr int kEndAddress = kBaseAddress + kSize;
+
+  // The value returned by load when all the records are loaded.
+  static constexpr uint32_t kAllLoaded =
+      kNumRecords == 32 ? 0xffffffffUL : (1UL << kNumRecords) - 1;
+
+  // Address at which record I (0 for the first) is stored.
+  template <size_t I>
+  static constexpr int address() {
+    return kBaseAddress + internal::RecordOffset<I, Records...>::value;
+  }
+
+  // Loads each record into the corresponding object. Returns a bitmask with
+  // bit I set if record I was loaded; objects whose records weren't loaded
+  // are unchanged.
+  static uint32_t load(typename Records::Type*... dests) {
+    return List::load(kBaseAddress, 1, dests...);
+  }
+
+  // Saves all of the records, writing only the bytes that have changed.
+  // Returns the number of bytes written (the layout always fits, so the
+  // commit can't fail). The shadow buffer of the transaction (kSize bytes) is
+  // on the stack, so keep schemas small on boards with little RAM.
+  static size_t save(const typename Records::Type&... srcs) {
+    EepromTransactionBuffer<kSize> txn(kBaseAddress);
+    List::save(&txn, kBaseAddress, srcs...);
+    return txn.commit();
+  }
+};
+
+}  // namespace eeprom_io
+
+#endif  // _JAMES_SYNGE_EEPROM_SCHEMA_H_
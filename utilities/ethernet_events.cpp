@@ -0,0 +1,138 @@
+#include "ethernet_events.h"
+
+#include <Ethernet.h>
+#include <SPI.h>
+#include <utility/w5100.h>
+
+#if defined(__AVR__) || defined(ARDUINO_HOST)
+#include <avr/sleep.h>
+#define ETHERNET_EVENTS_CAN_SLEEP 1
+#endif
+
+namespace {
+
+// The socket interrupts of interest: Sn_IR's CON, DISCON, RECV and TIMEOUT.
+// Not SEND_OK, which the Ethernet library waits for (and clears) itself
+// after each write.
+constexpr uint8_t kSocketEvents = 0x0F;
+
+// Socket Interrupt Mask register (Sn_IMR) of the W5200 and W5500; the W5100
+// has no such register, so it interrupts for SEND_OK too.
+constexpr uint16_t kSnImr = 0x002C;
+
+}  // namespace
+
+uint16_t EthernetEvents::sir_address_ = 0;
+uint8_t EthernetEvents::num_sockets_ = 0;
+volatile bool EthernetEvents::pending_ = false;
+volatile uint32_t EthernetEvents::interrupt_count_ = 0;
+
+bool EthernetEvents::begin(uint8_t pin) {
+  const int interrupt_num = digitalPinToInterrupt(pin);
+  if (interrupt_num == NOT_AN_INTERRUPT) {
+    return false;
+  }
+  // The addresses of the socket interrupt register, and its mask register,
+  // differ between the chips.
+  uint16_t simr_address;
+  uint8_t simr;
+  switch (Ethernet.hardwareStatus()) {
+    case EthernetW5100:
+      sir_address_ = 0x0015;
+      simr_address = 0x0016;
+      num_sockets_ = 4;
+      simr = 0x0F;
+      break;
+    case EthernetW5200:
+      sir_address_ = 0x0034;
+      simr_address = 0x0036;
+      num_sockets_ = 8;
+      simr = 0xFF;
+      break;
+    case EthernetW5500:
+      sir_address_ = 0x0017;
+      simr_address = 0x0018;
+      num_sockets_ = 8;
+      simr = 0xFF;
+      break;
+    default:
+      return false;
+  }
+  if (num_sockets_ > MAX_SOCK_NUM) {
+    num_sockets_ = MAX_SOCK_NUM;
+  }
+  pinMode(pin, INPUT_PULLUP);
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  if (sir_address_ != 0x0015) {
+    for (uint8_t s = 0; s < num_sockets_; ++s) {
+      W5100.writeSn(s, kSnImr, kSocketEvents);
+    }
+  }
+  W5100.write(simr_address, simr);
+  SPI.endTransaction();
+  // INTn is active low, and stays low until all of the pending interrupts
+  // have been cleared, so a falling edge is a new event after acknowledge.
+  attachInterrupt(interrupt_num, handleInterrupt, FALLING);
+  // In case INTn was already low, and so won't fall.
+  pending_ = true;
+  return true;
+}
+
+bool EthernetEvents::acknowledge() {
+  pending_ = false;
+  bool any = false;
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  const uint8_t sir = W5100.read(sir_address_);
+  for (uint8_t s = 0; s < num_sockets_; ++s) {
+    if (sir & (1 << s)) {
+      const uint8_t ir = W5100.readSnIR(s);
+      if (ir & kSocketEvents) {
+        any = true;
+      }
+      // Clearing SEND_OK too, on the W5100, would break the library's wait
+      // for it.
+      W5100.writeSnIR(s, ir & kSocketEvents);
+    }
+  }
+  SPI.endTransaction();
+  return any;
+}
+
+bool EthernetEvents::sleep(unsigned long timeout_ms) {
+  const unsigned long start_ms = millis();
+  while (millis() - start_ms < timeout_ms) {
+#ifdef ETHERNET_EVENTS_CAN_SLEEP
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    noInterrupts();
+    if (pending_) {
+      interrupts();
+      return true;
+    }
+    sleep_enable();
+    // The instruction after the one that enables interrupts is always
+    // executed before any pending interrupt is handled, so an interrupt
+    // that arrives after the check above still wakes the CPU from this.
+    interrupts();
+    sleep_cpu();
+    sleep_disable();
+#else
+    if (pending_) {
+      return true;
+    }
+    yield();
+#endif
+  }
+  return pending_;
+}
+
+uint32_t EthernetEvents::interruptCount() {
+  noInterrupts();
+  const uint32_t result = interrupt_count_;
+  interrupts();
+  return result;
+}
+
+void EthernetEvents::handleInterrupt() {
+  pending_ = true;
+  ++interrupt_count_;
+}
@@ -0,0 +1,76 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_ETHERNET_EVENTS_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_ETHERNET_EVENTS_H_
+
+// Lets a sketch sleep until the Wiznet chip has something for it to do,
+// rather than spinning in loop(), polling the chip over SPI for connections
+// and data thousands of times a second. That wastes power, and adds jitter
+// to anything else the sketch does.
+//
+// The chip raises its INTn output (i.e. pulls it low) when one of its sockets
+// gets a connection, data or a disconnection; if INTn is connected to one of
+// the board's external interrupt pins (2 or 3 on an Uno; most shields need a
+// jumper for this), its interrupt wakes the CPU from sleep. For example:
+//
+//     void setup() {
+//       ...
+//       use_events = EthernetEvents::begin(kEthernetIntPin);
+//     }
+//
+//     void loop() {
+//       EthernetEvents::acknowledge();
+//       ... call server.loop(), EthernetBonjour.run(), etc. ...
+//       if (use_events && server.idle()) {
+//         EthernetEvents::sleep(100);
+//       }
+//     }
+//
+// acknowledge() must be called before checking the sockets: the chip only
+// raises INTn again for events after those acknowledged, so checking first
+// could miss an event that arrived in between. For the same reason, the
+// sketch mustn't sleep while data that has arrived hasn't all been read (see
+// SimpleHttpServer::idle), as there will be no interrupt for it.
+//
+// The timeout of sleep is for the housekeeping that isn't driven by socket
+// events: renewing the DHCP lease, mDNS announcements, timing out requests,
+// and whatever else the sketch does (e.g. reading sensors). The CPU sleeps in
+// idle mode, so timer 0 keeps running (as do millis() and micros()), and its
+// interrupt wakes the CPU every millisecond or so, to check the time; that is
+// still asleep over 99% of the time when there is nothing to do.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+class EthernetEvents {
+ public:
+  // Enables the chip's socket interrupts, and attaches a handler to the
+  // interrupt of pin, which must be connected to the chip's INTn output.
+  // Returns false if the pin has no external interrupt, or the chip isn't
+  // known; the sketch should then poll as usual, i.e. not sleep.
+  static bool begin(uint8_t pin);
+
+  // Clears the chip's pending socket interrupts, so that it will raise INTn
+  // for the next event. Returns true if there were any, i.e. if a socket has
+  // had a connection, data or a disconnection since the last call.
+  static bool acknowledge();
+
+  // Sleeps until the chip raises INTn, or timeout_ms has passed. Returns
+  // true if woken by the chip (or it had already raised INTn since the last
+  // call to acknowledge).
+  static bool sleep(unsigned long timeout_ms);
+
+  // The number of times the chip has raised INTn since begin.
+  static uint32_t interruptCount();
+
+ private:
+  static void handleInterrupt();
+
+  // The chip's socket interrupt register, which has a bit per socket.
+  static uint16_t sir_address_;
+  static uint8_t num_sockets_;
+  static volatile bool pending_;
+  static volatile uint32_t interrupt_count_;
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_ETHERNET_EVENTS_H_
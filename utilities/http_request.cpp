@@ -0,0 +1,278 @@
+#include "http_request.h"
+
+#include <avr/pgmspace.h>
+
+namespace {
+
+// The tables of strings are in flash (PROGMEM) on AVR. The names are
+// lowercase, as header names and the Connection values are case-insensitive;
+// methods are case-sensitive, so must be matched exactly.
+
+const char kGetName[] PROGMEM = "GET";
+const char kHeadName[] PROGMEM = "HEAD";
+const char kPostName[] PROGMEM = "POST";
+const char kPutName[] PROGMEM = "PUT";
+const char kDeleteName[] PROGMEM = "DELETE";
+const char kOptionsName[] PROGMEM = "OPTIONS";
+// In the order of HttpRequest::Method, starting at kGet.
+const char* const kMethodNames[] PROGMEM = {
+    kGetName, kHeadName, kPostName, kPutName, kDeleteName, kOptionsName,
+};
+constexpr uint8_t kNumMethods = sizeof kMethodNames / sizeof kMethodNames[0];
+
+const char kContentLengthName[] PROGMEM = "content-length";
+const char kConnectionName[] PROGMEM = "connection";
+const char* const kHeaderNames[] PROGMEM = {
+    kContentLengthName, kConnectionName,
+};
+constexpr uint8_t kNumHeaders = sizeof kHeaderNames / sizeof kHeaderNames[0];
+constexpr int8_t kContentLength = 0;
+constexpr int8_t kConnection = 1;
+
+const char kCloseValue[] PROGMEM = "close";
+const char kKeepAliveValue[] PROGMEM = "keep-alive";
+const char* const kConnectionValues[] PROGMEM = {
+    kCloseValue, kKeepAliveValue,
+};
+constexpr uint8_t kNumConnectionValues =
+    sizeof kConnectionValues / sizeof kConnectionValues[0];
+constexpr int8_t kClose = 0;
+constexpr int8_t kKeepAlive = 1;
+
+const char kHttp10[] PROGMEM = "HTTP/1.0";
+const char* const kVersions[] PROGMEM = {kHttp10};
+
+char tableChar(const char* const* strings, uint8_t ndx, uint8_t pos) {
+  const char* s = static_cast<const char*>(pgm_read_ptr(&strings[ndx]));
+  return pgm_read_byte(s + pos);
+}
+
+char toLower(char c) { return ('A' <= c && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+}  // namespace
+
+constexpr uint8_t HttpRequest::kMaxPathLength;
+
+void HttpRequestParser::reset() {
+  memset(&request_, 0, sizeof request_);
+  status_ = kIncomplete;
+  state_ = kMethod;
+  path_length_ = 0;
+  header_ = -1;
+  has_content_length_ = false;
+  content_length_ = 0;
+  body_remaining_ = 0;
+  startMatch(kNumMethods);
+}
+
+size_t HttpRequestParser::consume(const uint8_t* buf, size_t size) {
+  size_t n = 0;
+  while (n < size && status_ == kIncomplete) {
+    if (state_ == kBody) {
+      // Skip over as much of the body as is here.
+      size_t skip = size - n;
+      if (skip > body_remaining_) {
+        skip = body_remaining_;
+      }
+      n += skip;
+      body_remaining_ -= skip;
+      if (body_remaining_ == 0) {
+        state_ = kDone;
+        status_ = kComplete;
+      }
+      continue;
+    }
+    consumeByte(static_cast<char>(buf[n++]));
+  }
+  return n;
+}
+
+void HttpRequestParser::consumeByte(char c) {
+  switch (state_) {
+    case kMethod:
+      if (c == ' ') {
+        const int8_t method = matched(kMethodNames, kNumMethods);
+        if (match_pos_ == 0) {
+          status_ = kBadRequest;
+          return;
+        }
+        request_.method = method < 0 ? HttpRequest::kUnknownMethod
+                                     : static_cast<HttpRequest::Method>(
+                                           HttpRequest::kGet + method);
+        state_ = kPath;
+      } else if (c == '\r' || c == '\n') {
+        status_ = kBadRequest;
+      } else {
+        matchNext(kMethodNames, kNumMethods, c);
+      }
+      return;
+
+    case kPath:
+      if (c == ' ') {
+        if (path_length_ == 0) {
+          status_ = kBadRequest;
+          return;
+        }
+        request_.path[path_length_] = 0;
+        state_ = kVersion;
+        startMatch(1);
+      } else if (c == '\r' || c == '\n') {
+        // HTTP/0.9 isn't supported.
+        status_ = kBadRequest;
+      } else if (path_length_ >= HttpRequest::kMaxPathLength) {
+        status_ = kUriTooLong;
+      } else {
+        request_.path[path_length_++] = c;
+      }
+      return;
+
+    case kVersion:
+      if (c == '\n') {
+        request_.http_1_0 = matched(kVersions, 1) == 0;
+        state_ = kLineStart;
+      } else if (c != '\r') {
+        matchNext(kVersions, 1, c);
+      }
+      return;
+
+    case kLineStart:
+      if (c == '\r') {
+        state_ = kEndOfHeader;
+        return;
+      } else if (c == '\n') {
+        state_ = kEndOfHeader;
+        consumeByte(c);
+        return;
+      } else if (isSpace(c)) {
+        // Continuation of the previous header line (obsolete), which we
+        // don't need.
+        state_ = kSkipLine;
+        return;
+      }
+      state_ = kHeaderName;
+      startMatch(kNumHeaders);
+      consumeByte(c);
+      return;
+
+    case kHeaderName:
+      if (c == ':') {
+        header_ = matched(kHeaderNames, kNumHeaders);
+        if (header_ == kConnection) {
+          startMatch(kNumConnectionValues);
+        } else if (header_ == kContentLength) {
+          value_ = 0;
+          value_started_ = false;
+          value_ended_ = false;
+        }
+        state_ = header_ < 0 ? kSkipLine : kHeaderValue;
+      } else if (c == '\n') {
+        // A header line without a colon.
+        status_ = kBadRequest;
+      } else {
+        matchNext(kHeaderNames, kNumHeaders, toLower(c));
+      }
+      return;
+
+    case kHeaderValue:
+      if (c == '\n') {
+        if (header_ == kConnection) {
+          const int8_t value = matched(kConnectionValues, kNumConnectionValues);
+          request_.connection_close = value == kClose;
+          request_.connection_keep_alive = value == kKeepAlive;
+        } else if (header_ == kContentLength) {
+          // A repeated Content-Length must have the same value (RFC 7230,
+          // section 3.3.2), else the request's length is ambiguous, and a
+          // proxy in front of us may have used the other one.
+          if (!value_started_ ||
+              (has_content_length_ && value_ != content_length_)) {
+            status_ = kBadRequest;
+            return;
+          }
+          has_content_length_ = true;
+          content_length_ = value_;
+        }
+        state_ = kLineStart;
+      } else if (c == '\r' || isSpace(c)) {
+        // Leading and trailing whitespace isn't part of the value.
+        if (header_ == kContentLength && value_started_) {
+          value_ended_ = true;
+        }
+      } else if (header_ == kContentLength) {
+        // Digits only, with no whitespace between them.
+        if (c < '0' || c > '9' || value_ended_) {
+          status_ = kBadRequest;
+          return;
+        }
+        value_started_ = true;
+        value_ = value_ * 10 + (c - '0');
+        if (value_ > 0xFFFF) {
+          status_ = kBadRequest;
+        }
+      } else {
+        matchNext(kConnectionValues, kNumConnectionValues, toLower(c));
+      }
+      return;
+
+    case kSkipLine:
+      if (c == '\n') {
+        state_ = kLineStart;
+      }
+      return;
+
+    case kEndOfHeader:
+      if (c != '\n') {
+        status_ = kBadRequest;
+        return;
+      }
+      request_.content_length = content_length_;
+      body_remaining_ = content_length_;
+      if (body_remaining_ > 0) {
+        state_ = kBody;
+      } else {
+        state_ = kDone;
+        status_ = kComplete;
+      }
+      return;
+
+    case kBody:
+    case kDone:
+      return;
+  }
+}
+
+void HttpRequestParser::startMatch(uint8_t num_strings) {
+  candidates_ = (1 << num_strings) - 1;
+  match_pos_ = 0;
+}
+
+void HttpRequestParser::matchNext(const char* const* strings,
+                                  uint8_t num_strings, char c) {
+  if (c == 0) {
+    // Would match the end of a string.
+    candidates_ = 0;
+  }
+  for (uint8_t i = 0; i < num_strings; ++i) {
+    if ((candidates_ & (1 << i)) && tableChar(strings, i, match_pos_) != c) {
+      candidates_ &= ~(1 << i);
+    }
+  }
+  // Once there are no candidates, stop counting, so that the position
+  // can't overflow.
+  if (candidates_) {
+    ++match_pos_;
+  } else {
+    match_pos_ = 1;
+  }
+}
+
+int8_t HttpRequestParser::matched(const char* const* strings,
+                                  uint8_t num_strings) const {
+  for (uint8_t i = 0; i < num_strings; ++i) {
+    if ((candidates_ & (1 << i)) && tableChar(strings, i, match_pos_) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
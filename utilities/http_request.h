@@ -0,0 +1,129 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_HTTP_REQUEST_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_HTTP_REQUEST_H_
+
+// An incremental parser of HTTP/1.x request headers, for servers that must
+// not wait for a whole request to arrive (e.g. SimpleHttpServer). The bytes
+// of a request are passed to consume() as they arrive, in pieces of any size,
+// and the parts of the request that we care about are saved in fixed size
+// fields of an HttpRequest; the rest (e.g. most header values) are examined
+// as they go by and then dropped, so no buffer is needed for them.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+// The parts of an HTTP request that are kept.
+struct HttpRequest {
+  enum Method : uint8_t {
+    kUnknownMethod,
+    kGet,
+    kHead,
+    kPost,
+    kPut,
+    kDelete,
+    kOptions,
+  };
+
+  // Longer paths (including the query string) are rejected, with status
+  // kUriTooLong.
+  static constexpr uint8_t kMaxPathLength = 31;
+
+  Method method;
+
+  // True if the request line ended with HTTP/1.0, else it is HTTP/1.1 (or
+  // later).
+  bool http_1_0;
+
+  // The value of the Connection header, if "close" or "keep-alive".
+  bool connection_close;
+  bool connection_keep_alive;
+
+  // The value of the Content-Length header, or zero if there isn't one.
+  // The body is consumed (so that the next request on the connection can be
+  // found), but isn't saved.
+  uint16_t content_length;
+
+  // NUL terminated; includes the query string, if any.
+  char path[kMaxPathLength + 1];
+
+  // Not from the request: set by SimpleHttpServer before calling the
+  // handler. If true, the connection is kept open after the response, for
+  // another request, so the end of the response must be marked by a
+  // Content-Length header or chunked encoding (e.g. by ResponseWriter). If
+  // false, the connection is closed after the response, which should include
+  // "Connection: close".
+  bool keep_alive;
+};
+
+class HttpRequestParser {
+ public:
+  enum Status : uint8_t {
+    kIncomplete,
+    kComplete,
+    kBadRequest,
+    kUriTooLong,
+  };
+
+  HttpRequestParser() { reset(); }
+
+  // Prepares to parse a new request.
+  void reset();
+
+  // Parses the bytes, stopping when the request is complete or found to be
+  // invalid. Returns the number of bytes consumed, which is less than size
+  // only if status() is no longer kIncomplete; the remaining bytes belong to
+  // whatever follows the request.
+  size_t consume(const uint8_t* buf, size_t size);
+
+  Status status() const { return status_; }
+
+  // Valid once status() is kComplete.
+  const HttpRequest& request() const { return request_; }
+
+ private:
+  enum State : uint8_t {
+    kMethod,
+    kPath,
+    kVersion,
+    kLineStart,
+    kHeaderName,
+    kHeaderValue,
+    kSkipLine,
+    kEndOfHeader,
+    kBody,
+    kDone,
+  };
+
+  // Handles one byte, updating state_ and status_.
+  void consumeByte(char c);
+
+  // Starts matching a token against a table of strings, and then narrows the
+  // candidates with each character of the token.
+  void startMatch(uint8_t num_strings);
+  void matchNext(const char* const* strings, uint8_t num_strings, char c);
+  // Returns the index of the string matched by the whole token, or -1.
+  int8_t matched(const char* const* strings, uint8_t num_strings) const;
+
+  HttpRequest request_;
+  Status status_;
+  State state_;
+  uint8_t path_length_;
+  // The header whose value is being parsed, from kHeaderNames.
+  int8_t header_;
+  // Bit i is set if string i of the table being matched is still a
+  // candidate, and match_pos_ is the number of characters matched.
+  uint8_t candidates_;
+  uint8_t match_pos_;
+  // The digits of the Content-Length header being parsed, whether any have
+  // been seen, and whether whitespace has followed them.
+  uint32_t value_;
+  bool value_started_;
+  bool value_ended_;
+  // True once a Content-Length header has been parsed, into content_length_.
+  bool has_content_length_;
+  uint16_t content_length_;
+  uint16_t body_remaining_;
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_HTTP_REQUEST_H_
@@ -0,0 +1,78 @@
+#include "http_router.h"
+
+#include <avr/pgmspace.h>
+
+namespace {
+
+// Compares the first len chars of key (which contains no NUL among them)
+// with the PROGMEM string route, as strcmp would if key ended after them.
+int compareKey(const char* key, uint8_t len, const char* route) {
+  const int result = strncmp_P(key, route, len);
+  if (result != 0) {
+    return result;
+  }
+  // The first len chars are equal, so route is either equal to the key, or
+  // longer (i.e. greater).
+  return pgm_read_byte(route + len) == 0 ? 0 : -1;
+}
+
+}  // namespace
+
+int8_t HttpRouter::find(const char* path) const {
+  uint8_t len = 0;
+  while (path[len] != 0 && path[len] != '?') {
+    ++len;
+  }
+  if (len == 0) {
+    return -1;
+  }
+  while (true) {
+    const int8_t index = search(path, len);
+    if (index >= 0) {
+      return index;
+    }
+    // Try again without the last segment of the path, but don't fall back
+    // to the root.
+    do {
+      --len;
+    } while (len > 0 && path[len] != '/');
+    if (len == 0) {
+      return -1;
+    }
+  }
+}
+
+int8_t HttpRouter::search(const char* key, uint8_t len) const {
+  int8_t low = 0;
+  int8_t high = num_routes_ - 1;
+  while (low <= high) {
+    const int8_t mid = (low + high) / 2;
+    const char* route =
+        static_cast<const char*>(pgm_read_ptr(&routes_[mid].path));
+    const int result = compareKey(key, len, route);
+    if (result == 0) {
+      return mid;
+    } else if (result < 0) {
+      high = mid - 1;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return -1;
+}
+
+SimpleHttpServer::RequestFunc HttpRouter::handler(int8_t index) const {
+  return reinterpret_cast<SimpleHttpServer::RequestFunc>(
+      pgm_read_ptr(&routes_[index].handler));
+}
+
+bool HttpRouter::dispatch(const HttpRequest& request,
+                          EthernetClient* client) const {
+  const int8_t index = find(request.path);
+  if (index < 0) {
+    SimpleHttpServer::sendError(client, "404 Not Found");
+    return false;
+  }
+  handler(index)(request, client);
+  return true;
+}
@@ -0,0 +1,94 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_HTTP_ROUTER_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_HTTP_ROUTER_H_
+
+// Maps the path of an HTTP request to the function that handles it, using a
+// table of routes stored in flash (PROGMEM), which is sorted by path so that
+// it can be binary searched, rather than comparing the path with each route
+// in turn. For example:
+//
+//     void handleRoot(const HttpRequest& request, EthernetClient* client);
+//     void handleRelay(const HttpRequest& request, EthernetClient* client);
+//
+//     constexpr char kRootPath[] PROGMEM = "/";
+//     constexpr char kRelayPath[] PROGMEM = "/relay";
+//     constexpr HttpRoute kRoutes[] PROGMEM = {
+//         {kRootPath, handleRoot},
+//         {kRelayPath, handleRelay},
+//     };
+//     static_assert(HttpRouter::isSorted(kRoutes), "Routes must be sorted");
+//     const HttpRouter router(kRoutes);
+//
+//     void handleRequest(const HttpRequest& request, EthernetClient* client) {
+//       router.dispatch(request, client);
+//     }
+//
+// The static_assert checks the order of the routes at compile time, so there
+// is no need to sort them (or check them) at runtime.
+//
+// A route matches a path that is equal to it, or that extends it with a
+// slash (e.g. "/relay" matches "/relay/on"); the longest such route is the
+// one chosen. The query string (from '?') isn't part of the match. The route
+// "/" matches only "/", not every path.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "http_request.h"
+#include "simple_http_server.h"
+
+// One entry of a route table; both the entry and the string it points to
+// must be in PROGMEM.
+struct HttpRoute {
+  const char* path;
+  SimpleHttpServer::RequestFunc handler;
+};
+
+class HttpRouter {
+ public:
+  template <size_t N>
+  constexpr explicit HttpRouter(const HttpRoute (&routes)[N])
+      : routes_(routes), num_routes_(N) {
+    static_assert(N < 128, "Too many routes");
+  }
+
+  // Returns the index of the route for path, or -1 if there is none.
+  int8_t find(const char* path) const;
+
+  // Returns the handler of the route at index (as returned by find).
+  SimpleHttpServer::RequestFunc handler(int8_t index) const;
+
+  // Calls the handler of the route for request.path, and returns true; or,
+  // if there is no such route, responds with 404 (Not Found) and returns
+  // false.
+  bool dispatch(const HttpRequest& request, EthernetClient* client) const;
+
+  // Returns true if the routes are in strictly increasing order of path
+  // (as compared by strcmp), as needed by find.
+  template <size_t N>
+  static constexpr bool isSorted(const HttpRoute (&routes)[N]) {
+    return isSorted(routes, N);
+  }
+
+ private:
+  static constexpr int comparePaths(const char* a, const char* b) {
+    return *a != *b ? (static_cast<uint8_t>(*a) < static_cast<uint8_t>(*b)
+                           ? -1
+                           : 1)
+                    : (*a == 0 ? 0 : comparePaths(a + 1, b + 1));
+  }
+  static constexpr bool isSorted(const HttpRoute* routes, size_t n) {
+    return n < 2 || (comparePaths(routes[0].path, routes[1].path) < 0 &&
+                     isSorted(routes + 1, n - 1));
+  }
+
+  // Returns the index of the route equal to the first len chars of key, or
+  // -1 if there is none.
+  int8_t search(const char* key, uint8_t len) const;
+
+  const HttpRoute* const routes_;
+  const uint8_t num_routes_;
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_HTTP_ROUTER_H_
@@ -0,0 +1,353 @@
+#include "json_writer.h"
+
+#include <math.h>
+
+namespace {
+
+constexpr uint32_t kPowersOf10[JsonWriter::kMaxDigits + 1] PROGMEM = {
+    1,      10,      100,      1000,      10000,
+    100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+// Formats magnitude / 10^digits, ending at end, and returns its start.
+// Templated so that a 64-bit unsigned long (on the host) is only divided as
+// such if it doesn't fit in 32 bits.
+template <typename T>
+char* formatDigits(T magnitude, uint8_t digits, char* end) {
+  char* p = end;
+  uint8_t n = 0;
+  do {
+    if (n == digits && n > 0) {
+      *--p = '.';
+    }
+    *--p = '0' + magnitude % 10;
+    magnitude /= 10;
+    ++n;
+  } while (magnitude > 0 || n <= digits);
+  return p;
+}
+
+}  // namespace
+
+// Escapes what is written to it as the contents of a JSON string.
+class JsonWriter::StringEscaper : public Print {
+ public:
+  explicit StringEscaper(JsonWriter* writer) : writer_(writer) {}
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    writer_->putEscaped(reinterpret_cast<const char*>(buffer), size);
+    return size;
+  }
+  using Print::write;
+
+ private:
+  JsonWriter* const writer_;
+};
+
+void JsonWriter::flush() {
+  if (used_ > 0) {
+    out_->write(buf_, used_);
+    used_ = 0;
+  }
+}
+
+void JsonWriter::put(char c) {
+  if (used_ == kBufferSize) {
+    flush();
+  }
+  buf_[used_++] = c;
+}
+
+void JsonWriter::put(const char* s, uint8_t size) {
+  if (size > kBufferSize - used_) {
+    flush();
+    if (size >= kBufferSize) {
+      // Not worth copying.
+      out_->write(s, size);
+      return;
+    }
+  }
+  memcpy(buf_ + used_, s, size);
+  used_ += size;
+}
+
+void JsonWriter::afterValue() {
+  if (depth_ == 0) {
+    flush();
+  }
+}
+
+bool JsonWriter::inObject() const {
+  return depth_ > 0 && (in_object_ & (1 << (depth_ - 1)));
+}
+
+void JsonWriter::separate() {
+  if (depth_ == 0) {
+    return;
+  }
+  const uint16_t bit = 1 << (depth_ - 1);
+  if (has_members_ & bit) {
+    put(',');
+  } else {
+    has_members_ |= bit;
+  }
+}
+
+void JsonWriter::beforeValue() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (inObject()) {
+    // A value without a key.
+    misused_ = true;
+  }
+  separate();
+}
+
+void JsonWriter::beforeKey() {
+  if (after_key_ || !inObject()) {
+    misused_ = true;
+  }
+  after_key_ = false;
+  separate();
+}
+
+void JsonWriter::putEscape(uint8_t c) {
+  char escape[6] = {'\\', 0};
+  uint8_t size = 2;
+  switch (c) {
+    case '"':
+    case '\\':
+      escape[1] = c;
+      break;
+    case '\b':
+      escape[1] = 'b';
+      break;
+    case '\f':
+      escape[1] = 'f';
+      break;
+    case '\n':
+      escape[1] = 'n';
+      break;
+    case '\r':
+      escape[1] = 'r';
+      break;
+    case '\t':
+      escape[1] = 't';
+      break;
+    default:
+      // The other control characters: \u00XX.
+      escape[1] = 'u';
+      escape[2] = '0';
+      escape[3] = '0';
+      escape[4] = '0' + (c >> 4);
+      escape[5] = "0123456789abcdef"[c & 0xF];
+      size = 6;
+      break;
+  }
+  put(escape, size);
+}
+
+void JsonWriter::putEscaped(const char* s, size_t size) {
+  // Runs of characters that needn't be escaped are appended together.
+  const char* run = s;
+  const char* const end = s + size;
+  for (const char* p = s; p < end; ++p) {
+    const uint8_t c = *p;
+    if (!needsEscape(c)) {
+      continue;
+    }
+    putRun(run, p);
+    run = p + 1;
+    putEscape(c);
+  }
+  putRun(run, end);
+}
+
+void JsonWriter::putRun(const char* start, const char* end) {
+  while (end - start > 255) {
+    put(start, 255);
+    start += 255;
+  }
+  if (end > start) {
+    put(start, end - start);
+  }
+}
+
+void JsonWriter::writeString(const char* s, bool progmem) {
+  put('"');
+  if (progmem) {
+    uint8_t c;
+    while ((c = pgm_read_byte(s++)) != 0) {
+      if (needsEscape(c)) {
+        putEscape(c);
+      } else {
+        put(c);
+      }
+    }
+  } else {
+    putEscaped(s, strlen(s));
+  }
+  put('"');
+}
+
+void JsonWriter::writeNumber(bool negative, unsigned long magnitude,
+                             uint8_t digits) {
+  // Room for a 64-bit unsigned long, a sign and a decimal point, or for
+  // kMaxDigits of leading zeros.
+  char buf[24];
+  char* const end = buf + sizeof buf;
+  char* p = magnitude <= 0xFFFFFFFFUL
+                ? formatDigits(static_cast<uint32_t>(magnitude), digits, end)
+                : formatDigits(magnitude, digits, end);
+  if (negative) {
+    *--p = '-';
+  }
+  put(p, end - p);
+}
+
+void JsonWriter::begin(char c, bool is_object) {
+  beforeValue();
+  if (depth_ >= kMaxDepth) {
+    misused_ = true;
+    return;
+  }
+  put(c);
+  const uint16_t bit = 1 << depth_;
+  ++depth_;
+  has_members_ &= ~bit;
+  if (is_object) {
+    in_object_ |= bit;
+  } else {
+    in_object_ &= ~bit;
+  }
+}
+
+void JsonWriter::end(char c, bool is_object) {
+  if (depth_ == 0 || after_key_ || inObject() != is_object) {
+    misused_ = true;
+    return;
+  }
+  --depth_;
+  put(c);
+  afterValue();
+}
+
+void JsonWriter::beginObject() { begin('{', true); }
+void JsonWriter::endObject() { end('}', true); }
+void JsonWriter::beginArray() { begin('[', false); }
+void JsonWriter::endArray() { end(']', false); }
+
+void JsonWriter::key(const char* name) {
+  beforeKey();
+  writeString(name, false);
+  put(':');
+  after_key_ = true;
+}
+
+void JsonWriter::key(const __FlashStringHelper* name) {
+  beforeKey();
+  writeString(reinterpret_cast<const char*>(name), true);
+  put(':');
+  after_key_ = true;
+}
+
+void JsonWriter::value(bool b) {
+  beforeValue();
+  if (b) {
+    put("true", 4);
+  } else {
+    put("false", 5);
+  }
+  afterValue();
+}
+
+void JsonWriter::value(long n) {
+  beforeValue();
+  writeNumber(n < 0, n < 0 ? 0UL - n : n, 0);
+  afterValue();
+}
+
+void JsonWriter::value(unsigned long n) {
+  beforeValue();
+  writeNumber(false, n, 0);
+  afterValue();
+}
+
+void JsonWriter::value(float v, uint8_t digits) {
+  if (isnan(v) || isinf(v)) {
+    nullValue();
+    return;
+  }
+  const bool negative = v < 0;
+  if (negative) {
+    v = -v;
+  }
+  if (digits > kMaxDigits) {
+    digits = kMaxDigits;
+  }
+  // The only floating point arithmetic: scale and round.
+  float scaled;
+  while (true) {
+    scaled = v * pgm_read_dword(kPowersOf10 + digits) + 0.5f;
+    if (scaled < 4294967296.0f) {
+      break;
+    }
+    if (digits == 0) {
+      nullValue();
+      return;
+    }
+    --digits;
+  }
+  const uint32_t magnitude = static_cast<uint32_t>(scaled);
+  beforeValue();
+  // No "-0.00" for tiny negative values.
+  writeNumber(negative && magnitude != 0, magnitude, digits);
+  afterValue();
+}
+
+void JsonWriter::fixedValue(long scaled, uint8_t digits) {
+  beforeValue();
+  if (digits > kMaxDigits) {
+    digits = kMaxDigits;
+  }
+  writeNumber(scaled < 0, scaled < 0 ? 0UL - scaled : scaled, digits);
+  afterValue();
+}
+
+void JsonWriter::value(const char* s) {
+  if (s == nullptr) {
+    nullValue();
+    return;
+  }
+  beforeValue();
+  writeString(s, false);
+  afterValue();
+}
+
+void JsonWriter::value(const __FlashStringHelper* s) {
+  if (s == nullptr) {
+    nullValue();
+    return;
+  }
+  beforeValue();
+  writeString(reinterpret_cast<const char*>(s), true);
+  afterValue();
+}
+
+void JsonWriter::value(const Printable& x) {
+  beforeValue();
+  put('"');
+  StringEscaper escaper(this);
+  x.printTo(escaper);
+  put('"');
+  afterValue();
+}
+
+void JsonWriter::nullValue() {
+  beforeValue();
+  put("null", 4);
+  afterValue();
+}
@@ -0,0 +1,171 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_JSON_WRITER_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_JSON_WRITER_H_
+
+// Writes JSON to a Print (e.g. a ResponseWriter) as it is generated, rather
+// than building a document in RAM first; the writer keeps just a few bytes of
+// state, and a small buffer, so a handler can stream as many values as it
+// likes, e.g. a long array of readings. The writer adds the punctuation
+// (quotes, colons, commas) and escapes strings, which is easy to get wrong
+// when printing JSON by hand.
+// For example:
+//
+//     JsonWriter json(&writer);
+//     json.beginObject();
+//     json.property(F("relay"), 1);
+//     json.property(F("object"), 21.37f);
+//     json.key(F("history"));
+//     json.beginArray();
+//     for (int i = 0; i < count; ++i) {
+//       json.value(history[i], 1);
+//     }
+//     json.endArray();
+//     json.endObject();
+//
+// produces:
+//
+//     {"relay":1,"object":21.37,"history":[20.5,20.6]}
+//
+// The punctuation, numbers and strings are gathered in the buffer, which is
+// written to the Print when full, and when the top level value (e.g. the
+// outermost object) is complete; flush() writes it sooner. So there are far
+// fewer writes to the Print than there would be with a print call per field,
+// which matters if it is an EthernetClient.
+//
+// Floats are written with a fixed number of digits after the decimal point,
+// by scaling and rounding them once to an integer, and then formatting that
+// with integer arithmetic; this is much quicker than Print::print(double),
+// which does a floating point multiply and subtract per digit (in software
+// on an AVR), and it rounds correctly (print(21.375) gives 21.37). If the
+// reading is available as a scaled integer (e.g. tenths of a degree from the
+// sensor), fixedValue avoids floating point altogether.
+//
+// JSON has no NaN or infinity, so those are written as null. The scaled
+// value must fit in 32 bits, so large floats are written with fewer digits
+// after the decimal point than requested, and those of 2^32 or more (which
+// are unlikely to be sensor readings) are written as null.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+class JsonWriter {
+ public:
+  // The maximum depth of nested objects and arrays.
+  static constexpr uint8_t kMaxDepth = 16;
+  // The maximum number of digits after the decimal point.
+  static constexpr uint8_t kMaxDigits = 9;
+
+  // The size of the buffer.
+  static constexpr uint8_t kBufferSize = 32;
+
+  explicit JsonWriter(Print* out) : out_(out) {}
+
+  // Writes whatever is in the buffer to the Print.
+  void flush();
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  // Writes the name of the next member of the current object.
+  void key(const char* name);
+  void key(const __FlashStringHelper* name);
+
+  void value(bool b);
+  void value(int n) { value(static_cast<long>(n)); }
+  void value(unsigned int n) { value(static_cast<unsigned long>(n)); }
+  void value(long n);
+  void value(unsigned long n);
+  // Writes v with digits after the decimal point; see above.
+  void value(float v, uint8_t digits = 2);
+  void value(double v, uint8_t digits = 2) {
+    value(static_cast<float>(v), digits);
+  }
+  // Writes a string, escaped as necessary; nullptr is written as null.
+  void value(const char* s);
+  void value(const __FlashStringHelper* s);
+  // Writes whatever x prints (e.g. an IPAddress) as an escaped string.
+  void value(const Printable& x);
+  void nullValue();
+
+  // Writes scaled / 10^digits, e.g. fixedValue(-2137, 2) writes -21.37,
+  // without any floating point arithmetic.
+  void fixedValue(long scaled, uint8_t digits);
+
+  // Writes the key and value of a member of the current object.
+  template <typename Name, typename Value>
+  void property(Name name, const Value& v) {
+    key(name);
+    value(v);
+  }
+  template <typename Name>
+  void property(Name name, float v, uint8_t digits) {
+    key(name);
+    value(v, digits);
+  }
+
+  // Returns false if the writer has been misused: objects and arrays nested
+  // more than kMaxDepth deep, or ended when not begun, or a key written
+  // outside of an object.
+  bool ok() const { return !misused_; }
+
+  // Returns true if all of the objects and arrays begun have been ended.
+  bool complete() const { return depth_ == 0 && !after_key_; }
+
+ private:
+  class StringEscaper;
+
+  // Appends to the buffer, flushing it first if there isn't room.
+  void put(char c);
+  void put(const char* s, uint8_t size);
+
+  static bool needsEscape(uint8_t c) {
+    return c < 0x20 || c == '"' || c == '\\';
+  }
+
+  // Appends s[0, size), escaping the characters that need it.
+  void putEscaped(const char* s, size_t size);
+  void putEscape(uint8_t c);
+  // Appends [start, end), which doesn't need escaping.
+  void putRun(const char* start, const char* end);
+
+  // Flushes the buffer if the top level value is complete.
+  void afterValue();
+
+  // Returns true if the innermost object or array is an object.
+  bool inObject() const;
+
+  // Writes a comma if a member has already been written to the current
+  // object or array.
+  void separate();
+
+  // Writes what is needed before a value or a key, checking that it is
+  // allowed there.
+  void beforeValue();
+  void beforeKey();
+
+  // Writes s (from PROGMEM if progmem) in quotes, escaped.
+  void writeString(const char* s, bool progmem);
+
+  void begin(char c, bool is_object);
+  void end(char c, bool is_object);
+
+  // Writes the magnitude (scaled by 10^digits) with a decimal point.
+  void writeNumber(bool negative, unsigned long magnitude, uint8_t digits);
+
+  Print* const out_;
+  char buf_[kBufferSize];
+  uint8_t used_ = 0;
+  // Bit i of has_members_ is set if the object or array at depth i + 1 has
+  // had a member written; bit i of in_object_ if it is an object.
+  uint16_t has_members_ = 0;
+  uint16_t in_object_ = 0;
+  uint8_t depth_ = 0;
+  // Set between writing a key and its value.
+  bool after_key_ = false;
+  bool misused_ = false;
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_JSON_WRITER_H_
@@ -0,0 +1,173 @@
+#include "metrics.h"
+
+#include "response_writer.h"
+
+namespace {
+
+void printP(Print* out, const char* str) {
+  out->print(reinterpret_cast<const __FlashStringHelper*>(str));
+}
+
+// Print has no overload for 64-bit integers.
+void printUint64(Print* out, uint64_t value) {
+  char buf[21];
+  char* p = buf + sizeof buf - 1;
+  *p = 0;
+  do {
+    *--p = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  out->print(p);
+}
+
+constexpr char kRequestsName[] PROGMEM = "http_requests_total";
+constexpr char kRequestsHelp[] PROGMEM = "HTTP requests served.";
+constexpr char kParseErrorsName[] PROGMEM = "http_request_parse_errors_total";
+constexpr char kParseErrorsHelp[] PROGMEM =
+    "HTTP requests rejected as malformed or too long.";
+constexpr char kDhcpFailuresName[] PROGMEM = "dhcp_renew_failures_total";
+constexpr char kDhcpFailuresHelp[] PROGMEM =
+    "Failures to renew or rebind the DHCP lease.";
+constexpr char kLoopTimeName[] PROGMEM = "loop_iteration_microseconds";
+constexpr char kLoopTimeHelp[] PROGMEM =
+    "Time from one iteration of the sketch's loop to the next.";
+constexpr uint32_t kLoopTimeBounds[] PROGMEM = {
+    100, 300, 1000, 3000, 10000, 30000, 100000, 1000000,
+};
+
+}  // namespace
+
+Metric::Metric(MetricRegistry* registry, Type type, const char* name,
+               const char* help)
+    : name_(name), help_(help), type_(type) {
+  if (registry->last_ == nullptr) {
+    registry->first_ = this;
+  } else {
+    registry->last_->next_ = this;
+  }
+  registry->last_ = this;
+}
+
+void Metric::printTo(Print* out) const {
+  if (help_ != nullptr) {
+    out->print("# HELP ");
+    printName(out, " ");
+    printP(out, help_);
+    out->print('\n');
+  }
+  out->print("# TYPE ");
+  printName(out, " ");
+  switch (type_) {
+    case kCounter:
+      out->print("counter\n");
+      break;
+    case kGauge:
+      out->print("gauge\n");
+      break;
+    case kHistogram:
+      out->print("histogram\n");
+      break;
+  }
+  printSamples(out);
+}
+
+void Metric::printName(Print* out, const char* suffix) const {
+  printP(out, name_);
+  out->print(suffix);
+}
+
+void Counter::printSamples(Print* out) const {
+  printName(out, " ");
+  out->print(value_);
+  out->print('\n');
+}
+
+void Gauge::printSamples(Print* out) const {
+  printName(out, " ");
+  // Print::print(float) would print "nan" and "inf", which Prometheus
+  // doesn't accept.
+  if (isnan(value_)) {
+    out->print("NaN");
+  } else if (isinf(value_)) {
+    out->print(value_ > 0 ? "+Inf" : "-Inf");
+  } else {
+    out->print(value_, digits_);
+  }
+  out->print('\n');
+}
+
+Histogram::Histogram(MetricRegistry* registry, const char* name,
+                     const char* help, const uint32_t* bounds,
+                     uint32_t* counts, uint8_t num_bounds)
+    : Metric(registry, kHistogram, name, help),
+      bounds_(bounds),
+      counts_(counts),
+      num_bounds_(num_bounds) {}
+
+void Histogram::observe(uint32_t value) {
+  ++count_;
+  sum_ += value;
+  // There are few buckets, and the lower ones are usually the most likely,
+  // so a linear search is fine.
+  for (uint8_t i = 0; i < num_bounds_; ++i) {
+    if (value <= pgm_read_dword(bounds_ + i)) {
+      ++counts_[i];
+      return;
+    }
+  }
+}
+
+void Histogram::printSamples(Print* out) const {
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < num_bounds_; ++i) {
+    cumulative += counts_[i];
+    printName(out, "_bucket{le=\"");
+    out->print(static_cast<unsigned long>(pgm_read_dword(bounds_ + i)));
+    out->print("\"} ");
+    out->print(cumulative);
+    out->print('\n');
+  }
+  printName(out, "_bucket{le=\"+Inf\"} ");
+  out->print(count_);
+  out->print('\n');
+  printName(out, "_sum ");
+  printUint64(out, sum_);
+  out->print('\n');
+  printName(out, "_count ");
+  out->print(count_);
+  out->print('\n');
+}
+
+void MetricRegistry::printTo(Print* out) const {
+  for (const Metric* metric = first_; metric != nullptr;
+       metric = metric->next_) {
+    metric->printTo(out);
+  }
+}
+
+bool MetricRegistry::sendResponse(const HttpRequest& request,
+                                  Print* client) const {
+  // The exposition is usually larger than this, so is sent in chunks; a
+  // larger buffer would mean fewer writes, but costs scarce stack space.
+  ResponseWriterBuffer<128> writer(client);
+  writer.beginResponse("200 OK", request);
+  writer.header("Content-Type", "text/plain; version=0.0.4");
+  writer.beginBody();
+  printTo(&writer);
+  return writer.endResponse();
+}
+
+HttpServerMetrics::HttpServerMetrics(MetricRegistry* registry)
+    : requests(registry, kRequestsName, kRequestsHelp),
+      parse_errors(registry, kParseErrorsName, kParseErrorsHelp),
+      dhcp_failures(registry, kDhcpFailuresName, kDhcpFailuresHelp),
+      loop_time(registry, kLoopTimeName, kLoopTimeHelp, kLoopTimeBounds) {}
+
+void HttpServerMetrics::loopIteration() {
+  const unsigned long now = micros();
+  if (looped_) {
+    loop_time.observe(now - last_loop_us_);
+  }
+  looped_ = true;
+  last_loop_us_ = now;
+}
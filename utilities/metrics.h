@@ -0,0 +1,190 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_METRICS_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_METRICS_H_
+
+// A registry of metrics (counters, gauges and histograms), which can be
+// served as a Prometheus (text exposition format) response, e.g. at
+// /metrics, so that a monitoring server can scrape a sketch without having to
+// parse a custom JSON or HTML format. For example:
+//
+//     MetricRegistry metrics;
+//     constexpr char kTempName[] PROGMEM = "temperature_celsius";
+//     constexpr char kTempHelp[] PROGMEM = "Air temperature.";
+//     Gauge temperature(&metrics, kTempName, kTempHelp);
+//
+//     void handleMetrics(const HttpRequest& request, EthernetClient* client) {
+//       metrics.sendResponse(request, client);
+//     }
+//
+// produces (in the body of the response):
+//
+//     # HELP temperature_celsius Air temperature.
+//     # TYPE temperature_celsius gauge
+//     temperature_celsius 21.25
+//
+// The names and help text of the metrics, and the bucket bounds of the
+// histograms, are stored in flash (PROGMEM), and are printed from there
+// straight into the response, so the only RAM used by a metric is for its
+// value(s) and a few pointers. The metrics are printed in the order in which
+// they were constructed.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "http_request.h"
+
+class MetricRegistry;
+
+class Metric {
+ public:
+  enum Type : uint8_t {
+    kCounter,
+    kGauge,
+    kHistogram,
+  };
+
+  // name and help must be in PROGMEM, and must outlive the metric; help may
+  // be nullptr. The metric is added to the end of registry.
+  Metric(MetricRegistry* registry, Type type, const char* name,
+         const char* help);
+
+  // Prints the HELP and TYPE lines, and then the samples.
+  void printTo(Print* out) const;
+
+ protected:
+  // Prints the metric's name (from PROGMEM), followed by suffix (from RAM).
+  void printName(Print* out, const char* suffix) const;
+
+  // Prints the lines with the values of the metric.
+  virtual void printSamples(Print* out) const = 0;
+
+ private:
+  friend class MetricRegistry;
+
+  const char* const name_;
+  const char* const help_;
+  Metric* next_ = nullptr;
+  const Type type_;
+};
+
+// A count which only increases (until the board resets), e.g. of requests.
+class Counter : public Metric {
+ public:
+  Counter(MetricRegistry* registry, const char* name, const char* help)
+      : Metric(registry, kCounter, name, help) {}
+
+  void increment(uint32_t n = 1) { value_ += n; }
+  uint32_t value() const { return value_; }
+
+ protected:
+  void printSamples(Print* out) const override;
+
+ private:
+  uint32_t value_ = 0;
+};
+
+// A value which can go up and down, e.g. a sensor reading. It is NaN until
+// set, so that a missing reading isn't mistaken for zero.
+class Gauge : public Metric {
+ public:
+  // The value is printed with digits decimal places.
+  Gauge(MetricRegistry* registry, const char* name, const char* help,
+        uint8_t digits = 2)
+      : Metric(registry, kGauge, name, help), digits_(digits) {}
+
+  void set(float value) { value_ = value; }
+  float value() const { return value_; }
+
+ protected:
+  void printSamples(Print* out) const override;
+
+ private:
+  float value_ = NAN;
+  const uint8_t digits_;
+};
+
+// Counts observations of an integer quantity (e.g. a duration in
+// microseconds) in buckets with fixed upper bounds, so that the scraper can
+// estimate quantiles. Integers rather than floats, as observations may be
+// frequent, and floating point arithmetic is slow on an AVR.
+class Histogram : public Metric {
+ public:
+  // bounds is a PROGMEM array of num_bounds strictly increasing upper bounds
+  // (inclusive); the +Inf bucket is implicit. counts must have room for
+  // num_bounds entries.
+  Histogram(MetricRegistry* registry, const char* name, const char* help,
+            const uint32_t* bounds, uint32_t* counts, uint8_t num_bounds);
+
+  void observe(uint32_t value);
+
+  uint32_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+
+ protected:
+  void printSamples(Print* out) const override;
+
+ private:
+  const uint32_t* const bounds_;
+  // Per bucket (i.e. not cumulative), excluding the +Inf bucket.
+  uint32_t* const counts_;
+  const uint8_t num_bounds_;
+  uint32_t count_ = 0;
+  uint64_t sum_ = 0;
+};
+
+// A Histogram which contains its own counts, for the N bounds in the PROGMEM
+// array bounds.
+template <uint8_t N>
+class HistogramBuffer : public Histogram {
+ public:
+  HistogramBuffer(MetricRegistry* registry, const char* name,
+                  const char* help, const uint32_t (&bounds)[N])
+      : Histogram(registry, name, help, bounds, counts_, N) {}
+
+ private:
+  uint32_t counts_[N] = {};
+};
+
+class MetricRegistry {
+ public:
+  // Prints all of the metrics in the Prometheus text format.
+  void printTo(Print* out) const;
+
+  // Sends an HTTP response to request (e.g. for GET /metrics) whose body is
+  // printed by printTo. Returns false if the write to the client failed.
+  bool sendResponse(const HttpRequest& request, Print* client) const;
+
+ private:
+  friend class Metric;
+
+  Metric* first_ = nullptr;
+  Metric* last_ = nullptr;
+};
+
+// The metrics of a sketch which serves HTTP requests. SimpleHttpServer
+// updates them if given them with setMetrics; a sketch with its own server
+// loop can update them itself.
+class HttpServerMetrics {
+ public:
+  explicit HttpServerMetrics(MetricRegistry* registry);
+
+  // Records the time since the previous call, so should be called once per
+  // iteration of the sketch's loop (SimpleHttpServer::loop does so).
+  void loopIteration();
+
+  // Requests passed to the handler.
+  Counter requests;
+  // Requests which couldn't be parsed (400 or 414 responses).
+  Counter parse_errors;
+  // Failures to renew or rebind the DHCP lease.
+  Counter dhcp_failures;
+  // Microseconds from one loop iteration to the next.
+  HistogramBuffer<8> loop_time;
+
+ private:
+  unsigned long last_loop_us_ = 0;
+  bool looped_ = false;
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_METRICS_H_
@@ -0,0 +1,88 @@
+#include "prerendered_response.h"
+
+namespace {
+
+// Appends str to buf (at *len), if there is room, leaving at least one byte
+// unused (so that the response never starts at offset 0). Returns false if
+// there isn't room.
+bool append(char* buf, uint8_t size, uint8_t* len, const char* str) {
+  const size_t n = strlen(str);
+  if (*len + n >= size) {
+    return false;
+  }
+  memcpy(buf + *len, str, n);
+  *len += n;
+  return true;
+}
+
+}  // namespace
+
+constexpr uint8_t PrerenderedResponse::kHeaderSpace;
+
+PrerenderedResponse::PrerenderedResponse(char* buf, uint16_t size)
+    : buf_(buf), buf_size_(size), finished_at_ms_(0) {
+  startBody();
+}
+
+void PrerenderedResponse::startBody() {
+  start_ = 0;
+  end_ = kHeaderSpace;
+  overflow_ = false;
+}
+
+bool PrerenderedResponse::finish(const char* content_type) {
+  if (overflow_) {
+    return false;
+  }
+  // Content-Length, in decimal.
+  char reversed[5];
+  uint8_t num_digits = 0;
+  uint16_t length = end_ - kHeaderSpace;
+  do {
+    reversed[num_digits++] = '0' + length % 10;
+    length /= 10;
+  } while (length > 0);
+  char length_str[sizeof reversed + 1];
+  for (uint8_t i = 0; i < num_digits; ++i) {
+    length_str[i] = reversed[num_digits - 1 - i];
+  }
+  length_str[num_digits] = 0;
+
+  char header[kHeaderSpace];
+  uint8_t len = 0;
+  if (!(append(header, kHeaderSpace, &len,
+               "HTTP/1.1 200 OK\r\nContent-Type: ") &&
+        append(header, kHeaderSpace, &len, content_type) &&
+        append(header, kHeaderSpace, &len, "\r\nContent-Length: ") &&
+        append(header, kHeaderSpace, &len, length_str) &&
+        append(header, kHeaderSpace, &len, "\r\n\r\n"))) {
+    return false;
+  }
+  start_ = kHeaderSpace - len;
+  memcpy(buf_ + start_, header, len);
+  finished_at_ms_ = millis();
+  return true;
+}
+
+bool PrerenderedResponse::send(Print* client) const {
+  if (!ready()) {
+    return false;
+  }
+  return client->write(data(), size()) == size();
+}
+
+size_t PrerenderedResponse::write(uint8_t b) { return write(&b, 1); }
+
+size_t PrerenderedResponse::write(const uint8_t* buffer, size_t size) {
+  if (start_ != 0) {
+    // Finished; startBody must be called first.
+    return 0;
+  }
+  if (size > static_cast<size_t>(buf_size_ - end_)) {
+    overflow_ = true;
+    return 0;
+  }
+  memcpy(buf_ + end_, buffer, size);
+  end_ += size;
+  return size;
+}
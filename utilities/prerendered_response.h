@@ -0,0 +1,92 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_PRERENDERED_RESPONSE_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_PRERENDERED_RESPONSE_H_
+
+// A complete HTTP response (status line, headers and body), rendered into a
+// buffer when the data it reports changes, and then sent to each client that
+// requests it with a single write, rather than being formatted anew (e.g.
+// reading sensors, printing floats) for every request. For example:
+//
+//     PrerenderedResponseBuffer<128> response;
+//
+//     void render() {
+//       response.startBody();
+//       response.print("{\"temperature\":");
+//       response.print(temperature);
+//       response.print("}");
+//       response.finish("application/json");
+//     }
+//
+//     void handleRequest(const HttpRequest& request, EthernetClient* client) {
+//       response.send(client);
+//     }
+//
+// The body is printed into the buffer after space reserved for the headers,
+// so that once its length is known, the headers (including Content-Length)
+// can be written immediately before it, leaving the whole response
+// contiguous, without having to move the body.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+class PrerenderedResponse : public Print {
+ public:
+  // Room for the status line and headers, with a content type of up to
+  // about 30 characters.
+  static constexpr uint8_t kHeaderSpace = 96;
+
+  // buf must have room for size bytes, which must be more than kHeaderSpace.
+  PrerenderedResponse(char* buf, uint16_t size);
+
+  // Discards the current response (if any), so that the new body can be
+  // printed to this.
+  void startBody();
+
+  // Completes the response to the body printed since startBody, adding the
+  // status line "HTTP/1.1 200 OK" and the headers. Returns false (and there
+  // is no response to send) if the body or the headers didn't fit.
+  bool finish(const char* content_type);
+
+  // Returns true if there is a complete response.
+  bool ready() const { return start_ != 0; }
+
+  // The value of millis() when the response was last completed.
+  unsigned long finishedAtMs() const { return finished_at_ms_; }
+
+  // Returns the response (after finish).
+  const char* data() const { return buf_ + start_; }
+  uint16_t size() const { return ready() ? end_ - start_ : 0; }
+
+  // Sends the response, if ready, with a single write.
+  bool send(Print* client) const;
+
+  // Print methods for rendering the body.
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+ private:
+  char* const buf_;
+  const uint16_t buf_size_;
+  // The response is buf_[start_, end_); start_ is 0 while there is none.
+  uint16_t start_;
+  uint16_t end_;
+  // Set if the body didn't fit.
+  bool overflow_;
+  unsigned long finished_at_ms_;
+};
+
+// A PrerenderedResponse which contains its own buffer of N bytes.
+template <uint16_t N>
+class PrerenderedResponseBuffer : public PrerenderedResponse {
+ public:
+  PrerenderedResponseBuffer() : PrerenderedResponse(buf_, N) {
+    static_assert(N > kHeaderSpace, "Buffer has no room for a body");
+  }
+
+ private:
+  char buf_[N];
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_PRERENDERED_RESPONSE_H_
@@ -0,0 +1,109 @@
+#include "reading_batch.h"
+
+#include "crc32.h"
+
+namespace {
+
+// Changed if the layout changes, so that a batch kept by an older sketch
+// isn't misread.
+constexpr uint32_t kMagic = 0x52424131;  // "RBA1"
+
+}  // namespace
+
+uint32_t ReadingBatch::computeCrc() const {
+  eeprom_io::Crc32 crc;
+  crc.append(reinterpret_cast<const uint8_t*>(&magic_),
+             sizeof *this - sizeof crc_);
+  return crc.value();
+}
+
+bool ReadingBatch::begin(uint8_t batch_size) {
+  if (batch_size == 0) {
+    batch_size = 1;
+  } else if (batch_size > kCapacity) {
+    batch_size = kCapacity;
+  }
+  if (magic_ != kMagic || crc_ != computeCrc() || count_ > kCapacity ||
+      head_ >= kCapacity) {
+    reset(batch_size);
+    return false;
+  }
+  if (batch_size_ != batch_size) {
+    // E.g. a new sketch; keep the readings, but don't wait longer than the
+    // new batch size to upload them.
+    batch_size_ = batch_size;
+    if (wakes_until_upload_ > batch_size) {
+      wakes_until_upload_ = batch_size;
+    }
+  }
+  return true;
+}
+
+void ReadingBatch::reset(uint8_t batch_size) {
+  memset(this, 0, sizeof *this);
+  magic_ = kMagic;
+  batch_size_ = batch_size;
+  wakes_until_upload_ = batch_size;
+}
+
+void ReadingBatch::startWake() {
+  ++wakes_;
+  if (wakes_until_upload_ > 0) {
+    --wakes_until_upload_;
+  }
+}
+
+void ReadingBatch::add(const int16_t* values) {
+  uint8_t n;
+  if (count_ < kCapacity) {
+    n = head_ + count_++;
+    if (n >= kCapacity) {
+      n -= kCapacity;
+    }
+  } else {
+    // Overwrite the oldest.
+    n = head_;
+    if (++head_ == kCapacity) {
+      head_ = 0;
+    }
+    if (dropped_ < 0xFFFF) {
+      ++dropped_;
+    }
+  }
+  Reading& r = readings_[n];
+  r.wake = static_cast<uint16_t>(wakes_);
+  memcpy(r.values, values, sizeof r.values);
+}
+
+void ReadingBatch::uploadSucceeded() {
+  head_ = 0;
+  count_ = 0;
+  failures_ = 0;
+  wakes_until_upload_ = batch_size_;
+}
+
+void ReadingBatch::uploadFailed() {
+  if (failures_ < 0xFF) {
+    ++failures_;
+  }
+  // Retry after 1, 2, 4, ... wakes, but no less often than usual.
+  const uint8_t shift = failures_ - 1;
+  wakes_until_upload_ =
+      shift < 7 && (1 << shift) < batch_size_ ? 1 << shift : batch_size_;
+}
+
+void ReadingBatch::seal() { crc_ = computeCrc(); }
+
+void ReadingBatch::writeJson(JsonWriter* json, const uint8_t* digits) const {
+  json->beginArray();
+  for (uint8_t i = 0; i < count_; ++i) {
+    const Reading& r = reading(i);
+    json->beginArray();
+    json->value(static_cast<uint16_t>(static_cast<uint16_t>(wakes_) - r.wake));
+    for (uint8_t c = 0; c < kChannels; ++c) {
+      json->fixedValue(r.values[c], digits[c]);
+    }
+    json->endArray();
+  }
+  json->endArray();
+}
@@ -0,0 +1,144 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_READING_BATCH_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_READING_BATCH_H_
+
+// A queue of sensor readings for a battery powered ESP8266 which spends
+// most of its time in deep sleep, waking only to take a reading. Connecting
+// to the WiFi access point takes seconds at 70mA or more, far longer than
+// taking the reading, so rather than reporting every reading, the readings
+// are kept in the RTC's user memory (the only RAM that survives deep sleep)
+// and uploaded together every batch_size wakes, in a single HTTP request.
+// The other wakes can then be with the radio disabled (WAKE_RF_DISABLED),
+// which also skips its calibration at boot.
+//
+// If an upload fails (e.g. the access point is down), the readings are kept
+// and the upload is retried after 1 wake, then 2, 4, ..., up to batch_size;
+// the queue is bounded by the size of the RTC memory, so if the failures
+// continue the oldest readings are discarded (and counted).
+//
+// The object itself is what is kept in the RTC memory, so it is read and
+// written as a block of words, with a CRC so that garbage (e.g. after power
+// on) is detected:
+//
+//     ReadingBatch batch;
+//
+//     ESP.rtcUserMemoryRead(0, batch.words(), sizeof batch);
+//     batch.begin(kBatchSize);
+//     batch.startWake();
+//     batch.add(values);
+//     if (batch.uploadDue()) {
+//       if (upload(batch)) {
+//         batch.uploadSucceeded();
+//       } else {
+//         batch.uploadFailed();
+//       }
+//     }
+//     batch.seal();
+//     ESP.rtcUserMemoryWrite(0, batch.words(), sizeof batch);
+//     ESP.deepSleep(us, batch.radioNeededNextWake() ? WAKE_RF_DEFAULT
+//                                                   : WAKE_RF_DISABLED);
+//
+// Each reading records the wake on which it was taken, rather than a time
+// (there is no clock that survives deep sleep, other than the RTC's, which
+// drifts by several percent), so it is uploaded with its age in wakes, from
+// which the server can compute the time it was taken.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "json_writer.h"
+
+class ReadingBatch {
+ public:
+  // The number of values in a reading (e.g. temperature, humidity,
+  // compensated humidity and Vcc).
+  static constexpr uint8_t kChannels = 4;
+  // The maximum number of readings, so that the whole object fits in the 512
+  // bytes of RTC user memory.
+  static constexpr uint8_t kCapacity = 48;
+
+  struct Reading {
+    // The low 16 bits of wakes() when the reading was taken.
+    uint16_t wake;
+    int16_t values[kChannels];
+  };
+
+  // Checks the CRC, and if it doesn't match (or this isn't a ReadingBatch,
+  // e.g. after power on), resets the queue; returns false if it did so.
+  // Either way, uploads are then every batch_size wakes (at most kCapacity,
+  // but no more than about half of it leaves room for retries).
+  bool begin(uint8_t batch_size);
+
+  // Discards the readings, and starts counting wakes from zero.
+  void reset(uint8_t batch_size);
+
+  // Counts a wake, on which an upload may be due.
+  void startWake();
+
+  // Adds a reading taken on this wake, discarding the oldest if the queue is
+  // full.
+  void add(const int16_t* values);
+
+  // Returns true if the readings should be uploaded on this wake. That is
+  // so even if there are none (e.g. the sensor has failed), so that the
+  // server still hears from the device.
+  bool uploadDue() const { return wakes_until_upload_ == 0; }
+
+  // Returns true if the next wake may upload, so needs the radio.
+  bool radioNeededNextWake() const { return wakes_until_upload_ <= 1; }
+
+  // Discards the readings that were uploaded, and schedules the next upload
+  // batch_size wakes from now.
+  void uploadSucceeded();
+
+  // Keeps the readings, and schedules a retry; see above.
+  void uploadFailed();
+
+  // Updates the CRC, before the object is written to the RTC memory.
+  void seal();
+
+  // For reading and writing the object as words of RTC memory.
+  uint32_t* words() { return &crc_; }
+
+  // The number of wakes since the queue was reset.
+  uint32_t wakes() const { return wakes_; }
+  uint8_t count() const { return count_; }
+  // The number of readings discarded because the queue was full.
+  uint16_t dropped() const { return dropped_; }
+  // The number of uploads that have failed since the last success.
+  uint8_t failures() const { return failures_; }
+
+  // The i-th oldest reading.
+  const Reading& reading(uint8_t i) const {
+    const uint8_t n = head_ + i;
+    return readings_[n < kCapacity ? n : n - kCapacity];
+  }
+
+  // Writes the readings as a JSON array of arrays, oldest first, each
+  // [age, value, ...], where age is the number of wakes since the reading
+  // was taken (0 for this wake's), and the values are written as fixed point
+  // numbers with digits[c] digits after the decimal point for channel c.
+  void writeJson(JsonWriter* json, const uint8_t* digits) const;
+
+ private:
+  uint32_t computeCrc() const;
+
+  // The CRC of the rest of the object.
+  uint32_t crc_;
+  uint32_t magic_;
+  uint32_t wakes_;
+  uint16_t dropped_;
+  uint8_t head_;
+  uint8_t count_;
+  uint8_t batch_size_;
+  uint8_t wakes_until_upload_;
+  uint8_t failures_;
+  uint8_t unused_;
+  Reading readings_[kCapacity];
+};
+
+static_assert(sizeof(ReadingBatch) <= 512, "Too big for RTC user memory");
+static_assert(sizeof(ReadingBatch) % 4 == 0, "RTC memory is read as words");
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_READING_BATCH_H_
@@ -0,0 +1,192 @@
+#include "response_writer.h"
+
+namespace {
+
+// Copies str to out, returning the number of chars copied (without the NUL).
+uint8_t putString(char* out, const char* str) {
+  const size_t n = strlen(str);
+  memcpy(out, str, n);
+  return n;
+}
+
+// Formats value in the base (10 or 16), returning the number of chars.
+uint8_t putNumber(char* out, uint16_t value, uint8_t base) {
+  char reversed[5];
+  uint8_t n = 0;
+  do {
+    const uint8_t digit = value % base;
+    reversed[n++] = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value > 0);
+  for (uint8_t i = 0; i < n; ++i) {
+    out[i] = reversed[n - 1 - i];
+  }
+  return n;
+}
+
+}  // namespace
+
+constexpr uint8_t ResponseWriter::kFramingSpace;
+constexpr uint8_t ResponseWriter::kChunkSizeSpace;
+constexpr uint8_t ResponseWriter::kTrailerSpace;
+
+ResponseWriter::ResponseWriter(Print* client, char* buf, uint16_t size)
+    : client_(client), buf_(buf), size_(size) {}
+
+void ResponseWriter::beginResponse(const char* status, bool http_1_0) {
+  state_ = kHeaders;
+  http_1_0_ = http_1_0;
+  write_failed_ = false;
+  end_ = 0;
+  body_limit_ = size_;
+  client_writes_ = 0;
+  print("HTTP/1.1 ");
+  print(status);
+  print("\r\n");
+}
+
+void ResponseWriter::beginResponse(const char* status,
+                                   const HttpRequest& request) {
+  beginResponse(status, request.http_1_0);
+  if (!request.keep_alive) {
+    header("Connection", "close");
+  }
+}
+
+void ResponseWriter::header(const char* name, const char* value) {
+  print(name);
+  print(": ");
+  print(value);
+  print("\r\n");
+}
+
+void ResponseWriter::beginBody() {
+  if (state_ != kHeaders) {
+    return;
+  }
+  if (end_ + kFramingSpace + kTrailerSpace + 16 > size_) {
+    // Too little room left for the body, so send the headers now.
+    send(0);
+    end_ = 0;
+  }
+  headers_end_ = end_;
+  body_start_ = headers_end_ + kFramingSpace;
+  end_ = body_start_;
+  body_limit_ = size_ - kTrailerSpace;
+  state_ = kFirstBody;
+}
+
+bool ResponseWriter::endResponse() {
+  switch (state_) {
+    case kHeaders:
+      beginBody();
+      sendFirstBody(true);
+      break;
+    case kFirstBody:
+      sendFirstBody(true);
+      break;
+    case kChunked:
+    case kUnframed:
+      sendMoreBody(true);
+      break;
+    case kDone:
+      break;
+  }
+  state_ = kDone;
+  return !write_failed_;
+}
+
+size_t ResponseWriter::write(uint8_t b) { return write(&b, 1); }
+
+size_t ResponseWriter::write(const uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (written < size && state_ != kDone) {
+    const uint16_t room = body_limit_ - end_;
+    if (room == 0) {
+      switch (state_) {
+        case kHeaders:
+          // The blank line at the end of the headers hasn't been sent, so
+          // the headers can be sent in pieces.
+          send(0);
+          end_ = 0;
+          break;
+        case kFirstBody:
+          sendFirstBody(false);
+          break;
+        default:
+          sendMoreBody(false);
+          break;
+      }
+      continue;
+    }
+    const size_t n = size - written < room ? size - written : room;
+    memcpy(buf_ + end_, buffer + written, n);
+    end_ += n;
+    written += n;
+  }
+  return written;
+}
+
+void ResponseWriter::sendFirstBody(bool final) {
+  char framing[kFramingSpace];
+  uint8_t len = 0;
+  if (final) {
+    len += putString(framing, "Content-Length: ");
+    len += putNumber(framing + len, bodySize(), 10);
+    len += putString(framing + len, "\r\n\r\n");
+  } else if (http_1_0_) {
+    len += putString(framing, "\r\n");
+  } else {
+    len += putString(framing, "Transfer-Encoding: chunked\r\n\r\n");
+    len += putNumber(framing + len, bodySize(), 16);
+    len += putString(framing + len, "\r\n");
+    end_ += putString(buf_ + end_, "\r\n");
+  }
+  // Put the framing immediately before the body, and move the headers up to
+  // meet it, so that the response is contiguous.
+  const uint16_t framing_start = body_start_ - len;
+  const uint16_t start = framing_start - headers_end_;
+  memmove(buf_ + start, buf_, headers_end_);
+  memcpy(buf_ + framing_start, framing, len);
+  send(start);
+  if (final) {
+    state_ = kDone;
+  } else if (http_1_0_) {
+    state_ = kUnframed;
+    body_start_ = 0;
+  } else {
+    state_ = kChunked;
+    body_start_ = kChunkSizeSpace;
+  }
+  end_ = body_start_;
+}
+
+void ResponseWriter::sendMoreBody(bool final) {
+  uint16_t start = body_start_;
+  if (state_ == kChunked) {
+    if (bodySize() > 0) {
+      char size[kChunkSizeSpace];
+      uint8_t len = putNumber(size, bodySize(), 16);
+      len += putString(size + len, "\r\n");
+      start = body_start_ - len;
+      memcpy(buf_ + start, size, len);
+      end_ += putString(buf_ + end_, "\r\n");
+    }
+    if (final) {
+      end_ += putString(buf_ + end_, "0\r\n\r\n");
+    }
+  }
+  send(start);
+  end_ = body_start_;
+}
+
+void ResponseWriter::send(uint16_t start) {
+  const uint16_t n = end_ - start;
+  if (n == 0) {
+    return;
+  }
+  ++client_writes_;
+  if (client_->write(buf_ + start, n) != n) {
+    write_failed_ = true;
+  }
+}
@@ -0,0 +1,135 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_RESPONSE_WRITER_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_RESPONSE_WRITER_H_
+
+// Buffers an HTTP response (status line, headers and body) so that it is sent
+// to the client in as few writes as possible, rather than with a write for
+// each print (or several, for println or print(float)). With the Ethernet
+// library each write to an EthernetClient is a separate SEND command to the
+// Wiznet chip, and hence at least one TCP segment.
+//
+// If the whole response fits in the buffer, it is sent with one write and a
+// Content-Length header. Otherwise the body is sent with chunked transfer
+// encoding, with one write per buffer full; or, for an HTTP/1.0 client, which
+// doesn't understand chunks, unframed (the end of the body is marked by
+// closing the connection). For example:
+//
+//     ResponseWriterBuffer<256> writer(client);
+//     writer.beginResponse("200 OK");
+//     writer.header("Content-Type", "text/plain");
+//     writer.beginBody();
+//     writer.print("Temperature: ");
+//     writer.println(temperature);
+//     writer.endResponse();
+//
+// For one segment per write, the buffer should be no larger than the TCP
+// maximum segment size (1460 on Ethernet), and it must be smaller than the
+// chip's transmit buffer for each socket (2KB by default on the W5100 and
+// W5500); on an AVR, RAM limits it to much less.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "http_request.h"
+
+class ResponseWriter : public Print {
+ public:
+  // Space at the end of the headers for the header(s) that frame the body,
+  // and the size of the first chunk; i.e.
+  // "Transfer-Encoding: chunked\r\n\r\nFFFF\r\n".
+  static constexpr uint8_t kFramingSpace = 36;
+  // Space before each subsequent chunk for its size: "FFFF\r\n".
+  static constexpr uint8_t kChunkSizeSpace = 6;
+  // Space after the body for the end of a chunk, and the last chunk:
+  // "\r\n0\r\n\r\n".
+  static constexpr uint8_t kTrailerSpace = 7;
+
+  // buf must have room for size bytes, which must be more than
+  // kFramingSpace + kTrailerSpace.
+  ResponseWriter(Print* client, char* buf, uint16_t size);
+
+  // Starts the response with the status line, e.g. for status "200 OK",
+  // "HTTP/1.1 200 OK\r\n". http_1_0 is true if the request was HTTP/1.0.
+  void beginResponse(const char* status, bool http_1_0 = false);
+
+  // Starts the response to request, adding "Connection: close" if the server
+  // will close the connection after the response.
+  void beginResponse(const char* status, const HttpRequest& request);
+
+  // Adds a header line. Must be called between beginResponse and beginBody.
+  void header(const char* name, const char* value);
+
+  // Ends the headers; anything written after this is the body.
+  void beginBody();
+
+  // Sends whatever remains of the response. Returns false if any write to
+  // the client was incomplete.
+  bool endResponse();
+
+  // The number of writes to the client so far.
+  uint16_t clientWrites() const { return client_writes_; }
+
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+ private:
+  enum State : uint8_t {
+    // Between beginResponse and beginBody.
+    kHeaders,
+    // In the body, and none of it has been sent.
+    kFirstBody,
+    // Parts of the body have been sent as chunks.
+    kChunked,
+    // Parts of the body have been sent unframed (HTTP/1.0).
+    kUnframed,
+    kDone,
+  };
+
+  // Sends the headers, the framing and the body buffered so far. If final,
+  // this is the whole of the body; else there is more to come.
+  void sendFirstBody(bool final);
+
+  // Sends the body buffered since the last send as a chunk (or unframed). If
+  // final, also sends the last (empty) chunk.
+  void sendMoreBody(bool final);
+
+  // Writes buf_[start, end_) to the client.
+  void send(uint16_t start);
+
+  // The size of the body in the buffer.
+  uint16_t bodySize() const { return end_ - body_start_; }
+
+  Print* const client_;
+  char* const buf_;
+  const uint16_t size_;
+  State state_ = kDone;
+  bool http_1_0_;
+  bool write_failed_;
+  // Bytes in use: buf_[0, end_).
+  uint16_t end_;
+  // The end of the headers (excluding the blank line), during kFirstBody.
+  uint16_t headers_end_;
+  // Where the (unsent) body starts.
+  uint16_t body_start_;
+  // Where the body must end, leaving room for the trailer.
+  uint16_t body_limit_;
+  uint16_t client_writes_ = 0;
+};
+
+// A ResponseWriter which contains its own buffer of N bytes.
+template <uint16_t N>
+class ResponseWriterBuffer : public ResponseWriter {
+ public:
+  explicit ResponseWriterBuffer(Print* client)
+      : ResponseWriter(client, buf_, N) {
+    static_assert(N > kFramingSpace + kTrailerSpace + 16,
+                  "Buffer is too small");
+  }
+
+ private:
+  char buf_[N];
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_RESPONSE_WRITER_H_
@@ -0,0 +1,168 @@
+#include "sensor_history.h"
+
+using jamessynge::ArdTime;
+using jamessynge::internal::repr;
+using jamessynge::internal::repr_to_ard_time;
+
+namespace {
+
+// Marks a time delta too large for 2 bytes, followed by the whole time.
+constexpr uint16_t kTimeEscape = 0xFFFF;
+// Marks a value change too large for 1 byte, followed by the whole value.
+constexpr uint8_t kValueEscape = 0x80;
+
+}  // namespace
+
+SensorHistory::Reader::Reader(const SensorHistory* history)
+    : history_(history),
+      offset_(0),
+      remaining_(history->count_),
+      time_ms_(history->base_ms_) {
+  memcpy(values_, history->base_values_, sizeof values_);
+}
+
+bool SensorHistory::Reader::next(ArdTime* t, int16_t* values) {
+  if (remaining_ == 0) {
+    return false;
+  }
+  offset_ += history_->decodeAt(offset_, &time_ms_, values_);
+  --remaining_;
+  *t = repr_to_ard_time(time_ms_);
+  memcpy(values, values_, history_->channels_ * sizeof values[0]);
+  return true;
+}
+
+void SensorHistory::Reader::writeJson(JsonWriter* json,
+                                      const uint8_t* digits) {
+  const uint8_t channels = history_->channels_;
+  ArdTime t;
+  int16_t values[kMaxChannels];
+  json->beginArray();
+  while (next(&t, values)) {
+    json->beginArray();
+    json->value(repr(t));
+    for (uint8_t c = 0; c < channels; ++c) {
+      json->fixedValue(values[c], digits[c]);
+    }
+    json->endArray();
+  }
+  json->endArray();
+}
+
+SensorHistory::SensorHistory(uint8_t* buf, uint16_t size, uint8_t channels)
+    : buf_(buf),
+      size_(size),
+      channels_(channels < 1 ? 1
+                             : (channels > kMaxChannels ? kMaxChannels
+                                                        : channels)) {}
+
+void SensorHistory::clear() {
+  head_ = 0;
+  used_ = 0;
+  count_ = 0;
+  base_ms_ = 0;
+  last_ms_ = 0;
+  memset(base_values_, 0, sizeof base_values_);
+  memset(last_values_, 0, sizeof last_values_);
+}
+
+void SensorHistory::add(ArdTime t, const int16_t* values) {
+  // Encode the sample.
+  uint8_t sample[maxSampleSize(kMaxChannels)];
+  uint8_t n = 0;
+  // millis() is 32 bits on the boards; so too the times here on the host.
+  const uint32_t ms = repr(t);
+  const uint32_t dt = ms - last_ms_;
+  if (dt < kTimeEscape) {
+    sample[n++] = dt;
+    sample[n++] = dt >> 8;
+  } else {
+    sample[n++] = kTimeEscape & 0xFF;
+    sample[n++] = kTimeEscape >> 8;
+    sample[n++] = ms;
+    sample[n++] = ms >> 8;
+    sample[n++] = ms >> 16;
+    sample[n++] = ms >> 24;
+  }
+  for (uint8_t c = 0; c < channels_; ++c) {
+    // Computed modulo 2^16, so there is no overflow.
+    const int16_t delta = static_cast<uint16_t>(values[c]) -
+                          static_cast<uint16_t>(last_values_[c]);
+    if (delta >= -127 && delta <= 127) {
+      sample[n++] = static_cast<uint8_t>(delta);
+    } else {
+      const uint16_t value = values[c];
+      sample[n++] = kValueEscape;
+      sample[n++] = value;
+      sample[n++] = value >> 8;
+    }
+    last_values_[c] = values[c];
+  }
+  last_ms_ = ms;
+
+  // Make room for it, by discarding the oldest samples.
+  while (size_ - used_ < n) {
+    const uint8_t oldest = decodeAt(0, &base_ms_, base_values_);
+    head_ += oldest;
+    if (head_ >= size_) {
+      head_ -= size_;
+    }
+    used_ -= oldest;
+    --count_;
+  }
+
+  uint16_t tail = head_ + used_;
+  if (tail >= size_) {
+    tail -= size_;
+  }
+  for (uint8_t i = 0; i < n; ++i) {
+    buf_[tail] = sample[i];
+    if (++tail == size_) {
+      tail = 0;
+    }
+  }
+  used_ += n;
+  ++count_;
+}
+
+SensorHistory::Reader SensorHistory::readSince(ArdTime since) const {
+  const uint32_t since_ms = repr(since);
+  Reader reader(this);
+  // Skip the samples up to since, without reading the first after it.
+  while (reader.remaining_ > 0) {
+    Reader ahead = reader;
+    ahead.offset_ += decodeAt(ahead.offset_, &ahead.time_ms_, ahead.values_);
+    if (static_cast<int32_t>(ahead.time_ms_ - since_ms) > 0) {
+      break;
+    }
+    --ahead.remaining_;
+    reader = ahead;
+  }
+  return reader;
+}
+
+uint8_t SensorHistory::decodeAt(uint16_t offset, uint32_t* ms,
+                                int16_t* values) const {
+  const uint16_t start = offset;
+  const uint16_t dt = byteAt(offset) | (byteAt(offset + 1) << 8);
+  offset += 2;
+  if (dt != kTimeEscape) {
+    *ms += dt;
+  } else {
+    *ms = static_cast<uint32_t>(byteAt(offset)) |
+          (static_cast<uint32_t>(byteAt(offset + 1)) << 8) |
+          (static_cast<uint32_t>(byteAt(offset + 2)) << 16) |
+          (static_cast<uint32_t>(byteAt(offset + 3)) << 24);
+    offset += 4;
+  }
+  for (uint8_t c = 0; c < channels_; ++c) {
+    const uint8_t b = byteAt(offset++);
+    if (b != kValueEscape) {
+      values[c] += static_cast<int8_t>(b);
+    } else {
+      values[c] = byteAt(offset) | (byteAt(offset + 1) << 8);
+      offset += 2;
+    }
+  }
+  return offset - start;
+}
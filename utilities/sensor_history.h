@@ -0,0 +1,154 @@
+#ifndef _JAMESSYNGE_ARDUINO_EXPERIMENTS_SENSOR_HISTORY_H_
+#define _JAMESSYNGE_ARDUINO_EXPERIMENTS_SENSOR_HISTORY_H_
+
+// A fixed size, circular history of sensor readings, so that a client can
+// fetch the samples it hasn't yet seen (e.g. after missing a poll), rather
+// than only the current value. Each sample has a timestamp (millis()) and up
+// to kMaxChannels int16_t values (e.g. tenths of a degree); when the buffer
+// is full, adding a sample discards the oldest.
+//
+// To fit as many samples as possible into an Arduino's little RAM, they are
+// delta encoded: each sample is stored as the time since the previous one,
+// and for each channel, the change in value:
+//
+//     time delta: 2 bytes (little endian); 0xFFFF is followed by the whole
+//                 time (4 bytes), for a gap of more than 65 seconds.
+//     per channel: the change as 1 signed byte, if from -127 to 127; -128
+//                  (0x80) is followed by the whole value (2 bytes).
+//
+// So a sample of slowly changing readings takes 2 bytes plus 1 per channel
+// (e.g. 4 bytes for temperature and pressure, rather than 8), and at
+// worst 6 plus 3 per channel. Decoding has to start from the oldest sample,
+// so the history is read in order by a Reader, e.g.:
+//
+//     SensorHistoryBuffer<256> history(2);
+//
+//     int16_t values[2] = {temperature_tenths, pressure_tenths};
+//     history.add(ArdTime::Now(), values);
+//     ...
+//     SensorHistory::Reader reader = history.readSince(since);
+//     ArdTime t;
+//     while (reader.next(&t, values)) {
+//       ...
+//     }
+//
+// or, for an HTTP response, reader.writeJson(&json, digits).
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "json_writer.h"
+#include "time.h"
+
+class SensorHistory {
+ public:
+  static constexpr uint8_t kMaxChannels = 4;
+
+  // The bytes used by a sample of slowly changing readings, and at most.
+  static constexpr uint8_t typicalSampleSize(uint8_t channels) {
+    return 2 + channels;
+  }
+  static constexpr uint8_t maxSampleSize(uint8_t channels) {
+    return 6 + 3 * channels;
+  }
+
+  // Reads samples, from the oldest to the newest. Adding a sample to the
+  // history invalidates the Reader.
+  class Reader {
+   public:
+    // Copies the next sample into t and values (which must have room for
+    // channels() values). Returns false if there are no more.
+    bool next(jamessynge::ArdTime* t, int16_t* values);
+
+    // The number of samples not yet read.
+    uint16_t remaining() const { return remaining_; }
+
+    // Reads the remaining samples, writing them as a JSON array of arrays,
+    // each [time, value, ...]. The values are written as fixed point numbers
+    // with digits[c] digits after the decimal point for channel c (e.g. 1
+    // if the values are tenths of a degree), without floating point.
+    void writeJson(JsonWriter* json, const uint8_t* digits);
+
+   private:
+    friend class SensorHistory;
+    explicit Reader(const SensorHistory* history);
+
+    const SensorHistory* history_;
+    uint16_t offset_;
+    uint16_t remaining_;
+    uint32_t time_ms_;
+    int16_t values_[kMaxChannels];
+  };
+
+  // buf must have room for size bytes, which must be at least
+  // maxSampleSize(channels), and less than 32KB; channels must be from 1 to
+  // kMaxChannels.
+  SensorHistory(uint8_t* buf, uint16_t size, uint8_t channels);
+
+  // Adds a sample, with channels() values, discarding the oldest sample(s)
+  // if there isn't room. Times must not decrease (other than by millis()
+  // wrapping around).
+  void add(jamessynge::ArdTime t, const int16_t* values);
+
+  // Discards all of the samples.
+  void clear();
+
+  uint8_t channels() const { return channels_; }
+  uint16_t count() const { return count_; }
+  // The bytes used by the samples, of capacityBytes().
+  uint16_t usedBytes() const { return used_; }
+  uint16_t capacityBytes() const { return size_; }
+
+  // Returns a Reader of all of the samples.
+  Reader read() const { return Reader(this); }
+
+  // Returns a Reader of the samples after since (i.e. whose time is later),
+  // so that a client can ask for the samples it hasn't seen. Times are
+  // compared allowing for millis() wrapping around, so since must be within
+  // about 24 days of the samples.
+  Reader readSince(jamessynge::ArdTime since) const;
+
+ private:
+  // The byte at offset from the start of the oldest sample.
+  uint8_t byteAt(uint16_t offset) const {
+    uint16_t i = head_ + offset;
+    return buf_[i < size_ ? i : i - size_];
+  }
+
+  // Decodes the sample at offset, which is a delta from *ms and values, into
+  // them. Returns the size of the sample.
+  uint8_t decodeAt(uint16_t offset, uint32_t* ms, int16_t* values) const;
+
+  uint8_t* const buf_;
+  const uint16_t size_;
+  const uint8_t channels_;
+  // The samples are in the used_ bytes starting at head_, wrapping around to
+  // the start of buf_.
+  uint16_t head_ = 0;
+  uint16_t used_ = 0;
+  uint16_t count_ = 0;
+  // The time and values from which the oldest sample is a delta (those of the
+  // sample before it, since discarded), and those of the newest sample, from
+  // which the next is a delta.
+  uint32_t base_ms_ = 0;
+  int16_t base_values_[kMaxChannels] = {};
+  uint32_t last_ms_ = 0;
+  int16_t last_values_[kMaxChannels] = {};
+};
+
+// A SensorHistory which contains its own buffer of N bytes.
+template <uint16_t N>
+class SensorHistoryBuffer : public SensorHistory {
+ public:
+  explicit SensorHistoryBuffer(uint8_t channels)
+      : SensorHistory(buf_, N, channels) {
+    static_assert(N >= maxSampleSize(kMaxChannels), "Buffer is too small");
+  }
+
+ private:
+  uint8_t buf_[N];
+};
+
+#endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_SENSOR_HISTORY_H_
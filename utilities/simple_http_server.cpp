@@ -1,8 +1,11 @@
 #include "simple_http_server.h"
 
 #include "addresses.h"
+#include "arp_prober.h"
+#include "dhcp_client.h"
 #include "eeprom_io.h"
 
+constexpr unsigned long SimpleHttpServer::kRequestTimeoutMs;
 
 SimpleHttpServer::SimpleHttpServer(int chip_select_pin, int port)
     : server_(port) {
@@ -15,52 +18,86 @@ SimpleHttpServer::SimpleHttpServer(int chip_select_pin, int port)
 }
 
 bool SimpleHttpServer::setup(const OuiPrefix* oui_prefix) {
-  // Load the addresses saved to EEPROM, if they were previously saved. If they
-  // were not successfully loaded, then generate them and save them into the
+  // Load the profiles saved to EEPROM, if they were previously saved. If they
+  // were not successfully loaded, then generate one and save it into the
   // EEPROM.
   Addresses addresses;
   addresses.loadOrGenAndSave(oui_prefix);
 
-  Serial.print("MAC: ");
-  Serial.println(addresses.mac);
-  Serial.print("Default IP: ");
-  Serial.println(addresses.ip);
+  DhcpLease cached;
+  const bool have_lease = cached.load();
+  if (have_lease) {
+    Serial.print("Cached lease: ");
+    printIPAddress(Serial, cached.ip);
+    Serial.println();
+  }
 
-  if (Ethernet.begin(addresses.mac.mac)) {
-    // Yeah, we were able to get an IP address via DHCP.
-    using_dhcp_ = true;
-  } else {
-    // No DHCP server responded with a lease on an IP address.
-    // Is there hardware?
-    if (Ethernet.hardwareStatus() == EthernetNoHardware) {
-      // Oops, this isn't the right board to run this sketch.
-      return false;
+  // Start the chip without an IP address, so that the link-local address can
+  // be probed for (see arp_prober.h) while waiting for DHCP.
+  Ethernet.begin(addresses.profiles[addresses.order[0]].mac.mac,
+                 IPAddress(0, 0, 0, 0));
+  if (Ethernet.hardwareStatus() == EthernetNoHardware) {
+    // Oops, this isn't the right board to run this sketch.
+    return false;
+  }
+
+  ArpProber prober;
+  bool changed = false;
+  bool jumpered = false;
+  if (jumper_pin_ != kNoJumper && jumper_profile_ < addresses.count) {
+    pinMode(jumper_pin_, INPUT_PULLUP);
+    jumpered = digitalRead(jumper_pin_) == LOW;
+  }
+  if (jumpered) {
+    Serial.print("Jumpered to profile #");
+    Serial.println(jumper_profile_);
+    profile_index_ = jumper_profile_;
+    if (tryProfile(&prober, &addresses.profiles[profile_index_],
+                   have_lease ? &cached : nullptr, &changed) &&
+        addresses.markSuccessful(profile_index_)) {
+      changed = true;
     }
-    Serial.println("No DHCP");
+  } else {
+    profile_index_ = chooseProfile(&prober, &addresses,
+                                   have_lease ? &cached : nullptr, &changed);
+  }
+  if (changed) {
+    addresses.save();
+  }
+  profile_ = addresses.profiles[profile_index_];
 
-    // No DHCP server responded with a lease on an IP address, so we'll
-    // fallback to using our randomly generated IP.
-    using_dhcp_ = false;
-    Ethernet.setLocalIP(addresses.ip);
+  if (!profile_.use_dhcp) {
+    // Check that no other device has the address before announcing it; it is
+    // used anyway, as there is no other.
+    prober.end();
+    if (prober.begin(profile_.mac.mac, profile_.ip) ==
+            ArpProber::Result::kProbing &&
+        finishProbe(&prober) == ArpProber::Result::kConflict) {
+      Serial.print("In use by another device: ");
+      Serial.println(profile_.ip);
+      prober.end();
+    }
+    useStatic();
+    prober.announce();
+  } else if (dhcp_.bound()) {
+    // Yeah, we were able to get an IP address via DHCP.
+    prober.end();
+    useLease();
+  } else {
+    Serial.println("No DHCP yet");
 
-    // The link-local address range must not be divided into smaller
-    // subnets, so we set our subnet mask accordingly:
-    IPAddress subnet(255, 255, 0, 0);
-    Ethernet.setSubnetMask(subnet);
+    // No DHCP server has responded with a lease on an IP address yet, so
+    // we'll use our randomly generated IP, or another if another device is
+    // using it, until one does.
+    useLinkLocal();
 
-    // Assume that the gateway is on the same subnet, at address 1 within
-    // the subnet. This code will work with many subnets, not just a /16.
-    IPAddress gateway = addresses.ip;
-    gateway[0] &= subnet[0];
-    gateway[1] &= subnet[1];
-    gateway[2] &= subnet[2];
-    gateway[3] &= subnet[3];
-    gateway[3] |= 1;
-    Ethernet.setGatewayIP(gateway);
+    // Tell the other devices that the address is now ours.
+    prober.announce();
   }
 
   Serial.print("IP: ");
-  Serial.println(Ethernet.localIP());
+  printIPAddress(Serial, Ethernet.localIP());
+  Serial.println();
 
   // These other 3 addresses aren't particularly necessary when we aren't
   // initiating IP communications, IIUC.
@@ -76,75 +113,377 @@ bool SimpleHttpServer::setup(const OuiPrefix* oui_prefix) {
   return true;
 }
 
-bool SimpleHttpServer::loop(ClientFunc handler) {
-  // If we're using an IP address assigned via DHCP, renew the lease
-  // periodically. The Ethernet library will do so at the appropriate interval
-  // if we call it often enough.
-  if (using_dhcp_) {
-    switch (Ethernet.maintain()) {
-      case 1: // Renew failed
-      case 3: // Rebind failed
-        Serial.println("WARNING! lost our DHCP assigned address!");
-        return false;
-    }
-  }
-
-  // Has a client connected since we last checked?
-  EthernetClient client = server_.available();
-
-  if (client) {
-    // Looks like we have a client. However, there is a bug in EthernetServer
-    // w.r.t. the W5100. In general, EthernetServer.available() returns an
-    // EthernetClient with a sockIndex of MAX_SOCK_NUM when there is no
-    // connection. However, the W5100 supports at most 4 sockets at once, not
-    // the 8 supported by the W5200 and W5500 chips, so available() stops
-    // searching for a new connection when it gets to index 4; BUT instead of
-    // returning MAX_SOCK_NUM (typically 8), it returns the index it stopped at
-    // 4. We can cover that up here, while waiting for the fix to be patched
-    // and distributed.
-    if (!(client.getSocketNumber() == 4 && 
-      Ethernet.hardwareStatus() == EthernetW5100)) {
-      // Looks valid.
-      handler(&client);
-
-      // Give the web browser time to receive the data.
-      // TODO(jamessynge): Figure out if this delay, from one of the Ethernet
-      // library examples, is really necessary. Are we basically making sure
-      // that the chip has sent the data before closing this side of the
-      // connection?
+uint8_t SimpleHttpServer::chooseProfile(ArpProber* prober,
+                                        Addresses* addresses,
+                                        const DhcpLease* cached,
+                                        bool* changed) {
+  // A DHCP profile is preferred if none is confirmed, as DHCP carries on in
+  // loop, so it may yet be.
+  uint8_t fallback = Addresses::kMaxProfiles;
+  for (uint8_t i = 0; i < addresses->count; ++i) {
+    const uint8_t index = addresses->order[i];
+    NetworkProfile& profile = addresses->profiles[index];
+    if (tryProfile(prober, &profile, cached, changed)) {
+      if (addresses->markSuccessful(index)) {
+        *changed = true;
+      }
+      return index;
+    }
+    if (fallback == Addresses::kMaxProfiles ||
+        (profile.use_dhcp && !addresses->profiles[fallback].use_dhcp)) {
+      fallback = index;
+    }
+  }
+  if (fallback != addresses->order[addresses->count - 1]) {
+    // Not the last one tried, so prober and dhcp_ need restarting for it.
+    tryProfile(prober, &addresses->profiles[fallback], cached, changed);
+  }
+  return fallback;
+}
+
+bool SimpleHttpServer::tryProfile(ArpProber* prober, NetworkProfile* profile,
+                                  const DhcpLease* cached, bool* changed) {
+  prober->end();
+  dhcp_.end();
+  Ethernet.setMACAddress(profile->mac.mac);
+  Serial.print("MAC: ");
+  Serial.println(profile->mac);
+
+  if (!profile->use_dhcp) {
+    Serial.print("Static IP: ");
+    Serial.println(profile->ip);
+    // The gateway replying to a probe for its address shows that this is
+    // its network.
+    if (profile->gateway == IPAddress(0, 0, 0, 0) ||
+        prober->begin(profile->mac.mac, profile->gateway) !=
+            ArpProber::Result::kProbing) {
+      return false;
+    }
+    if (finishProbe(prober) == ArpProber::Result::kConflict) {
+      return true;
+    }
+    Serial.println("No gateway");
+    return false;
+  }
+
+  Serial.print("Default IP: ");
+  Serial.println(profile->ip);
+  // The prober needs socket 0, so must be started before DHCP opens its UDP
+  // socket.
+  const bool probing = prober->begin(profile->mac.mac, profile->ip) ==
+                       ArpProber::Result::kProbing;
+  dhcp_.begin(profile->mac.mac, cached);
+  if (probing && probeLinkLocal(prober, profile)) {
+    *changed = true;
+  }
+  return dhcp_.bound();
+}
+
+ArpProber::Result SimpleHttpServer::finishProbe(ArpProber* prober) {
+  ArpProber::Result result;
+  while ((result = prober->poll()) == ArpProber::Result::kProbing) {
+    // Nothing else to do until the next probe is due.
+    delay(1);
+  }
+  return result;
+}
+
+bool SimpleHttpServer::probeLinkLocal(ArpProber* prober,
+                                      NetworkProfile* profile) {
+  bool changed = false;
+  while (true) {
+    ArpProber::Result result;
+    while ((result = prober->poll()) == ArpProber::Result::kProbing) {
+      if (dhcp_.poll() == DhcpClient::Event::kBound) {
+        // The link-local address isn't needed.
+        return changed;
+      }
+      // Nothing else to do until the next probe is due.
       delay(1);
+    }
+    if (result != ArpProber::Result::kConflict) {
+      return changed;
+    }
+    Serial.print("In use by another device: ");
+    Serial.println(profile->ip);
+    if (prober->conflicts() >= kMaxIPConflicts) {
+      // Something is amiss (e.g. a device that claims every address); use
+      // the address anyway, rather than never starting.
+      return changed;
+    }
+    profile->regenerateIP();
+    changed = true;
+    prober->restart(profile->ip);
+  }
+}
+
+void SimpleHttpServer::rememberProfile() {
+  Addresses addresses;
+  if (addresses.load(nullptr) && addresses.markSuccessful(profile_index_)) {
+    addresses.save();
+  }
+}
+
+void SimpleHttpServer::useLease() {
+  const DhcpLease& lease = dhcp_.lease();
+  Ethernet.setLocalIP(lease.ip);
+  Ethernet.setSubnetMask(lease.subnet);
+  Ethernet.setGatewayIP(lease.gateway);
+  Ethernet.setDnsServerIP(lease.dns);
+  lease.save();
+}
+
+void SimpleHttpServer::useLinkLocal() {
+  Ethernet.setLocalIP(profile_.ip);
 
+  // The link-local address range must not be divided into smaller
+  // subnets, so we set our subnet mask accordingly:
+  IPAddress subnet(255, 255, 0, 0);
+  Ethernet.setSubnetMask(subnet);
+
+  // Assume that the gateway is on the same subnet, at address 1 within
+  // the subnet. This code will work with many subnets, not just a /16.
+  IPAddress gateway = profile_.ip;
+  gateway[0] &= subnet[0];
+  gateway[1] &= subnet[1];
+  gateway[2] &= subnet[2];
+  gateway[3] &= subnet[3];
+  gateway[3] |= 1;
+  Ethernet.setGatewayIP(gateway);
+}
+
+void SimpleHttpServer::useStatic() {
+  Ethernet.setLocalIP(profile_.ip);
+  Ethernet.setSubnetMask(profile_.subnet);
+  Ethernet.setGatewayIP(profile_.gateway);
+  Ethernet.setDnsServerIP(profile_.dns);
+}
+
+bool SimpleHttpServer::loop(RequestFunc handler) {
+  if (metrics_ != nullptr) {
+    metrics_->loopIteration();
+  }
+
+  // Get a DHCP lease if we don't have one yet, and renew it periodically.
+  switch (dhcp_.poll()) {
+    case DhcpClient::Event::kNone:
+      break;
+    case DhcpClient::Event::kBound:
+      useLease();
+      Serial.print("DHCP IP: ");
+      printIPAddress(Serial, Ethernet.localIP());
+      Serial.println();
+      // The profile suits this network after all.
+      rememberProfile();
+      break;
+    case DhcpClient::Event::kExpired:
+      Serial.println("WARNING! lost our DHCP assigned address!");
+      if (metrics_ != nullptr) {
+        metrics_->dhcp_failures.increment();
+      }
+      useLinkLocal();
+      return false;
+  }
+
+  idle_ = true;
+  acceptConnections();
+  for (Connection& conn : connections_) {
+    if (conn.socket < MAX_SOCK_NUM) {
+      serviceConnection(conn, handler);
+    }
+  }
+  return true;
+}
+
+void SimpleHttpServer::enableKeepAlive(unsigned long idle_timeout_ms,
+                                       uint8_t max_requests,
+                                       uint8_t max_persistent) {
+  keep_alive_timeout_ms_ = idle_timeout_ms;
+  keep_alive_max_requests_ = max_requests;
+  max_persistent_ = max_persistent;
+}
+
+uint8_t SimpleHttpServer::activeConnections() const {
+  uint8_t result = 0;
+  for (const Connection& conn : connections_) {
+    if (conn.socket < MAX_SOCK_NUM) {
+      ++result;
+    }
+  }
+  return result;
+}
+
+void SimpleHttpServer::acceptConnections() {
+  while (true) {
+    EthernetClient client = server_.accept();
+    if (!client) {
+      return;
+    }
+    // The W5100 supports at most 4 sockets at once, not the 8 supported by
+    // the W5200 and W5500 chips, and some versions of the Ethernet library
+    // return a client for socket 4 of a W5100, which doesn't exist, rather
+    // than an invalid client.
+    if (client.getSocketNumber() == 4 &&
+        Ethernet.hardwareStatus() == EthernetW5100) {
+      return;
+    }
+    Connection* free_conn = nullptr;
+    for (Connection& conn : connections_) {
+      if (conn.socket >= MAX_SOCK_NUM) {
+        free_conn = &conn;
+        break;
+      }
+    }
+    if (free_conn == nullptr && closeIdleConnection()) {
+      for (Connection& conn : connections_) {
+        if (conn.socket >= MAX_SOCK_NUM) {
+          free_conn = &conn;
+          break;
+        }
+      }
+    }
+    if (free_conn == nullptr) {
+      // Only when SIMPLE_HTTP_SERVER_MAX_CONNECTIONS < MAX_SOCK_NUM.
+      sendError(&client, "503 Service Unavailable");
       client.stop();
+      continue;
+    }
+    free_conn->parser.reset();
+    free_conn->last_read_ms = millis();
+    free_conn->socket = client.getSocketNumber();
+    free_conn->requests_served = 0;
+    free_conn->idle = false;
+
+    // Make room for the connection after this one, so that persistent
+    // connections don't use up the sockets.
+    if (keep_alive_max_requests_ > 0 &&
+        activeConnections() > max_persistent_) {
+      closeIdleConnection();
     }
   }
+}
 
+bool SimpleHttpServer::closeIdleConnection() {
+  Connection* lru = nullptr;
+  const unsigned long now = millis();
+  for (Connection& conn : connections_) {
+    if (conn.socket < MAX_SOCK_NUM && conn.idle &&
+        (lru == nullptr ||
+         now - conn.last_read_ms > now - lru->last_read_ms)) {
+      lru = &conn;
+    }
+  }
+  if (lru == nullptr) {
+    return false;
+  }
+  EthernetClient client(lru->socket);
+  close(*lru, &client);
   return true;
 }
 
-bool SimpleHttpServer::skipHttpRequestHeader(EthernetClient* client) {
-  boolean currentLineIsBlank = true;
-  while (client->connected()) {
-    if (!client->available()) {
-      // Keep trying until we have some input, or the connection is closed.
-      continue;
+bool SimpleHttpServer::shouldKeepAlive(const Connection& conn,
+                                       const HttpRequest& request) {
+  // HTTP/1.0 clients must ask for keep-alive, and then need a
+  // "Connection: keep-alive" response header; not worth supporting.
+  return keep_alive_max_requests_ > 0 && !request.http_1_0 &&
+         !request.connection_close &&
+         conn.requests_served + 1 < keep_alive_max_requests_ &&
+         activeConnections() <= max_persistent_;
+}
+
+void SimpleHttpServer::serviceConnection(Connection& conn,
+                                         RequestFunc handler) {
+  EthernetClient client(conn.socket);
+  // Read at most one buffer full per call, so that each connection gets a
+  // turn, and the loop isn't held up for long.
+  uint8_t buf[32];
+  int n = 0;
+  size_t used = 0;
+  int available = client.available();
+  if (available > 0) {
+    n = client.read(
+        buf, available < static_cast<int>(sizeof buf) ? available : sizeof buf);
+    if (n < available) {
+      idle_ = false;
+    }
+    if (n > 0) {
+      used = conn.parser.consume(buf, n);
+      conn.last_read_ms = millis();
+      conn.idle = false;
     }
-    char c = client->read();
-    Serial.print(c);
-    if (c == '\n') {
-      // Reached the end of the current line. If there was nothing on it
-      // (i.e. it just ended \r\n), then we've consumed an empty line, and
-      // have reached the end of the header. Note that we're not validating
-      // that each line ends with exactly \r\n.
-      if (currentLineIsBlank) {
-        return true;
+  } else if (!client.connected()) {
+    // The client gave up before sending the whole request, or closed an
+    // idle connection.
+    close(conn, &client);
+    return;
+  }
+
+  switch (conn.parser.status()) {
+    case HttpRequestParser::kIncomplete:
+      if (conn.idle) {
+        if (millis() - conn.last_read_ms >= keep_alive_timeout_ms_) {
+          close(conn, &client);
+        }
+      } else if (millis() - conn.last_read_ms >= kRequestTimeoutMs) {
+        sendError(&client, "408 Request Timeout");
+        close(conn, &client);
+      }
+      return;
+    case HttpRequestParser::kComplete: {
+      HttpRequest request = conn.parser.request();
+      // Any bytes after the end of the request (i.e. a pipelined request)
+      // are dropped, so the connection is closed, and the client will send
+      // that request again.
+      request.keep_alive =
+          static_cast<int>(used) == n && shouldKeepAlive(conn, request);
+      if (metrics_ != nullptr) {
+        metrics_->requests.increment();
+      }
+      handler(request, &client);
+      if (request.keep_alive) {
+        ++conn.requests_served;
+        conn.parser.reset();
+        conn.idle = true;
+        conn.last_read_ms = millis();
+        return;
       }
-      // We're starting a new line, and the last line wasn't empty.
-      currentLineIsBlank = true;
-    } else if (c != '\r') {
-      // c isn't a line terminator, so the line isn't empty.
-      currentLineIsBlank = false;
+      break;
     }
+    case HttpRequestParser::kBadRequest:
+      sendError(&client, "400 Bad Request");
+      break;
+    case HttpRequestParser::kUriTooLong:
+      sendError(&client, "414 URI Too Long");
+      break;
   }
-  // The connection was broken.
-  return false;
+  if (metrics_ != nullptr &&
+      conn.parser.status() != HttpRequestParser::kComplete) {
+    metrics_->parse_errors.increment();
+  }
+  close(conn, &client);
+}
+
+void SimpleHttpServer::sendError(EthernetClient* client, const char* status) {
+  // Formatted first, so that it is sent with one write (i.e. one packet).
+  constexpr char kStart[] = "HTTP/1.1 ";
+  constexpr char kEnd[] =
+      "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  constexpr size_t kMaxStatusLength = 40;
+  char buf[sizeof kStart + kMaxStatusLength + sizeof kEnd];
+  char* out = buf;
+  memcpy(out, kStart, sizeof kStart - 1);
+  out += sizeof kStart - 1;
+  for (size_t i = 0; i < kMaxStatusLength && status[i] != 0; ++i) {
+    *out++ = status[i];
+  }
+  memcpy(out, kEnd, sizeof kEnd - 1);
+  out += sizeof kEnd - 1;
+  client->write(reinterpret_cast<const uint8_t*>(buf), out - buf);
+}
+
+void SimpleHttpServer::close(Connection& conn, EthernetClient* client) {
+  // EthernetClient::stop waits (briefly) for the chip to finish sending and
+  // close the connection, so there is no need for a delay first.
+  client->stop();
+  conn.socket = MAX_SOCK_NUM;
 }
@@ -3,6 +3,10 @@
 
 #include "Ethernet.h"
 #include "addresses.h"
+#include "arp_prober.h"
+#include "dhcp_client.h"
+#include "http_request.h"
+#include "metrics.h"
 
 // Some chip select pin numbers:
 constexpr int kEthernetShieldCS = 10;    // Most Arduino shields
@@ -12,36 +16,196 @@ constexpr int kTeensyPlusPlus20CS = 20;  // Teensy++ 2.0
 constexpr int kAdafruitEsp8266FeatherwingCS = 15;  // ESP8266 with Adafruit Featherwing Ethernet
 constexpr int kAdafruitEsp32FeatherwingCS = 33;    // ESP32 with Adafruit Featherwing Ethernet
 
-// Wraps up all interactions with Ethernet and EthernetServer,
-// except for handling a client connection, which is delegated
-// to function ptr passed in to loop.
+// The number of connections that SimpleHttpServer handles at once. Each
+// costs about 45 bytes of RAM.
+#ifndef SIMPLE_HTTP_SERVER_MAX_CONNECTIONS
+#define SIMPLE_HTTP_SERVER_MAX_CONNECTIONS MAX_SOCK_NUM
+#endif
+
+// Wraps up all interactions with Ethernet and EthernetServer, including
+// reading HTTP requests, except for producing the response, which is
+// delegated to the function ptr passed in to loop.
+//
+// Nothing waits for a client: each call to loop reads whatever request bytes
+// have arrived on each connection, and passes them to that connection's
+// HttpRequestParser, so a slow client doesn't hold up the others or the rest
+// of the sketch (e.g. EthernetBonjour.run()).
 class SimpleHttpServer {
 public:
-  using ClientFunc = void(*)(EthernetClient*);
+  // Called once the whole request header has arrived. Writes the response
+  // (status line, headers and body) to client; the connection is closed
+  // afterwards.
+  using RequestFunc = void(*)(const HttpRequest& request,
+                              EthernetClient* client);
+
+  // A client that sends nothing for this long is sent a 408 (Request
+  // Timeout) response, and disconnected.
+  static constexpr unsigned long kRequestTimeoutMs = 5000;
+
+  // The number of conflicts after which setup uses a link-local address
+  // anyway, as in RFC 3927 (MAX_CONFLICTS).
+  static constexpr uint8_t kMaxIPConflicts = 10;
 
   SimpleHttpServer(int chip_select_pin, int port=80);
 
   // Setup the Ethernet chip and start listening for connections. Returns false
   // if unable to configure addresses or if there is no Ethernet hardware, else
   // returns true.
+  // The network profiles (see Addresses) are tried in the order in which they
+  // were last used successfully, until one is confirmed to suit the network
+  // the device is on:
+  //
+  // * A DHCP profile is confirmed by getting a lease. Setup doesn't wait for
+  //   a DHCP server: DHCP (see DhcpClient) and checking that no other device
+  //   is using the profile's link-local address (with ARP probes; see
+  //   ArpProber) are started together, and whichever finishes first decides
+  //   the address used; that takes well under a second. If the link-local
+  //   address is in use, another is picked, and saved.
+  // * A static profile is confirmed by its gateway answering an ARP probe
+  //   (which takes under half a second if it doesn't). Its own address is
+  //   probed for once it is chosen.
+  //
+  // If none is confirmed, the first DHCP profile (else the first profile) is
+  // used anyway. If DHCP hasn't finished, loop carries on with it, and
+  // switches to the leased address when it is granted; the lease is saved,
+  // so that after a reboot it is usually reclaimed before the probing
+  // finishes. With a single profile (the default), that is all there is to
+  // it.
   // It *MAY* help you identify devices on your network as using this software
   // if they have the same "Organizationally Unique Identifier" (the first 3
   // bytes of the MAC address).
   bool setup(const OuiPrefix* oui_prefix=nullptr);
 
-  // Check for a new client connection, and if found pass it to handler.
-  // Also ensures that the DHCP lease (if there is one) is maintained.
+  // Makes setup use the profile at index profile (in Addresses::profiles),
+  // rather than trying each in turn, if pin is connected to ground (e.g. by
+  // a jumper) when setup is called. The pin's pull-up resistor is enabled.
+  void setProfileJumper(uint8_t pin, uint8_t profile) {
+    jumper_pin_ = pin;
+    jumper_profile_ = profile;
+  }
+
+  // The profile chosen by setup, e.g. for its name (which is empty if the
+  // sketch's default mDNS name is to be used).
+  const NetworkProfile& profile() const { return profile_; }
+
+  // Accepts new connections, reads the request bytes that have arrived on
+  // each connection, and passes each complete request to handler. Also
+  // obtains and maintains the DHCP lease. Connections open when the address
+  // changes (i.e. from the link-local address to the leased one, or back
+  // when the lease is lost) are broken, as the chip has just one address.
   // Returns false if the DHCP lease is lost.
-  bool loop(ClientFunc handler);
+  bool loop(RequestFunc handler);
+
+  // Enables persistent (HTTP/1.1 keep-alive) connections: after a response,
+  // the connection is kept open for up to idle_timeout_ms for another
+  // request, for up to max_requests requests in all. The handler must then
+  // mark the end of each response with Content-Length or chunked encoding;
+  // see HttpRequest::keep_alive.
+  //
+  // The Wiznet chips have few sockets (4 on the W5100), and one must be free
+  // to accept a new connection, so at most max_persistent connections are
+  // kept open: beyond that, each response closes its connection, and when a
+  // new connection is accepted, the least recently used idle one is closed.
+  // max_persistent should leave room for the listening socket and any other
+  // sockets the sketch uses (e.g. for mDNS).
+  void enableKeepAlive(unsigned long idle_timeout_ms, uint8_t max_requests,
+                       uint8_t max_persistent);
 
-  // Skip input bytes until we reach the end of the HTTP request header
-  // (i.e. read an empty line). Returns true if the connection is still open
-  // after reading the entire header, false otherwise.
-  static bool skipHttpRequestHeader(EthernetClient* client);
+  // Counts requests, parse errors and DHCP failures in metrics, and records
+  // the time between calls to loop, from now on.
+  void setMetrics(HttpServerMetrics* metrics) { metrics_ = metrics; }
+
+  // Returns true if the last call to loop read all of the data that had
+  // arrived, so it has nothing more to do until there is a new connection,
+  // more data, or a timeout; i.e. the sketch may sleep until then (see
+  // ethernet_events.h).
+  bool idle() const { return idle_; }
+
+  // Number of open connections, including those waiting (idle) for another
+  // request.
+  uint8_t activeConnections() const;
+
+  // Sends a response with just a status line (e.g. "404 Not Found", at most
+  // 40 chars) and a "Connection: close" header, with a single write.
+  static void sendError(EthernetClient* client, const char* status);
 
 private:
+  struct Connection {
+    HttpRequestParser parser;
+    // When the last bytes were read, or (if idle) the last response sent.
+    unsigned long last_read_ms;
+    // MAX_SOCK_NUM if not in use.
+    uint8_t socket = MAX_SOCK_NUM;
+    uint8_t requests_served;
+    // True if a response has been sent, and no more bytes have arrived.
+    bool idle;
+  };
+
+  // Tries the profiles in order, returning the index of the first to be
+  // confirmed, or else of the one to use anyway. Sets *changed if addresses
+  // needs saving.
+  uint8_t chooseProfile(ArpProber* prober, Addresses* addresses,
+                        const DhcpLease* cached, bool* changed);
+
+  // Switches the chip to profile's MAC address, and starts checking that the
+  // profile suits the network (see setup), leaving prober (and for a DHCP
+  // profile, dhcp_) running for it. Returns true if it was confirmed. Sets
+  // *changed if the profile's link-local address was changed.
+  bool tryProfile(ArpProber* prober, NetworkProfile* profile,
+                  const DhcpLease* cached, bool* changed);
+
+  // Polls prober until it finishes, returning the result.
+  static ArpProber::Result finishProbe(ArpProber* prober);
+
+  // Polls prober and dhcp_ until either finishes, picking another
+  // link-local address (for prober to check) after each conflict. Returns
+  // true if the address was changed.
+  bool probeLinkLocal(ArpProber* prober, NetworkProfile* profile);
+
+  // Saves profile_index_ as the most recently used profile, if it isn't
+  // already.
+  void rememberProfile();
+
+  // Configures the chip with the DHCP lease, and saves it.
+  void useLease();
+
+  // Configures the chip with profile_'s link-local address.
+  void useLinkLocal();
+
+  // Configures the chip with profile_'s static addresses.
+  void useStatic();
+
+  void acceptConnections();
+
+  // Closes the least recently used idle connection. Returns false if there
+  // are none.
+  bool closeIdleConnection();
+
+  // Returns true if the connection should be kept open after the response
+  // to request.
+  bool shouldKeepAlive(const Connection& conn, const HttpRequest& request);
+
+  // Reads from the connection, and when the request is complete (or found to
+  // be invalid, or the client has given up), responds and closes it.
+  void serviceConnection(Connection& conn, RequestFunc handler);
+
+  static void close(Connection& conn, EthernetClient* client);
+
   EthernetServer server_;
-  bool using_dhcp_{false};
+  DhcpClient dhcp_;
+  NetworkProfile profile_;
+  uint8_t profile_index_{0};
+  // kNoJumper if setProfileJumper hasn't been called.
+  static constexpr uint8_t kNoJumper = 0xFF;
+  uint8_t jumper_pin_{kNoJumper};
+  uint8_t jumper_profile_{0};
+  // Zero if keep-alive isn't enabled.
+  uint8_t keep_alive_max_requests_{0};
+  uint8_t max_persistent_{0};
+  unsigned long keep_alive_timeout_ms_{0};
+  HttpServerMetrics* metrics_{nullptr};
+  bool idle_{true};
+  Connection connections_[SIMPLE_HTTP_SERVER_MAX_CONNECTIONS];
 };
 
 #endif  // _JAMESSYNGE_ARDUINO_EXPERIMENTS_SIMPLE_HTTP_SERVER_H_
@@ -3,14 +3,33 @@
 
 #include <Arduino.h>
 
+#ifdef ARDUINO_HOST
+#include "arduino_host.h"
+#endif
+
 namespace {
+// Number of failed checks; the host build (see host/sketch_main.cpp) uses
+// this to report whether a tester sketch passed.
+int test_failure_count = 0;
+
 inline void AssertFailedAt(const char* file, unsigned long line) {
+  ++test_failure_count;
   Serial.println();
   Serial.print("Assertion failed at ");
   Serial.print(file);
   Serial.print(":");
   Serial.println(line);
 }
+
+// Returns a timestamp in microseconds for use by benchmarks. In the host
+// build micros() is a virtual clock, so the host's own clock is used there.
+inline unsigned long BenchmarkMicros() {
+#ifdef ARDUINO_HOST
+  return static_cast<unsigned long>(arduino_host::hostMicros());
+#else
+  return micros();
+#endif
+}
 }
 
 #define STRINGIFY(x) #x
@@ -18,8 +37,8 @@ inline void AssertFailedAt(const char* file, unsigned long line) {
 #define ASSERT_FAILED_AT AssertFailedAt(__FILE__, __LINE__)
 
 #define EXPECT_TRUE(exp) if (exp) ; else {ASSERT_FAILED_AT; Serial.println("NOT TRUE: " #exp); }
-#define EXPECT_FALSE(exp) if (!exp) ; else {ASSERT_FAILED_AT; Serial.println("NOT FALSE: " #exp); }
-#define EXPECT_EQ(a,b) if (a == b) ; else {ASSERT_FAILED_AT; \
+#define EXPECT_FALSE(exp) if (!(exp)) ; else {ASSERT_FAILED_AT; Serial.println("NOT FALSE: " #exp); }
+#define EXPECT_EQ(a,b) if ((a) == (b)) ; else {ASSERT_FAILED_AT; \
   Serial.println("NOT TRUE: " #a " == " #b); \
   Serial.print(#a " is: "); \
   Serial.println(a); \
@@ -28,8 +47,8 @@ inline void AssertFailedAt(const char* file, unsigned long line) {
 }
 
 #define ASSERT_TRUE(exp) if (exp) ; else {ASSERT_FAILED_AT; Serial.println("NOT TRUE: " #exp); return; }
-#define ASSERT_FALSE(exp) if (!exp) ; else {ASSERT_FAILED_AT; Serial.println("NOT FALSE: " #exp); return; }
-#define ASSERT_EQ(a, b) if (a == b) ; else {ASSERT_FAILED_AT; \
+#define ASSERT_FALSE(exp) if (!(exp)) ; else {ASSERT_FAILED_AT; Serial.println("NOT FALSE: " #exp); return; }
+#define ASSERT_EQ(a, b) if ((a) == (b)) ; else {ASSERT_FAILED_AT; \
   Serial.println("NOT TRUE: " #a " == " #b); \
   Serial.print(#a " is: "); \
   Serial.println(a); \
@@ -37,7 +56,7 @@ inline void AssertFailedAt(const char* file, unsigned long line) {
   Serial.println(b); \
   return; \
 }
-#define ASSERT_NE(a, b) if (!(a == b)) ; else {ASSERT_FAILED_AT; \
+#define ASSERT_NE(a, b) if (!((a) == (b))) ; else {ASSERT_FAILED_AT; \
   Serial.println("NOT TRUE: !(" #a " == " #b ")"); \
   Serial.print(#a " is: "); \
   Serial.println(a); \
@@ -1,41 +1,99 @@
 #include "time.h"
 
+// Only printing and MonotonicClock are implemented here; the arithmetic is
+// all in time.h.
+
 namespace jamessynge {
-namespace internal {
-// Functions for internal use by functions in this file.
-unsigned long repr(ArdTime t) {
-  return t.ms_;
-}
-long repr(ArdDuration d) {
-  return d.ms_;
-}
 
-ArdTime repr_to_ard_time(unsigned long ms) {
-  return ArdTime(ms);
-}
-ArdDuration repr_to_ard_duration(long ms) {
-  return ArdDuration(ms);
-}
+namespace {
+// Disables interrupts while in scope, restoring the previous state when
+// destroyed, so that it can be used in an ISR (where they are already
+// disabled), or within another critical section. On boards other than AVR,
+// ESP8266 and ARM (Cortex-M), where the previous state isn't known, it
+// re-enables interrupts when destroyed, so it mustn't be used in an ISR.
+class InterruptGuard {
+ public:
+#if defined(__AVR__)
+  InterruptGuard() : sreg_(SREG) { cli(); }
+  ~InterruptGuard() { SREG = sreg_; }
+
+ private:
+  const uint8_t sreg_;
+#elif defined(ESP8266)
+  // Raises the interrupt level to 15 (all masked), returning the old PS.
+  InterruptGuard() : ps_(xt_rsil(15)) {}
+  ~InterruptGuard() { xt_wsr_ps(ps_); }
 
-}  // namespace internal
+ private:
+  const uint32_t ps_;
+#elif defined(__arm__)
+  InterruptGuard() {
+    asm volatile("mrs %0, primask" : "=r"(primask_));
+    asm volatile("cpsid i" ::: "memory");
+  }
+  ~InterruptGuard() {
+    asm volatile("msr primask, %0" ::"r"(primask_) : "memory");
+  }
 
-using internal::repr;
-using internal::repr_to_ard_time;
-using internal::repr_to_ard_duration;
+ private:
+  uint32_t primask_;
+#else
+  InterruptGuard() { noInterrupts(); }
+  ~InterruptGuard() { interrupts(); }
+#endif
+};
 
-namespace {
-size_t printWithLeadingZeros(Print& p, unsigned long value, int min_width) {
-  size_t result = 0;
-  if (value >= 10) {
-    result += printWithLeadingZeros(p, value / 10, min_width - 1);
-    value = value % 10;
-    min_width = 0;
+// Extends a 32-bit counter, which wraps around, to 64 bits. Must be given
+// each reading before the counter has wrapped around twice since the last.
+struct CounterExtender {
+  uint64_t Extend(uint32_t now) {
+    if (now < last) {
+      ++wraps;
+    }
+    last = now;
+    return (static_cast<uint64_t>(wraps) << 32) | now;
   }
-  while (min_width > 1) {
-    result += p.print('0');
-    --min_width;
+
+  uint32_t last;
+  uint32_t wraps;
+};
+
+CounterExtender millis_extender;
+CounterExtender micros_extender;
+
+// The digits are computed by multiplying by a reciprocal and shifting, rather
+// than dividing, as an AVR has a hardware multiplier but no divider; e.g.
+// v / 10 == (v * 205) >> 11 for v < 1029.
+
+// Writes the two digits of value (< 100) to buf, returning the end.
+char* putTwoDigits(char* buf, uint8_t value) {
+  const uint8_t tens = (static_cast<uint16_t>(value) * 205) >> 11;
+  *buf++ = '0' + tens;
+  *buf++ = '0' + (value - tens * 10);
+  return buf;
+}
+
+// Writes the three digits of value (< 1000) to buf, returning the end.
+char* putThreeDigits(char* buf, uint16_t value) {
+  const uint8_t hundreds = (static_cast<uint32_t>(value) * 41) >> 12;
+  *buf++ = '0' + hundreds;
+  return putTwoDigits(buf, value - hundreds * 100);
+}
+
+// Writes value without leading zeros to buf, returning the end.
+char* putNumber(char* buf, uint16_t value) {
+  char digits[5];
+  uint8_t n = 0;
+  do {
+    // Exact for all 16-bit values.
+    const uint16_t quotient = (static_cast<uint32_t>(value) * 0xCCCD) >> 19;
+    digits[n++] = '0' + (value - quotient * 10);
+    value = quotient;
+  } while (value);
+  while (n) {
+    *buf++ = digits[--n];
   }
-  return result + p.print(value, DEC);
+  return buf;
 }
 }  // namespace
 
@@ -51,169 +109,60 @@ ArdTimeParts::ArdTimeParts(unsigned long ms) {
   ms /= 24;
   days = ms;
 };
+// Formats the whole time in a buffer, then writes it with a single call,
+// which is much cheaper for a network client (one packet rather than one per
+// character) and for Serial.
 size_t ArdTimeParts::printTo(Print& p) const {
-  size_t result = 0;
+  // Longest is "-65535d 23:59:59.999".
+  char buf[20];
+  char* end = buf;
   if (negative) {
-    result += p.print('-');
+    *end++ = '-';
   }
-  bool first = true;
   if (days > 0) {
-    first = false;
-    result += p.print(days, DEC);
-    result += p.print("d ");
+    end = putNumber(end, days);
+    *end++ = 'd';
+    *end++ = ' ';
   }
-  if (!first || hours > 0) {
-    first = false;
-    result += printWithLeadingZeros(p, hours, 2);
-    result += p.print(":");
+  if (days > 0 || hours > 0) {
+    end = putTwoDigits(end, hours);
+    *end++ = ':';
   }
-  result += printWithLeadingZeros(p, minutes, 2);
-  result += p.print(":");
-  result += printWithLeadingZeros(p, seconds, 2);
-  result += p.print(".");
-  result += printWithLeadingZeros(p, milliseconds, 3);
-  return result;
+  end = putTwoDigits(end, minutes);
+  *end++ = ':';
+  end = putTwoDigits(end, seconds);
+  *end++ = '.';
+  end = putThreeDigits(end, milliseconds);
+  return p.write(buf, end - buf);
 }
 
-ArdTime::ArdTime() : ms_(0) {}
-ArdTime::ArdTime(unsigned long ms) : ms_(ms) {}
-ArdTime& ArdTime::operator=(ArdTime other) {
-  ms_ = other.ms_;
-  return this;
+uint64_t MonotonicClock::Millis64() {
+  InterruptGuard guard;
+  return millis_extender.Extend(static_cast<uint32_t>(millis()));
 }
-ArdTime& ArdTime::operator+=(ArdDuration d) {
-  ms_ += repr(d);
-  return this;
+
+uint64_t MonotonicClock::Micros64() {
+  InterruptGuard guard;
+  return micros_extender.Extend(static_cast<uint32_t>(micros()));
 }
-ArdTimeParts ArdTime::Split() const {
-  return ArdTimeParts(ms_);
+
+ArdTimeParts ArdTime64::Split() const {
+  const uint32_t kMillisPerDay = 24UL * 60 * 60 * 1000;
+  ArdTimeParts parts(static_cast<unsigned long>(ms_ % kMillisPerDay));
+  parts.days = static_cast<uint16_t>(ms_ / kMillisPerDay);
+  return parts;
 }
-// static
-ArdTime ArdTime::Now() {
-  return ArdTime(millis());
+
+size_t ArdTime64::printTo(Print& p) const {
+  return Split().printTo(p);
 }
+
 size_t ArdTime::printTo(Print& p) const {
   return Split().printTo(p);
 }
 
-ArdDuration::ArdDuration() : ms_(0) {}
-ArdDuration::ArdDuration(long ms) : ms_(ms) {}
-ArdDuration ArdDuration::operator=(const ArdDuration& other) {
-  ms_ = other.ms_;
-}
-ArdTimeParts ArdDuration::Split() const {
-  if (ms_ >= 0) {
-    return ArdTimeParts(ms_);
-  }
-  ArdTimeParts p(-ms_);
-  p.negative = true;
-  return p;
-}
 size_t ArdDuration::printTo(Print& p) const {
   return Split().printTo(p);
 }
 
-ArdDuration operator-(ArdTime a, ArdTime b) {
-  auto a_ms = repr(a);
-  auto b_ms = repr(b);
-  if (a_ms >= b_ms) {
-    return repr_to_ard_duration(a_ms - b_ms);
-  } else {
-    return repr_to_ard_duration(-(b_ms - a_ms));
-  }
-}
-bool operator>=(ArdTime a, ArdTime b) {
-  return repr(a) >= repr(b);
-}
-ArdTime operator-(ArdTime t, ArdDuration d) {
-  auto t_ms = repr(t);
-  auto d_ms = repr(d);
-  return repr_to_ard_time(t_ms - d_ms);
-}
-ArdTime operator+(ArdTime t, ArdDuration d) {
-  auto t_ms = repr(t);
-  auto d_ms = repr(d);
-  return repr_to_ard_time(t_ms + d_ms);
-}
-ArdDuration operator-(ArdDuration a, ArdDuration b) {
-  auto a_ms = repr(a);
-  auto b_ms = repr(b);
-  return repr_to_ard_duration(a_ms - b_ms);
-}
-ArdDuration operator+(ArdDuration a, ArdDuration b) {
-  auto a_ms = repr(a);
-  auto b_ms = repr(b);
-  return repr_to_ard_duration(a_ms + b_ms);
-}
-ArdDuration operator/(ArdDuration dur, long div) {
-  auto dur_ms = repr(dur);
-  return repr_to_ard_duration(dur_ms / div);
-}
-ArdDuration operator*(ArdDuration dur, long mul) {
-  auto dur_ms = repr(dur);
-  return repr_to_ard_duration(dur_ms * mul);
-}
-ArdDuration operator/(ArdDuration dur, double div) {
-  auto dur_ms = repr(dur);
-  return repr_to_ard_duration(dur_ms / div);
-}
-ArdDuration operator*(ArdDuration dur, double mul) {
-  auto dur_ms = repr(dur);
-  return repr_to_ard_duration(dur_ms * mul);
-}
-bool operator>=(ArdDuration a, ArdDuration b) {
-  auto a_ms = repr(a);
-  auto b_ms = repr(b);
-  return a_ms >= b_ms;
-}
-bool operator>(ArdDuration a, ArdDuration b) {
-  auto a_ms = repr(a);
-  auto b_ms = repr(b);
-  return a_ms > b_ms;
-}
-bool operator<=(ArdDuration a, ArdDuration b) {
-  auto a_ms = repr(a);
-  auto b_ms = repr(b);
-  return a_ms <= b_ms;
-}
-bool operator<(ArdDuration a, ArdDuration b) {
-  auto a_ms = repr(a);
-  auto b_ms = repr(b);
-  return a_ms < b_ms;
-}
-
-ArdDuration Milliseconds(long ms) {
-  return repr_to_ard_duration(ms);
-}
-ArdDuration Milliseconds(int ms) {
-  return repr_to_ard_duration(static_cast<long>(ms));
-}
-ArdDuration Milliseconds(double ms) {
-  return repr_to_ard_duration(static_cast<long>(round(ms)));
-}
-ArdDuration Seconds(long seconds) {
-  return Milliseconds(seconds * 1000);
-}
-ArdDuration Seconds(int seconds) {
-  return Milliseconds(seconds * 1000L);
-}
-ArdDuration Seconds(double seconds) {
-  return Milliseconds(seconds * 1000);
-}
-ArdDuration Minutes(int minutes) {
-  return Seconds(minutes * 60L);
-}
-ArdDuration Minutes(long minutes) {
-  return Seconds(minutes * 60);
-}
-ArdDuration Minutes(double minutes) {
-  return Seconds(minutes * 60);
-}
-ArdDuration Hours(int hours) {
-  return Minutes(hours * 60L);
-}
-ArdDuration Hours(double hours) {
-  return Minutes(hours * 60);
-}
-
 }  // namespace jamessynge
@@ -4,7 +4,22 @@
 // Types to support Ardunio times and durations. Not generalized to long
 // durations; an Arduino's 32-bit millisecond granularity clock can only
 // record times up to 49.7 days, so this is focused on durations that are
-// generally far shorter than that.
+// generally far shorter than that. For a sketch that runs for longer than
+// that, use ArdTime64 (or MonotonicClock), which never wrap around.
+//
+// The arithmetic is all constexpr and defined here, so that it can be inlined
+// and so that constant durations are computed at compile time, e.g.:
+//
+//     constexpr ArdDuration kHeartbeatInterval = Minutes(5);
+//
+// There is no floating point; to scale a duration by a fraction, use
+// ScaleDuration. Only printing is implemented in time.cpp.
+//
+// To be literal types (i.e. usable in constexpr expressions) ArdTime,
+// ArdDuration and ArdTime64 can't derive from Printable, which has a virtual
+// destructor on some cores (e.g. ESP8266 and ESP32). Instead each converts to
+// an ArdTimeParts, which is Printable, so Serial.print(ArdTime::Now()) still
+// works.
 
 #include <Arduino.h>
 #include <inttypes.h>
@@ -12,15 +27,31 @@
 namespace jamessynge {
 class ArdDuration;
 class ArdTime;
+class ArdTime64;
 
 namespace internal {
 // Functions for internal use by functions in this file.
-unsigned long repr(ArdTime t);
-long repr(ArdDuration d);
-ArdTime repr_to_ard_time(unsigned long ms);
-ArdDuration repr_to_ard_duration(long ms);
+constexpr unsigned long repr(ArdTime t);
+constexpr long repr(ArdDuration d);
+constexpr uint64_t repr(ArdTime64 t);
+constexpr ArdTime repr_to_ard_time(unsigned long ms);
+constexpr ArdDuration repr_to_ard_duration(long ms);
+constexpr ArdTime64 repr_to_ard_time64(uint64_t ms);
 }  // namespace internal
 
+// Extends millis() and micros() to 64 bits, which won't wrap around for
+// hundreds of millions of years. The wrap around of the 32-bit clock is
+// detected when it is read, by comparing with the previous reading, so
+// Millis64 must be called at least once every 49.7 days, and Micros64 at
+// least once every 71.5 minutes; calling them from loop() takes care of that.
+// On AVR, ESP8266 and ARM boards, both may be called from an interrupt
+// service routine.
+class MonotonicClock {
+ public:
+  static uint64_t Millis64();
+  static uint64_t Micros64();
+};
+
 // This is used for ArdTime and ArdDuration. The field `negative` is false
 // when produced from a ArdTime.
 struct ArdTimeParts : Printable {
@@ -30,77 +61,200 @@ struct ArdTimeParts : Printable {
   uint8_t seconds;
   uint8_t minutes;
   uint8_t hours;
-  uint8_t days;
+  uint16_t days;
   bool negative;  // false == positive; true == negative;
 };
 
-ArdDuration operator-(ArdTime a, ArdTime b);
-bool operator>=(ArdTime a, ArdTime b);
-ArdTime operator-(ArdTime t, ArdDuration d);
-ArdTime operator+(ArdTime t, ArdDuration d);
-ArdDuration operator-(ArdDuration a, ArdDuration b);
-ArdDuration operator+(ArdDuration a, ArdDuration b);
-ArdDuration operator/(ArdDuration dur, long div);
-ArdDuration operator*(ArdDuration dur, long mul);
-ArdDuration operator/(ArdDuration dur, double div);
-ArdDuration operator*(ArdDuration dur, double mul);
-bool operator>=(ArdDuration a, ArdDuration b);
-bool operator>(ArdDuration a, ArdDuration b);
-bool operator<=(ArdDuration a, ArdDuration b);
-bool operator<(ArdDuration a, ArdDuration b);
-ArdDuration Milliseconds(int ms);
-ArdDuration Milliseconds(long ms);
-ArdDuration Milliseconds(double ms);
-ArdDuration Seconds(int seconds);
-ArdDuration Seconds(long seconds);
-ArdDuration Seconds(double seconds);
-ArdDuration Minutes(int minutes);
-ArdDuration Minutes(long minutes);
-ArdDuration Minutes(double minutes);
-ArdDuration Hours(int hours);
-ArdDuration Hours(long hours);
-ArdDuration Hours(double hours);
-
-class ArdTime : public Printable {
+class ArdTime {
  public:
   // Start of epoch, which for an Arduino is when it booted or rolled over.
-  ArdTime();  
-  ArdTime(const ArdTime&) = default;
-  ~ArdTime() = default;
+  constexpr ArdTime() : ms_(0) {}
 
-  ArdTime& operator=(ArdTime);
   ArdTime& operator+=(ArdDuration);
-  ArdTimeParts Split() const;
-  size_t printTo(Print&) const override;
+  ArdTimeParts Split() const { return ArdTimeParts(ms_); }
+  size_t printTo(Print&) const;
+  operator ArdTimeParts() const { return Split(); }
 
-  static ArdTime Now();
+  static ArdTime Now() { return ArdTime(millis()); }
 
  private:
-  friend unsigned long internal::repr(ArdTime t);
-  friend ArdTime internal::repr_to_ard_time(unsigned long ms);
+  friend constexpr unsigned long internal::repr(ArdTime t);
+  friend constexpr ArdTime internal::repr_to_ard_time(unsigned long ms);
 
-  ArdTime(unsigned long ms);
+  constexpr explicit ArdTime(unsigned long ms) : ms_(ms) {}
   unsigned long ms_;
 };
 
-class ArdDuration : public Printable {
+class ArdDuration {
  public:
-  ArdDuration();
-  ArdDuration(const ArdDuration&) = default;
-  ArdDuration operator=(const ArdDuration&);
-  ~ArdDuration() = default;
+  constexpr ArdDuration() : ms_(0) {}
 
   ArdTimeParts Split() const;
-  size_t printTo(Print&) const override;
+  size_t printTo(Print&) const;
+  operator ArdTimeParts() const { return Split(); }
 
  private:
-  friend long internal::repr(ArdDuration d);
-  friend ArdDuration internal::repr_to_ard_duration(long ms);
+  friend constexpr long internal::repr(ArdDuration d);
+  friend constexpr ArdDuration internal::repr_to_ard_duration(long ms);
 
-  ArdDuration(long ms);
+  constexpr explicit ArdDuration(long ms) : ms_(ms) {}
   long ms_;
 };
 
+// A time since boot which, unlike ArdTime, doesn't wrap around, so two times
+// can always be compared directly. Differences are returned as ArdDurations,
+// so are limited to about +/- 24.8 days.
+class ArdTime64 {
+ public:
+  // Start of epoch, which is when the Arduino booted.
+  constexpr ArdTime64() : ms_(0) {}
+
+  ArdTime64& operator+=(ArdDuration);
+  ArdTimeParts Split() const;
+  size_t printTo(Print&) const;
+  operator ArdTimeParts() const { return Split(); }
+
+  static ArdTime64 Now() { return ArdTime64(MonotonicClock::Millis64()); }
+
+ private:
+  friend constexpr uint64_t internal::repr(ArdTime64 t);
+  friend constexpr ArdTime64 internal::repr_to_ard_time64(uint64_t ms);
+
+  constexpr explicit ArdTime64(uint64_t ms) : ms_(ms) {}
+  uint64_t ms_;
+};
+
+namespace internal {
+constexpr unsigned long repr(ArdTime t) { return t.ms_; }
+constexpr long repr(ArdDuration d) { return d.ms_; }
+constexpr uint64_t repr(ArdTime64 t) { return t.ms_; }
+constexpr ArdTime repr_to_ard_time(unsigned long ms) { return ArdTime(ms); }
+constexpr ArdDuration repr_to_ard_duration(long ms) {
+  return ArdDuration(ms);
+}
+constexpr ArdTime64 repr_to_ard_time64(uint64_t ms) { return ArdTime64(ms); }
+}  // namespace internal
+
+inline ArdTime& ArdTime::operator+=(ArdDuration d) {
+  ms_ += internal::repr(d);
+  return *this;
+}
+
+inline ArdTime64& ArdTime64::operator+=(ArdDuration d) {
+  ms_ += internal::repr(d);
+  return *this;
+}
+
+inline ArdTimeParts ArdDuration::Split() const {
+  if (ms_ >= 0) {
+    return ArdTimeParts(ms_);
+  }
+  ArdTimeParts p(-ms_);
+  p.negative = true;
+  return p;
+}
+
+constexpr ArdDuration operator-(ArdTime a, ArdTime b) {
+  return internal::repr(a) >= internal::repr(b)
+             ? internal::repr_to_ard_duration(internal::repr(a) -
+                                              internal::repr(b))
+             : internal::repr_to_ard_duration(
+                   -static_cast<long>(internal::repr(b) - internal::repr(a)));
+}
+constexpr bool operator>=(ArdTime a, ArdTime b) {
+  return internal::repr(a) >= internal::repr(b);
+}
+constexpr ArdTime operator-(ArdTime t, ArdDuration d) {
+  return internal::repr_to_ard_time(internal::repr(t) - internal::repr(d));
+}
+constexpr ArdTime operator+(ArdTime t, ArdDuration d) {
+  return internal::repr_to_ard_time(internal::repr(t) + internal::repr(d));
+}
+constexpr ArdDuration operator-(ArdDuration a, ArdDuration b) {
+  return internal::repr_to_ard_duration(internal::repr(a) - internal::repr(b));
+}
+constexpr ArdDuration operator+(ArdDuration a, ArdDuration b) {
+  return internal::repr_to_ard_duration(internal::repr(a) + internal::repr(b));
+}
+constexpr ArdDuration operator/(ArdDuration dur, long div) {
+  return internal::repr_to_ard_duration(internal::repr(dur) / div);
+}
+constexpr ArdDuration operator*(ArdDuration dur, long mul) {
+  return internal::repr_to_ard_duration(internal::repr(dur) * mul);
+}
+constexpr bool operator>=(ArdDuration a, ArdDuration b) {
+  return internal::repr(a) >= internal::repr(b);
+}
+constexpr bool operator>(ArdDuration a, ArdDuration b) {
+  return internal::repr(a) > internal::repr(b);
+}
+constexpr bool operator<=(ArdDuration a, ArdDuration b) {
+  return internal::repr(a) <= internal::repr(b);
+}
+constexpr bool operator<(ArdDuration a, ArdDuration b) {
+  return internal::repr(a) < internal::repr(b);
+}
+constexpr bool operator==(ArdDuration a, ArdDuration b) {
+  return internal::repr(a) == internal::repr(b);
+}
+
+constexpr ArdDuration operator-(ArdTime64 a, ArdTime64 b) {
+  return internal::repr_to_ard_duration(
+      static_cast<long>(internal::repr(a) - internal::repr(b)));
+}
+constexpr ArdTime64 operator-(ArdTime64 t, ArdDuration d) {
+  return internal::repr_to_ard_time64(internal::repr(t) - internal::repr(d));
+}
+constexpr ArdTime64 operator+(ArdTime64 t, ArdDuration d) {
+  return internal::repr_to_ard_time64(internal::repr(t) + internal::repr(d));
+}
+constexpr bool operator>=(ArdTime64 a, ArdTime64 b) {
+  return internal::repr(a) >= internal::repr(b);
+}
+constexpr bool operator>(ArdTime64 a, ArdTime64 b) {
+  return internal::repr(a) > internal::repr(b);
+}
+constexpr bool operator<=(ArdTime64 a, ArdTime64 b) {
+  return internal::repr(a) <= internal::repr(b);
+}
+constexpr bool operator<(ArdTime64 a, ArdTime64 b) {
+  return internal::repr(a) < internal::repr(b);
+}
+constexpr bool operator==(ArdTime64 a, ArdTime64 b) {
+  return internal::repr(a) == internal::repr(b);
+}
+constexpr bool operator!=(ArdTime64 a, ArdTime64 b) {
+  return internal::repr(a) != internal::repr(b);
+}
+
+// Returns dur * numerator / denominator, rounded toward zero. The product is
+// computed with 64 bits, so it doesn't overflow, and the result is exact
+// (unlike multiplying by a double, which on AVR is only a 32-bit float).
+// This replaces multiplying by a ratio of two counts, such as the fraction of
+// some work remaining.
+constexpr ArdDuration ScaleDuration(ArdDuration dur, uint32_t numerator,
+                                    uint32_t denominator) {
+  return internal::repr_to_ard_duration(static_cast<long>(
+      static_cast<int64_t>(internal::repr(dur)) * numerator / denominator));
+}
+
+constexpr ArdDuration Milliseconds(long ms) {
+  return internal::repr_to_ard_duration(ms);
+}
+constexpr ArdDuration Milliseconds(int ms) {
+  return internal::repr_to_ard_duration(static_cast<long>(ms));
+}
+constexpr ArdDuration Seconds(long seconds) {
+  return Milliseconds(seconds * 1000);
+}
+constexpr ArdDuration Seconds(int seconds) {
+  return Milliseconds(seconds * 1000L);
+}
+constexpr ArdDuration Minutes(long minutes) { return Seconds(minutes * 60); }
+constexpr ArdDuration Minutes(int minutes) { return Seconds(minutes * 60L); }
+constexpr ArdDuration Hours(long hours) { return Minutes(hours * 60); }
+constexpr ArdDuration Hours(int hours) { return Minutes(hours * 60L); }
+
 }  // namespace jamessynge
 
-#endif  // _JAMES_SYNGE_TIME_H_
\ No newline at end of file
+#endif  // _JAMES_SYNGE_TIME_H_
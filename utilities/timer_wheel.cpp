@@ -0,0 +1,237 @@
+#include "timer_wheel.h"
+
+namespace jamessynge {
+namespace {
+
+// Returns the index of the lowest set bit of a non-zero value.
+uint8_t lowestBit(uint16_t value) {
+  return __builtin_ctz(value);
+}
+
+}  // namespace
+
+constexpr TimerWheel::TimerId TimerWheel::kNoTimer;
+
+TimerWheel::TimerWheel(Timer* timers, uint16_t capacity, ArdTime64 now)
+    : timers_(timers),
+      capacity_(capacity),
+      free_(capacity > 0 ? 0 : kNone),
+      current_(internal::repr(now)) {
+  for (uint16_t i = 0; i < capacity; ++i) {
+    timers_[i].list = kFree;
+    timers_[i].next = i + 1 < capacity ? i + 1 : kNone;
+  }
+  for (uint8_t list = 0; list < kNumLists; ++list) {
+    heads_[list] = kNone;
+  }
+  for (uint8_t level = 0; level < kLevels; ++level) {
+    occupied_[level] = 0;
+  }
+}
+
+TimerWheel::TimerId TimerWheel::schedule(ArdTime64 deadline,
+                                         TimerCallback callback,
+                                         void* context) {
+  if (free_ == kNone) {
+    return kNoTimer;
+  }
+  const uint16_t i = free_;
+  Timer& timer = timers_[i];
+  free_ = timer.next;
+  timer.deadline = internal::repr(deadline);
+  timer.callback = callback;
+  timer.context = context;
+  place(i, false);
+  ++size_;
+  return i;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+  if (!isPending(id)) {
+    return false;
+  }
+  unlink(id);
+  timers_[id].list = kFree;
+  timers_[id].next = free_;
+  free_ = id;
+  --size_;
+  return true;
+}
+
+bool TimerWheel::isPending(TimerId id) const {
+  return id < capacity_ && timers_[id].list != kFree;
+}
+
+int TimerWheel::runExpired(ArdTime64 now) {
+  const uint64_t now_ms = internal::repr(now);
+  int count = runList(kDueList);
+  while (current_ < now_ms) {
+    uint8_t list;
+    const uint64_t next = nextEventTime(&list);
+    if (next > now_ms) {
+      // Nothing happens before now_ms, so there is nothing to cascade.
+      current_ = now_ms;
+      break;
+    }
+    current_ = next;
+    cascade();
+    count += runList(current_ & (kSlots - 1));
+  }
+  return count;
+}
+
+bool TimerWheel::nextDeadline(ArdTime64* deadline) const {
+  uint64_t result;
+  if (heads_[kDueList] != kNone) {
+    result = current_;
+  } else {
+    uint8_t list;
+    result = nextEventTime(&list);
+    if (result == UINT64_MAX) {
+      return false;
+    }
+    // The timers of a level 0 slot all have the same deadline, but those of
+    // a higher level slot, or of the overflow list, must be examined.
+    if (list >= kSlots) {
+      result = UINT64_MAX;
+      for (uint16_t i = heads_[list]; i != kNone; i = timers_[i].next) {
+        if (timers_[i].deadline < result) {
+          result = timers_[i].deadline;
+        }
+      }
+    }
+  }
+  *deadline = internal::repr_to_ard_time64(result);
+  return true;
+}
+
+void TimerWheel::place(uint16_t i, bool allow_current) {
+  const uint64_t deadline = timers_[i].deadline;
+  if (deadline < current_ || (deadline == current_ && !allow_current)) {
+    pushFront(kDueList, i);
+    return;
+  }
+  // The timer goes into the lowest level whose slots span all of the bits in
+  // which the deadline differs from the current time.
+  const uint64_t differs = deadline ^ current_;
+  for (uint8_t level = 0; level < kLevels; ++level) {
+    const uint8_t shift = level * kSlotBits;
+    if ((differs >> (shift + kSlotBits)) == 0) {
+      pushFront(level * kSlots + ((deadline >> shift) & (kSlots - 1)), i);
+      return;
+    }
+  }
+  pushFront(kOverflowList, i);
+}
+
+void TimerWheel::pushFront(uint8_t list, uint16_t i) {
+  Timer& timer = timers_[i];
+  timer.list = list;
+  timer.prev = kNone;
+  timer.next = heads_[list];
+  if (timer.next != kNone) {
+    timers_[timer.next].prev = i;
+  }
+  heads_[list] = i;
+  if (list < kWheelLists) {
+    occupied_[list / kSlots] |= 1 << (list % kSlots);
+  }
+}
+
+void TimerWheel::unlink(uint16_t i) {
+  Timer& timer = timers_[i];
+  if (timer.prev != kNone) {
+    timers_[timer.prev].next = timer.next;
+  } else {
+    heads_[timer.list] = timer.next;
+    if (timer.next == kNone && timer.list < kWheelLists) {
+      occupied_[timer.list / kSlots] &= ~(1 << (timer.list % kSlots));
+    }
+  }
+  if (timer.next != kNone) {
+    timers_[timer.next].prev = timer.prev;
+  }
+}
+
+int TimerWheel::runList(uint8_t list) {
+  uint16_t i = heads_[list];
+  if (i == kNone) {
+    return 0;
+  }
+  // Relabel the timers as running, so that a callback which cancels one of
+  // them unlinks it from the right list.
+  heads_[kRunningList] = i;
+  heads_[list] = kNone;
+  if (list < kWheelLists) {
+    occupied_[list / kSlots] &= ~(1 << (list % kSlots));
+  }
+  for (; i != kNone; i = timers_[i].next) {
+    timers_[i].list = kRunningList;
+  }
+
+  int count = 0;
+  while ((i = heads_[kRunningList]) != kNone) {
+    unlink(i);
+    Timer& timer = timers_[i];
+    timer.list = kFree;
+    timer.next = free_;
+    free_ = i;
+    --size_;
+    ++count;
+    timer.callback(timer.context);
+  }
+  return count;
+}
+
+void TimerWheel::cascadeList(uint8_t list) {
+  uint16_t i = heads_[list];
+  heads_[list] = kNone;
+  if (list < kWheelLists) {
+    occupied_[list / kSlots] &= ~(1 << (list % kSlots));
+  }
+  while (i != kNone) {
+    const uint16_t next = timers_[i].next;
+    place(i, true);
+    i = next;
+  }
+}
+
+void TimerWheel::cascade() {
+  // From the top down, so that timers cascaded into a slot whose span also
+  // begins now are cascaded again.
+  if ((current_ & ((1ULL << (kLevels * kSlotBits)) - 1)) == 0) {
+    cascadeList(kOverflowList);
+  }
+  for (uint8_t level = kLevels - 1; level > 0; --level) {
+    const uint8_t shift = level * kSlotBits;
+    if ((current_ & ((1ULL << shift) - 1)) == 0) {
+      cascadeList(level * kSlots + ((current_ >> shift) & (kSlots - 1)));
+    }
+  }
+}
+
+uint64_t TimerWheel::nextEventTime(uint8_t* list) const {
+  // The timers of a level are all due before any of those of a higher level,
+  // and are in the slots after that of current_, in deadline order, so the
+  // first occupied one is the answer.
+  for (uint8_t level = 0; level < kLevels; ++level) {
+    const uint8_t shift = level * kSlotBits;
+    const uint8_t slot = (current_ >> shift) & (kSlots - 1);
+    const uint16_t later = occupied_[level] & ~((2UL << slot) - 1);
+    if (later != 0) {
+      const uint8_t next_slot = lowestBit(later);
+      *list = level * kSlots + next_slot;
+      const uint64_t span_start = (current_ >> (shift + kSlotBits))
+                                  << (shift + kSlotBits);
+      return span_start + (static_cast<uint64_t>(next_slot) << shift);
+    }
+  }
+  if (heads_[kOverflowList] != kNone) {
+    *list = kOverflowList;
+    const uint8_t shift = kLevels * kSlotBits;
+    return ((current_ >> shift) + 1) << shift;
+  }
+  return UINT64_MAX;
+}
+
+}  // namespace jamessynge
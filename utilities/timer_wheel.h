@@ -0,0 +1,161 @@
+#ifndef _JAMES_SYNGE_TIMER_WHEEL_H_
+#define _JAMES_SYNGE_TIMER_WHEEL_H_
+
+// A scheduler for one-shot timers (e.g. blink an LED, take a reading, end an
+// alert), as a hierarchical timing wheel: scheduling, cancelling and expiring
+// a timer each take constant time, regardless of how many are pending, and
+// the earliest deadline is found without scanning the timers.
+//
+// There are kLevels wheels of kSlots slots each. A slot in level 0 holds the
+// timers due in one particular millisecond, a slot in level 1 those due in
+// one particular 16ms span, and so on up to about 17 minutes for level 4.
+// As time passes, the timers of a slot in a higher level are moved down into
+// the lower levels (cascaded) once the slot's span begins. Timers further in
+// the future than the wheels cover are kept in an overflow list, which is
+// revisited every 17 minutes or so.
+//
+// Deadlines are ArdTime64s, so they don't wrap around, and there is no limit
+// on how far in the future they can be. The wheel only knows the time that
+// it is given by runExpired, so a sketch's loop would look like:
+//
+//     void loop() {
+//       timers.runExpired(ArdTime64::Now());
+//       ArdTime64 deadline;
+//       if (timers.nextDeadline(&deadline)) {
+//         ... sleep or do background work until then ...
+//       }
+//     }
+//
+// The timers are stored in an array supplied by the caller, usually via
+// TimerWheelBuffer, so no heap is used.
+//
+// Author: James Synge
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+#include "time.h"
+
+namespace jamessynge {
+
+// Called when a timer expires, with the context given when it was scheduled.
+typedef void (*TimerCallback)(void* context);
+
+class TimerWheel {
+ public:
+  // Identifies a scheduled timer. Only valid until the timer has expired or
+  // been cancelled, after which it may be reused for another timer.
+  typedef uint16_t TimerId;
+  static constexpr TimerId kNoTimer = 0xFFFF;
+
+  // Storage for one timer; exposed only so that TimerWheelBuffer can declare
+  // an array of them.
+  struct Timer {
+    uint64_t deadline;
+    TimerCallback callback;
+    void* context;
+    uint16_t next;
+    uint16_t prev;
+    uint8_t list;
+  };
+
+  // timers must have room for capacity (fewer than 65535) Timers. The time of
+  // the wheel starts at now.
+  TimerWheel(Timer* timers, uint16_t capacity, ArdTime64 now);
+
+  // Schedules callback(context) to be called by the first call to runExpired
+  // for a time at or after deadline; a deadline in the past means the next
+  // call. Returns kNoTimer if all of the timers are in use.
+  TimerId schedule(ArdTime64 deadline, TimerCallback callback, void* context);
+
+  // Cancels the timer, if it hasn't yet expired. Returns true if cancelled.
+  bool cancel(TimerId id);
+
+  // Returns true if the timer is scheduled and hasn't yet expired.
+  bool isPending(TimerId id) const;
+
+  // Advances the time of the wheel to now, calling the callbacks of all of
+  // the timers whose deadline is at or before now, in deadline order (within
+  // a millisecond, in no particular order). A callback may schedule or cancel
+  // timers; one scheduled for a time that has already been reached is called
+  // by the next call to runExpired. Returns the number of callbacks called.
+  int runExpired(ArdTime64 now);
+
+  // Sets *deadline to the earliest deadline of the pending timers, and
+  // returns true, or returns false if there are none. This is the time at
+  // which runExpired next needs to be called.
+  bool nextDeadline(ArdTime64* deadline) const;
+
+  // The time that the wheel has reached.
+  ArdTime64 now() const { return internal::repr_to_ard_time64(current_); }
+
+  // Number of pending timers.
+  uint16_t size() const { return size_; }
+  uint16_t capacity() const { return capacity_; }
+
+ private:
+  static constexpr uint8_t kSlotBits = 4;
+  static constexpr uint8_t kSlots = 1 << kSlotBits;
+  static constexpr uint8_t kLevels = 5;
+  static constexpr uint8_t kWheelLists = kLevels * kSlots;
+  // Deadlines beyond what the wheels cover.
+  static constexpr uint8_t kOverflowList = kWheelLists;
+  // Deadlines that were already reached when they were scheduled.
+  static constexpr uint8_t kDueList = kOverflowList + 1;
+  // The timers whose callbacks are being called by runExpired.
+  static constexpr uint8_t kRunningList = kDueList + 1;
+  static constexpr uint8_t kNumLists = kRunningList + 1;
+  // The list of a Timer which isn't in use.
+  static constexpr uint8_t kFree = 0xFF;
+  static constexpr uint16_t kNone = 0xFFFF;
+
+  // Puts timer i into the list for its deadline. If allow_current is false,
+  // a deadline at or before current_ goes into the due list; else only one
+  // before current_ does, and one at current_ goes into its level 0 slot
+  // (which runExpired is about to run).
+  void place(uint16_t i, bool allow_current);
+
+  void pushFront(uint8_t list, uint16_t i);
+  void unlink(uint16_t i);
+
+  // Moves the timers of the list to the running list, then calls their
+  // callbacks. Returns the number called.
+  int runList(uint8_t list);
+
+  // Moves the timers of the list back into the wheels, i.e. into lower
+  // levels, relative to current_.
+  void cascadeList(uint8_t list);
+
+  // Cascades the slots whose span begins at current_.
+  void cascade();
+
+  // Returns the time at which the next slot after that of current_ which has
+  // timers begins, and sets *list to it; or, if there is none, the time at
+  // which the overflow list must be revisited, setting *list to that. Returns
+  // UINT64_MAX if there are no timers in either.
+  uint64_t nextEventTime(uint8_t* list) const;
+
+  Timer* const timers_;
+  const uint16_t capacity_;
+  uint16_t size_ = 0;
+  uint16_t free_;
+  uint64_t current_;
+  uint16_t heads_[kNumLists];
+  // Bit s of occupied_[level] is set if the slot s of the level has timers.
+  uint16_t occupied_[kLevels];
+};
+
+// A TimerWheel which contains its own storage for N timers.
+template <uint16_t N>
+class TimerWheelBuffer : public TimerWheel {
+ public:
+  explicit TimerWheelBuffer(ArdTime64 now = ArdTime64())
+      : TimerWheel(timers_, N, now) {}
+
+ private:
+  Timer timers_[N];
+};
+
+}  // namespace jamessynge
+
+#endif  // _JAMES_SYNGE_TIMER_WHEEL_H_